@@ -293,6 +293,7 @@ void CL_Record_f (void)
 		Con_Printf ("ERROR: couldn't create %s\n", name);
 		return;
 	}
+	COM_FlushDirs ();
 
 	cls.forcetrack = track;
 	fprintf (cls.demofile, "%i\n", cls.forcetrack);
@@ -368,6 +369,10 @@ void CL_Record_f (void)
 		// restore net_message
 		net_message.data = data;
 		net_message.cursize = cursize;
+
+		// the demo has none of the frames the next entity updates are built on
+		if (cl.protocol == PROTOCOL_DELTA)
+			CL_ClearDeltaFrames ();
 	}
 }
 
@@ -388,6 +388,12 @@ void CL_SendMove (const usercmd_t *cmd)
 	MSG_WriteByte (&buf, in_impulse);
 	in_impulse = 0;
 
+	if (cl.protocol == PROTOCOL_DELTA)
+	{
+		MSG_WriteByte (&buf, clc_deltaack);
+		MSG_WriteLong (&buf, cl.deltasequence);
+	}
+
 //
 // deliver the message
 //
@@ -80,12 +80,12 @@ const char *svc_strings[] =
 	"svc_spawnbaseline2", //42			// support for large modelindex, large framenum, alpha, using flags
 	"svc_spawnstatic2", // 43			// support for large modelindex, large framenum, alpha, using flags
 	"svc_spawnstaticsound2", //	44		// [coord3] [short] samp [byte] vol [byte] aten
-	"", // 44
-	"", // 45
+	"svc_deltaentities", // 45			// PROTOCOL_DELTA
 	"", // 46
 	"", // 47
 	"", // 48
 	"", // 49
+	"", // 50
 //johnfitz
 };
 
@@ -272,13 +272,14 @@ void CL_ParseServerInfo (void)
 // wipe the client_state_t struct
 //
 	CL_ClearState ();
+	Loader_BeginStage ("serverinfo");
 
 // parse protocol version number
 	i = MSG_ReadLong ();
 	//johnfitz -- support multiple protocols
-	if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE) {
+	if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE && i != PROTOCOL_DELTA) {
 		Con_Printf ("\n"); //because there's no newline after serverinfo print
-		Host_Error ("Server returned version %i, not %i or %i", i, PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE);
+		Host_Error ("Server returned version %i, not %i, %i or %i", i, PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE, PROTOCOL_DELTA);
 	}
 	cl.protocol = i;
 	//johnfitz
@@ -349,6 +350,12 @@ void CL_ParseServerInfo (void)
 		Con_DWarning ("%i sounds exceeds standard limit of 256.\n", numsounds);
 	//johnfitz
 
+// start reading what isn't in memory in the background
+	for (i = 1; i < nummodels; i++)
+		Mod_QueueLoad (model_precache[i]);
+	for (i = 1; i < numsounds; i++)
+		S_QueuePrecache (sound_precache[i]);
+
 //
 // now we try to load everything else until a cache allocation fails
 //
@@ -356,6 +363,7 @@ void CL_ParseServerInfo (void)
 	// copy the naked name of the map file to the cl structure -- O.S
 	COM_StripExtension (COM_SkipPath(model_precache[1]), cl.mapname, sizeof(cl.mapname));
 
+	Loader_BeginStage ("models");
 	for (i = 1; i < nummodels; i++)
 	{
 		cl.model_precache[i] = Mod_ForName (model_precache[i], false);
@@ -366,6 +374,7 @@ void CL_ParseServerInfo (void)
 		CL_KeepaliveMessage ();
 	}
 
+	Loader_BeginStage ("sounds");
 	S_BeginPrecaching ();
 	for (i = 1; i < numsounds; i++)
 	{
@@ -377,7 +386,9 @@ void CL_ParseServerInfo (void)
 // local state
 	cl_entities[0].model = cl.worldmodel = cl.model_precache[1];
 
+	Loader_BeginStage ("newmap");
 	R_NewMap ();
+	Loader_Finish ("client precache");
 
 	//johnfitz -- clear out string; we don't consider identical
 	//messages to be duplicates if the map has changed in between
@@ -396,6 +407,48 @@ void CL_ParseServerInfo (void)
 	memset(&dev_overflows, 0, sizeof(dev_overflows));
 }
 
+/*
+==================
+CL_SetEntityModel
+
+The end of an entity update, once the rest of it has been read
+==================
+*/
+static void CL_SetEntityModel (entity_t *ent, int num, int modnum, qboolean forcelink)
+{
+	qmodel_t	*model;
+
+	model = cl.model_precache[modnum];
+	if (model != ent->model)
+	{
+		ent->model = model;
+	// automatic animation (torches, etc) can be either all together
+	// or randomized
+		if (model)
+		{
+			if (model->synctype == ST_RAND)
+				ent->syncbase = (float)(rand()&0x7fff) / 0x7fff;
+			else
+				ent->syncbase = 0.0;
+		}
+		else
+			forcelink = true;	// hack to make null model players work
+		if (num > 0 && num <= cl.maxclients)
+			R_TranslateNewPlayerSkin (num - 1); //johnfitz -- was R_TranslatePlayerSkin
+
+		ent->lerpflags |= LERP_RESETANIM; //johnfitz -- don't lerp animation across model changes
+	}
+
+	if ( forcelink )
+	{	// didn't have an update last message
+		VectorCopy (ent->msg_origins[0], ent->msg_origins[1]);
+		VectorCopy (ent->msg_origins[0], ent->origin);
+		VectorCopy (ent->msg_angles[0], ent->msg_angles[1]);
+		VectorCopy (ent->msg_angles[0], ent->angles);
+		ent->forcelink = true;
+	}
+}
+
 /*
 ==================
 CL_ParseUpdate
@@ -408,7 +461,6 @@ relinked.  Other attributes can change without relinking.
 void CL_ParseUpdate (int bits)
 {
 	int		i;
-	qmodel_t	*model;
 	int		modnum;
 	qboolean	forcelink;
 	entity_t	*ent;
@@ -581,37 +633,7 @@ void CL_ParseUpdate (int bits)
 	}
 	//johnfitz
 
-	//johnfitz -- moved here from above
-	model = cl.model_precache[modnum];
-	if (model != ent->model)
-	{
-		ent->model = model;
-	// automatic animation (torches, etc) can be either all together
-	// or randomized
-		if (model)
-		{
-			if (model->synctype == ST_RAND)
-				ent->syncbase = (float)(rand()&0x7fff) / 0x7fff;
-			else
-				ent->syncbase = 0.0;
-		}
-		else
-			forcelink = true;	// hack to make null model players work
-		if (num > 0 && num <= cl.maxclients)
-			R_TranslateNewPlayerSkin (num - 1); //johnfitz -- was R_TranslatePlayerSkin
-
-		ent->lerpflags |= LERP_RESETANIM; //johnfitz -- don't lerp animation across model changes
-	}
-	//johnfitz
-
-	if ( forcelink )
-	{	// didn't have an update last message
-		VectorCopy (ent->msg_origins[0], ent->msg_origins[1]);
-		VectorCopy (ent->msg_origins[0], ent->origin);
-		VectorCopy (ent->msg_angles[0], ent->msg_angles[1]);
-		VectorCopy (ent->msg_angles[0], ent->angles);
-		ent->forcelink = true;
-	}
+	CL_SetEntityModel (ent, num, modnum, forcelink);
 }
 
 /*
@@ -642,6 +664,240 @@ void CL_ParseBaseline (entity_t *ent, int version) //johnfitz -- added argument
 }
 
 
+/*
+=============================================================================
+
+DELTA ENTITIES -- PROTOCOL_DELTA
+
+=============================================================================
+*/
+
+static deltahistory_t	cl_deltahistory;
+
+/*
+==================
+CL_ClearDeltaFrames
+
+Forgets the frames, so the server sends the next one from the baselines
+==================
+*/
+void CL_ClearDeltaFrames (void)
+{
+	memset (&cl_deltahistory, 0, sizeof(cl_deltahistory));
+	cl.deltasequence = 0;
+}
+
+/*
+==================
+CL_ReadDeltaEntity
+
+Applies one entity's changes to to. lerpfinish is -1 when there is none.
+==================
+*/
+static void CL_ReadDeltaEntity (deltaent_t *to, int *lerpfinish)
+{
+	int		i, bits;
+
+	bits = MSG_ReadByte ();
+	if (bits & U_MOREBITS)
+		bits |= MSG_ReadByte () << 8;
+	if (bits & U_EXTEND1)
+		bits |= MSG_ReadByte () << 16;
+
+	if (bits & U_MODEL)
+		to->modelindex = MSG_ReadByte ();
+	if (bits & U_FRAME)
+		to->frame = MSG_ReadByte ();
+	if (bits & U_COLORMAP)
+		to->colormap = MSG_ReadByte ();
+	if (bits & U_SKIN)
+		to->skin = MSG_ReadByte ();
+	if (bits & U_EFFECTS)
+		to->effects = MSG_ReadByte ();
+	for (i = 0; i < 3; i++)
+		if (bits & (U_ORIGIN1<<i))
+			to->origin[i] = MSG_ReadShort ();
+	if (bits & U_ANGLE1)
+		to->angles[0] = MSG_ReadByte ();
+	if (bits & U_ANGLE2)
+		to->angles[1] = MSG_ReadByte ();
+	if (bits & U_ANGLE3)
+		to->angles[2] = MSG_ReadByte ();
+	if (bits & U_STEP)
+		to->flags ^= DE_STEP;
+	if (bits & U_ALPHA)
+		to->alpha = MSG_ReadByte ();
+	if (bits & U_FRAME2)
+		to->frame |= MSG_ReadByte () << 8;
+	if (bits & U_MODEL2)
+		to->modelindex |= MSG_ReadByte () << 8;
+	*lerpfinish = (bits & U_LERPFINISH) ? MSG_ReadByte () : -1;
+}
+
+/*
+==================
+CL_SetDeltaEntity
+
+What CL_ParseUpdate does with the values it read
+==================
+*/
+static void CL_SetDeltaEntity (const deltaent_t *s, int lerpfinish)
+{
+	entity_t	*ent;
+	qboolean	forcelink;
+	int			i, num;
+
+	num = s->num;
+	ent = CL_EntityNum (num);
+
+	forcelink = (ent->msgtime != cl.mtime[1]);	// no previous frame to lerp from
+	if (ent->msgtime + 0.2 < cl.mtime[0])
+		ent->lerpflags |= LERP_RESETANIM;
+	ent->msgtime = cl.mtime[0];
+
+	if (s->modelindex >= MAX_MODELS)
+		Host_Error ("CL_ParseModel: bad modnum");
+
+	ent->frame = s->frame;
+
+	if (!s->colormap)
+		ent->colormap = vid.colormap;
+	else
+	{
+		if (s->colormap > cl.maxclients)
+			Sys_Error ("i >= cl.maxclients");
+		ent->colormap = cl.scores[s->colormap-1].translations;
+	}
+	if (s->skin != ent->skinnum)
+	{
+		ent->skinnum = s->skin;
+		if (num > 0 && num <= cl.maxclients)
+			R_TranslateNewPlayerSkin (num - 1);
+	}
+	ent->effects = s->effects;
+
+	VectorCopy (ent->msg_origins[0], ent->msg_origins[1]);
+	VectorCopy (ent->msg_angles[0], ent->msg_angles[1]);
+	for (i = 0; i < 3; i++)
+	{
+		ent->msg_origins[0][i] = s->origin[i] * (1.0/8);
+		ent->msg_angles[0][i] = (signed char)s->angles[i] * (360.0/256);
+	}
+
+	if (s->flags & DE_STEP)
+	{
+		ent->lerpflags |= LERP_MOVESTEP;
+		ent->forcelink = true;
+	}
+	else
+		ent->lerpflags &= ~LERP_MOVESTEP;
+
+	ent->alpha = s->alpha;
+	if (lerpfinish != -1)
+	{
+		ent->lerpfinish = ent->msgtime + ((float)lerpfinish / 255);
+		ent->lerpflags |= LERP_FINISH;
+	}
+	else
+		ent->lerpflags &= ~LERP_FINISH;
+
+	CL_SetEntityModel (ent, num, s->modelindex, forcelink);
+}
+
+/*
+==================
+CL_ParseDeltaEntities
+
+Rebuilds the frame from the one it was sent against, updating every entity
+in it. A frame whose old frame is gone is read and dropped, and the entities
+stay as they were; the server sends one from the baselines once it sees the
+acknowledged frame isn't moving.
+==================
+*/
+static void CL_ParseDeltaEntities (void)
+{
+	deltahistory_t	*h = &cl_deltahistory;
+	deltaframe_t	*from, *to;
+	deltaent_t		state, *old;
+	int				sequence, delta, word, num, lerpfinish;
+	int				oldfirst, oldindex, oldcount;
+	qboolean		valid;
+
+	if (cls.signon == SIGNONS - 1)
+	{	// first update is the final signon stage
+		cls.signon = SIGNONS;
+		CL_SignonReply ();
+	}
+
+	sequence = MSG_ReadLong ();
+	delta = MSG_ReadLong ();
+	from = Delta_FindFrame (h, delta, sequence);
+	valid = (sequence > cl.deltasequence && (from || !delta));
+	cl.deltarejected = !valid;
+	oldfirst = from ? from->first : 0;
+	oldcount = from ? from->count : 0;
+	if (!valid)
+		Con_DPrintf ("delta frame %i against missing frame %i\n", sequence, delta);
+
+	to = &h->frames[sequence & (DELTA_FRAMES-1)];
+	if (valid)
+	{
+		to->sequence = 0;	// not usable until it's done
+		to->first = h->poolhead;
+		to->count = 0;
+	}
+
+	for (oldindex = 0; ; )
+	{
+		word = (unsigned short) MSG_ReadShort ();
+		if (msg_badread)
+			Host_Error ("CL_ParseDeltaEntities: bad read");
+		num = word ? (word & ~DELTA_REMOVE) : MAX_EDICTS;
+
+		// entities that didn't change
+		for ( ; valid && oldindex < oldcount; oldindex++)
+		{
+			old = Delta_PoolEnt (h, oldfirst + oldindex);
+			if (old->num >= num)
+				break;
+			*Delta_PoolEnt (h, to->first + to->count++) = *old;
+			CL_SetDeltaEntity (old, -1);
+		}
+		if (!word)
+			break;
+
+		old = (valid && oldindex < oldcount) ? Delta_PoolEnt (h, oldfirst + oldindex) : NULL;
+		if (old && old->num != num)
+			old = NULL;
+		if (old)
+			oldindex++;
+
+		if (word & DELTA_REMOVE)
+			continue;
+
+		if (old)
+			state = *old;
+		else
+			Delta_PackState (&CL_EntityNum (num)->baseline, num, 0, &state);
+		CL_ReadDeltaEntity (&state, &lerpfinish);
+
+		if (valid)
+		{
+			if (to->count >= DELTA_MAXENTITIES)
+				Host_Error ("CL_ParseDeltaEntities: more than %i entities", DELTA_MAXENTITIES);
+			*Delta_PoolEnt (h, to->first + to->count++) = state;
+			CL_SetDeltaEntity (&state, lerpfinish);
+		}
+	}
+
+	if (valid)
+	{
+		h->poolhead += to->count;
+		to->sequence = sequence;
+		cl.deltasequence = sequence;
+	}
+}
+
 /*
 ==================
 CL_ParseClientdata
@@ -984,11 +1240,15 @@ void CL_ParseServerMessage (void)
 			CL_ParseClientdata (); //johnfitz -- removed bits parameter, we will read this inside CL_ParseClientdata()
 			break;
 
+		case svc_deltaentities:
+			CL_ParseDeltaEntities ();
+			break;
+
 		case svc_version:
 			i = MSG_ReadLong ();
 			//johnfitz -- support multiple protocols
-			if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE)
-				Host_Error ("Server returned version %i, not %i or %i", i, PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE);
+			if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE && i != PROTOCOL_DELTA)
+				Host_Error ("Server returned version %i, not %i, %i or %i", i, PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE, PROTOCOL_DELTA);
 			cl.protocol = i;
 			//johnfitz
 			break;
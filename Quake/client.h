@@ -224,6 +224,8 @@ typedef struct
 	scoreboard_t	*scores;		// [cl.maxclients]
 
 	unsigned	protocol; //johnfitz
+	int			deltasequence;	// last svc_deltaentities frame rebuilt, PROTOCOL_DELTA
+	qboolean	deltarejected;	// the last one couldn't be, so entities keep their old state
 } client_state_t;
 
 
@@ -341,6 +343,7 @@ void CL_TimeDemo_f (void);
 // cl_parse.c
 //
 void CL_ParseServerMessage (void);
+void CL_ClearDeltaFrames (void);
 void CL_NewTranslation (int slot);
 
 //
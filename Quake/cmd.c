@@ -30,14 +30,19 @@ void Cmd_ForwardToServer (void);
 
 #define CMDLINE_LENGTH 256 //johnfitz -- mirrored in common.c
 
+#define	CMD_HASH_SIZE	512	// must be a power of two
+#define	ALIAS_HASH_SIZE	256
+
 typedef struct cmdalias_s
 {
 	struct cmdalias_s	*next;
 	char	name[MAX_ALIAS_NAME];
 	char	*value;
+	struct cmdalias_s	*hash_next;
 } cmdalias_t;
 
 cmdalias_t	*cmd_alias;
+static cmdalias_t	*alias_hash[ALIAS_HASH_SIZE];
 
 qboolean	cmd_wait;
 
@@ -57,6 +62,27 @@ void Cmd_Wait_f (void)
 	cmd_wait = true;
 }
 
+/*
+============
+Cmd_FindAlias
+
+Looks the name up in the alias hash table. The hash folds case, so both
+exact and case insensitive matches live in the same chain.
+============
+*/
+static cmdalias_t *Cmd_FindAlias (const char *name, qboolean nocase)
+{
+	cmdalias_t	*a;
+
+	for (a = alias_hash[COM_HashStringNoCase(name) & (ALIAS_HASH_SIZE - 1)] ; a ; a = a->hash_next)
+	{
+		if (nocase ? !q_strcasecmp(name, a->name) : !strcmp(name, a->name))
+			return a;
+	}
+
+	return NULL;
+}
+
 /*
 =============================================================================
 
@@ -308,6 +334,7 @@ void Cmd_Alias_f (void)
 	cmdalias_t	*a;
 	char		cmd[1024];
 	int			i, c;
+	unsigned int	h;
 	const char	*s;
 
 
@@ -322,9 +349,9 @@ void Cmd_Alias_f (void)
 			Con_SafePrintf ("no alias commands found\n");
 		break;
 	case 2: //output current alias string
-		for (a = cmd_alias ; a ; a=a->next)
-			if (!strcmp(Cmd_Argv(1), a->name))
-				Con_Printf ("   %s: %s", a->name, a->value);
+		a = Cmd_FindAlias (Cmd_Argv(1), false);
+		if (a)
+			Con_Printf ("   %s: %s", a->name, a->value);
 		break;
 	default: //set alias string
 		s = Cmd_Argv(1);
@@ -335,22 +362,19 @@ void Cmd_Alias_f (void)
 		}
 
 		// if the alias allready exists, reuse it
-		for (a = cmd_alias ; a ; a=a->next)
-		{
-			if (!strcmp(s, a->name))
-			{
-				Z_Free (a->value);
-				break;
-			}
-		}
-
-		if (!a)
+		a = Cmd_FindAlias (s, false);
+		if (a)
+			Z_Free (a->value);
+		else
 		{
 			a = (cmdalias_t *) Z_Malloc (sizeof(cmdalias_t));
 			a->next = cmd_alias;
 			cmd_alias = a;
+			strcpy (a->name, s);
+			h = COM_HashStringNoCase(s) & (ALIAS_HASH_SIZE - 1);
+			a->hash_next = alias_hash[h];
+			alias_hash[h] = a;
 		}
-		strcpy (a->name, s);
 
 		// copy the rest of the command line
 		cmd[0] = 0;		// start out with a null string
@@ -380,7 +404,7 @@ Cmd_Unalias_f -- johnfitz
 */
 void Cmd_Unalias_f (void)
 {
-	cmdalias_t	*a, *prev;
+	cmdalias_t	*a, *prev, **link;
 
 	switch (Cmd_Argc())
 	{
@@ -399,6 +423,11 @@ void Cmd_Unalias_f (void)
 				else
 					cmd_alias  = a->next;
 
+				link = &alias_hash[COM_HashStringNoCase(a->name) & (ALIAS_HASH_SIZE - 1)];
+				while (*link != a)
+					link = &(*link)->hash_next;
+				*link = a->hash_next;
+
 				Z_Free (a->value);
 				Z_Free (a);
 				return;
@@ -426,6 +455,7 @@ void Cmd_Unaliasall_f (void)
 		Z_Free(cmd_alias);
 		cmd_alias = blah;
 	}
+	memset (alias_hash, 0, sizeof(alias_hash));
 }
 
 /*
@@ -441,6 +471,7 @@ typedef struct cmd_function_s
 	struct cmd_function_s	*next;
 	const char		*name;
 	xcommand_t		function;
+	struct cmd_function_s	*hash_next;
 } cmd_function_t;
 
 
@@ -457,6 +488,28 @@ cmd_source_t	cmd_source;
 //static	cmd_function_t	*cmd_functions;		// possible commands to execute
 cmd_function_t	*cmd_functions;		// possible commands to execute
 //johnfitz
+static cmd_function_t	*cmd_hash[CMD_HASH_SIZE];
+
+/*
+============
+Cmd_FindCommand
+
+Hashed lookup, see Cmd_FindAlias. cmd_functions stays sorted for
+listing and tab completion.
+============
+*/
+static cmd_function_t *Cmd_FindCommand (const char *name, qboolean nocase)
+{
+	cmd_function_t	*cmd;
+
+	for (cmd = cmd_hash[COM_HashStringNoCase(name) & (CMD_HASH_SIZE - 1)] ; cmd ; cmd = cmd->hash_next)
+	{
+		if (nocase ? !q_strcasecmp(name, cmd->name) : !Q_strcmp(name, cmd->name))
+			return cmd;
+	}
+
+	return NULL;
+}
 
 /*
 ============
@@ -499,6 +552,129 @@ void Cmd_List_f (void)
 	Con_SafePrintf ("\n");
 }
 
+#define	BENCH_CVARS		1024
+#define	BENCH_ALIASES	64
+#define	BENCH_CHUNK		4096	// must fit in cmd_text
+
+/*
+============
+Cmd_HashLongest
+============
+*/
+static int Cmd_HashLongest (void)
+{
+	cmd_function_t	*cmd;
+	int		i, len, longest;
+
+	longest = 0;
+	for (i = 0; i < CMD_HASH_SIZE; i++)
+	{
+		for (cmd = cmd_hash[i], len = 0; cmd; cmd = cmd->hash_next)
+			len++;
+		longest = q_max (longest, len);
+	}
+	return longest;
+}
+
+/*
+============
+Cmd_Bench_f
+
+Runs a synthetic config through the command buffer: cvar sets to the current
+value, aliases and upper case alias names, so nothing changes state. The
+pending command buffer is saved off and restored afterwards.
+============
+*/
+static void Cmd_Bench_f (void)
+{
+	cvar_t		*vars[BENCH_CVARS], *var;
+	char		chunk[BENCH_CHUNK], line[1024];
+	byte		*saved;
+	int			savedsize, numvars, count, i, len, pos;
+	double		time;
+
+	count = (Cmd_Argc () > 1) ? Q_atoi (Cmd_Argv (1)) : 50000;
+	if (count < 1)
+		count = 1;
+
+	numvars = 0;
+	for (var = Cvar_FindVarAfter ("", CVAR_NONE); var && numvars < BENCH_CVARS; var = var->next)
+	{
+		if (var->flags & (CVAR_ROM|CVAR_LOCKED))
+			continue;
+		if (strchr (var->string, '"') || strchr (var->string, '\n') || Q_strlen (var->string) > 256)
+			continue;
+		vars[numvars++] = var;
+	}
+	if (!numvars)
+	{
+		Con_Printf ("no cvars to benchmark\n");
+		return;
+	}
+
+	for (i = 0; i < BENCH_ALIASES; i++)
+	{
+		q_snprintf (line, sizeof(line), "alias bench_alias%i \"\"", i);
+		Cmd_ExecuteString (line, src_command);
+	}
+
+	savedsize = cmd_text.cursize;
+	saved = savedsize ? (byte *) Z_Malloc (savedsize) : NULL;
+	if (saved)
+		memcpy (saved, cmd_text.data, savedsize);
+	SZ_Clear (&cmd_text);
+
+	time = Sys_DoubleTime ();
+	pos = 0;
+	for (i = 0; i < count; i++)
+	{
+		switch (i & 3)
+		{
+		case 0:
+		case 1:
+			var = vars[(i * 7 + (i >> 2)) % numvars];
+			len = q_snprintf (line, sizeof(line), "%s \"%s\"\n", var->name, var->string);
+			break;
+		case 2:
+			len = q_snprintf (line, sizeof(line), "bench_alias%i\n", (i >> 2) % BENCH_ALIASES);
+			break;
+		default:
+			len = q_snprintf (line, sizeof(line), "BENCH_ALIAS%i\n", (i >> 2) % BENCH_ALIASES);
+			break;
+		}
+		if (pos + len >= BENCH_CHUNK)
+		{
+			chunk[pos] = 0;
+			Cbuf_AddText (chunk);
+			Cbuf_Execute ();
+			pos = 0;
+		}
+		memcpy (chunk + pos, line, len);
+		pos += len;
+	}
+	chunk[pos] = 0;
+	Cbuf_AddText (chunk);
+	Cbuf_Execute ();
+	time = Sys_DoubleTime () - time;
+
+	SZ_Clear (&cmd_text);
+	if (saved)
+	{
+		SZ_Write (&cmd_text, saved, savedsize);
+		Z_Free (saved);
+	}
+
+	for (i = 0; i < BENCH_ALIASES; i++)
+	{
+		q_snprintf (line, sizeof(line), "unalias bench_alias%i", i);
+		Cmd_ExecuteString (line, src_command);
+	}
+
+	Con_Printf ("%i lines, %i cvars, %i aliases: %.2f ms, %.3f us/line\n",
+		count, numvars, BENCH_ALIASES, time * 1000.0, time * 1000000.0 / count);
+	Con_Printf ("longest command hash chain %i\n", Cmd_HashLongest ());
+}
+
 /*
 ============
 Cmd_Init
@@ -516,6 +692,7 @@ void Cmd_Init (void)
 	Cmd_AddCommand ("alias",Cmd_Alias_f);
 	Cmd_AddCommand ("cmd", Cmd_ForwardToServer);
 	Cmd_AddCommand ("wait", Cmd_Wait_f);
+	Cmd_AddCommand ("cmd_bench", Cmd_Bench_f);
 }
 
 /*
@@ -611,6 +788,7 @@ void	Cmd_AddCommand (const char *cmd_name, xcommand_t function)
 {
 	cmd_function_t	*cmd;
 	cmd_function_t	*cursor,*prev; //johnfitz -- sorted list insert
+	unsigned int	hash;
 
 	if (host_initialized)	// because hunk allocation would get stomped
 		Sys_Error ("Cmd_AddCommand after host_initialized");
@@ -623,18 +801,18 @@ void	Cmd_AddCommand (const char *cmd_name, xcommand_t function)
 	}
 
 // fail if the command already exists
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
+	if (Cmd_FindCommand (cmd_name, false))
 	{
-		if (!Q_strcmp (cmd_name, cmd->name))
-		{
-			Con_Printf ("Cmd_AddCommand: %s already defined\n", cmd_name);
-			return;
-		}
+		Con_Printf ("Cmd_AddCommand: %s already defined\n", cmd_name);
+		return;
 	}
 
 	cmd = (cmd_function_t *) Hunk_Alloc (sizeof(cmd_function_t));
 	cmd->name = cmd_name;
 	cmd->function = function;
+	hash = COM_HashStringNoCase(cmd_name) & (CMD_HASH_SIZE - 1);
+	cmd->hash_next = cmd_hash[hash];
+	cmd_hash[hash] = cmd;
 
 	//johnfitz -- insert each entry in alphabetical order
 	if (cmd_functions == NULL || strcmp(cmd->name, cmd_functions->name) < 0) //insert at front
@@ -664,15 +842,7 @@ Cmd_Exists
 */
 qboolean	Cmd_Exists (const char *cmd_name)
 {
-	cmd_function_t	*cmd;
-
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
-	{
-		if (!Q_strcmp (cmd_name,cmd->name))
-			return true;
-	}
-
-	return false;
+	return Cmd_FindCommand (cmd_name, false) != NULL;
 }
 
 
@@ -705,7 +875,6 @@ const char *Cmd_CompleteCommand (const char *partial)
 Cmd_ExecuteString
 
 A complete command line has been parsed, so try to execute it
-FIXME: lookupnoadd the token to speed search?
 ============
 */
 void	Cmd_ExecuteString (const char *text, cmd_source_t src)
@@ -721,23 +890,19 @@ void	Cmd_ExecuteString (const char *text, cmd_source_t src)
 		return;		// no tokens
 
 // check functions
-	for (cmd=cmd_functions ; cmd ; cmd=cmd->next)
+	cmd = Cmd_FindCommand (cmd_argv[0], true);
+	if (cmd)
 	{
-		if (!q_strcasecmp (cmd_argv[0],cmd->name))
-		{
-			cmd->function ();
-			return;
-		}
+		cmd->function ();
+		return;
 	}
 
 // check alias
-	for (a=cmd_alias ; a ; a=a->next)
+	a = Cmd_FindAlias (cmd_argv[0], true);
+	if (a)
 	{
-		if (!q_strcasecmp (cmd_argv[0], a->name))
-		{
-			Cbuf_InsertText (a->value);
-			return;
-		}
+		Cbuf_InsertText (a->value);
+		return;
 	}
 
 // check cvars
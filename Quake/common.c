@@ -22,9 +22,15 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 // common.c -- misc functions used in client and server
 
+#ifdef VK_USE_PLATFORM_WIN32
+#include <windows.h>
+#endif
 #include "quakedef.h"
 #include "q_ctype.h"
 #include <errno.h>
+#ifndef _WIN32
+#include <dirent.h>
+#endif
 
 static char	*largv[MAX_NUM_ARGVS + 1];
 static char	argvdummy[] = " ";
@@ -39,6 +45,7 @@ static qboolean		com_modified;	// set true if using non-id files
 qboolean		fitzmode;
 
 static void COM_Path_f (void);
+static void COM_FileStats_f (void);
 
 // if a packfile directory differs from this, it is assumed to be hacked
 #define PAK0_COUNT		339	/* id1/pak0.pak - v1.0x */
@@ -214,6 +221,32 @@ char *q_strupr (char *str)
 	return str;
 }
 
+/* FNV-1a string hashes for lookup tables. The NoCase variant folds
+ * ascii case, so it can be used with q_strcasecmp comparisons. */
+unsigned int COM_HashString (const char *str)
+{
+	unsigned int	hash = 2166136261u;
+
+	while (*str)
+	{
+		hash ^= (unsigned char)*str++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+unsigned int COM_HashStringNoCase (const char *str)
+{
+	unsigned int	hash = 2166136261u;
+
+	while (*str)
+	{
+		hash ^= (unsigned char)q_tolower(*str++);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
 /* platform dependant (v)snprintf function names: */
 #if defined(_WIN32)
 #define	snprintf_func		_snprintf
@@ -1436,10 +1469,17 @@ typedef struct
 char	com_gamedir[MAX_OSPATH];
 char	com_basedir[MAX_OSPATH];
 int	file_from_pak;		// ZOID: global indicating that file came from a pak
+qboolean	file_mapped;
+
+static searchpath_t	*com_filesearch;	// where the last file was found
+static pack_t	*com_filepak;	// pak and offset of the last file found in one
+static int	com_filepos;
 
 searchpath_t	*com_searchpaths;
 searchpath_t	*com_base_searchpaths;
 
+static int	fs_dirflushes;	// bumped when we write into a game directory
+
 /*
 ============
 COM_Path_f
@@ -1454,7 +1494,8 @@ static void COM_Path_f (void)
 	{
 		if (s->pack)
 		{
-			Con_Printf ("%s (%i files)\n", s->pack->filename, s->pack->numfiles);
+			Con_Printf ("%s (%i files%s)\n", s->pack->filename, s->pack->numfiles,
+					s->pack->mapped ? ", mapped" : "");
 		}
 		else
 			Con_Printf ("%s\n", s->filename);
@@ -1487,6 +1528,21 @@ void COM_WriteFile (const char *filename, const void *data, int len)
 	Sys_Printf ("COM_WriteFile: %s\n", name);
 	Sys_FileWrite (handle, data, len);
 	Sys_FileClose (handle);
+
+	COM_FlushDirs ();
+}
+
+/*
+============
+COM_FlushDirs
+
+Call after creating a file in a game directory other than through
+COM_WriteFile, so the cached directory listings pick it up
+============
+*/
+void COM_FlushDirs (void)
+{
+	fs_dirflushes++;
 }
 
 /*
@@ -1527,62 +1583,462 @@ long COM_filelength (FILE *f)
 }
 
 /*
-===========
-COM_FindFile
+==============================================================================
 
-Finds the file in the search path.
-Sets com_filesize and one of handle or file
-If neither of file or handle is set, this
-can be used for detecting a file's presence.
+FILE INDEX
+
+The entries of all pak files in the search path are kept in one hash
+table, pointing at the highest priority pak holding each name, so that
+COM_FindFile doesn't have to strcmp through every pak. Loose files are
+checked against a cached listing of their directory first, which is
+rescanned once per host frame (or after COM_WriteFile), so a lookup
+missing a game directory doesn't cost a filesystem stat.
+
+==============================================================================
+*/
+
+typedef struct
+{
+	packfile_t	*file;
+	searchpath_t	*search;
+} fsindexentry_t;
+
+static fsindexentry_t	*fs_index;
+static unsigned int	fs_indexmask;
+static int		fs_indexfiles;
+static qboolean		fs_indexdirty = true;	// search path changed, rebuild before use
+
+#define	FS_DIRHASHSIZE	256
+
+typedef struct fsdir_s
+{
+	char		path[MAX_OSPATH];
+	int		framecount;	// host_framecount at the time of the scan
+	int		flushcount;	// fs_dirflushes at the time of the scan
+	int		numfiles;
+	char		*names;		// nul separated file names
+	int		*table;		// offsets into names, -1 for empty slots
+	unsigned int	tablemask;
+	qboolean	nocase;		// names are looked up ignoring case
+	struct fsdir_s	*next;
+} fsdir_t;
+
+static fsdir_t	*fs_dirs[FS_DIRHASHSIZE];
+
+/* directory paths are keyed by the case rules of the host os; the
+   names inside a listing follow the filesystem they were read from */
+#ifdef _WIN32
+#define	FS_NameHash	COM_HashStringNoCase
+#define	FS_NameCompare	q_strcasecmp
+#else
+#define	FS_NameHash	COM_HashString
+#define	FS_NameCompare	strcmp
+#endif
+
+static struct
+{
+	int		lookups;
+	int		found;
+	int		pakhits;
+	int		dirhits;
+	int		dirskips;	// loose file misses answered by a listing
+	int		dirscans;
+	int		stats;
+	double		time;
+} fs_stats;
+
+/*
+============
+COM_BuildFileIndex
+============
+*/
+static void COM_BuildFileIndex (void)
+{
+	searchpath_t	*search;
+	packfile_t	*file;
+	unsigned int	size, slot;
+	int		i, total;
+
+	total = 0;
+	for (search = com_searchpaths; search; search = search->next)
+	{
+		if (search->pack)
+			total += search->pack->numfiles;
+	}
+
+	for (size = 64; size < (unsigned int)total * 2; size <<= 1)
+		;
+
+	free (fs_index);
+	fs_index = (fsindexentry_t *) calloc (size, sizeof(fsindexentry_t));
+	if (!fs_index)
+		Sys_Error ("COM_BuildFileIndex: failed on %i files", total);
+	fs_indexmask = size - 1;
+	fs_indexfiles = 0;
+
+	// walk in search order, so the first pak holding a name keeps it
+	for (search = com_searchpaths; search; search = search->next)
+	{
+		if (!search->pack)
+			continue;
+		for (i = 0; i < search->pack->numfiles; i++)
+		{
+			file = &search->pack->files[i];
+			slot = COM_HashString (file->name) & fs_indexmask;
+			while (fs_index[slot].file && strcmp (fs_index[slot].file->name, file->name) != 0)
+				slot = (slot + 1) & fs_indexmask;
+			if (fs_index[slot].file)
+				continue;	// overridden by a higher priority pak
+			fs_index[slot].file = file;
+			fs_index[slot].search = search;
+			fs_indexfiles++;
+		}
+	}
+
+	fs_indexdirty = false;
+}
+
+/*
+============
+COM_FindPackEntry
+
+Returns the highest priority pak entry for filename, or NULL
+============
+*/
+static fsindexentry_t *COM_FindPackEntry (const char *filename)
+{
+	unsigned int	slot;
+
+	if (fs_indexdirty)
+		COM_BuildFileIndex ();
+
+	slot = COM_HashString (filename) & fs_indexmask;
+	while (fs_index[slot].file)
+	{
+		if (!strcmp (fs_index[slot].file->name, filename))
+			return &fs_index[slot];
+		slot = (slot + 1) & fs_indexmask;
+	}
+
+	return NULL;
+}
+
+/*
+============
+COM_DirectoryIgnoresCase
+
+Probes a scanned directory by looking up one of its names with the case
+flipped, so listings on case-insensitive filesystems (macOS, mounted FAT
+or NTFS volumes) still answer lookups like maps/E1M1.bsp
+============
+*/
+static qboolean COM_DirectoryIgnoresCase (fsdir_t *dir, int used)
+{
+#ifdef _WIN32
+	return true;
+#else
+	char		path[MAX_OSPATH], *c, *name;
+	int		ofs, other, len;
+	qboolean	flipped;
+
+	for (ofs = 0; ofs < used; ofs += strlen(dir->names + ofs) + 1)
+	{
+		len = q_snprintf (path, sizeof(path), "%s/%s", dir->path, dir->names + ofs);
+		if (len >= (int)sizeof(path))
+			continue;
+		name = path + len - strlen(dir->names + ofs);
+		flipped = false;
+		for (c = name; *c; c++)
+		{
+			if (q_isupper(*c))
+				*c = q_tolower(*c);
+			else if (q_islower(*c))
+				*c = q_toupper(*c);
+			else
+				continue;
+			flipped = true;
+		}
+		if (!flipped)
+			continue;
+		if (Sys_FileTime (path) == -1)
+			return false;
+		// a case-sensitive filesystem only finds it if it is listed too
+		for (other = 0; other < used; other += strlen(dir->names + other) + 1)
+		{
+			if (!strcmp (dir->names + other, name))
+				break;
+		}
+		if (other >= used)
+			return true;
+	}
+
+	return false;
+#endif
+}
+
+/*
+============
+COM_ScanDirectory
+============
+*/
+static void COM_ScanDirectory (fsdir_t *dir)
+{
+#ifdef _WIN32
+	WIN32_FIND_DATA	fdat;
+	HANDLE		fhnd;
+	char		filestring[MAX_OSPATH];
+#else
+	DIR		*dir_p;
+	struct dirent	*dir_t;
+#endif
+	const char	*name;
+	int		len, used, maxsize, ofs;
+	unsigned int	size, slot;
+
+	fs_stats.dirscans++;
+
+	free (dir->names);
+	free (dir->table);
+	dir->names = NULL;
+	dir->table = NULL;
+	dir->numfiles = 0;
+	dir->tablemask = 0;
+	dir->nocase = false;
+	dir->framecount = host_framecount;
+	dir->flushcount = fs_dirflushes;
+
+	used = maxsize = 0;
+#ifdef _WIN32
+	q_snprintf (filestring, sizeof(filestring), "%s/*", dir->path);
+	fhnd = FindFirstFile(filestring, &fdat);
+	if (fhnd == INVALID_HANDLE_VALUE)
+		return;
+	do
+	{
+		name = fdat.cFileName;
+#else
+	dir_p = opendir(dir->path);
+	if (dir_p == NULL)
+		return;
+	while ((dir_t = readdir(dir_p)) != NULL)
+	{
+		name = dir_t->d_name;
+#endif
+		if (!strcmp(name, ".") || !strcmp(name, ".."))
+			continue;
+		len = strlen(name) + 1;
+		if (used + len > maxsize)
+		{
+			maxsize = q_max(maxsize * 2, used + len + 1024);
+			dir->names = (char *) realloc (dir->names, maxsize);
+			if (!dir->names)
+				Sys_Error ("COM_ScanDirectory: failed on %s", dir->path);
+		}
+		memcpy (dir->names + used, name, len);
+		used += len;
+		dir->numfiles++;
+#ifdef _WIN32
+	} while (FindNextFile(fhnd, &fdat));
+	FindClose(fhnd);
+#else
+	}
+	closedir(dir_p);
+#endif
+
+	if (!dir->numfiles)
+		return;
+
+	for (size = 16; size < (unsigned int)dir->numfiles * 2; size <<= 1)
+		;
+	dir->table = (int *) malloc (size * sizeof(int));
+	if (!dir->table)
+		Sys_Error ("COM_ScanDirectory: failed on %s", dir->path);
+	memset (dir->table, -1, size * sizeof(int));
+	dir->tablemask = size - 1;
+	dir->nocase = COM_DirectoryIgnoresCase (dir, used);
+
+	for (ofs = 0; ofs < used; ofs += strlen(dir->names + ofs) + 1)
+	{
+		if (dir->nocase)
+			slot = COM_HashStringNoCase (dir->names + ofs) & dir->tablemask;
+		else
+			slot = COM_HashString (dir->names + ofs) & dir->tablemask;
+		while (dir->table[slot] != -1)
+			slot = (slot + 1) & dir->tablemask;
+		dir->table[slot] = ofs;
+	}
+}
+
+/*
+============
+COM_GetDirectory
+
+Returns the listing of an os path, rescanning it if it is out of date
+============
+*/
+static fsdir_t *COM_GetDirectory (const char *path)
+{
+	fsdir_t		*dir;
+	unsigned int	hash;
+
+	hash = FS_NameHash (path) & (FS_DIRHASHSIZE - 1);
+	for (dir = fs_dirs[hash]; dir; dir = dir->next)
+	{
+		if (!FS_NameCompare (dir->path, path))
+			break;
+	}
+
+	if (!dir)
+	{
+		dir = (fsdir_t *) calloc (1, sizeof(fsdir_t));
+		if (!dir)
+			Sys_Error ("COM_GetDirectory: failed on %s", path);
+		q_strlcpy (dir->path, path, sizeof(dir->path));
+		dir->next = fs_dirs[hash];
+		fs_dirs[hash] = dir;
+		COM_ScanDirectory (dir);
+	}
+	else if (dir->framecount != host_framecount || dir->flushcount != fs_dirflushes)
+		COM_ScanDirectory (dir);
+
+	return dir;
+}
+
+/*
+============
+COM_LooseFileListed
+
+Returns false if filename is known to be missing from the game
+directory of search, true if it has to be checked on disk
+============
+*/
+static qboolean COM_LooseFileListed (searchpath_t *search, const char *filename)
+{
+	char		dirpath[MAX_OSPATH];
+	const char	*slash, *name;
+	fsdir_t		*dir;
+	unsigned int	slot;
+	int		len;
+
+	// leave unusual paths to the filesystem
+	if (filename[0] == '/' || strchr(filename, '\\') || strchr(filename, ':') ||
+	    strstr(filename, "./") || strstr(filename, "//") || strstr(filename, ".."))
+		return true;
+
+	slash = strrchr (filename, '/');
+	if (slash)
+	{
+		len = q_snprintf (dirpath, sizeof(dirpath), "%s/%.*s", search->filename, (int)(slash - filename), filename);
+		name = slash + 1;
+	}
+	else
+	{
+		len = q_snprintf (dirpath, sizeof(dirpath), "%s", search->filename);
+		name = filename;
+	}
+	if (!*name || len >= (int)sizeof(dirpath))
+		return true;
+
+	dir = COM_GetDirectory (dirpath);
+	if (!dir->numfiles)
+		return false;
+
+	if (dir->nocase)
+		slot = COM_HashStringNoCase (name) & dir->tablemask;
+	else
+		slot = COM_HashString (name) & dir->tablemask;
+	while (dir->table[slot] != -1)
+	{
+		if (dir->nocase ? !q_strcasecmp (dir->names + dir->table[slot], name)
+				: !strcmp (dir->names + dir->table[slot], name))
+			return true;
+		slot = (slot + 1) & dir->tablemask;
+	}
+
+	return false;
+}
+
+/*
+============
+COM_FileStats_f
+============
+*/
+static void COM_FileStats_f (void)
+{
+	if (Cmd_Argc () > 1 && !strcmp (Cmd_Argv (1), "reset"))
+	{
+		memset (&fs_stats, 0, sizeof(fs_stats));
+		return;
+	}
+
+	if (fs_indexdirty)
+		COM_BuildFileIndex ();
+
+	Con_Printf ("%i lookups, %i found (%i pak, %i dir), %i missed\n",
+			fs_stats.lookups, fs_stats.found, fs_stats.pakhits, fs_stats.dirhits,
+			fs_stats.lookups - fs_stats.found);
+	Con_Printf ("%i file stats, %i skipped by %i directory scans\n",
+			fs_stats.stats, fs_stats.dirskips, fs_stats.dirscans);
+	Con_Printf ("%i pak files indexed, %.3f ms spent in lookups\n",
+			fs_indexfiles, fs_stats.time * 1000.0);
+}
+
+/*
+===========
+COM_SearchFile
 ===========
 */
-static int COM_FindFile (const char *filename, int *handle, FILE **file,
+static int COM_SearchFile (const char *filename, int *handle, FILE **file,
 							unsigned int *path_id)
 {
 	searchpath_t	*search;
 	char		netpath[MAX_OSPATH];
 	pack_t		*pak;
+	packfile_t	*packfile;
+	fsindexentry_t	*entry;
 	int		i, findtime;
 
-	if (file && handle)
-		Sys_Error ("COM_FindFile: both handle and file set");
-
 	file_from_pak = 0;
+	com_filepak = NULL;
+
+	entry = COM_FindPackEntry (filename);
 
 //
 // search through the path, one element at a time
 //
 	for (search = com_searchpaths; search; search = search->next)
 	{
-		if (search->pack)	/* look through all the pak file elements */
+		if (search->pack)	/* the index knows which pak has it */
 		{
+			if (!entry || entry->search != search)
+				continue;
+			// found it!
 			pak = search->pack;
-			for (i = 0; i < pak->numfiles; i++)
+			packfile = entry->file;
+			fs_stats.pakhits++;
+			com_filesize = packfile->filelen;
+			file_from_pak = 1;
+			com_filesearch = search;
+			com_filepak = pak;
+			com_filepos = packfile->filepos;
+			if (path_id)
+				*path_id = search->path_id;
+			if (handle)
 			{
-				if (strcmp(pak->files[i].name, filename) != 0)
-					continue;
-				// found it!
-				com_filesize = pak->files[i].filelen;
-				file_from_pak = 1;
-				if (path_id)
-					*path_id = search->path_id;
-				if (handle)
-				{
-					*handle = pak->handle;
-					Sys_FileSeek (pak->handle, pak->files[i].filepos);
-					return com_filesize;
-				}
-				else if (file)
-				{ /* open a new file on the pakfile */
-					*file = fopen (pak->filename, "rb");
-					if (*file)
-						fseek (*file, pak->files[i].filepos, SEEK_SET);
-					return com_filesize;
-				}
-				else /* for COM_FileExists() */
-				{
-					return com_filesize;
-				}
+				*handle = pak->handle;
+				Sys_FileSeek (pak->handle, packfile->filepos);
+				return com_filesize;
+			}
+			else if (file)
+			{ /* open a new file on the pakfile */
+				*file = fopen (pak->filename, "rb");
+				if (*file)
+					fseek (*file, packfile->filepos, SEEK_SET);
+				return com_filesize;
+			}
+			else /* for COM_FileExists() */
+			{
+				return com_filesize;
 			}
 		}
 		else	/* check a file in the directory tree */
@@ -1593,11 +2049,20 @@ static int COM_FindFile (const char *filename, int *handle, FILE **file,
 					continue;
 			}
 
+			if (!COM_LooseFileListed (search, filename))
+			{
+				fs_stats.dirskips++;
+				continue;
+			}
+
 			q_snprintf (netpath, sizeof(netpath), "%s/%s",search->filename, filename);
+			fs_stats.stats++;
 			findtime = Sys_FileTime (netpath);
 			if (findtime == -1)
 				continue;
 
+			fs_stats.dirhits++;
+			com_filesearch = search;
 			if (path_id)
 				*path_id = search->path_id;
 			if (handle)
@@ -1635,6 +2100,36 @@ static int COM_FindFile (const char *filename, int *handle, FILE **file,
 	return com_filesize;
 }
 
+/*
+===========
+COM_FindFile
+
+Finds the file in the search path.
+Sets com_filesize and one of handle or file
+If neither of file or handle is set, this
+can be used for detecting a file's presence.
+===========
+*/
+static int COM_FindFile (const char *filename, int *handle, FILE **file,
+							unsigned int *path_id)
+{
+	double	time;
+	int	ret;
+
+	if (file && handle)
+		Sys_Error ("COM_FindFile: both handle and file set");
+
+	time = Sys_DoubleTime ();
+	ret = COM_SearchFile (filename, handle, file, path_id);
+
+	fs_stats.lookups++;
+	if (ret != -1)
+		fs_stats.found++;
+	fs_stats.time += Sys_DoubleTime () - time;
+
+	return ret;
+}
+
 
 /*
 ===========
@@ -1676,6 +2171,110 @@ int COM_FOpenFile (const char *filename, FILE **file, unsigned int *path_id)
 	return COM_FindFile (filename, NULL, file, path_id);
 }
 
+/*
+===========
+COM_MappedData
+
+Returns the data of the last file found, if it is in a mapped pak
+===========
+*/
+static byte *COM_MappedData (int len)
+{
+	if (!com_filepak || !com_filepak->mapped)
+		return NULL;
+	if (com_filepos < 0 || len < 0 || com_filepos + (long)len > com_filepak->mapsize)
+		return NULL;
+	return com_filepak->mapped + com_filepos;
+}
+
+/*
+===========
+COM_LocateFile
+
+Finds the file in the search path without opening it
+===========
+*/
+qboolean COM_LocateFile (const char *filename, fileloc_t *loc)
+{
+	if (COM_FindFile (filename, NULL, NULL, &loc->path_id) == -1)
+		return false;
+
+	if (com_filepak)
+	{
+		q_strlcpy (loc->ospath, com_filepak->filename, sizeof(loc->ospath));
+		loc->offset = com_filepos;
+		loc->length = com_filesize;
+		loc->mapped = COM_MappedData (com_filesize);
+	}
+	else
+	{
+		q_snprintf (loc->ospath, sizeof(loc->ospath), "%s/%s", com_filesearch->filename, filename);
+		loc->offset = 0;
+		loc->length = -1;
+		loc->mapped = NULL;
+	}
+
+	return true;
+}
+
+/*
+===========
+COM_OpenLocatedFile
+===========
+*/
+FILE *COM_OpenLocatedFile (fileloc_t *loc)
+{
+	FILE	*f;
+
+	f = fopen (loc->ospath, "rb");
+	if (!f)
+		return NULL;
+
+	if (loc->length == -1)
+		loc->length = COM_filelength (f);
+	else
+		fseek (f, loc->offset, SEEK_SET);
+
+	return f;
+}
+
+/*
+===========
+COM_ReadLocatedFile
+===========
+*/
+byte *COM_ReadLocatedFile (fileloc_t *loc)
+{
+	FILE	*f;
+	byte	*buf;
+
+	if (loc->mapped)
+	{
+		buf = (byte *) malloc (loc->length + 1);
+		if (!buf)
+			return NULL;
+		memcpy (buf, loc->mapped, loc->length);
+		buf[loc->length] = 0;
+		return buf;
+	}
+
+	f = COM_OpenLocatedFile (loc);
+	if (!f)
+		return NULL;
+
+	buf = (byte *) malloc (loc->length + 1);
+	if (buf && fread (buf, 1, loc->length, f) != (size_t)loc->length)
+	{
+		free (buf);
+		buf = NULL;
+	}
+	if (buf)
+		buf[loc->length] = 0;
+
+	fclose (f);
+	return buf;
+}
+
 /*
 ============
 COM_CloseFile
@@ -1709,6 +2308,7 @@ Allways appends a 0 byte.
 #define	LOADFILE_CACHE		3
 #define	LOADFILE_STACK		4
 #define	LOADFILE_MALLOC		5
+#define	LOADFILE_MAPPED		6
 
 static byte	*loadbuf;
 static cache_user_t *loadcache;
@@ -1717,17 +2317,31 @@ static int	loadsize;
 byte *COM_LoadFile (const char *path, int usehunk, unsigned int *path_id)
 {
 	int		h;
-	byte	*buf;
+	byte	*buf, *mapped;
 	char	base[32];
 	int		len;
 
 	buf = NULL;	// quiet compiler warning
+	file_mapped = false;
 
 // look for it in the filesystem or pack files
 	len = COM_OpenFile (path, &h, path_id);
 	if (h == -1)
 		return NULL;
 
+	mapped = COM_MappedData (len);
+	if (usehunk == LOADFILE_MAPPED)
+	{
+		// hand out the mapping itself if it is suitably aligned
+		if (mapped && !((size_t)mapped & 3))
+		{
+			file_mapped = true;
+			COM_CloseFile (h);
+			return mapped;
+		}
+		usehunk = LOADFILE_STACK;
+	}
+
 // extract the filename base name for hunk tag
 	COM_FileBase (path, base, sizeof(base));
 
@@ -1763,7 +2377,10 @@ byte *COM_LoadFile (const char *path, int usehunk, unsigned int *path_id)
 
 	((byte *)buf)[len] = 0;
 
-	Sys_FileRead (h, buf, len);
+	if (mapped)
+		memcpy (buf, mapped, len);
+	else
+		Sys_FileRead (h, buf, len);
 	COM_CloseFile (h);
 
 	return buf;
@@ -1808,6 +2425,14 @@ byte *COM_LoadMallocFile (const char *path, unsigned int *path_id)
 	return COM_LoadFile (path, LOADFILE_MALLOC, path_id);
 }
 
+// returns read-only memory, or uses the stack buffer / temp hunk like COM_LoadStackFile
+const byte *COM_LoadMappedFile (const char *path, void *buffer, int bufsize, unsigned int *path_id)
+{
+	loadbuf = (byte *)buffer;
+	loadsize = bufsize;
+	return COM_LoadFile (path, LOADFILE_MAPPED, path_id);
+}
+
 
 /*
 =================
@@ -1884,6 +2509,8 @@ static pack_t *COM_LoadPackFile (const char *packfile)
 	pack->handle = packhandle;
 	pack->numfiles = numpackfiles;
 	pack->files = newfiles;
+	if (!COM_CheckParm ("-nomappaks"))
+		pack->mapped = (byte *) Sys_MapFile (packfile, &pack->mapsize);
 
 	//Sys_Printf ("Added packfile %s (%i files)\n", packfile, numpackfiles);
 	return pack;
@@ -1956,6 +2583,8 @@ _add_path:
 		Sys_mkdir(com_gamedir);
 		goto _add_path;
 	}
+
+	fs_indexdirty = true;
 }
 
 //==============================================================================
@@ -2023,11 +2652,16 @@ static void COM_Game_f (void)
 		//Write config file
 		Host_WriteConfiguration ();
 
+		//Nothing may be reading the paks while they close
+		Loader_Flush ();
+
 		//Kill the extra game if it is loaded
 		while (com_searchpaths != com_base_searchpaths)
 		{
 			if (com_searchpaths->pack)
 			{
+				if (com_searchpaths->pack->mapped)
+					Sys_UnmapFile (com_searchpaths->pack->mapped, com_searchpaths->pack->mapsize);
 				Sys_FileClose (com_searchpaths->pack->handle);
 				Z_Free (com_searchpaths->pack->files);
 				Z_Free (com_searchpaths->pack);
@@ -2036,6 +2670,7 @@ static void COM_Game_f (void)
 			Z_Free (com_searchpaths);
 			com_searchpaths = search;
 		}
+		fs_indexdirty = true;
 		hipnotic = false;
 		rogue = false;
 		standard_quake = true;
@@ -2106,6 +2741,7 @@ void COM_InitFilesystem (void) //johnfitz -- modified based on topaz's tutorial
 	Cvar_RegisterVariable (&cmdline);
 	Cmd_AddCommand ("path", COM_Path_f);
 	Cmd_AddCommand ("game", COM_Game_f); //johnfitz
+	Cmd_AddCommand ("fs_stats", COM_FileStats_f);
 
 	i = COM_CheckParm ("-basedir");
 	if (i && i < com_argc-1)
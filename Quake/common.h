@@ -145,6 +145,10 @@ extern int q_strncasecmp (const char *s1, const char *s2, size_t n);
 extern char *q_strlwr (char *str);
 extern char *q_strupr (char *str);
 
+/* string hash functions for lookup tables: */
+extern unsigned int COM_HashString (const char *str);
+extern unsigned int COM_HashStringNoCase (const char *str);
+
 /* snprintf, vsnprintf : always use our versions. */
 extern int q_snprintf (char *str, size_t size, const char *format, ...) __attribute__((__format__(__printf__,3,4)));
 extern int q_vsnprintf(char *str, size_t size, const char *format, va_list args)
@@ -204,6 +208,8 @@ typedef struct pack_s
 	int		handle;
 	int		numfiles;
 	packfile_t	*files;
+	byte		*mapped;	// read-only view of the whole pak, or NULL
+	long		mapsize;
 } pack_t;
 
 typedef struct searchpath_s
@@ -225,8 +231,10 @@ struct cache_user_s;
 extern	char	com_basedir[MAX_OSPATH];
 extern	char	com_gamedir[MAX_OSPATH];
 extern	int	file_from_pak;	// global indicating that file came from a pak
+extern	qboolean	file_mapped;	// last COM_LoadMappedFile returned a view
 
 void COM_WriteFile (const char *filename, const void *data, int len);
+void COM_FlushDirs (void);
 int COM_OpenFile (const char *filename, int *handle, unsigned int *path_id);
 int COM_FOpenFile (const char *filename, FILE **file, unsigned int *path_id);
 qboolean COM_FileExists (const char *filename, unsigned int *path_id);
@@ -251,6 +259,30 @@ void COM_LoadCacheFile (const char *path, struct cache_user_s *cu,
 	// uses cache mem for allocating the buffer.
 byte *COM_LoadMallocFile (const char *path, unsigned int *path_id);
 	// allocates the buffer on the system mem (malloc).
+const byte *COM_LoadMappedFile (const char *path, void *buffer, int bufsize,
+						unsigned int *path_id);
+	// returns a view into a memory mapped pak file without copying,
+	// otherwise behaves like COM_LoadStackFile. the data must not be
+	// modified, and a view isn't followed by a 0 byte. sets file_mapped
+	// accordingly.
+
+// where a file was found in the search path. COM_LocateFile has to be
+// called from the main thread, but the file can then be opened or read
+// from any thread without touching the filesystem state.
+typedef struct
+{
+	char		ospath[MAX_OSPATH];	// the pak or the loose file
+	int		offset;			// start of the file in the pak
+	int		length;			// -1 for loose files, until opened
+	const byte	*mapped;		// the file data in a mapped pak, or NULL
+	unsigned int	path_id;
+} fileloc_t;
+
+qboolean COM_LocateFile (const char *filename, fileloc_t *loc);
+FILE *COM_OpenLocatedFile (fileloc_t *loc);
+	// opens a FILE positioned at the start of the file, sets loc->length.
+byte *COM_ReadLocatedFile (fileloc_t *loc);
+	// returns malloc'd data with a 0 byte appended, sets loc->length.
 
 /* The following FS_*() stdio replacements are necessary if one is
  * to perform non-sequential reads on files reopened on pak files
@@ -165,6 +165,7 @@ static void Con_Dump_f (void)
 		Con_Printf ("ERROR: couldn't open file %s.\n", name);
 		return;
 	}
+	COM_FlushDirs ();
 
 	// skip initial empty lines
 	for (l = con_current - con_totallines + 1; l <= con_current; l++)
@@ -722,6 +723,7 @@ typedef struct cmd_function_s
 	struct cmd_function_s	*next;
 	const char		*name;
 	xcommand_t		function;
+	struct cmd_function_s	*hash_next;
 } cmd_function_t;
 extern	cmd_function_t	*cmd_functions;
 #define	MAX_ALIAS_NAME	32
@@ -730,6 +732,7 @@ typedef struct cmdalias_s
 	struct cmdalias_s	*next;
 	char	name[MAX_ALIAS_NAME];
 	char	*value;
+	struct cmdalias_s	*hash_next;
 } cmdalias_t;
 extern	cmdalias_t	*cmd_alias;
 
@@ -23,7 +23,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
-static cvar_t	*cvar_vars;
+#define	CVAR_HASH_SIZE	512	// must be a power of two
+
+static cvar_t	*cvar_vars;	// sorted, for listing and completion
+static cvar_t	*cvar_hash[CVAR_HASH_SIZE];
 static char	cvar_null_string[] = "";
 
 //==============================================================================
@@ -249,7 +252,8 @@ cvar_t *Cvar_FindVar (const char *var_name)
 {
 	cvar_t	*var;
 
-	for (var = cvar_vars ; var ; var = var->next)
+	var = cvar_hash[COM_HashStringNoCase(var_name) & (CVAR_HASH_SIZE - 1)];
+	for ( ; var ; var = var->hash_next)
 	{
 		if (!Q_strcmp(var_name, var->name))
 			return var;
@@ -534,6 +538,7 @@ void Cvar_RegisterVariable (cvar_t *variable)
 	char	value[512];
 	qboolean	set_rom;
 	cvar_t	*cursor,*prev; //johnfitz -- sorted list insert
+	unsigned int	hash;
 
 // first check to see if it has already been defined
 	if (Cvar_FindVar (variable->name))
@@ -570,6 +575,9 @@ void Cvar_RegisterVariable (cvar_t *variable)
 		prev->next = variable;
 	}
 	//johnfitz
+	hash = COM_HashStringNoCase(variable->name) & (CVAR_HASH_SIZE - 1);
+	variable->hash_next = cvar_hash[hash];
+	cvar_hash[hash] = variable;
 	variable->flags |= CVAR_REGISTERED;
 
 // copy the value off, because future sets will Z_Free it
@@ -813,6 +813,7 @@ void GL_Viewport(float x, float y, float width, float height)
 	viewport.minDepth = 0.0f;
 	viewport.maxDepth = 1.0f;
 
+	vulkan_globals.viewport = viewport;
 	vkCmdSetViewport(vulkan_globals.command_buffer, 0, 1, &viewport);
 }
 
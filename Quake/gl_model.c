@@ -123,12 +123,11 @@ mleaf_t *Mod_PointInLeaf (vec3_t p, qmodel_t *model)
 
 /*
 ===================
-Mod_DecompressVis
+Mod_DecompressVisTo
 ===================
 */
-byte *Mod_DecompressVis (byte *in, qmodel_t *model)
+static byte *Mod_DecompressVisTo (byte *in, qmodel_t *model, byte *decompressed)
 {
-	static byte	decompressed[MAX_MAP_LEAFS/8];
 	int		c;
 	byte	*out;
 	int		row;
@@ -170,6 +169,18 @@ byte *Mod_DecompressVis (byte *in, qmodel_t *model)
 	return decompressed;
 }
 
+/*
+===================
+Mod_DecompressVis
+===================
+*/
+byte *Mod_DecompressVis (byte *in, qmodel_t *model)
+{
+	static byte	decompressed[MAX_MAP_LEAFS/8];
+
+	return Mod_DecompressVisTo (in, model, decompressed);
+}
+
 byte *Mod_LeafPVS (mleaf_t *leaf, qmodel_t *model)
 {
 	if (leaf == model->leafs)
@@ -177,6 +188,21 @@ byte *Mod_LeafPVS (mleaf_t *leaf, qmodel_t *model)
 	return Mod_DecompressVis (leaf->compressed_vis, model);
 }
 
+/*
+===================
+Mod_LeafPVSTo
+
+Mod_LeafPVS for other threads: decompresses into out, which has to hold
+MAX_MAP_LEAFS/8 bytes, instead of a shared buffer
+===================
+*/
+byte *Mod_LeafPVSTo (mleaf_t *leaf, qmodel_t *model, byte *out)
+{
+	if (leaf == model->leafs)
+		return mod_novis;
+	return Mod_DecompressVisTo (leaf->compressed_vis, model, out);
+}
+
 /*
 ===================
 Mod_ClearAll
@@ -264,6 +290,29 @@ void Mod_TouchModel (const char *name)
 	}
 }
 
+/*
+==================
+Mod_QueueLoad
+
+Starts reading a model in the background if it isn't loaded yet
+==================
+*/
+void Mod_QueueLoad (const char *name)
+{
+	qmodel_t	*mod;
+
+	if (name[0] == '*')
+		return;	// inline brush model
+
+	mod = Mod_FindName (name);
+	if (!mod->needload && (mod->type != mod_alias || Cache_Check (&mod->cache)))
+		return;
+
+	Loader_QueueFile (name);
+}
+
+static byte	*mod_loaded;	// file data from the loader
+
 /*
 ==================
 Mod_LoadModel
@@ -298,8 +347,17 @@ qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 
 //
 // load the file
+// (the brush loader leaves the data alone, so it can read the pak mapping)
 //
-	buf = COM_LoadStackFile (mod->name, stackbuf, sizeof(stackbuf), & mod->path_id);
+	free (mod_loaded);	// left over if the last load errored out
+	mod_loaded = Loader_TakeFile (mod->name, &com_filesize, &mod->path_id);
+	if (mod_loaded)
+	{
+		buf = mod_loaded;
+		file_mapped = false;
+	}
+	else
+		buf = (byte *) COM_LoadMappedFile (mod->name, stackbuf, sizeof(stackbuf), & mod->path_id);
 	if (!buf)
 	{
 		if (crash)
@@ -322,6 +380,14 @@ qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 	mod->needload = false;
 
 	mod_type = (buf[0] | (buf[1] << 8) | (buf[2] << 16) | (buf[3] << 24));
+	if (file_mapped && (mod_type == IDPOLYHEADER || mod_type == IDSPRITEHEADER))
+	{	// these swap and flood fill the file data in place
+		if (com_filesize < (int) sizeof(stackbuf))
+			buf = (byte *) memcpy (stackbuf, buf, com_filesize);
+		else
+			buf = (byte *) memcpy (Hunk_TempAlloc (com_filesize), buf, com_filesize);
+	}
+
 	switch (mod_type)
 	{
 	case IDPOLYHEADER:
@@ -337,6 +403,9 @@ qmodel_t *Mod_LoadModel (qmodel_t *mod, qboolean crash)
 		break;
 	}
 
+	free (mod_loaded);
+	mod_loaded = NULL;
+
 	return mod;
 }
 
@@ -381,6 +450,41 @@ qboolean Mod_CheckFullbrights (byte *pixels, int count)
 	return false;
 }
 
+/*
+=================
+Mod_QueueTextureImages
+
+queues the external images Mod_LoadTextures is going to look for
+=================
+*/
+static void Mod_QueueTextureImages (const char *mapname, const char *mtname)
+{
+	char	name[16+1], filename[MAX_OSPATH], filename2[MAX_OSPATH];
+
+	q_strlcpy (name, mtname, sizeof(name));
+	if (!q_strncasecmp (name, "sky", 3))
+		return;
+	if (name[0] == '*')
+		name[0] = '#';
+
+	q_snprintf (filename, sizeof(filename), "textures/%s/%s", mapname, name);
+	if (!Loader_QueueImage (filename))
+	{
+		q_snprintf (filename, sizeof(filename), "textures/%s", name);
+		if (!Loader_QueueImage (filename))
+			return;
+	}
+
+	if (name[0] == '#')
+		return;	// no fullbrights for warping textures
+	q_snprintf (filename2, sizeof(filename2), "%s_glow", filename);
+	if (!Loader_QueueImage (filename2))
+	{
+		q_snprintf (filename2, sizeof(filename2), "%s_luma", filename);
+		Loader_QueueImage (filename2);
+	}
+}
+
 /*
 =================
 Mod_LoadTextures
@@ -394,6 +498,7 @@ void Mod_LoadTextures (lump_t *l)
 	texture_t	*anims[10];
 	texture_t	*altanims[10];
 	dmiptexlump_t	*m;
+	int		dataofs, width, height;
 //johnfitz -- more variables
 	char		texturename[64];
 	int			nummiptex;
@@ -414,36 +519,48 @@ void Mod_LoadTextures (lump_t *l)
 	else
 	{
 		m = (dmiptexlump_t *)(mod_base + l->fileofs);
-		m->nummiptex = LittleLong (m->nummiptex);
-		nummiptex = m->nummiptex;
+		nummiptex = LittleLong (m->nummiptex);
 	}
 	//johnfitz
 
+	//get the loader threads started on the external textures
+	if (!isDedicated)
+	{
+		COM_StripExtension (loadmodel->name + 5, mapname, sizeof(mapname));
+		for (i=0 ; i<nummiptex ; i++)
+		{
+			dataofs = LittleLong (m->dataofs[i]);
+			if (dataofs == -1)
+				continue;
+			mt = (miptex_t *)((byte *)m + dataofs);
+			Mod_QueueTextureImages (mapname, mt->name);
+		}
+	}
+
 	loadmodel->numtextures = nummiptex + 2; //johnfitz -- need 2 dummy texture chains for missing textures
 	loadmodel->textures = (texture_t **) Hunk_AllocName (loadmodel->numtextures * sizeof(*loadmodel->textures) , loadname);
 
 	for (i=0 ; i<nummiptex ; i++)
 	{
-		m->dataofs[i] = LittleLong(m->dataofs[i]);
-		if (m->dataofs[i] == -1)
+		// the file data may be read-only, so swap into locals
+		dataofs = LittleLong (m->dataofs[i]);
+		if (dataofs == -1)
 			continue;
-		mt = (miptex_t *)((byte *)m + m->dataofs[i]);
-		mt->width = LittleLong (mt->width);
-		mt->height = LittleLong (mt->height);
-		for (j=0 ; j<MIPLEVELS ; j++)
-			mt->offsets[j] = LittleLong (mt->offsets[j]);
+		mt = (miptex_t *)((byte *)m + dataofs);
+		width = LittleLong (mt->width);
+		height = LittleLong (mt->height);
 
-		if ( (mt->width & 15) || (mt->height & 15) )
+		if ( (width & 15) || (height & 15) )
 			Sys_Error ("Texture %s is not 16 aligned", mt->name);
-		pixels = mt->width*mt->height/64*85;
+		pixels = width*height/64*85;
 		tx = (texture_t *) Hunk_AllocName (sizeof(texture_t) +pixels, loadname );
 		loadmodel->textures[i] = tx;
 
 		memcpy (tx->name, mt->name, sizeof(tx->name));
-		tx->width = mt->width;
-		tx->height = mt->height;
+		tx->width = width;
+		tx->height = height;
 		for (j=0 ; j<MIPLEVELS ; j++)
-			tx->offsets[j] = mt->offsets[j] + sizeof(texture_t) - sizeof(miptex_t);
+			tx->offsets[j] = LittleLong (mt->offsets[j]) + sizeof(texture_t) - sizeof(miptex_t);
 		// the pixels immediately follow the structures
 
 		// ericw -- check for pixels extending past the end of the lump.
@@ -534,8 +651,10 @@ void Mod_LoadTextures (lump_t *l)
 					q_snprintf (filename2, sizeof(filename2), "%s_glow", filename);
 					data = Image_LoadImage (filename2, &fwidth, &fheight);
 					if (!data)
+					{
 						q_snprintf (filename2, sizeof(filename2), "%s_luma", filename);
 						data = Image_LoadImage (filename2, &fwidth, &fheight);
+					}
 
 					if (data)
 						tx->fullbright = TexMgr_LoadImage (loadmodel, filename2, fwidth, fheight,
@@ -1969,14 +2088,13 @@ void Mod_LoadBrushModel (qmodel_t *mod, void *buffer)
 	int			i, j;
 	int			bsp2;
 	dheader_t	*header;
+	dheader_t	swapped;
 	dmodel_t 	*bm;
 	float		radius; //johnfitz
 
 	loadmodel->type = mod_brush;
 
-	header = (dheader_t *)buffer;
-
-	mod->bspversion = LittleLong (header->version);
+	mod->bspversion = LittleLong (((dheader_t *)buffer)->version);
 
 	switch(mod->bspversion)
 	{
@@ -1995,10 +2113,12 @@ void Mod_LoadBrushModel (qmodel_t *mod, void *buffer)
 	}
 
 // swap all the lumps
-	mod_base = (byte *)header;
+// (into a copy of the header, the buffer may be a read-only file mapping)
+	mod_base = (byte *)buffer;
 
 	for (i = 0; i < (int) sizeof(dheader_t) / 4; i++)
-		((int *)header)[i] = LittleLong ( ((int *)header)[i]);
+		((int *)&swapped)[i] = LittleLong ( ((int *)buffer)[i]);
+	header = &swapped;
 
 // load into heap
 
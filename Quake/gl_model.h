@@ -163,6 +163,8 @@ typedef struct msurface_s
 	mtexinfo_t	*texinfo;
 
 	int		vbo_firstvert;		// index of this surface's first vert in the VBO
+	int		vbo_firstindex;		// first of this surface's triangle indices in the IBO
+	int		vbo_numindices;
 
 // lighting info
 	int			dlightframe;
@@ -508,9 +510,11 @@ void	Mod_ResetAll (void); // for gamedir changes (Host_Game_f)
 qmodel_t *Mod_ForName (const char *name, qboolean crash);
 void	*Mod_Extradata (qmodel_t *mod);	// handles caching
 void	Mod_TouchModel (const char *name);
+void	Mod_QueueLoad (const char *name);	// read it in the background
 
 mleaf_t *Mod_PointInLeaf (float *p, qmodel_t *model);
 byte	*Mod_LeafPVS (mleaf_t *leaf, qmodel_t *model);
+byte	*Mod_LeafPVSTo (mleaf_t *leaf, qmodel_t *model, byte *out);
 
 void Mod_SetExtraFlags (qmodel_t *mod);
 
@@ -36,6 +36,7 @@ mplane_t	frustum[4];
 //johnfitz -- rendering statistics
 int rs_brushpolys, rs_aliaspolys, rs_skypolys, rs_particles, rs_fogpolys;
 int rs_dynamiclightmaps, rs_brushpasses, rs_aliaspasses, rs_skypasses;
+int rs_lightmaprects, rs_lightmapbytes;
 float rs_megatexels;
 
 //
@@ -104,6 +105,8 @@ cvar_t	r_lavaalpha = {"r_lavaalpha","0",CVAR_NONE};
 cvar_t	r_telealpha = {"r_telealpha","0",CVAR_NONE};
 cvar_t	r_slimealpha = {"r_slimealpha","0",CVAR_NONE};
 
+cvar_t	r_parallelrecord = {"r_parallelrecord", "1", CVAR_ARCHIVE};
+
 float	map_wateralpha, map_lavaalpha, map_telealpha, map_slimealpha;
 
 qboolean r_drawflat_cheatsafe, r_fullbright_cheatsafe, r_lightmap_cheatsafe, r_drawworld_cheatsafe; //johnfitz
@@ -484,7 +487,7 @@ R_SetupScene
 */
 void R_SetupScene (void)
 {
-	vkCmdBeginRenderPass(vulkan_globals.command_buffer, &vulkan_globals.main_render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+	GL_BeginMainRenderPass ();
 
 	R_PushDlights ();
 	R_AnimateLight ();
@@ -922,6 +925,7 @@ void R_RenderView (void)
 		//johnfitz -- rendering statistics
 		rs_brushpolys = rs_aliaspolys = rs_skypolys = rs_particles = rs_fogpolys = rs_megatexels =
 		rs_dynamiclightmaps = rs_aliaspasses = rs_skypasses = rs_brushpasses = 0;
+		rs_lightmaprects = rs_lightmapbytes = 0;
 	}
 	//else if (gl_finish.value)
 	//	glFinish ();
@@ -943,13 +947,15 @@ void R_RenderView (void)
 			(int)cl.viewangles[YAW],
 			(int)cl.viewangles[ROLL]);
 	else if (r_speeds.value == 2)
-		Con_Printf ("%3i ms  %4i/%4i wpoly %4i/%4i epoly %3i lmap %4i/%4i sky %1.1f mtex\n",
+		Con_Printf ("%3i ms  %4i/%4i wpoly %4i/%4i epoly %3i/%3i lmap %4i kb %4i/%4i sky %1.1f mtex\n",
 					(int)((time2-time1)*1000),
 					rs_brushpolys,
 					rs_brushpasses,
 					rs_aliaspolys,
 					rs_aliaspasses,
 					rs_dynamiclightmaps,
+					rs_lightmaprects,
+					rs_lightmapbytes / 1024,
 					rs_skypolys,
 					rs_skypasses,
 					TexMgr_FrameUsage ());
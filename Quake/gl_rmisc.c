@@ -81,22 +81,27 @@ Dynamic vertex/index & uniform buffer
 #define DYNAMIC_VERTEX_BUFFER_SIZE_KB	1024
 #define DYNAMIC_INDEX_BUFFER_SIZE_KB	512
 #define DYNAMIC_UNIFORM_BUFFER_SIZE_KB	128
+#define DYNAMIC_INDIRECT_BUFFER_SIZE_KB	512	// starting size, grows with the map
 #define NUM_DYNAMIC_BUFFERS				2
 #define MAX_UNIFORM_ALLOC				2048
 
+// allocations can come from the record threads, so offsets are bumped atomically
 typedef struct
 {
 	VkBuffer			buffer;
-	uint32_t			current_offset;
+	SDL_atomic_t		current_offset;
 	unsigned char *		data;
 } dynbuffer_t;
 
 static VkDeviceMemory	dyn_vertex_buffer_memory;
 static VkDeviceMemory	dyn_index_buffer_memory;
 static VkDeviceMemory	dyn_uniform_buffer_memory;
+static VkDeviceMemory	dyn_indirect_buffer_memory;
 static dynbuffer_t		dyn_vertex_buffers[NUM_DYNAMIC_BUFFERS];
 static dynbuffer_t		dyn_index_buffers[NUM_DYNAMIC_BUFFERS];
 static dynbuffer_t		dyn_uniform_buffers[NUM_DYNAMIC_BUFFERS];
+static dynbuffer_t		dyn_indirect_buffers[NUM_DYNAMIC_BUFFERS];
+static uint32_t			dyn_indirect_buffer_size;
 static int				current_dyn_buffer_index = 0;
 static VkDescriptorSet	ubo_descriptor_sets[2];
 
@@ -432,7 +437,7 @@ static void R_InitDynamicVertexBuffers()
 
 	for(int i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
 	{
-		dyn_vertex_buffers[i].current_offset = 0;
+		SDL_AtomicSet(&dyn_vertex_buffers[i].current_offset, 0);
 
 		err = vkCreateBuffer(vulkan_globals.device, &buffer_create_info, NULL, &dyn_vertex_buffers[i].buffer);
 		if (err != VK_SUCCESS)
@@ -492,7 +497,7 @@ static void R_InitDynamicIndexBuffers()
 
 	for(int i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
 	{
-		dyn_index_buffers[i].current_offset = 0;
+		SDL_AtomicSet(&dyn_index_buffers[i].current_offset, 0);
 
 		err = vkCreateBuffer(vulkan_globals.device, &buffer_create_info, NULL, &dyn_index_buffers[i].buffer);
 		if (err != VK_SUCCESS)
@@ -552,7 +557,7 @@ static void R_InitDynamicUniformBuffers()
 
 	for(int i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
 	{
-		dyn_uniform_buffers[i].current_offset = 0;
+		SDL_AtomicSet(&dyn_uniform_buffers[i].current_offset, 0);
 
 		err = vkCreateBuffer(vulkan_globals.device, &buffer_create_info, NULL, &dyn_uniform_buffers[i].buffer);
 		if (err != VK_SUCCESS)
@@ -624,6 +629,106 @@ static void R_InitDynamicUniformBuffers()
 	}
 }
 
+/*
+===============
+R_InitDynamicIndirectBuffers
+===============
+*/
+static void R_InitDynamicIndirectBuffers(uint32_t size)
+{
+	Con_DPrintf("Initializing dynamic indirect buffers (%u KB)\n", size / 1024);
+
+	VkResult err;
+
+	dyn_indirect_buffer_size = size;
+
+	VkBufferCreateInfo buffer_create_info;
+	memset(&buffer_create_info, 0, sizeof(buffer_create_info));
+	buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_create_info.size = size;
+	buffer_create_info.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+
+	for(int i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+	{
+		SDL_AtomicSet(&dyn_indirect_buffers[i].current_offset, 0);
+
+		err = vkCreateBuffer(vulkan_globals.device, &buffer_create_info, NULL, &dyn_indirect_buffers[i].buffer);
+		if (err != VK_SUCCESS)
+			Sys_Error("vkCreateBuffer failed");
+	}
+
+	VkMemoryRequirements memory_requirements;
+	vkGetBufferMemoryRequirements(vulkan_globals.device, dyn_indirect_buffers[0].buffer, &memory_requirements);
+
+	const int align_mod = memory_requirements.size % memory_requirements.alignment;
+	const int aligned_size = ((memory_requirements.size % memory_requirements.alignment) == 0) 
+		? memory_requirements.size 
+		: (memory_requirements.size + memory_requirements.alignment - align_mod);
+
+	VkMemoryAllocateInfo memory_allocate_info;
+	memset(&memory_allocate_info, 0, sizeof(memory_allocate_info));
+	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memory_allocate_info.allocationSize = NUM_DYNAMIC_BUFFERS * aligned_size;
+	memory_allocate_info.memoryTypeIndex = GL_MemoryTypeFromProperties(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+
+	err = vkAllocateMemory(vulkan_globals.device, &memory_allocate_info, NULL, &dyn_indirect_buffer_memory);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkAllocateMemory failed");
+
+	for(int i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+	{
+		err = vkBindBufferMemory(vulkan_globals.device, dyn_indirect_buffers[i].buffer, dyn_indirect_buffer_memory, i * aligned_size);
+		if (err != VK_SUCCESS)
+			Sys_Error("vkBindBufferMemory failed");
+	}
+
+	unsigned char * data;
+	err = vkMapMemory(vulkan_globals.device, dyn_indirect_buffer_memory, 0, NUM_DYNAMIC_BUFFERS * aligned_size, 0, &data);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkMapMemory failed");
+
+	for(int i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+		dyn_indirect_buffers[i].data = data + (i * aligned_size);
+}
+
+/*
+===============
+R_ResizeDynamicIndirectBuffers
+
+Recreates the indirect buffers with room for at least size bytes
+===============
+*/
+static void R_ResizeDynamicIndirectBuffers(uint32_t size)
+{
+	uint32_t new_size = dyn_indirect_buffer_size;
+
+	while (new_size < size)
+		new_size *= 2;
+	if (new_size == dyn_indirect_buffer_size)
+		return;
+
+	GL_WaitForDeviceIdle();
+
+	for(int i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+		vkDestroyBuffer(vulkan_globals.device, dyn_indirect_buffers[i].buffer, NULL);
+	vkFreeMemory(vulkan_globals.device, dyn_indirect_buffer_memory, NULL);
+
+	R_InitDynamicIndirectBuffers(new_size);
+}
+
+/*
+===============
+R_ReserveIndirectCommands
+
+Called at map load with the number of brush surfaces, so the world and
+brush models fit without having to grow the buffers during play
+===============
+*/
+void R_ReserveIndirectCommands(int count)
+{
+	R_ResizeDynamicIndirectBuffers(count * sizeof(VkDrawIndexedIndirectCommand));
+}
+
 /*
 ===============
 R_SwapDynamicBuffers
@@ -631,10 +736,17 @@ R_SwapDynamicBuffers
 */
 void R_SwapDynamicBuffers()
 {
+	// a frame that ran out of indirect space drew directly; make room
+	// for what it asked for
+	const uint32_t indirect_used = SDL_AtomicGet(&dyn_indirect_buffers[current_dyn_buffer_index].current_offset);
+	if (indirect_used > dyn_indirect_buffer_size)
+		R_ResizeDynamicIndirectBuffers(indirect_used);
+
 	current_dyn_buffer_index = (current_dyn_buffer_index + 1) % NUM_DYNAMIC_BUFFERS;
-	dyn_vertex_buffers[current_dyn_buffer_index].current_offset = 0;
-	dyn_index_buffers[current_dyn_buffer_index].current_offset = 0;
-	dyn_uniform_buffers[current_dyn_buffer_index].current_offset = 0;
+	SDL_AtomicSet(&dyn_vertex_buffers[current_dyn_buffer_index].current_offset, 0);
+	SDL_AtomicSet(&dyn_index_buffers[current_dyn_buffer_index].current_offset, 0);
+	SDL_AtomicSet(&dyn_uniform_buffers[current_dyn_buffer_index].current_offset, 0);
+	SDL_AtomicSet(&dyn_indirect_buffers[current_dyn_buffer_index].current_offset, 0);
 }
 
 /*
@@ -645,17 +757,15 @@ R_VertexAllocate
 byte * R_VertexAllocate(int size, VkBuffer * buffer, VkDeviceSize * buffer_offset)
 {
 	dynbuffer_t *dyn_vb = &dyn_vertex_buffers[current_dyn_buffer_index];
+	const uint32_t offset = SDL_AtomicAdd(&dyn_vb->current_offset, size);
 
-	if ((dyn_vb->current_offset + size) > (DYNAMIC_VERTEX_BUFFER_SIZE_KB * 1024))
+	if ((offset + size) > (DYNAMIC_VERTEX_BUFFER_SIZE_KB * 1024))
 		Sys_Error("Out of dynamic vertex buffer space, increase DYNAMIC_VERTEX_BUFFER_SIZE_KB");
 
 	*buffer = dyn_vb->buffer;
-	*buffer_offset = dyn_vb->current_offset;
+	*buffer_offset = offset;
 
-	unsigned char *data = dyn_vb->data + dyn_vb->current_offset;
-	dyn_vb->current_offset += size;
-
-	return data;
+	return dyn_vb->data + offset;
 }
 
 /*
@@ -666,17 +776,39 @@ R_IndexAllocate
 byte * R_IndexAllocate(int size, VkBuffer * buffer, VkDeviceSize * buffer_offset)
 {
 	dynbuffer_t *dyn_ib = &dyn_index_buffers[current_dyn_buffer_index];
+	const uint32_t offset = SDL_AtomicAdd(&dyn_ib->current_offset, size);
 
-	if ((dyn_ib->current_offset + size) > (DYNAMIC_INDEX_BUFFER_SIZE_KB * 1024))
+	if ((offset + size) > (DYNAMIC_INDEX_BUFFER_SIZE_KB * 1024))
 		Sys_Error("Out of dynamic index buffer space, increase DYNAMIC_INDEX_BUFFER_SIZE_KB");
 
 	*buffer = dyn_ib->buffer;
-	*buffer_offset = dyn_ib->current_offset;
+	*buffer_offset = offset;
 
-	unsigned char *data = dyn_ib->data + dyn_ib->current_offset;
-	dyn_ib->current_offset += size;
+	return dyn_ib->data + offset;
+}
 
-	return data;
+/*
+===============
+R_IndirectAllocate
+
+Room for count VkDrawIndexedIndirectCommands, or NULL if this frame's
+buffer is full. The caller then draws directly and the buffers grow
+at the next R_SwapDynamicBuffers
+===============
+*/
+VkDrawIndexedIndirectCommand * R_IndirectAllocate(int count, VkBuffer * buffer, VkDeviceSize * buffer_offset)
+{
+	const int size = count * sizeof(VkDrawIndexedIndirectCommand);
+	dynbuffer_t *dyn_db = &dyn_indirect_buffers[current_dyn_buffer_index];
+	const uint32_t offset = SDL_AtomicAdd(&dyn_db->current_offset, size);
+
+	if ((offset + size) > dyn_indirect_buffer_size)
+		return NULL;
+
+	*buffer = dyn_db->buffer;
+	*buffer_offset = offset;
+
+	return (VkDrawIndexedIndirectCommand *)(dyn_db->data + offset);
 }
 
 /*
@@ -696,15 +828,15 @@ byte * R_UniformAllocate(int size, VkBuffer * buffer, uint32_t * buffer_offset,
 	const int aligned_size = ((size % 256) == 0) ? size : (size + 256 - align_mod);
 
 	dynbuffer_t *dyn_ub = &dyn_uniform_buffers[current_dyn_buffer_index];
+	const uint32_t offset = SDL_AtomicAdd(&dyn_ub->current_offset, aligned_size);
 
-	if ((dyn_ub->current_offset + MAX_UNIFORM_ALLOC) > (DYNAMIC_UNIFORM_BUFFER_SIZE_KB * 1024))
+	if ((offset + MAX_UNIFORM_ALLOC) > (DYNAMIC_UNIFORM_BUFFER_SIZE_KB * 1024))
 		Sys_Error("Out of dynamic uniform buffer space, increase DYNAMIC_UNIFORM_BUFFER_SIZE_KB");
 
 	*buffer = dyn_ub->buffer;
-	*buffer_offset = dyn_ub->current_offset;
+	*buffer_offset = offset;
 
-	unsigned char *data = dyn_ub->data + dyn_ub->current_offset;
-	dyn_ub->current_offset += aligned_size;
+	unsigned char *data = dyn_ub->data + offset;
 
 	*descriptor_set = ubo_descriptor_sets[current_dyn_buffer_index];
 
@@ -721,6 +853,7 @@ void R_InitDynamicBuffers()
 	R_InitDynamicVertexBuffers();
 	R_InitDynamicIndexBuffers();
 	R_InitDynamicUniformBuffers();
+	R_InitDynamicIndirectBuffers(DYNAMIC_INDIRECT_BUFFER_SIZE_KB * 1024);
 }
 
 /*
@@ -782,6 +915,24 @@ void R_CreateDescriptorSetLayouts()
 	err = vkCreateDescriptorSetLayout(vulkan_globals.device, &descriptor_set_layout_create_info, NULL, &vulkan_globals.ubo_set_layout);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateDescriptorSetLayout failed");
+
+	// surfaces, surface leafs, vis, draw commands
+	VkDescriptorSetLayoutBinding cull_layout_bindings[4];
+	memset(cull_layout_bindings, 0, sizeof(cull_layout_bindings));
+	for (int i = 0; i < 4; ++i)
+	{
+		cull_layout_bindings[i].binding = i;
+		cull_layout_bindings[i].descriptorCount = 1;
+		cull_layout_bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		cull_layout_bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	descriptor_set_layout_create_info.bindingCount = 4;
+	descriptor_set_layout_create_info.pBindings = cull_layout_bindings;
+
+	err = vkCreateDescriptorSetLayout(vulkan_globals.device, &descriptor_set_layout_create_info, NULL, &vulkan_globals.cull_set_layout);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkCreateDescriptorSetLayout failed");
 }
 
 /*
@@ -791,19 +942,21 @@ R_CreateDescriptorPool
 */
 void R_CreateDescriptorPool()
 {
-	VkDescriptorPoolSize pool_sizes[3];
+	VkDescriptorPoolSize pool_sizes[4];
 	pool_sizes[0].type = VK_DESCRIPTOR_TYPE_SAMPLER;
 	pool_sizes[0].descriptorCount = 16;
 	pool_sizes[1].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
 	pool_sizes[1].descriptorCount = MAX_GLTEXTURES;
 	pool_sizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	pool_sizes[2].descriptorCount = 16;
+	pool_sizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_sizes[3].descriptorCount = 8;
 
 	VkDescriptorPoolCreateInfo descriptor_pool_create_info;
 	memset(&descriptor_pool_create_info, 0, sizeof(descriptor_pool_create_info));
 	descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	descriptor_pool_create_info.maxSets = MAX_GLTEXTURES + 32;
-	descriptor_pool_create_info.poolSizeCount = 3;
+	descriptor_pool_create_info.poolSizeCount = 4;
 	descriptor_pool_create_info.pPoolSizes = pool_sizes;
 
 	vkCreateDescriptorPool(vulkan_globals.device, &descriptor_pool_create_info, NULL, &vulkan_globals.descriptor_pool);
@@ -894,6 +1047,17 @@ void R_CreatePipelineLayouts()
 	err = vkCreatePipelineLayout(vulkan_globals.device, &pipeline_layout_create_info, NULL, &vulkan_globals.sky_layer_pipeline_layout);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreatePipelineLayout failed");
+
+	// Cull
+	push_constant_range.size = 20 * sizeof(float);
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	pipeline_layout_create_info.setLayoutCount = 1;
+	pipeline_layout_create_info.pSetLayouts = &vulkan_globals.cull_set_layout;
+
+	err = vkCreatePipelineLayout(vulkan_globals.device, &pipeline_layout_create_info, NULL, &vulkan_globals.cull_pipeline_layout);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkCreatePipelineLayout failed");
 }
 
 /*
@@ -1370,6 +1534,30 @@ void R_CreatePipelines()
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 
+	if (vulkan_globals.compute_culling_able)
+	{
+		VkShaderModule cull_comp_module = R_CreateShaderModule(cull_comp_spv, cull_comp_spv_size);
+
+		VkComputePipelineCreateInfo compute_pipeline_create_info;
+		memset(&compute_pipeline_create_info, 0, sizeof(compute_pipeline_create_info));
+		compute_pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		compute_pipeline_create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		compute_pipeline_create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		compute_pipeline_create_info.stage.module = cull_comp_module;
+		compute_pipeline_create_info.stage.pName = "main";
+		compute_pipeline_create_info.layout = vulkan_globals.cull_pipeline_layout;
+
+		// the world can still be culled on the CPU, so this isn't fatal
+		err = vkCreateComputePipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, NULL, &vulkan_globals.cull_pipeline);
+		if (err != VK_SUCCESS)
+		{
+			Con_Printf("vkCreateComputePipelines failed, GPU culling disabled\n");
+			vulkan_globals.compute_culling_able = false;
+		}
+
+		vkDestroyShaderModule(vulkan_globals.device, cull_comp_module, NULL);
+	}
+
 	vkDestroyShaderModule(vulkan_globals.device, sky_layer_frag_module, NULL);
 	vkDestroyShaderModule(vulkan_globals.device, sky_layer_vert_module, NULL);
 	vkDestroyShaderModule(vulkan_globals.device, alias_frag_module, NULL);
@@ -1446,6 +1634,9 @@ void R_Init (void)
 	Cvar_RegisterVariable (&r_lavaalpha);
 	Cvar_RegisterVariable (&r_telealpha);
 	Cvar_RegisterVariable (&r_slimealpha);
+	Cvar_RegisterVariable (&r_parallelrecord);
+	Cvar_RegisterVariable (&r_gpuculling);
+	R_InitLightKernels ();
 	Cvar_SetCallback (&r_lavaalpha, R_SetLavaalpha_f);
 	Cvar_SetCallback (&r_telealpha, R_SetTelealpha_f);
 	Cvar_SetCallback (&r_slimealpha, R_SetSlimealpha_f);
@@ -1608,6 +1799,7 @@ void R_NewMap (void)
 
 	GL_BuildLightmaps ();
 	GL_BuildBModelVertexBuffer ();
+	R_BuildCullBuffers ();
 	//ericw -- no longer load alias models into a VBO here, it's done in Mod_LoadAliasModel
 
 	r_framecount = 0; //johnfitz -- paranoid?
@@ -35,7 +35,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define MAXWIDTH		10000
 #define MAXHEIGHT		10000
 
-#define NUM_COMMAND_BUFFERS 2
+#define MAX_SECONDARY_COMMAND_BUFFERS 32
 #define NUM_SWAP_CHAIN_IMAGES 2
 #define DEPTH_FORMAT VK_FORMAT_D16_UNORM
 
@@ -98,6 +98,9 @@ static VkCommandPool				command_pool;
 static VkCommandBuffer				command_buffers[NUM_COMMAND_BUFFERS];
 static VkFence						command_buffer_fences[NUM_COMMAND_BUFFERS];
 static qboolean						command_buffer_submitted[NUM_COMMAND_BUFFERS];
+static VkCommandPool				secondary_command_pools[NUM_COMMAND_BUFFERS][MAX_SECONDARY_COMMAND_BUFFERS];
+static VkCommandBuffer				secondary_command_buffers[NUM_COMMAND_BUFFERS][MAX_SECONDARY_COMMAND_BUFFERS];
+static int							num_secondary_command_buffers[NUM_COMMAND_BUFFERS];
 static VkFramebuffer				framebuffers[NUM_SWAP_CHAIN_IMAGES];
 static VkImageView					swapchain_images_views[NUM_SWAP_CHAIN_IMAGES];
 static VkSemaphore					image_aquired_semaphores[NUM_SWAP_CHAIN_IMAGES];
@@ -476,6 +479,7 @@ static void VID_Restart (void)
 	TexMgr_DeleteTextureObjects ();
 	GLSLGamma_DeleteTexture ();
 	GL_DeleteBModelVertexBuffer ();
+	R_DeleteCullBuffers ();
 	GLMesh_DeleteVertexBuffers ();
 
 	//
@@ -486,6 +490,7 @@ static void VID_Restart (void)
 	GL_CreateRenderTargets();
 	TexMgr_ReloadImages ();
 	GL_BuildBModelVertexBuffer ();
+	R_BuildCullBuffers ();
 	GLMesh_LoadVertexBuffers ();
 	Fog_SetupState ();
 
@@ -743,6 +748,7 @@ static void GL_InitDevice( void )
 	Con_Printf("Device: %s\n", vulkan_globals.device_properties.deviceName);
 
 	qboolean found_graphics_queue = false;
+	qboolean graphics_queue_compute = false;
 
 	uint32_t vulkan_queue_count;
 	vkGetPhysicalDeviceQueueFamilyProperties(vulkan_physical_device, &vulkan_queue_count, NULL);
@@ -758,6 +764,7 @@ static void GL_InitDevice( void )
 		if ((queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0)
 		{
 			found_graphics_queue = true;
+			graphics_queue_compute = (queue_family_properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
 			vulkan_globals.gfx_queue_family_index = i;
 			break;
 		}
@@ -778,6 +785,19 @@ static void GL_InitDevice( void )
 
 	char * device_extensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
+	// the world is drawn with one indirect draw per texture & lightmap if possible
+	VkPhysicalDeviceFeatures device_features;
+	VkPhysicalDeviceFeatures enabled_features;
+	vkGetPhysicalDeviceFeatures(vulkan_physical_device, &device_features);
+	memset(&enabled_features, 0, sizeof(enabled_features));
+	enabled_features.multiDrawIndirect = device_features.multiDrawIndirect;
+	vulkan_globals.multi_draw_indirect = device_features.multiDrawIndirect && (vulkan_globals.device_properties.limits.maxDrawIndirectCount > 1);
+	Con_Printf("Multi draw indirect: %s\n", vulkan_globals.multi_draw_indirect ? "yes" : "no");
+
+	// r_gpuculling writes the draws of the world in a compute shader
+	vulkan_globals.compute_culling_able = graphics_queue_compute && vulkan_globals.multi_draw_indirect;
+	Con_Printf("Compute culling: %s\n", vulkan_globals.compute_culling_able ? "yes" : "no");
+
 	VkDeviceCreateInfo device_create_info;
 	memset(&device_create_info, 0, sizeof(device_create_info));
 	device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -785,6 +805,7 @@ static void GL_InitDevice( void )
 	device_create_info.pQueueCreateInfos = &queue_create_info;
 	device_create_info.enabledExtensionCount = 1;
 	device_create_info.ppEnabledExtensionNames = device_extensions;
+	device_create_info.pEnabledFeatures = &enabled_features;
 
 	err = vkCreateDevice(vulkan_physical_device, &device_create_info, NULL, &vulkan_globals.device);
 	if (err != VK_SUCCESS)
@@ -799,6 +820,175 @@ static void GL_InitDevice( void )
 	vkGetDeviceQueue(vulkan_globals.device, vulkan_globals.gfx_queue_family_index, 0, &vulkan_globals.queue);
 }
 
+/*
+===================================================================
+
+PARALLEL COMMAND RECORDING
+
+When r_parallelrecord is on, the main render pass is recorded into
+secondary command buffers instead of the primary one. The main thread
+records into one, and every GL_RecordParallel task gets its own which a
+job worker fills in. GL_EndRendering executes them in the order they
+were started, so the frame comes out the same as if recorded inline.
+
+===================================================================
+*/
+
+typedef struct
+{
+	recordfunc_t	func;
+	void			*data;
+	int				index;
+	VkCommandBuffer	command_buffer;
+} recordtask_t;
+
+static recordtask_t	record_tasks[MAX_SECONDARY_COMMAND_BUFFERS];
+static job_t		*record_jobs[MAX_SECONDARY_COMMAND_BUFFERS];
+static int			num_record_tasks;
+static qboolean		parallel_frame;
+
+/*
+===============
+GL_RecordJob
+===============
+*/
+static void GL_RecordJob (void *data)
+{
+	recordtask_t *task = (recordtask_t *) data;
+
+	task->func (task->command_buffer, task->data, task->index);
+	if (vkEndCommandBuffer (task->command_buffer) != VK_SUCCESS)
+		Sys_Error ("vkEndCommandBuffer failed");
+}
+
+/*
+===============
+GL_BeginSecondary
+
+Starts the next secondary command buffer of the frame with the state
+the main render pass starts with
+===============
+*/
+static VkCommandBuffer GL_BeginSecondary (void)
+{
+	VkResult err;
+	VkCommandBuffer command_buffer;
+	int *num_secondary = &num_secondary_command_buffers[current_command_buffer];
+
+	if (*num_secondary == MAX_SECONDARY_COMMAND_BUFFERS)
+		Sys_Error ("GL_BeginSecondary: out of secondary command buffers");
+	command_buffer = secondary_command_buffers[current_command_buffer][(*num_secondary)++];
+
+	VkCommandBufferInheritanceInfo inheritance_info;
+	memset(&inheritance_info, 0, sizeof(inheritance_info));
+	inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritance_info.renderPass = vulkan_globals.main_render_pass;
+	inheritance_info.subpass = 0;
+	inheritance_info.framebuffer = vulkan_globals.main_render_pass_begin_info.framebuffer;
+
+	VkCommandBufferBeginInfo command_buffer_begin_info;
+	memset(&command_buffer_begin_info, 0, sizeof(command_buffer_begin_info));
+	command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	command_buffer_begin_info.pInheritanceInfo = &inheritance_info;
+
+	err = vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkBeginCommandBuffer failed");
+
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.basic_pipeline_layout, 0, 1, &vulkan_globals.sampler_descriptor_set, 0, NULL);
+	vkCmdSetScissor(command_buffer, 0, 1, &vulkan_globals.main_render_pass_begin_info.renderArea);
+	vkCmdSetViewport(command_buffer, 0, 1, &vulkan_globals.viewport);
+	vkCmdPushConstants(command_buffer, vulkan_globals.basic_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, 16 * sizeof(float), vulkan_globals.view_projection_matrix);
+
+	return command_buffer;
+}
+
+/*
+===============
+GL_BeginMainRenderPass
+===============
+*/
+void GL_BeginMainRenderPass (void)
+{
+	parallel_frame = r_parallelrecord.value && Jobs_NumWorkers () > 0;
+
+	if (!parallel_frame)
+	{
+		vkCmdBeginRenderPass(vulkan_globals.command_buffer, &vulkan_globals.main_render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+		return;
+	}
+
+	vkCmdBeginRenderPass(vulkan_globals.command_buffer, &vulkan_globals.main_render_pass_begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	vulkan_globals.command_buffer = GL_BeginSecondary ();
+}
+
+/*
+===============
+GL_ParallelRecordThreads
+===============
+*/
+int GL_ParallelRecordThreads (void)
+{
+	return parallel_frame ? Jobs_NumWorkers () : 0;
+}
+
+/*
+===============
+GL_RecordParallel
+
+Only valid inside the 3D scene, the tasks start with the view matrix and
+viewport the scene was set up with
+===============
+*/
+void GL_RecordParallel (recordfunc_t func, void *data, int count)
+{
+	VkResult err;
+	int i;
+
+	// one more for the main thread to carry on in
+	if (!parallel_frame || num_secondary_command_buffers[current_command_buffer] + count + 1 > MAX_SECONDARY_COMMAND_BUFFERS)
+	{
+		for (i = 0; i < count; i++)
+			func (vulkan_globals.command_buffer, data, i);
+		return;
+	}
+
+	err = vkEndCommandBuffer(vulkan_globals.command_buffer);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkEndCommandBuffer failed");
+
+	for (i = 0; i < count; i++, num_record_tasks++)
+	{
+		recordtask_t *task = &record_tasks[num_record_tasks];
+		task->func = func;
+		task->data = data;
+		task->index = i;
+		task->command_buffer = GL_BeginSecondary ();
+		record_jobs[num_record_tasks] = Job_Create (GL_RecordJob, task, 0);
+		Job_Submit (record_jobs[num_record_tasks]);
+	}
+
+	vulkan_globals.command_buffer = GL_BeginSecondary ();
+}
+
+/*
+===============
+GL_WaitParallel
+===============
+*/
+void GL_WaitParallel (void)
+{
+	int i;
+
+	if (!parallel_frame)
+		return;
+
+	for (i = 0; i < num_record_tasks; i++)
+		Job_Wait (record_jobs[i]);
+	num_record_tasks = 0;
+}
+
 /*
 ===============
 GL_InitCommandBuffers
@@ -840,6 +1030,27 @@ static void GL_InitCommandBuffers( void )
 		if (err != VK_SUCCESS)
 			Sys_Error("vkCreateFence failed");
 	}
+
+	// secondary command buffers each get their own pool, so they can be recorded on any thread
+	command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+	command_buffer_allocate_info.commandBufferCount = 1;
+
+	for (int i = 0; i < NUM_COMMAND_BUFFERS; ++i)
+	{
+		for (int j = 0; j < MAX_SECONDARY_COMMAND_BUFFERS; ++j)
+		{
+			err = vkCreateCommandPool(vulkan_globals.device, &command_pool_create_info, NULL, &secondary_command_pools[i][j]);
+			if (err != VK_SUCCESS)
+				Sys_Error("vkCreateCommandPool failed");
+
+			command_buffer_allocate_info.commandPool = secondary_command_pools[i][j];
+			err = vkAllocateCommandBuffers(vulkan_globals.device, &command_buffer_allocate_info, &secondary_command_buffers[i][j]);
+			if (err != VK_SUCCESS)
+				Sys_Error("vkAllocateCommandBuffers failed");
+		}
+	}
+
 }
 
 /*
@@ -1123,6 +1334,7 @@ GL_BeginRendering
 void GL_BeginRendering (int *x, int *y, int *width, int *height)
 {
 	R_SwapDynamicBuffers();
+	R_BeginCullFrame(current_command_buffer);
 	R_SubmitStagingBuffers();
 
 	device_idle = false;
@@ -1143,6 +1355,14 @@ void GL_BeginRendering (int *x, int *y, int *width, int *height)
 	if (err != VK_SUCCESS)
 		Sys_Error("vkResetFences failed");
 
+	for (int i = 0; i < num_secondary_command_buffers[current_command_buffer]; ++i)
+	{
+		err = vkResetCommandPool(vulkan_globals.device, secondary_command_pools[current_command_buffer][i], 0);
+		if (err != VK_SUCCESS)
+			Sys_Error("vkResetCommandPool failed");
+	}
+	num_secondary_command_buffers[current_command_buffer] = 0;
+
 	VkCommandBufferBeginInfo command_buffer_begin_info;
 	memset(&command_buffer_begin_info, 0, sizeof(command_buffer_begin_info));
 	command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1189,6 +1409,7 @@ void GL_BeginRendering (int *x, int *y, int *width, int *height)
 	viewport.minDepth = 0.0f;
 	viewport.maxDepth = 1.0f;
 
+	vulkan_globals.viewport = viewport;
 	vkCmdSetViewport(vulkan_globals.command_buffer, 0, 1, &viewport);
 }
 
@@ -1201,6 +1422,20 @@ void GL_EndRendering (void)
 {
 	VkResult err;
 
+	if (parallel_frame)
+	{
+		GL_WaitParallel ();
+
+		err = vkEndCommandBuffer(vulkan_globals.command_buffer);
+		if (err != VK_SUCCESS)
+			Sys_Error("vkEndCommandBuffer failed");
+
+		vulkan_globals.command_buffer = command_buffers[current_command_buffer];
+		vkCmdExecuteCommands(vulkan_globals.command_buffer, num_secondary_command_buffers[current_command_buffer], secondary_command_buffers[current_command_buffer]);
+
+		parallel_frame = false;
+	}
+
 	vkCmdEndRenderPass(vulkan_globals.command_buffer);
 
 	err = vkEndCommandBuffer(vulkan_globals.command_buffer);
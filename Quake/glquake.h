@@ -105,10 +105,13 @@ typedef struct
 	VkDevice							device;
 	VkQueue								queue;
 	VkCommandBuffer						command_buffer;
+	VkViewport							viewport;	// last set by GL_Viewport
 	VkClearValue						color_clear_value;
 	VkFormat							swap_chain_format;
 	VkPhysicalDeviceProperties			device_properties;
 	VkPhysicalDeviceMemoryProperties	memory_properties;
+	qboolean							multi_draw_indirect;	// drawCount > 1 allowed
+	qboolean							compute_culling_able;	// compute queue and multi draw indirect
 	uint32_t							gfx_queue_family_index;
 
 	// Render passes
@@ -134,6 +137,8 @@ typedef struct
 	VkPipelineLayout					sky_layer_pipeline_layout;
 	VkPipeline							alias_pipeline;
 	VkPipelineLayout					alias_pipeline_layout;
+	VkPipeline							cull_pipeline;
+	VkPipelineLayout					cull_pipeline_layout;
 
 	// Descriptors
 	VkDescriptorPool					descriptor_pool;
@@ -142,6 +147,7 @@ typedef struct
 	VkDescriptorSetLayout				sampler_set_layout;
 	VkDescriptorSetLayout				ubo_set_layout;
 	VkDescriptorSetLayout				single_texture_set_layout;
+	VkDescriptorSetLayout				cull_set_layout;
 
 	// Samplers
 	VkSampler							point_sampler;
@@ -195,6 +201,7 @@ extern	cvar_t	r_telealpha;
 extern	cvar_t	r_slimealpha;
 extern	cvar_t	r_dynamic;
 extern	cvar_t	r_novis;
+extern	cvar_t	r_parallelrecord;
 
 extern	cvar_t	gl_clear;
 extern	cvar_t	gl_cull;
@@ -225,6 +232,7 @@ extern	qboolean	gl_anisotropy_able;
 //johnfitz -- rendering statistics
 extern int rs_brushpolys, rs_aliaspolys, rs_skypolys, rs_particles, rs_fogpolys;
 extern int rs_dynamiclightmaps, rs_brushpasses, rs_aliaspasses, rs_skypasses;
+extern int rs_lightmaprects, rs_lightmapbytes;	// dirty rectangles and bytes uploaded this frame
 extern float rs_megatexels;
 
 //johnfitz -- track developer statistics that vary every frame
@@ -309,6 +317,7 @@ void R_RenderDlights (void);
 void GL_BuildLightmaps (void);
 void GL_DeleteBModelVertexBuffer (void);
 void GL_BuildBModelVertexBuffer (void);
+void GL_CreateStaticBuffer (const void *data, unsigned int size, VkBufferUsageFlags usage, VkBuffer *buffer, VkDeviceMemory *memory);
 void GLMesh_LoadVertexBuffers (void);
 void GLMesh_DeleteVertexBuffers (void);
 void R_RebuildAllLightmaps (void);
@@ -317,6 +326,18 @@ int R_LightPoint (vec3_t p);
 
 void GL_SubdivideSurface (msurface_t *fa);
 void R_BuildLightMap (msurface_t *surf, byte *dest, int stride);
+
+// lightmap building inner loops, r_lightmap.c
+typedef struct
+{
+	const char	*name;
+	void (*addstyle) (unsigned *bl, const byte *lightmap, int size, unsigned scale);
+	void (*adddlight) (unsigned *bl, int smax, int tmax, const float *local, float rad, float minlight, const float *color);
+	void (*store) (const unsigned *bl, int smax, int tmax, byte *dest, int stride);
+} lightkernels_t;
+
+extern const lightkernels_t *lightkernels;
+void R_InitLightKernels (void);
 void R_RenderDynamicLightmaps (msurface_t *fa);
 void R_UploadLightmaps (void);
 
@@ -338,9 +359,20 @@ void Sky_LoadSkyBox (const char *name);
 
 void R_ClearTextureChains (qmodel_t *mod, texchain_t chain);
 void R_ChainSurface (msurface_t *surf, texchain_t chain);
+qboolean R_BackFaceCull (msurface_t *surf);
+void R_DrawIndirect (VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset, uint32_t count);
 void R_DrawTextureChains (qmodel_t *model, entity_t *ent, texchain_t chain);
 void R_DrawWorld_Water (void);
 
+// world surface culling in a compute shader, r_cull.c
+extern cvar_t r_gpuculling;
+void R_BuildCullBuffers (void);
+void R_DeleteCullBuffers (void);
+qboolean R_GPUCullingActive (void);
+void R_BeginCullFrame (int command_buffer_index);
+void R_GPUCullSurfaces (byte *vis);
+qboolean R_DrawWorldGPUCulled (VkCommandBuffer command_buffer);
+
 void GLSLGamma_DeleteTexture (void);
 void GLSLGamma_GammaCorrect (void);
 
@@ -358,11 +390,28 @@ void R_InitStagingBuffers();
 void R_SubmitStagingBuffers();
 byte * R_StagingAllocate(int size, VkCommandBuffer * command_buffer, VkBuffer * buffer, int * buffer_offset);
 
+#define NUM_COMMAND_BUFFERS 2	// frames in flight
+
 void R_InitDynamicBuffers();
 void R_SwapDynamicBuffers();
 byte * R_VertexAllocate(int size, VkBuffer * buffer, VkDeviceSize * buffer_offset);
 byte * R_IndexAllocate(int size, VkBuffer * buffer, VkDeviceSize * buffer_offset);
+VkDrawIndexedIndirectCommand * R_IndirectAllocate(int count, VkBuffer * buffer, VkDeviceSize * buffer_offset);
+void R_ReserveIndirectCommands(int count);
 byte * R_UniformAllocate(int size, VkBuffer * buffer, uint32_t * buffer_offset, VkDescriptorSet * descriptor_set);
 
+// parallel command recording. when r_parallelrecord is on the main render pass
+// is recorded into secondary command buffers, and GL_RecordParallel hands work
+// to the record threads. the commands are executed in the order the calls were
+// made, so the result is the same as recording everything inline.
+typedef void (*recordfunc_t) (VkCommandBuffer command_buffer, void *data, int index);
+
+void GL_BeginMainRenderPass (void);
+void GL_RecordParallel (recordfunc_t func, void *data, int count);
+	// calls func for index 0..count-1, each in its own command buffer
+void GL_WaitParallel (void);
+int GL_ParallelRecordThreads (void);
+	// the number of record threads, 0 if this frame is recorded inline
+
 #endif	/* __GLQUAKE_H */
 
@@ -145,6 +145,7 @@ void Host_Error (const char *error, ...)
 	inerror = true;
 
 	SCR_EndLoadingPlaque ();		// reenable screen updates
+	NET_EndBatch ();			// the error may have cut SV_SendClientMessages short
 
 	va_start (argptr,error);
 	q_vsnprintf (string, sizeof(string), error, argptr);
@@ -298,6 +299,7 @@ void Host_WriteConfiguration (void)
 			Con_Printf ("Couldn't write config.cfg.\n");
 			return;
 		}
+		COM_FlushDirs ();
 
 		VID_SyncCvars (); //johnfitz -- write actual current mode to config file, in case cvars were messed with
 
@@ -544,6 +546,7 @@ not reinitialize anything.
 void Host_ClearMemory (void)
 {
 	Con_DPrintf ("Clearing memory\n");
+	Loader_Flush ();
 	Mod_ClearAll ();
 /* host_hunklevel MUST be set at this point */
 	Hunk_FreeToLowMark (host_hunklevel);
@@ -698,6 +701,9 @@ void _Host_Frame (float time)
 // process console commands
 	Cbuf_Execute ();
 
+// finish up whatever the workers left for the main thread
+	Jobs_RunMainThread ();
+
 	NET_Poll();
 
 // if running the server locally, make intentions now
@@ -832,6 +838,7 @@ void Host_Init (void)
 	COM_Init ();
 	COM_InitFilesystem ();
 	Host_InitLocal ();
+	Jobs_Init ();
 	W_LoadWadFile (); //johnfitz -- filename is now hard-coded for honesty
 	if (cls.state != ca_dedicated)
 	{
@@ -840,6 +847,7 @@ void Host_Init (void)
 	}
 	PR_Init ();
 	Mod_Init ();
+	Loader_Init ();
 	NET_Init ();
 	SV_Init ();
 
@@ -921,6 +929,7 @@ void Host_Shutdown(void)
 	Host_WriteConfiguration ();
 
 	NET_Shutdown ();
+	Loader_Shutdown ();
 
 	if (cls.state != ca_dedicated)
 	{
@@ -933,6 +942,8 @@ void Host_Shutdown(void)
 		VID_Shutdown();
 	}
 
+	Jobs_Shutdown ();
+
 	LOG_Close ();
 }
 
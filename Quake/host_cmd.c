@@ -1007,6 +1007,7 @@ void Host_Savegame_f (void)
 		Con_Printf ("ERROR: couldn't open.\n");
 		return;
 	}
+	COM_FlushDirs ();
 
 	fprintf (f, "%i\n", SAVEGAME_VERSION);
 	Host_SavegameComment (comment);
@@ -1182,6 +1183,7 @@ void Host_Loadgame_f (void)
 
 	sv.num_edicts = entnum;
 	sv.time = time;
+	ED_RebuildEdictLists ();
 
 	fclose (f);
 
@@ -70,6 +70,20 @@ TODO: search order: tga png jpg pcx lmp
 byte *Image_LoadImage (const char *name, int *width, int *height)
 {
 	FILE	*f;
+	byte	*data, *rgba;
+	qboolean	missing;
+
+	// see if a loader thread decoded it already
+	data = Loader_TakeImage (name, width, height, &missing);
+	if (data)
+	{
+		rgba = (byte *) Hunk_Alloc ((*width) * (*height) * 4);
+		memcpy (rgba, data, (*width) * (*height) * 4);
+		free (data);
+		return rgba;
+	}
+	if (missing)
+		return NULL;
 
 	q_snprintf (loadfilename, sizeof(loadfilename), "%s.tga", name);
 	COM_FOpenFile (loadfilename, &f, NULL);
@@ -100,8 +114,6 @@ typedef struct targaheader_s {
 
 #define TARGAHEADERSIZE 18 //size on disk
 
-targaheader_t targa_header;
-
 int fgetLittleShort (FILE *f)
 {
 	byte	b1, b2;
@@ -144,6 +156,7 @@ qboolean Image_WriteTGA (const char *name, byte *data, int width, int height, in
 	handle = Sys_FileOpenWrite (pathname);
 	if (handle == -1)
 		return false;
+	COM_FlushDirs ();
 
 	Q_memset (&header, 0, TARGAHEADERSIZE);
 	header[2] = 2; // uncompressed type
@@ -174,11 +187,15 @@ qboolean Image_WriteTGA (const char *name, byte *data, int width, int height, in
 
 /*
 =============
-Image_LoadTGA
+Image_ReadTGA
+
+the threaded version mallocs the image and returns NULL for bad files
+instead of throwing errors
 =============
 */
-byte *Image_LoadTGA (FILE *fin, int *width, int *height)
+static byte *Image_ReadTGA (FILE *fin, int *width, int *height, qboolean threaded)
 {
+	targaheader_t	targa_header;
 	int				columns, rows, numPixels;
 	byte			*pixbuf;
 	int				row, column;
@@ -201,9 +218,19 @@ byte *Image_LoadTGA (FILE *fin, int *width, int *height)
 	targa_header.pixel_size = fgetc(fin);
 	targa_header.attributes = fgetc(fin);
 
+	if (threaded && (targa_header.image_type!=2 && targa_header.image_type!=10))
+	{
+		fclose(fin);
+		return NULL;
+	}
 	if (targa_header.image_type!=2 && targa_header.image_type!=10)
 		Sys_Error ("Image_LoadTGA: %s is not a type 2 or type 10 targa\n", loadfilename);
 
+	if (threaded && (targa_header.colormap_type !=0 || (targa_header.pixel_size!=32 && targa_header.pixel_size!=24)))
+	{
+		fclose(fin);
+		return NULL;
+	}
 	if (targa_header.colormap_type !=0 || (targa_header.pixel_size!=32 && targa_header.pixel_size!=24))
 		Sys_Error ("Image_LoadTGA: %s is not a 24bit or 32bit targa\n", loadfilename);
 
@@ -212,7 +239,17 @@ byte *Image_LoadTGA (FILE *fin, int *width, int *height)
 	numPixels = columns * rows;
 	upside_down = !(targa_header.attributes & 0x20); //johnfitz -- fix for upside-down targas
 
-	targa_rgba = (byte *) Hunk_Alloc (numPixels*4);
+	if (threaded)
+	{
+		targa_rgba = (byte *) malloc (numPixels*4);
+		if (!targa_rgba)
+		{
+			fclose(fin);
+			return NULL;
+		}
+	}
+	else
+		targa_rgba = (byte *) Hunk_Alloc (numPixels*4);
 
 	if (targa_header.id_length != 0)
 		fseek(fin, targa_header.id_length, SEEK_CUR);  // skip TARGA image comment
@@ -365,6 +402,16 @@ byte *Image_LoadTGA (FILE *fin, int *width, int *height)
 	return targa_rgba;
 }
 
+/*
+=============
+Image_LoadTGA
+=============
+*/
+byte *Image_LoadTGA (FILE *fin, int *width, int *height)
+{
+	return Image_ReadTGA (fin, width, height, false);
+}
+
 //==============================================================================
 //
 //  PCX
@@ -389,10 +436,13 @@ typedef struct
 
 /*
 ============
-Image_LoadPCX
+Image_ReadPCX
+
+the threaded version mallocs the image and returns NULL for bad files
+instead of throwing errors
 ============
 */
-byte *Image_LoadPCX (FILE *f, int *width, int *height)
+static byte *Image_ReadPCX (FILE *f, int filesize, int *width, int *height, qboolean threaded)
 {
 	pcxheader_t	pcx;
 	int			x, y, w, h, readbyte, runlength, start;
@@ -409,6 +459,13 @@ byte *Image_LoadPCX (FILE *f, int *width, int *height)
 	pcx.ymax = (unsigned short)LittleShort (pcx.ymax);
 	pcx.bytes_per_line = (unsigned short)LittleShort (pcx.bytes_per_line);
 
+	if (threaded && (pcx.signature != 0x0A || pcx.version != 5 ||
+			 pcx.encoding != 1 || pcx.bits_per_pixel != 8 || pcx.color_planes != 1))
+	{
+		fclose(f);
+		return NULL;
+	}
+
 	if (pcx.signature != 0x0A)
 		Sys_Error ("'%s' is not a valid PCX file", loadfilename);
 
@@ -421,10 +478,20 @@ byte *Image_LoadPCX (FILE *f, int *width, int *height)
 	w = pcx.xmax - pcx.xmin + 1;
 	h = pcx.ymax - pcx.ymin + 1;
 
-	data = (byte *) Hunk_Alloc((w*h+1)*4); //+1 to allow reading padding byte on last line
+	if (threaded)
+	{
+		data = (byte *) malloc((w*h+1)*4); //+1 to allow reading padding byte on last line
+		if (!data)
+		{
+			fclose(f);
+			return NULL;
+		}
+	}
+	else
+		data = (byte *) Hunk_Alloc((w*h+1)*4); //+1 to allow reading padding byte on last line
 
 	//load palette
-	fseek (f, start + com_filesize - 768, SEEK_SET);
+	fseek (f, start + filesize - 768, SEEK_SET);
 	fread (palette, 1, 768, f);
 
 	//back to start of image data
@@ -467,3 +534,28 @@ byte *Image_LoadPCX (FILE *f, int *width, int *height)
 	*height = h;
 	return data;
 }
+
+/*
+============
+Image_LoadPCX
+============
+*/
+byte *Image_LoadPCX (FILE *f, int *width, int *height)
+{
+	return Image_ReadPCX (f, com_filesize, width, height, false);
+}
+
+/*
+============
+Image_DecodeFile
+
+thread safe image decoding for the loader. takes ownership of f, returns
+malloc'd RGBA data or NULL if the file is bad
+============
+*/
+byte *Image_DecodeFile (FILE *f, int filesize, qboolean pcx, int *width, int *height)
+{
+	if (pcx)
+		return Image_ReadPCX (f, filesize, width, height, true);
+	return Image_ReadTGA (f, width, height, true);
+}
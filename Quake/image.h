@@ -30,6 +30,9 @@ byte *Image_LoadTGA (FILE *f, int *width, int *height);
 byte *Image_LoadPCX (FILE *f, int *width, int *height);
 byte *Image_LoadImage (const char *name, int *width, int *height);
 
+//thread safe, returns malloc'd data
+byte *Image_DecodeFile (FILE *f, int filesize, qboolean pcx, int *width, int *height);
+
 qboolean Image_WriteTGA (const char *name, byte *data, int width, int height, int bpp, qboolean upsidedown);
 
 #endif	/* __GL_IMAGE_H */
@@ -0,0 +1,905 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// jobs.c -- worker thread pool
+
+#include "quakedef.h"
+
+// threads including the main one, 0 for one per core
+cvar_t	host_jobs = {"host_jobs", "0", CVAR_ARCHIVE};
+
+#define	MAX_JOBS		2048
+#define	MAX_JOB_LINKS		4096
+#define	MAX_JOB_WORKERS		16
+#define	MAX_JOB_RANGES		(4 * (MAX_JOB_WORKERS + 1))
+
+typedef struct joblink_s
+{
+	job_t			*job;
+	struct joblink_s	*next;
+} joblink_t;
+
+struct job_s
+{
+	jobfunc_t	func;
+	jobrangefunc_t	rangefunc;
+	void		*data;
+	int		first, last;	// for rangefunc
+	int		flags;
+
+	SDL_atomic_t	blockers;	// unfinished dependencies, plus one until submitted
+	SDL_atomic_t	refs;		// the scheduler's and the handle's
+	SDL_atomic_t	done;
+	SDL_SpinLock	lock;		// protects done and dependents
+	joblink_t	*dependents;
+
+	job_t		*nextfree;
+};
+
+// the owner pushes and pops at the tail, other threads steal from the head
+typedef struct
+{
+	SDL_SpinLock	lock;
+	unsigned int	head, tail;
+	job_t		*jobs[MAX_JOBS];
+} jobqueue_t;
+
+static job_t		jobs[MAX_JOBS];
+static job_t		*free_jobs;
+static joblink_t	job_links[MAX_JOB_LINKS];
+static joblink_t	*free_links;
+static SDL_SpinLock	free_lock;
+
+static jobqueue_t	job_queues[MAX_JOB_WORKERS + 1];	// 0 is the main thread's
+static jobqueue_t	main_queue;				// JOB_MAINTHREAD jobs
+static SDL_Thread	*job_threads[MAX_JOB_WORKERS];
+static int		num_job_workers;
+static SDL_threadID	main_thread_id;
+static SDL_TLSID	job_tls;	// the thread's own queue
+
+static SDL_mutex	*jobs_lock;
+static SDL_cond		*jobs_wake;	// work queued or a job done
+static SDL_atomic_t	jobs_queued;	// in job_queues
+static SDL_atomic_t	jobs_main_queued;
+static SDL_atomic_t	jobs_unfinished;	// submitted and not done yet
+static SDL_atomic_t	jobs_sleepers;
+static qboolean		jobs_quit;
+
+static void Jobs_Execute (job_t *job);
+
+//==============================================================================
+//
+//  QUEUES
+//
+//==============================================================================
+
+/*
+================
+Jobs_Push
+================
+*/
+static void Jobs_Push (jobqueue_t *q, job_t *job)
+{
+	SDL_AtomicLock (&q->lock);
+	q->jobs[q->tail++ % MAX_JOBS] = job;
+	SDL_AtomicUnlock (&q->lock);
+}
+
+/*
+================
+Jobs_PopTail
+================
+*/
+static job_t *Jobs_PopTail (jobqueue_t *q)
+{
+	job_t	*job = NULL;
+
+	SDL_AtomicLock (&q->lock);
+	if (q->head != q->tail)
+		job = q->jobs[--q->tail % MAX_JOBS];
+	SDL_AtomicUnlock (&q->lock);
+
+	return job;
+}
+
+/*
+================
+Jobs_PopHead
+================
+*/
+static job_t *Jobs_PopHead (jobqueue_t *q)
+{
+	job_t	*job = NULL;
+
+	SDL_AtomicLock (&q->lock);
+	if (q->head != q->tail)
+		job = q->jobs[q->head++ % MAX_JOBS];
+	SDL_AtomicUnlock (&q->lock);
+
+	return job;
+}
+
+/*
+================
+Jobs_Wake
+================
+*/
+static void Jobs_Wake (void)
+{
+	if (!SDL_AtomicGet (&jobs_sleepers))
+		return;
+
+	SDL_LockMutex (jobs_lock);
+	SDL_CondBroadcast (jobs_wake);
+	SDL_UnlockMutex (jobs_lock);
+}
+
+/*
+================
+Jobs_Ready
+
+The job's dependencies are done, hand it out
+================
+*/
+static void Jobs_Ready (job_t *job)
+{
+	jobqueue_t	*q;
+
+	if (job->flags & JOB_MAINTHREAD)
+	{
+		Jobs_Push (&main_queue, job);
+		SDL_AtomicAdd (&jobs_main_queued, 1);
+	}
+	else if (!num_job_workers)
+	{
+		Jobs_Execute (job);
+		return;
+	}
+	else
+	{
+		q = (jobqueue_t *) SDL_TLSGet (job_tls);
+		if (!q)
+			q = &job_queues[0];
+		Jobs_Push (q, job);
+		SDL_AtomicAdd (&jobs_queued, 1);
+	}
+
+	Jobs_Wake ();
+}
+
+/*
+================
+Jobs_Take
+
+Own queue newest first, then the oldest job of the others
+================
+*/
+static job_t *Jobs_Take (jobqueue_t *self)
+{
+	job_t	*job;
+	int	i, start, count;
+
+	if (!SDL_AtomicGet (&jobs_queued))
+		return NULL;
+
+	if (self && (job = Jobs_PopTail (self)))
+		goto found;
+
+	count = num_job_workers + 1;
+	start = self ? (int)(self - job_queues) : 0;
+	for (i = 1; i <= count; i++)
+	{
+		if ((job = Jobs_PopHead (&job_queues[(start + i) % count])))
+			goto found;
+	}
+
+	return NULL;
+
+found:
+	SDL_AtomicAdd (&jobs_queued, -1);
+	return job;
+}
+
+/*
+================
+Jobs_TakeMain
+================
+*/
+static job_t *Jobs_TakeMain (void)
+{
+	job_t	*job;
+
+	if (!SDL_AtomicGet (&jobs_main_queued))
+		return NULL;
+	if (!(job = Jobs_PopHead (&main_queue)))
+		return NULL;
+	SDL_AtomicAdd (&jobs_main_queued, -1);
+
+	return job;
+}
+
+//==============================================================================
+//
+//  JOBS
+//
+//==============================================================================
+
+/*
+================
+Jobs_Release
+================
+*/
+static void Jobs_Release (job_t *job)
+{
+	if (SDL_AtomicAdd (&job->refs, -1) != 1)
+		return;
+
+	SDL_AtomicLock (&free_lock);
+	job->nextfree = free_jobs;
+	free_jobs = job;
+	SDL_AtomicUnlock (&free_lock);
+}
+
+/*
+================
+Jobs_Unblock
+================
+*/
+static void Jobs_Unblock (job_t *job)
+{
+	if (SDL_AtomicAdd (&job->blockers, -1) == 1)
+		Jobs_Ready (job);
+}
+
+/*
+================
+Jobs_Execute
+================
+*/
+static void Jobs_Execute (job_t *job)
+{
+	joblink_t	*link, *next;
+
+	if (job->rangefunc)
+		job->rangefunc (job->data, job->first, job->last);
+	else
+		job->func (job->data);
+
+	SDL_AtomicLock (&job->lock);
+	SDL_AtomicSet (&job->done, 1);
+	link = job->dependents;
+	job->dependents = NULL;
+	SDL_AtomicUnlock (&job->lock);
+
+	for ( ; link; link = next)
+	{
+		next = link->next;
+		Jobs_Unblock (link->job);
+
+		SDL_AtomicLock (&free_lock);
+		link->next = free_links;
+		free_links = link;
+		SDL_AtomicUnlock (&free_lock);
+	}
+
+	SDL_AtomicAdd (&jobs_unfinished, -1);
+	Jobs_Release (job);
+	Jobs_Wake ();
+}
+
+/*
+================
+Job_Create
+================
+*/
+job_t *Job_Create (jobfunc_t func, void *data, int flags)
+{
+	job_t	*job;
+
+	SDL_AtomicLock (&free_lock);
+	job = free_jobs;
+	if (job)
+		free_jobs = job->nextfree;
+	SDL_AtomicUnlock (&free_lock);
+
+	if (!job)
+		Sys_Error ("Job_Create: more than %i jobs", MAX_JOBS);
+
+	job->func = func;
+	job->rangefunc = NULL;
+	job->data = data;
+	job->first = job->last = 0;
+	job->flags = flags;
+	SDL_AtomicSet (&job->blockers, 1);
+	SDL_AtomicSet (&job->refs, (flags & JOB_DETACHED) ? 1 : 2);
+	SDL_AtomicSet (&job->done, 0);
+	job->lock = 0;
+	job->dependents = NULL;
+
+	return job;
+}
+
+/*
+================
+Job_DependsOn
+================
+*/
+void Job_DependsOn (job_t *job, job_t *dependency)
+{
+	joblink_t	*link;
+
+	SDL_AtomicLock (&dependency->lock);
+	if (!SDL_AtomicGet (&dependency->done))
+	{
+		SDL_AtomicLock (&free_lock);
+		link = free_links;
+		if (link)
+			free_links = link->next;
+		SDL_AtomicUnlock (&free_lock);
+
+		if (!link)
+			Sys_Error ("Job_DependsOn: more than %i dependencies", MAX_JOB_LINKS);
+
+		link->job = job;
+		link->next = dependency->dependents;
+		dependency->dependents = link;
+		SDL_AtomicAdd (&job->blockers, 1);
+	}
+	SDL_AtomicUnlock (&dependency->lock);
+}
+
+/*
+================
+Job_Submit
+================
+*/
+void Job_Submit (job_t *job)
+{
+	SDL_AtomicAdd (&jobs_unfinished, 1);
+	Jobs_Unblock (job);
+}
+
+/*
+================
+Job_Run
+================
+*/
+void Job_Run (jobfunc_t func, void *data)
+{
+	Job_Submit (Job_Create (func, data, JOB_DETACHED));
+}
+
+/*
+================
+Job_Wait
+================
+*/
+void Job_Wait (job_t *job)
+{
+	jobqueue_t	*self;
+	job_t		*other;
+	qboolean	mainjobs;
+
+	if (job->flags & JOB_DETACHED)
+		Sys_Error ("Job_Wait: detached job");
+
+	self = (jobqueue_t *) SDL_TLSGet (job_tls);
+	mainjobs = (job->flags & JOB_MAINTHREAD) && Jobs_IsMainThread ();
+
+	while (!SDL_AtomicGet (&job->done))
+	{
+		if ((mainjobs && (other = Jobs_TakeMain ())) || (other = Jobs_Take (self)))
+		{
+			Jobs_Execute (other);
+			continue;
+		}
+
+		SDL_LockMutex (jobs_lock);
+		SDL_AtomicAdd (&jobs_sleepers, 1);
+		while (!SDL_AtomicGet (&job->done) && !SDL_AtomicGet (&jobs_queued) &&
+			!(mainjobs && SDL_AtomicGet (&jobs_main_queued)))
+			SDL_CondWait (jobs_wake, jobs_lock);
+		SDL_AtomicAdd (&jobs_sleepers, -1);
+		SDL_UnlockMutex (jobs_lock);
+	}
+
+	Jobs_Release (job);
+}
+
+/*
+================
+Jobs_ParallelFor
+================
+*/
+void Jobs_ParallelFor (jobrangefunc_t func, void *data, int count, int grain)
+{
+	job_t	*ranges[MAX_JOB_RANGES];
+	int	i, numranges;
+
+	if (count <= 0)
+		return;
+
+	numranges = (num_job_workers + 1) * 4;
+	if (grain < 1)
+		grain = 1;
+	if (numranges > count / grain)
+		numranges = count / grain;
+	if (numranges <= 1)
+	{
+		func (data, 0, count);
+		return;
+	}
+
+	// the calling thread takes the first range itself
+	for (i = 1; i < numranges; i++)
+	{
+		ranges[i] = Job_Create (NULL, data, 0);
+		ranges[i]->rangefunc = func;
+		ranges[i]->first = (int)((long long)count * i / numranges);
+		ranges[i]->last = (int)((long long)count * (i + 1) / numranges);
+		Job_Submit (ranges[i]);
+	}
+
+	func (data, 0, (int)((long long)count / numranges));
+
+	for (i = 1; i < numranges; i++)
+		Job_Wait (ranges[i]);
+}
+
+/*
+================
+Jobs_RunMainThread
+================
+*/
+void Jobs_RunMainThread (void)
+{
+	job_t	*job;
+	int	count;
+
+	// only the ones that are ready now, so a job that queues another can't keep us here
+	for (count = SDL_AtomicGet (&jobs_main_queued); count > 0; count--)
+	{
+		if (!(job = Jobs_TakeMain ()))
+			break;
+		Jobs_Execute (job);
+	}
+}
+
+//==============================================================================
+//
+//  WORKERS
+//
+//==============================================================================
+
+/*
+================
+Jobs_Worker
+================
+*/
+static int SDLCALL Jobs_Worker (void *data)
+{
+	jobqueue_t	*self = (jobqueue_t *) data;
+	job_t		*job;
+	qboolean	quit;
+
+	SDL_TLSSet (job_tls, self, NULL);
+
+	for (;;)
+	{
+		if ((job = Jobs_Take (self)))
+		{
+			Jobs_Execute (job);
+			continue;
+		}
+
+		SDL_LockMutex (jobs_lock);
+		SDL_AtomicAdd (&jobs_sleepers, 1);
+		while (!jobs_quit && !SDL_AtomicGet (&jobs_queued))
+			SDL_CondWait (jobs_wake, jobs_lock);
+		SDL_AtomicAdd (&jobs_sleepers, -1);
+		quit = jobs_quit;
+		SDL_UnlockMutex (jobs_lock);
+
+		if (quit)
+			break;
+	}
+
+	return 0;
+}
+
+/*
+================
+Jobs_Drain
+
+Runs or waits out everything that was submitted
+================
+*/
+static void Jobs_Drain (void)
+{
+	job_t	*job;
+
+	while (SDL_AtomicGet (&jobs_unfinished) > 0)
+	{
+		if ((job = Jobs_TakeMain ()) || (job = Jobs_Take (&job_queues[0])))
+			Jobs_Execute (job);
+		else
+			SDL_Delay (1);
+	}
+}
+
+/*
+================
+Jobs_StartWorkers
+================
+*/
+static void Jobs_StartWorkers (int count)
+{
+	int	i;
+
+	count = CLAMP (0, count, MAX_JOB_WORKERS);
+
+	jobs_quit = false;
+	num_job_workers = count;
+	for (i = 0; i < count; i++)
+	{
+		job_threads[i] = SDL_CreateThread (Jobs_Worker, "Jobs", &job_queues[i + 1]);
+		if (!job_threads[i])
+		{
+			Con_Warning ("Couldn't create job thread: %s\n", SDL_GetError ());
+			break;
+		}
+	}
+	num_job_workers = i;
+}
+
+/*
+================
+Jobs_StopWorkers
+================
+*/
+static void Jobs_StopWorkers (void)
+{
+	int	i;
+
+	Jobs_Drain ();
+
+	SDL_LockMutex (jobs_lock);
+	jobs_quit = true;
+	SDL_CondBroadcast (jobs_wake);
+	SDL_UnlockMutex (jobs_lock);
+
+	for (i = 0; i < num_job_workers; i++)
+		SDL_WaitThread (job_threads[i], NULL);
+	num_job_workers = 0;
+}
+
+/*
+================
+Jobs_WantedWorkers
+================
+*/
+static int Jobs_WantedWorkers (void)
+{
+	int	threads;
+
+	threads = (int) host_jobs.value;
+	if (threads <= 0)
+		threads = SDL_GetCPUCount ();
+
+	return CLAMP (0, threads - 1, MAX_JOB_WORKERS);
+}
+
+/*
+================
+Jobs_NumWorkers
+================
+*/
+int Jobs_NumWorkers (void)
+{
+	return num_job_workers;
+}
+
+/*
+================
+Jobs_IsMainThread
+================
+*/
+qboolean Jobs_IsMainThread (void)
+{
+	return SDL_ThreadID () == main_thread_id;
+}
+
+/*
+================
+Jobs_Changed_f
+================
+*/
+static void Jobs_Changed_f (cvar_t *var)
+{
+	int	count;
+
+	if (!jobs_lock)
+		return;
+
+	count = Jobs_WantedWorkers ();
+	if (count == num_job_workers)
+		return;
+
+	Jobs_StopWorkers ();
+	Jobs_StartWorkers (count);
+	Con_Printf ("%i job worker threads\n", num_job_workers);
+}
+
+//==============================================================================
+//
+//  BENCHMARK
+//
+//==============================================================================
+
+#define	BENCH_BATCH		1024
+#define	BENCH_CHAIN		1024
+#define	BENCH_SUM_COUNT		(1 << 20)
+#define	BENCH_SUM_ROUNDS	16
+#define	BENCH_NESTED		64
+#define	BENCH_NESTED_RANGES	16	// per nested job, so they all fit in MAX_JOBS at once
+
+typedef struct
+{
+	SDL_atomic_t	counter;
+	SDL_atomic_t	sum;
+	SDL_atomic_t	errors;
+	int		order[BENCH_CHAIN];
+	qboolean	ranonmain;
+} jobbench_t;
+
+static jobbench_t	bench;
+
+static void Jobs_BenchCount (void *data)
+{
+	SDL_AtomicAdd (&bench.counter, 1);
+}
+
+static void Jobs_BenchChain (void *data)
+{
+	// every link has to see all the ones before it
+	if (SDL_AtomicAdd (&bench.counter, 1) != *(int *)data)
+		SDL_AtomicAdd (&bench.errors, 1);
+}
+
+static void Jobs_BenchFanIn (void *data)
+{
+	if (SDL_AtomicGet (&bench.counter) != BENCH_BATCH)
+		SDL_AtomicAdd (&bench.errors, 1);
+}
+
+static void Jobs_BenchMain (void *data)
+{
+	bench.ranonmain = Jobs_IsMainThread ();
+}
+
+static void Jobs_BenchSum (void *data, int first, int last)
+{
+	unsigned int	sum = 0, x;
+	int		i, j;
+
+	for (i = first; i < last; i++)
+	{
+		x = (unsigned int) i;
+		for (j = 0; j < BENCH_SUM_ROUNDS; j++)
+		{
+			x ^= x >> 16;
+			x *= 0x7feb352d;
+			x ^= x >> 15;
+			x *= 0x846ca68b;
+			x ^= x >> 16;
+		}
+		sum += x;
+	}
+
+	SDL_AtomicAdd (&bench.sum, (int) sum);
+}
+
+static void Jobs_BenchNested (void *data)
+{
+	Jobs_ParallelFor (Jobs_BenchSum, NULL, BENCH_SUM_COUNT / BENCH_NESTED, BENCH_SUM_COUNT / BENCH_NESTED / BENCH_NESTED_RANGES);
+}
+
+/*
+================
+Jobs_Bench_f
+
+Stresses the scheduler and checks the results: job overhead, a dependency
+chain, a fan-in, parallel-for against a serial loop, jobs waiting inside
+jobs, and main thread jobs
+================
+*/
+static void Jobs_Bench_f (void)
+{
+	job_t		*batch[BENCH_BATCH], *last;
+	int		i, j, count, errors;
+	unsigned int	serialsum;
+	double		time, serialtime;
+
+	count = (Cmd_Argc () > 1) ? Q_atoi (Cmd_Argv (1)) : 100000;
+	count = q_max (count / BENCH_BATCH, 1) * BENCH_BATCH;
+	errors = 0;
+	memset (&bench, 0, sizeof(bench));
+
+	Con_Printf ("%i worker threads\n", num_job_workers);
+
+	// spawn and wait
+	time = Sys_DoubleTime ();
+	for (i = 0; i < count; i += BENCH_BATCH)
+	{
+		for (j = 0; j < BENCH_BATCH; j++)
+		{
+			batch[j] = Job_Create (Jobs_BenchCount, NULL, 0);
+			Job_Submit (batch[j]);
+		}
+		for (j = 0; j < BENCH_BATCH; j++)
+			Job_Wait (batch[j]);
+	}
+	time = Sys_DoubleTime () - time;
+	if (SDL_AtomicGet (&bench.counter) != count)
+		errors++;
+	Con_Printf ("spawn    %7i jobs %8.2f ms %6.2f us/job\n", count, time * 1000.0, time * 1000000.0 / count);
+
+	// dependency chain, submitted back to front
+	SDL_AtomicSet (&bench.counter, 0);
+	time = Sys_DoubleTime ();
+	for (i = 0; i < BENCH_CHAIN; i++)
+	{
+		bench.order[i] = i;
+		batch[i] = Job_Create (Jobs_BenchChain, &bench.order[i], 0);
+		if (i)
+			Job_DependsOn (batch[i], batch[i - 1]);
+	}
+	for (i = BENCH_CHAIN - 1; i >= 0; i--)
+		Job_Submit (batch[i]);
+	for (i = 0; i < BENCH_CHAIN; i++)
+		Job_Wait (batch[i]);
+	time = Sys_DoubleTime () - time;
+	Con_Printf ("chain    %7i jobs %8.2f ms\n", BENCH_CHAIN, time * 1000.0);
+
+	// fan-in
+	SDL_AtomicSet (&bench.counter, 0);
+	time = Sys_DoubleTime ();
+	last = Job_Create (Jobs_BenchFanIn, NULL, 0);
+	for (i = 0; i < BENCH_BATCH - 1; i++)
+	{
+		batch[i] = Job_Create (Jobs_BenchCount, NULL, 0);
+		Job_DependsOn (last, batch[i]);
+		Job_Submit (batch[i]);
+	}
+	batch[i] = Job_Create (Jobs_BenchCount, NULL, JOB_MAINTHREAD);
+	Job_DependsOn (last, batch[i]);
+	Job_Submit (batch[i]);
+	Job_Submit (last);
+	Job_Wait (batch[i]);
+	Job_Wait (last);
+	for (i = 0; i < BENCH_BATCH - 1; i++)
+		Job_Wait (batch[i]);
+	time = Sys_DoubleTime () - time;
+	Con_Printf ("fan-in   %7i jobs %8.2f ms\n", BENCH_BATCH, time * 1000.0);
+
+	// parallel-for against the same loop on one thread
+	SDL_AtomicSet (&bench.sum, 0);
+	serialtime = Sys_DoubleTime ();
+	Jobs_BenchSum (NULL, 0, BENCH_SUM_COUNT);
+	serialtime = Sys_DoubleTime () - serialtime;
+	serialsum = (unsigned int) SDL_AtomicGet (&bench.sum);
+
+	SDL_AtomicSet (&bench.sum, 0);
+	time = Sys_DoubleTime ();
+	Jobs_ParallelFor (Jobs_BenchSum, NULL, BENCH_SUM_COUNT, 256);
+	time = Sys_DoubleTime () - time;
+	if ((unsigned int) SDL_AtomicGet (&bench.sum) != serialsum)
+		errors++;
+	Con_Printf ("for      %7i items %7.2f ms, %.2f ms serial, %.2fx\n", BENCH_SUM_COUNT, time * 1000.0, serialtime * 1000.0, serialtime / q_max (time, 0.000001));
+
+	// jobs that wait for jobs, each summing the same range
+	SDL_AtomicSet (&bench.sum, 0);
+	Jobs_BenchSum (NULL, 0, BENCH_SUM_COUNT / BENCH_NESTED);
+	serialsum = (unsigned int) SDL_AtomicGet (&bench.sum) * BENCH_NESTED;
+
+	SDL_AtomicSet (&bench.sum, 0);
+	time = Sys_DoubleTime ();
+	for (i = 0; i < BENCH_NESTED; i++)
+	{
+		batch[i] = Job_Create (Jobs_BenchNested, NULL, 0);
+		Job_Submit (batch[i]);
+	}
+	for (i = 0; i < BENCH_NESTED; i++)
+		Job_Wait (batch[i]);
+	time = Sys_DoubleTime () - time;
+	if ((unsigned int) SDL_AtomicGet (&bench.sum) != serialsum)
+		errors++;
+	Con_Printf ("nested   %7i jobs %8.2f ms\n", BENCH_NESTED, time * 1000.0);
+
+	// main thread job after a worker job
+	batch[0] = Job_Create (Jobs_BenchCount, NULL, 0);
+	batch[1] = Job_Create (Jobs_BenchMain, NULL, JOB_MAINTHREAD);
+	Job_DependsOn (batch[1], batch[0]);
+	Job_Submit (batch[1]);
+	Job_Submit (batch[0]);
+	Job_Wait (batch[1]);
+	Job_Wait (batch[0]);
+	if (!bench.ranonmain)
+		errors++;
+
+	errors += SDL_AtomicGet (&bench.errors);
+	if (errors)
+		Con_Printf ("%i errors\n", errors);
+	else
+		Con_Printf ("all passed\n");
+}
+
+//==============================================================================
+//
+//  INIT
+//
+//==============================================================================
+
+/*
+================
+Jobs_Init
+================
+*/
+void Jobs_Init (void)
+{
+	int	i;
+
+	Cvar_RegisterVariable (&host_jobs);
+	Cvar_SetCallback (&host_jobs, Jobs_Changed_f);
+	Cmd_AddCommand ("jobs_bench", Jobs_Bench_f);
+
+	for (i = 0; i < MAX_JOBS - 1; i++)
+		jobs[i].nextfree = &jobs[i + 1];
+	free_jobs = jobs;
+	for (i = 0; i < MAX_JOB_LINKS - 1; i++)
+		job_links[i].next = &job_links[i + 1];
+	free_links = job_links;
+
+	main_thread_id = SDL_ThreadID ();
+	job_tls = SDL_TLSCreate ();
+	jobs_lock = SDL_CreateMutex ();
+	jobs_wake = SDL_CreateCond ();
+	if (!job_tls || !jobs_lock || !jobs_wake)
+		Sys_Error ("Jobs_Init: %s", SDL_GetError ());
+	SDL_TLSSet (job_tls, &job_queues[0], NULL);
+
+	Jobs_StartWorkers (Jobs_WantedWorkers ());
+	Con_Printf ("Jobs: %i worker threads\n", num_job_workers);
+}
+
+/*
+================
+Jobs_Shutdown
+================
+*/
+void Jobs_Shutdown (void)
+{
+	// a Sys_Error on a worker can't wait for itself
+	if (!jobs_lock || !Jobs_IsMainThread ())
+		return;
+
+	Jobs_StopWorkers ();
+}
@@ -0,0 +1,66 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef _QUAKE_JOBS_H
+#define _QUAKE_JOBS_H
+
+// jobs.h -- worker thread pool
+
+// A fixed set of worker threads runs jobs off per-thread queues, stealing
+// from each other when their own queue runs dry. A thread waiting for a job
+// runs other jobs in the meantime, so jobs may wait too. JOB_MAINTHREAD jobs
+// only run from Jobs_RunMainThread, or when the main thread waits for one.
+
+typedef struct job_s job_t;
+
+typedef void (*jobfunc_t) (void *data);
+typedef void (*jobrangefunc_t) (void *data, int first, int last);
+
+#define JOB_MAINTHREAD	1	// only runs on the main thread
+#define JOB_DETACHED	2	// freed when done, can't be waited for
+
+extern	cvar_t	host_jobs;
+
+void Jobs_Init (void);
+void Jobs_Shutdown (void);
+int Jobs_NumWorkers (void);
+	// worker threads, not counting the main thread
+qboolean Jobs_IsMainThread (void);
+
+job_t *Job_Create (jobfunc_t func, void *data, int flags);
+void Job_DependsOn (job_t *job, job_t *dependency);
+	// job won't start before dependency is done. job must not have been
+	// submitted yet, and neither may a JOB_DETACHED dependency
+void Job_Submit (job_t *job);
+void Job_Wait (job_t *job);
+	// runs other jobs until job is done, then frees it. every job that
+	// isn't JOB_DETACHED has to be waited for exactly once
+void Job_Run (jobfunc_t func, void *data);
+	// fire and forget
+
+void Jobs_ParallelFor (jobrangefunc_t func, void *data, int count, int grain);
+	// splits 0..count-1 into ranges of at least grain and returns when all
+	// of them are done
+void Jobs_RunMainThread (void);
+	// runs the JOB_MAINTHREAD jobs that are ready, once a frame
+
+#endif	/* _QUAKE_JOBS_H */
@@ -0,0 +1,655 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// loader.c -- background precaching
+
+#include "quakedef.h"
+
+cvar_t	loader_async = {"loader_async", "1", CVAR_ARCHIVE};
+
+#define	LOADER_HASH_SIZE	256
+#define	MAX_LOAD_STAGES		16
+
+typedef enum
+{
+	LOAD_FILE,
+	LOAD_SOUND,
+	LOAD_IMAGE,
+	NUM_LOAD_TYPES
+} loadtype_t;
+
+static const char *loadtypenames[NUM_LOAD_TYPES] = {"files", "sounds", "images"};
+
+typedef enum
+{
+	JOB_QUEUED,
+	JOB_RUNNING,
+	JOB_DONE
+} jobstate_t;
+
+typedef struct loadjob_s
+{
+	char		name[MAX_QPATH];
+	loadtype_t	type;
+	jobstate_t	state;		// protected by loader_lock
+
+	fileloc_t	loc;
+	qboolean	found;		// image: false if neither tga nor pcx exists
+	qboolean	pcx;		// image: loc is a pcx
+
+	byte		*data;		// malloc'd result
+	int		size;
+	int		width, height;
+
+	struct loadjob_s	*hashnext;	// main thread only
+	struct loadjob_s	*prev, *next;	// work queue, protected by loader_lock
+} loadjob_t;
+
+typedef struct
+{
+	const char	*name;
+	double		time;
+} loadstage_t;
+
+static struct
+{
+	int		queued[NUM_LOAD_TYPES];
+	int		taken[NUM_LOAD_TYPES];
+	double		worktime[NUM_LOAD_TYPES];	// summed over the threads
+	int		inlined;	// still queued when needed, run on the main thread
+	int		waits;		// still running when needed
+	double		waittime;
+	int		unused;		// dropped without being taken
+} loadstats;
+
+static SDL_mutex	*loader_lock;
+static SDL_cond		*loader_done;	// signaled when a job finishes
+static int		loader_running;	// jobs being worked on
+static int		loader_workers;	// Loader_Work jobs posted, at most Jobs_NumWorkers ()
+
+static loadjob_t	*loader_hash[LOADER_HASH_SIZE];
+static loadjob_t	*queue_head, *queue_tail;
+
+static loadstage_t	loader_stages[MAX_LOAD_STAGES];
+static int		loader_numstages;
+static double		loader_starttime, loader_stagetime;
+static char		loader_report[1024];	// breakdown of the last load
+
+//==============================================================================
+//
+//  WORKERS
+//
+//==============================================================================
+
+/*
+================
+Loader_RunJob
+
+Called without the lock held, from any thread
+================
+*/
+static void Loader_RunJob (loadjob_t *job)
+{
+	FILE	*f;
+	byte	*raw;
+	volatile byte	sum;
+	int		i;
+
+	switch (job->type)
+	{
+	case LOAD_FILE:
+		if (job->loc.mapped)
+		{
+			// fault the pages in, the model loader reads the mapping directly
+			sum = 0;
+			for (i = 0; i < job->loc.length; i += 4096)
+				sum += job->loc.mapped[i];
+			(void)sum;
+			break;
+		}
+		job->data = COM_ReadLocatedFile (&job->loc);
+		job->size = job->loc.length;
+		break;
+
+	case LOAD_SOUND:
+		if (job->loc.mapped)
+			raw = (byte *) job->loc.mapped;
+		else if (!(raw = COM_ReadLocatedFile (&job->loc)))
+			break;
+		job->data = (byte *) S_DecodeSound (raw, job->loc.length, &job->size);
+		if (raw != job->loc.mapped)
+			free (raw);
+		break;
+
+	case LOAD_IMAGE:
+		if (!job->found)
+			break;
+		f = COM_OpenLocatedFile (&job->loc);
+		if (f)
+			job->data = Image_DecodeFile (f, job->loc.length, job->pcx, &job->width, &job->height);
+		break;
+
+	default:
+		break;
+	}
+}
+
+/*
+================
+Loader_Unqueue
+
+Called with the lock held
+================
+*/
+static void Loader_Unqueue (loadjob_t *job)
+{
+	if (job->prev)
+		job->prev->next = job->next;
+	else
+		queue_head = job->next;
+	if (job->next)
+		job->next->prev = job->prev;
+	else
+		queue_tail = job->prev;
+	job->prev = job->next = NULL;
+}
+
+/*
+================
+Loader_Work
+
+At most Jobs_NumWorkers () of these are posted at a time, rather than one
+per queued file, so a big map can't use up the job pool. Each one runs the
+oldest queued jobs until the queue is empty, and Loader_AddJob posts
+another if fewer are left running than there are workers
+================
+*/
+static void Loader_Work (void *unused)
+{
+	loadjob_t	*job;
+	double		time;
+
+	SDL_LockMutex (loader_lock);
+	while ((job = queue_head))
+	{
+		Loader_Unqueue (job);
+		job->state = JOB_RUNNING;
+		loader_running++;
+		SDL_UnlockMutex (loader_lock);
+
+		time = Sys_DoubleTime ();
+		Loader_RunJob (job);
+		time = Sys_DoubleTime () - time;
+
+		SDL_LockMutex (loader_lock);
+		loadstats.worktime[job->type] += time;
+		job->state = JOB_DONE;
+		loader_running--;
+		SDL_CondBroadcast (loader_done);
+	}
+	loader_workers--;
+	SDL_UnlockMutex (loader_lock);
+}
+
+//==============================================================================
+//
+//  JOBS
+//
+//==============================================================================
+
+/*
+================
+Loader_FindJob
+================
+*/
+static loadjob_t *Loader_FindJob (const char *name, loadtype_t type, loadjob_t ***link)
+{
+	loadjob_t	**j;
+
+	for (j = &loader_hash[COM_HashString (name) & (LOADER_HASH_SIZE - 1)]; *j; j = &(*j)->hashnext)
+	{
+		if ((*j)->type == type && !strcmp ((*j)->name, name))
+		{
+			if (link)
+				*link = j;
+			return *j;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+================
+Loader_AddJob
+================
+*/
+static void Loader_AddJob (loadjob_t *job)
+{
+	unsigned int	hash;
+	qboolean	post;
+
+	hash = COM_HashString (job->name) & (LOADER_HASH_SIZE - 1);
+	job->hashnext = loader_hash[hash];
+	loader_hash[hash] = job;
+	loadstats.queued[job->type]++;
+
+	SDL_LockMutex (loader_lock);
+	job->state = JOB_QUEUED;
+	job->prev = queue_tail;
+	job->next = NULL;
+	if (queue_tail)
+		queue_tail->next = job;
+	else
+		queue_head = job;
+	queue_tail = job;
+	post = loader_workers < Jobs_NumWorkers ();
+	if (post)
+		loader_workers++;
+	SDL_UnlockMutex (loader_lock);
+
+	if (post)
+		Job_Run (Loader_Work, NULL);
+}
+
+/*
+================
+Loader_NewJob
+
+Returns NULL if the job is already queued or the loader is off
+================
+*/
+static loadjob_t *Loader_NewJob (const char *name, loadtype_t type)
+{
+	loadjob_t	*job;
+
+	if (!loader_lock || !Jobs_NumWorkers () || !loader_async.value)
+		return NULL;
+	if (strlen (name) >= MAX_QPATH || Loader_FindJob (name, type, NULL))
+		return NULL;
+
+	job = (loadjob_t *) calloc (1, sizeof(loadjob_t));
+	if (!job)
+		return NULL;
+	q_strlcpy (job->name, name, sizeof(job->name));
+	job->type = type;
+
+	return job;
+}
+
+/*
+================
+Loader_TakeJob
+
+Unlinks the job and returns it once it is done, or NULL if it wasn't queued
+================
+*/
+static loadjob_t *Loader_TakeJob (const char *name, loadtype_t type)
+{
+	loadjob_t	*job, **link;
+	double		time;
+
+	if (!loader_lock)
+		return NULL;
+	job = Loader_FindJob (name, type, &link);
+	if (!job)
+		return NULL;
+	*link = job->hashnext;
+
+	SDL_LockMutex (loader_lock);
+	if (job->state == JOB_QUEUED)
+	{
+		// nobody got to it yet, quicker to do it here than to wait
+		Loader_Unqueue (job);
+		SDL_UnlockMutex (loader_lock);
+		time = Sys_DoubleTime ();
+		Loader_RunJob (job);
+		loadstats.worktime[type] += Sys_DoubleTime () - time;
+		loadstats.inlined++;
+	}
+	else
+	{
+		if (job->state == JOB_RUNNING)
+		{
+			time = Sys_DoubleTime ();
+			while (job->state != JOB_DONE)
+				SDL_CondWait (loader_done, loader_lock);
+			loadstats.waittime += Sys_DoubleTime () - time;
+			loadstats.waits++;
+		}
+		SDL_UnlockMutex (loader_lock);
+	}
+
+	loadstats.taken[type]++;
+	return job;
+}
+
+/*
+================
+Loader_QueueFile
+================
+*/
+void Loader_QueueFile (const char *path)
+{
+	loadjob_t	*job;
+
+	job = Loader_NewJob (path, LOAD_FILE);
+	if (!job)
+		return;
+	if (!COM_LocateFile (path, &job->loc))
+	{
+		free (job);
+		return;
+	}
+	Loader_AddJob (job);
+}
+
+/*
+================
+Loader_QueueSound
+================
+*/
+void Loader_QueueSound (const char *path)
+{
+	loadjob_t	*job;
+
+	job = Loader_NewJob (path, LOAD_SOUND);
+	if (!job)
+		return;
+	if (!COM_LocateFile (path, &job->loc))
+	{
+		free (job);
+		return;
+	}
+	Loader_AddJob (job);
+}
+
+/*
+================
+Loader_QueueImage
+
+Does the same search as Image_LoadImage, so that missing images can be
+skipped without touching the filesystem again. Returns false if the image
+doesn't exist or the loader is off.
+================
+*/
+qboolean Loader_QueueImage (const char *name)
+{
+	loadjob_t	*job;
+	char		filename[MAX_QPATH];
+
+	if (!loader_lock || !Jobs_NumWorkers () || !loader_async.value)
+		return false;
+	job = Loader_FindJob (name, LOAD_IMAGE, NULL);
+	if (job)
+		return job->found;
+
+	job = Loader_NewJob (name, LOAD_IMAGE);
+	if (!job)
+		return false;
+
+	q_snprintf (filename, sizeof(filename), "%s.tga", name);
+	job->found = COM_LocateFile (filename, &job->loc);
+	if (!job->found)
+	{
+		q_snprintf (filename, sizeof(filename), "%s.pcx", name);
+		job->found = job->pcx = COM_LocateFile (filename, &job->loc);
+	}
+	Loader_AddJob (job);
+
+	return job->found;
+}
+
+/*
+================
+Loader_TakeFile
+================
+*/
+byte *Loader_TakeFile (const char *path, int *size, unsigned int *path_id)
+{
+	loadjob_t	*job;
+	byte		*data;
+
+	job = Loader_TakeJob (path, LOAD_FILE);
+	if (!job)
+		return NULL;
+
+	data = job->data;
+	*size = job->size;
+	if (path_id)
+		*path_id = job->loc.path_id;
+	free (job);
+
+	return data;
+}
+
+/*
+================
+Loader_TakeSound
+================
+*/
+void *Loader_TakeSound (const char *path, int *size)
+{
+	loadjob_t	*job;
+	byte		*data;
+
+	job = Loader_TakeJob (path, LOAD_SOUND);
+	if (!job)
+		return NULL;
+
+	data = job->data;
+	*size = job->size;
+	free (job);
+
+	return data;
+}
+
+/*
+================
+Loader_TakeImage
+================
+*/
+byte *Loader_TakeImage (const char *name, int *width, int *height, qboolean *missing)
+{
+	loadjob_t	*job;
+	byte		*data;
+
+	*missing = false;
+	job = Loader_TakeJob (name, LOAD_IMAGE);
+	if (!job)
+		return NULL;
+
+	data = job->data;
+	*width = job->width;
+	*height = job->height;
+	*missing = !job->found;
+	free (job);
+
+	return data;
+}
+
+/*
+================
+Loader_Flush
+================
+*/
+void Loader_Flush (void)
+{
+	loadjob_t	*job;
+	int		i;
+
+	loader_starttime = 0;	// a load that errored out never finished
+	if (!loader_lock)
+		return;
+
+	SDL_LockMutex (loader_lock);
+	queue_head = queue_tail = NULL;
+	while (loader_running)
+		SDL_CondWait (loader_done, loader_lock);
+	SDL_UnlockMutex (loader_lock);
+
+	for (i = 0; i < LOADER_HASH_SIZE; i++)
+	{
+		while ((job = loader_hash[i]))
+		{
+			loader_hash[i] = job->hashnext;
+			loadstats.unused++;
+			free (job->data);
+			free (job);
+		}
+	}
+}
+
+//==============================================================================
+//
+//  STAGES
+//
+//==============================================================================
+
+/*
+================
+Loader_EndStage
+================
+*/
+static void Loader_EndStage (double now)
+{
+	if (loader_numstages)
+		loader_stages[loader_numstages - 1].time = now - loader_stagetime;
+	loader_stagetime = now;
+}
+
+/*
+================
+Loader_BeginStage
+
+The first stage after a Loader_Finish starts a new breakdown
+================
+*/
+void Loader_BeginStage (const char *name)
+{
+	double	now;
+
+	now = Sys_DoubleTime ();
+	if (!loader_starttime)
+	{
+		loader_starttime = now;
+		loader_numstages = 0;
+		memset (&loadstats, 0, sizeof(loadstats));
+	}
+
+	Loader_EndStage (now);
+	if (loader_numstages == MAX_LOAD_STAGES)
+		return;	// keep counting it in the last one
+	loader_stages[loader_numstages].name = name;
+	loader_stages[loader_numstages].time = 0;
+	loader_numstages++;
+}
+
+/*
+================
+Loader_Finish
+================
+*/
+void Loader_Finish (const char *what)
+{
+	double	now;
+	int		i, len;
+
+	if (!loader_starttime)
+		return;
+
+	now = Sys_DoubleTime ();
+	Loader_EndStage (now);
+
+	len = q_snprintf (loader_report, sizeof(loader_report), "%s: %.1f ms\n",
+			what, (now - loader_starttime) * 1000.0);
+	for (i = 0; i < loader_numstages && len < (int)sizeof(loader_report); i++)
+		len += q_snprintf (loader_report + len, sizeof(loader_report) - len, "  %-10s %7.1f ms\n",
+				loader_stages[i].name, loader_stages[i].time * 1000.0);
+	for (i = 0; i < NUM_LOAD_TYPES && len < (int)sizeof(loader_report); i++)
+	{
+		if (!loadstats.queued[i])
+			continue;
+		len += q_snprintf (loader_report + len, sizeof(loader_report) - len, "  %i/%i %s, %.1f ms decoding\n",
+				loadstats.taken[i], loadstats.queued[i], loadtypenames[i], loadstats.worktime[i] * 1000.0);
+	}
+	if (len < (int)sizeof(loader_report))
+		q_snprintf (loader_report + len, sizeof(loader_report) - len,
+				"  %i waits (%.1f ms), %i run inline, %i unused, %i threads\n",
+				loadstats.waits, loadstats.waittime * 1000.0, loadstats.inlined,
+				loadstats.unused, Jobs_NumWorkers ());
+
+	Con_DPrintf ("%s", loader_report);
+	loader_starttime = 0;
+}
+
+/*
+================
+Loader_Stats_f
+================
+*/
+static void Loader_Stats_f (void)
+{
+	if (!loader_report[0])
+		Con_Printf ("nothing loaded yet\n");
+	else
+		Con_Printf ("%s", loader_report);
+}
+
+//==============================================================================
+//
+//  INIT
+//
+//==============================================================================
+
+/*
+================
+Loader_Init
+
+The work itself runs on the job workers, see jobs.c
+================
+*/
+void Loader_Init (void)
+{
+	Cvar_RegisterVariable (&loader_async);
+	Cmd_AddCommand ("loadstats", Loader_Stats_f);
+
+	if (COM_CheckParm ("-noasyncload"))
+		return;
+
+	loader_lock = SDL_CreateMutex ();
+	loader_done = SDL_CreateCond ();
+	if (!loader_lock || !loader_done)
+	{
+		Con_Printf ("Loader_Init: %s\n", SDL_GetError ());
+		loader_lock = NULL;
+	}
+}
+
+/*
+================
+Loader_Shutdown
+================
+*/
+void Loader_Shutdown (void)
+{
+	Loader_Flush ();
+}
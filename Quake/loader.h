@@ -0,0 +1,59 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef _QUAKE_LOADER_H
+#define _QUAKE_LOADER_H
+
+// loader.h -- background precaching
+
+// Files are queued on the main thread as soon as their names are known, and
+// read and decoded on the job workers while the main thread keeps loading.
+// The Take functions hand back the result when the main thread gets to the
+// file, waiting for it if necessary. Everything that touches the hunk, the
+// cache or the GPU still happens on the main thread.
+
+extern	cvar_t	loader_async;
+
+void Loader_Init (void);
+void Loader_Shutdown (void);
+
+void Loader_QueueFile (const char *path);
+void Loader_QueueSound (const char *path);
+qboolean Loader_QueueImage (const char *name);	// name without extension
+
+byte *Loader_TakeFile (const char *path, int *size, unsigned int *path_id);
+	// returns malloc'd data with a 0 byte appended, or NULL if the file wasn't
+	// queued or is in a mapped pak (its pages will have been touched instead)
+void *Loader_TakeSound (const char *path, int *size);
+	// returns a malloc'd sfxcache_t of *size bytes
+byte *Loader_TakeImage (const char *name, int *width, int *height, qboolean *missing);
+	// returns malloc'd RGBA data. sets *missing if the image doesn't exist
+
+void Loader_Flush (void);
+	// waits for the workers and drops all results. has to be called before
+	// anything a queued job might reference goes away
+
+void Loader_BeginStage (const char *name);
+void Loader_Finish (const char *what);
+	// ends the last stage and prints the load time breakdown
+
+#endif	/* _QUAKE_LOADER_H */
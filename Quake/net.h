@@ -90,6 +90,10 @@ void	NET_Close (struct qsocket_s *sock);
 
 void	NET_Poll (void);
 
+void	NET_BeginBatch (void);
+void	NET_EndBatch (void);
+// packets written between the two may go out together at NET_EndBatch
+
 
 // Server list related globals:
 extern	qboolean	slistInProgress;
@@ -45,11 +45,32 @@ struct qsockaddr
 #define NETFLAG_NAK		0x00040000
 #define NETFLAG_EOM		0x00080000
 #define NETFLAG_UNRELIABLE	0x00100000
+#define NETFLAG_COMPRESSED	0x00200000
 #define NETFLAG_CTL		0x80000000
 
 
 #define NET_PROTOCOL_VERSION	3
 
+// sliding window reliable stream, used when both ends put NET_WINDOWMAGIC
+// after CCREQ_CONNECT and CCREP_ACCEPT. Reliable messages go out in
+// NET_FRAGMENTSIZE fragments, up to NET_WINDOWSIZE of them unacknowledged.
+// An ACK's sequence is the next fragment the receiver wants, and two longs
+// follow, bits 0-31 then 32-63, with bit n set for fragment sequence + n if
+// it already has it. The window covers NET_MAXFRAGMENTS, so a whole message
+// goes out without waiting for an ACK.
+#define NET_WINDOWMAGIC		0x57494e44	// "WIND"
+#define NET_FRAGMENTSIZE	DATAGRAM_MTU
+#define NET_MAXFRAGMENTS	((NET_MAXMESSAGE + NET_FRAGMENTSIZE - 1) / NET_FRAGMENTSIZE)
+#define NET_WINDOWSIZE		64		// bits in the ACK's two longs
+#define NET_MINRTO			0.05
+#define NET_MAXRTO			1.0		// the stop and wait resend time
+
+// LZ compressed reliable messages, used when both ends put NET_COMPRESSMAGIC
+// after CCREQ_CONNECT and CCREP_ACCEPT. Every packet of a compressed message
+// has NETFLAG_COMPRESSED set.
+#define NET_COMPRESSMAGIC	0x4c5a3031	// "LZ01"
+#define NET_COMPRESSMIN		256		// smaller messages go out as they are
+
 /**
 
 This is the network info/connection protocol.  It is used to find Quake
@@ -64,6 +85,8 @@ General notes:
 CCREQ_CONNECT
 		string	game_name		"QUAKE"
 		byte	net_protocol_version	NET_PROTOCOL_VERSION
+		long	NET_WINDOWMAGIC		optional
+		long	NET_COMPRESSMAGIC	optional, after NET_WINDOWMAGIC if both are sent
 
 CCREQ_SERVER_INFO
 		string	game_name		"QUAKE"
@@ -77,6 +100,8 @@ CCREQ_RULE_INFO
 
 CCREP_ACCEPT
 		long	port
+		long	NET_WINDOWMAGIC		if it was in CCREQ_CONNECT
+		long	NET_COMPRESSMAGIC	if it was in CCREQ_CONNECT and is allowed
 
 CCREP_REJECT
 		string	reason
@@ -151,6 +176,29 @@ typedef struct qsocket_s
 	int		receiveMessageLength;
 	byte		receiveMessage [NET_MAXMESSAGE];
 
+	// sliding window reliable stream
+	qboolean	windowed;
+	unsigned int	sendFirstSequence;	// of the first fragment of sendMessage
+	int		sendFragments;
+	int		sendAcked;		// fragments before this one are acked
+	int		sendLastAcked;		// highest fragment acked, -1 for none
+	byte		fragmentSends[NET_MAXFRAGMENTS];
+	byte		fragmentAcked[NET_MAXFRAGMENTS];
+	double		fragmentTime[NET_MAXFRAGMENTS];
+	double		rtt, rttvar, rto;
+	int		rttSamples;
+	int		retransmits;
+	unsigned long long	receiveWindow;	// bit n: fragment receiveSequence + n is in receiveMessage
+	unsigned int	receiveEndSequence;	// one past the EOM fragment, 0 until it arrives
+	int		receiveEndLength;
+
+	// compressed reliable messages
+	qboolean	compress;
+	qboolean	sendCompressed;		// sendMessage is compressed
+	int		uncompressRead;		// receiveMessage bytes decoded so far
+	int		uncompressLength;
+	byte		uncompressMessage [NET_MAXMESSAGE];
+
 	struct qsockaddr	addr;
 	char		address[NET_NAMELEN];
 
@@ -183,6 +231,7 @@ typedef struct
 	int		(*AddrCompare) (struct qsockaddr *addr1, struct qsockaddr *addr2);
 	int		(*GetSocketPort) (struct qsockaddr *addr);
 	int		(*SetSocketPort) (struct qsockaddr *addr, int port);
+	void		(*Batch) (qboolean state);	// optional: hold writes back while on, send them when turned off
 } net_landriver_t;
 
 #define	MAX_NET_DRIVERS		8
@@ -220,6 +269,12 @@ extern int		messagesReceived;
 extern int		unreliableMessagesSent;
 extern int		unreliableMessagesReceived;
 
+// system calls made by the lan drivers, and the packets they moved
+extern int		lanReadCalls;
+extern int		lanPacketsRead;
+extern int		lanWriteCalls;
+extern int		lanPacketsWritten;
+
 qsocket_t *NET_NewQSocket (void);
 void NET_FreeQSocket(qsocket_t *);
 double SetNetTime(void);
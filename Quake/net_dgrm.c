@@ -130,6 +130,180 @@ static void NET_Ban_f (void)
 #endif	// BAN_TEST
 
 
+/*
+=============================================================================
+
+COMPRESSION
+
+A compressed message is a run of tokens. A byte c below 0x80 is followed by
+c + 1 literal bytes, and a byte c of 0x80 or more is followed by a little
+endian short distance and copies (c & 0x7f) + LZ_MINMATCH bytes from that
+far back in the output.
+
+=============================================================================
+*/
+
+#define LZ_MINMATCH		4
+#define LZ_MAXMATCH		(0x7f + LZ_MINMATCH)
+#define LZ_MAXLITERALS	0x80
+#define LZ_MAXDISTANCE	0xffff
+#define LZ_HASHBITS		13
+
+static cvar_t	net_compress = {"net_compress", "1", CVAR_NONE};
+
+static int compressedMessages = 0;
+static int compressedBytesIn = 0;
+static int compressedBytesOut = 0;
+
+static int LZ_Hash (const byte *p)
+{
+	unsigned int	v = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+
+	return (v * 2654435761u) >> (32 - LZ_HASHBITS);
+}
+
+static int LZ_WriteLiterals (const byte *in, int count, byte *out, int outlen, int outmax)
+{
+	int	n;
+
+	while (count > 0)
+	{
+		n = q_min(count, LZ_MAXLITERALS);
+		if (outlen + 1 + n > outmax)
+			return -1;
+		out[outlen++] = n - 1;
+		Q_memcpy (out + outlen, in, n);
+		outlen += n;
+		in += n;
+		count -= n;
+	}
+	return outlen;
+}
+
+/*
+================
+LZ_Compress
+
+Greedy matching against the last position seen for each hash. Returns the
+compressed length, or -1 if it would not fit in outmax bytes.
+================
+*/
+static int LZ_Compress (const byte *in, int inlen, byte *out, int outmax)
+{
+	static int	hash[1 << LZ_HASHBITS];
+	int			pos, literal, outlen, match, limit, candidate, h, i;
+
+	for (i = 0; i < (1 << LZ_HASHBITS); i++)
+		hash[i] = -1;
+
+	pos = literal = outlen = 0;
+	while (pos + LZ_MINMATCH <= inlen)
+	{
+		h = LZ_Hash (in + pos);
+		candidate = hash[h];
+		hash[h] = pos;
+		if (candidate < 0 || pos - candidate > LZ_MAXDISTANCE || memcmp (in + candidate, in + pos, LZ_MINMATCH))
+		{
+			pos++;
+			continue;
+		}
+
+		limit = q_min(inlen - pos, LZ_MAXMATCH);
+		for (match = LZ_MINMATCH; match < limit && in[candidate + match] == in[pos + match]; match++)
+			;
+
+		outlen = LZ_WriteLiterals (in + literal, pos - literal, out, outlen, outmax);
+		if (outlen < 0 || outlen + 3 > outmax)
+			return -1;
+		out[outlen++] = 0x80 | (match - LZ_MINMATCH);
+		out[outlen++] = (pos - candidate) & 0xff;
+		out[outlen++] = (pos - candidate) >> 8;
+
+		for (i = pos + 1; i < pos + match && i + LZ_MINMATCH <= inlen; i++)
+			hash[LZ_Hash (in + i)] = i;
+		pos += match;
+		literal = pos;
+	}
+
+	return LZ_WriteLiterals (in + literal, inlen - literal, out, outlen, outmax);
+}
+
+/*
+================
+LZ_Decompress
+
+Decodes the whole tokens in in[*inpos] to in[inlen], so a message can be
+decoded as its packets come in. Returns false for bad data.
+================
+*/
+static qboolean LZ_Decompress (const byte *in, int inlen, int *inpos, byte *out, int outmax, int *outpos)
+{
+	int	i, o, n, distance;
+
+	i = *inpos;
+	o = *outpos;
+	while (i < inlen)
+	{
+		if (in[i] < 0x80)
+		{
+			n = in[i] + 1;
+			if (i + 1 + n > inlen)
+				break;
+			if (o + n > outmax)
+				return false;
+			Q_memcpy (out + o, in + i + 1, n);
+			i += 1 + n;
+			o += n;
+		}
+		else
+		{
+			if (i + 3 > inlen)
+				break;
+			n = (in[i] & 0x7f) + LZ_MINMATCH;
+			distance = in[i + 1] | (in[i + 2] << 8);
+			if (!distance || distance > o || o + n > outmax)
+				return false;
+			for ( ; n; n--, o++)	// may overlap itself
+				out[o] = out[o - distance];
+			i += 3;
+		}
+	}
+
+	*inpos = i;
+	*outpos = o;
+	return true;
+}
+
+/*
+================
+ReceiveCompressed
+
+Decodes what has arrived of a compressed message, the first length bytes of
+receiveMessage. Once the whole message is in, it is put in net_message.
+================
+*/
+static qboolean ReceiveCompressed (qsocket_t *sock, int length, qboolean eom)
+{
+	if (!LZ_Decompress (sock->receiveMessage, length, &sock->uncompressRead,
+			sock->uncompressMessage, NET_MAXMESSAGE, &sock->uncompressLength)
+		|| (eom && sock->uncompressRead != length))
+	{
+		Con_Printf ("Bad compressed message from %s\n", sock->address);
+		sock->uncompressRead = sock->uncompressLength = 0;
+		return false;
+	}
+
+	if (eom)
+	{
+		SZ_Clear (&net_message);
+		SZ_Write (&net_message, sock->uncompressMessage, sock->uncompressLength);
+		sock->uncompressRead = sock->uncompressLength = 0;
+	}
+	return true;
+}
+
+static int SendWindow (qsocket_t *sock);
+
 int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 {
 	unsigned int	packetLen;
@@ -147,12 +321,40 @@ int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 		Sys_Error("SendMessage: called with canSend == false\n");
 #endif
 
-	Q_memcpy(sock->sendMessage, data->data, data->cursize);
-	sock->sendMessageLength = data->cursize;
+	sock->sendCompressed = false;
+	if (sock->compress && data->cursize >= NET_COMPRESSMIN)
+	{
+		sock->sendMessageLength = LZ_Compress (data->data, data->cursize, sock->sendMessage, data->cursize - 1);
+		if (sock->sendMessageLength > 0)
+		{
+			sock->sendCompressed = true;
+			compressedMessages++;
+			compressedBytesIn += data->cursize;
+			compressedBytesOut += sock->sendMessageLength;
+		}
+	}
+	if (!sock->sendCompressed)
+	{
+		Q_memcpy(sock->sendMessage, data->data, data->cursize);
+		sock->sendMessageLength = data->cursize;
+	}
 
-	if (data->cursize <= MAX_DATAGRAM)
+	if (sock->windowed)
 	{
-		dataLen = data->cursize;
+		sock->sendFirstSequence = sock->sendSequence;
+		sock->sendFragments = q_max(1, (sock->sendMessageLength + NET_FRAGMENTSIZE - 1) / NET_FRAGMENTSIZE);
+		sock->sendSequence += sock->sendFragments;
+		sock->sendAcked = 0;
+		sock->sendLastAcked = -1;
+		memset (sock->fragmentSends, 0, sizeof(sock->fragmentSends));
+		memset (sock->fragmentAcked, 0, sizeof(sock->fragmentAcked));
+		sock->canSend = false;
+		return SendWindow (sock);
+	}
+
+	if (sock->sendMessageLength <= MAX_DATAGRAM)
+	{
+		dataLen = sock->sendMessageLength;
 		eom = NETFLAG_EOM;
 	}
 	else
@@ -162,7 +364,7 @@ int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 	}
 	packetLen = NET_HEADERSIZE + dataLen;
 
-	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom));
+	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom | (sock->sendCompressed ? NETFLAG_COMPRESSED : 0)));
 	packetBuffer.sequence = BigLong(sock->sendSequence++);
 	Q_memcpy (packetBuffer.data, sock->sendMessage, dataLen);
 
@@ -195,7 +397,7 @@ static int SendMessageNext (qsocket_t *sock)
 	}
 	packetLen = NET_HEADERSIZE + dataLen;
 
-	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom));
+	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom | (sock->sendCompressed ? NETFLAG_COMPRESSED : 0)));
 	packetBuffer.sequence = BigLong(sock->sendSequence++);
 	Q_memcpy (packetBuffer.data, sock->sendMessage, dataLen);
 
@@ -228,7 +430,7 @@ static int ReSendMessage (qsocket_t *sock)
 	}
 	packetLen = NET_HEADERSIZE + dataLen;
 
-	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom));
+	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom | (sock->sendCompressed ? NETFLAG_COMPRESSED : 0)));
 	packetBuffer.sequence = BigLong(sock->sendSequence - 1);
 	Q_memcpy (packetBuffer.data, sock->sendMessage, dataLen);
 
@@ -243,8 +445,209 @@ static int ReSendMessage (qsocket_t *sock)
 }
 
 
+/*
+=============================================================================
+
+SLIDING WINDOW
+
+=============================================================================
+*/
+
+COMPILE_TIME_ASSERT(net_window, NET_MAXFRAGMENTS <= NET_WINDOWSIZE);
+
+static int SendFragment (qsocket_t *sock, int n)
+{
+	unsigned int	packetLen;
+	unsigned int	dataLen;
+	unsigned int	eom;
+
+	dataLen = q_min(NET_FRAGMENTSIZE, sock->sendMessageLength - n * NET_FRAGMENTSIZE);
+	eom = (n == sock->sendFragments - 1) ? NETFLAG_EOM : 0;
+	packetLen = NET_HEADERSIZE + dataLen;
+
+	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom | (sock->sendCompressed ? NETFLAG_COMPRESSED : 0)));
+	packetBuffer.sequence = BigLong(sock->sendFirstSequence + n);
+	Q_memcpy (packetBuffer.data, sock->sendMessage + n * NET_FRAGMENTSIZE, dataLen);
+
+	if (sfunc.Write (sock->socket, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
+		return -1;
+
+	if (sock->fragmentSends[n]++)
+	{
+		sock->retransmits++;
+		packetsReSent++;
+	}
+	else
+		packetsSent++;
+	sock->fragmentTime[n] = net_time;
+	sock->lastSendTime = net_time;
+	return 1;
+}
+
+/*
+================
+SendWindow
+
+Sends the fragments in the window that haven't gone out yet, the ones that
+timed out, and holes that later fragments have been acked past
+================
+*/
+static int SendWindow (qsocket_t *sock)
+{
+	int			n, end;
+	qboolean	timedout = false, hole;
+
+	end = q_min(sock->sendFragments, sock->sendAcked + NET_WINDOWSIZE);
+	for (n = sock->sendAcked; n < end; n++)
+	{
+		if (sock->fragmentAcked[n])
+			continue;
+		if (sock->fragmentSends[n])
+		{
+			hole = (n < sock->sendLastAcked && sock->rttSamples && sock->fragmentSends[n] == 1
+				&& net_time - sock->fragmentTime[n] > sock->rtt);
+			if (!hole && net_time - sock->fragmentTime[n] <= sock->rto)
+				continue;
+			if (!hole)
+				timedout = true;
+		}
+		if (SendFragment (sock, n) == -1)
+			return -1;
+	}
+
+	if (timedout)
+		sock->rto = q_min(sock->rto * 2, NET_MAXRTO);
+	return 1;
+}
+
+static void UpdateRTT (qsocket_t *sock, double sample)
+{
+	if (!sock->rttSamples++)
+	{
+		sock->rtt = sample;
+		sock->rttvar = sample / 2;
+	}
+	else
+	{
+		sock->rttvar = 0.75 * sock->rttvar + 0.25 * fabs(sock->rtt - sample);
+		sock->rtt = 0.875 * sock->rtt + 0.125 * sample;
+	}
+	sock->rto = CLAMP(NET_MINRTO, sock->rtt + 4 * sock->rttvar, NET_MAXRTO);
+}
+
+static void ReceiveWindowAck (qsocket_t *sock, unsigned int sequence, unsigned long long mask)
+{
+	unsigned int	d;
+	int				n;
+
+	if (sock->canSend || sequence - sock->sendFirstSequence > (unsigned int)sock->sendFragments)
+	{
+		Con_DPrintf("Stale ACK received\n");
+		return;
+	}
+
+	for (n = sock->sendAcked; n < sock->sendFragments; n++)
+	{
+		if (sock->fragmentAcked[n])
+			continue;
+		d = sock->sendFirstSequence + n - sequence;	// below the cumulative ack when negative
+		if ((int)d >= 0 && !(d < NET_WINDOWSIZE && (mask & (1ull << d))))
+			continue;
+		sock->fragmentAcked[n] = true;
+		sock->sendLastAcked = q_max(sock->sendLastAcked, n);
+		if (sock->fragmentSends[n] == 1)	// a resent fragment's ack could be for either copy
+			UpdateRTT (sock, net_time - sock->fragmentTime[n]);
+	}
+
+	while (sock->sendAcked < sock->sendFragments && sock->fragmentAcked[sock->sendAcked])
+		sock->sendAcked++;
+
+	if (sock->sendAcked == sock->sendFragments)
+	{
+		sock->ackSequence = sock->sendSequence;
+		sock->sendMessageLength = 0;
+		sock->canSend = true;
+	}
+	else
+		SendWindow (sock);
+}
+
+/*
+================
+ReceiveFragment
+
+Puts a reliable fragment where it goes in receiveMessage and acks what has
+arrived. Returns 1 once the message is whole, in net_message, and -1 if it
+can't be decompressed.
+================
+*/
+static int ReceiveFragment (qsocket_t *sock, unsigned int sequence, unsigned int flags, int length, struct qsockaddr *addr)
+{
+	unsigned int	n;
+	int				offset;
+	qboolean		complete = false, arrived = false;
+
+	n = sequence - sock->receiveSequence;
+	if (n >= NET_WINDOWSIZE || (sock->receiveWindow & (1ull << n)))
+		receivedDuplicateCount++;	// or too far ahead, which it can't be
+	else
+	{
+		offset = sock->receiveMessageLength + n * NET_FRAGMENTSIZE;
+		if ((length != NET_FRAGMENTSIZE && !(flags & NETFLAG_EOM)) || offset + length > NET_MAXMESSAGE)
+		{
+			Con_DPrintf("Bad fragment received\n");
+			return 0;
+		}
+		Q_memcpy(sock->receiveMessage + offset, packetBuffer.data, length);
+		sock->receiveWindow |= 1ull << n;
+		if (flags & NETFLAG_EOM)
+		{
+			sock->receiveEndSequence = sequence + 1;
+			sock->receiveEndLength = offset + length;
+		}
+
+		while (sock->receiveWindow & 1)
+		{
+			arrived = true;
+			sock->receiveWindow >>= 1;
+			sock->receiveSequence++;
+			if (sock->receiveSequence == sock->receiveEndSequence)
+			{
+				complete = true;
+				break;
+			}
+			sock->receiveMessageLength += NET_FRAGMENTSIZE;
+		}
+	}
+
+	packetBuffer.length = BigLong((NET_HEADERSIZE + 8) | NETFLAG_ACK);
+	packetBuffer.sequence = BigLong(sock->receiveSequence);
+	((unsigned int *)packetBuffer.data)[0] = BigLong((unsigned int)sock->receiveWindow);
+	((unsigned int *)packetBuffer.data)[1] = BigLong((unsigned int)(sock->receiveWindow >> 32));
+	sfunc.Write (sock->socket, (byte *)&packetBuffer, NET_HEADERSIZE + 8, addr);
+
+	if (arrived && (flags & NETFLAG_COMPRESSED)
+		&& !ReceiveCompressed (sock, complete ? sock->receiveEndLength : sock->receiveMessageLength, complete))
+		return -1;
+
+	if (!complete)
+		return 0;
+
+	if (!(flags & NETFLAG_COMPRESSED))
+	{
+		SZ_Clear(&net_message);
+		SZ_Write(&net_message, sock->receiveMessage, sock->receiveEndLength);
+	}
+	sock->receiveMessageLength = 0;
+	sock->receiveWindow = 0;
+	sock->receiveEndSequence = 0;
+	return 1;
+}
+
 qboolean Datagram_CanSendMessage (qsocket_t *sock)
 {
+	if (sock->windowed && !sock->canSend)
+		SendWindow (sock);
 	if (sock->sendNext)
 		SendMessageNext (sock);
 
@@ -293,7 +696,12 @@ int	Datagram_GetMessage (qsocket_t *sock)
 	unsigned int	sequence;
 	unsigned int	count;
 
-	if (!sock->canSend)
+	if (sock->windowed)
+	{
+		if (!sock->canSend)
+			SendWindow (sock);
+	}
+	else if (!sock->canSend)
 		if ((net_time - sock->lastSendTime) > 1.0)
 			ReSendMessage (sock);
 
@@ -363,6 +771,26 @@ int	Datagram_GetMessage (qsocket_t *sock)
 			break;
 		}
 
+		if ((flags & NETFLAG_ACK) && sock->windowed)
+		{
+			if (length < NET_HEADERSIZE + 8)
+			{
+				shortPacketCount++;
+				continue;
+			}
+			ReceiveWindowAck (sock, sequence, (unsigned int)BigLong(((unsigned int *)packetBuffer.data)[0])
+				| (unsigned long long)(unsigned int)BigLong(((unsigned int *)packetBuffer.data)[1]) << 32);
+			continue;
+		}
+
+		if ((flags & NETFLAG_DATA) && sock->windowed)
+		{
+			ret = ReceiveFragment (sock, sequence, flags, length - NET_HEADERSIZE, &readaddr);
+			if (ret)
+				break;
+			continue;
+		}
+
 		if (flags & NETFLAG_ACK)
 		{
 			if (sequence != (sock->sendSequence - 1))
@@ -410,6 +838,31 @@ int	Datagram_GetMessage (qsocket_t *sock)
 
 			length -= NET_HEADERSIZE;
 
+			if (flags & NETFLAG_COMPRESSED)
+			{
+				if (sock->receiveMessageLength + length > NET_MAXMESSAGE)
+				{
+					Con_Printf ("Compressed message from %s is too long\n", sock->address);
+					sock->receiveMessageLength = 0;
+					sock->uncompressRead = sock->uncompressLength = 0;
+					ret = -1;
+					break;
+				}
+				Q_memcpy(sock->receiveMessage + sock->receiveMessageLength, packetBuffer.data, length);
+				sock->receiveMessageLength += length;
+				if (!ReceiveCompressed (sock, sock->receiveMessageLength, (flags & NETFLAG_EOM) != 0))
+				{
+					ret = -1;
+					break;
+				}
+				if (!(flags & NETFLAG_EOM))
+					continue;
+				sock->receiveMessageLength = 0;
+
+				ret = 1;
+				break;
+			}
+
 			if (flags & NETFLAG_EOM)
 			{
 				SZ_Clear(&net_message);
@@ -439,6 +892,14 @@ static void PrintStats(qsocket_t *s)
 	Con_Printf("canSend = %4u   \n", s->canSend);
 	Con_Printf("sendSeq = %4u   ", s->sendSequence);
 	Con_Printf("recvSeq = %4u   \n", s->receiveSequence);
+	Con_Printf("windowed = %4u   ", s->windowed);
+	Con_Printf("compress = %4u   \n", s->compress);
+	if (s->windowed)
+	{
+		Con_Printf("rtt = %.1f ms   rttvar = %.1f ms   rto = %.1f ms\n", s->rtt * 1000.0, s->rttvar * 1000.0, s->rto * 1000.0);
+		Con_Printf("retransmits = %i   ", s->retransmits);
+		Con_Printf("inFlight = %i/%i\n", s->canSend ? 0 : s->sendFragments - s->sendAcked, s->canSend ? 0 : s->sendFragments);
+	}
 	Con_Printf("\n");
 }
 
@@ -458,6 +919,10 @@ static void NET_Stats_f (void)
 		Con_Printf("receivedDuplicateCount     = %i\n", receivedDuplicateCount);
 		Con_Printf("shortPacketCount           = %i\n", shortPacketCount);
 		Con_Printf("droppedDatagrams           = %i\n", droppedDatagrams);
+		Con_Printf("compressedMessages         = %i\n", compressedMessages);
+		Con_Printf("compressedBytes            = %i -> %i\n", compressedBytesIn, compressedBytesOut);
+		Con_Printf("lanReadCalls               = %i (%i packets)\n", lanReadCalls, lanPacketsRead);
+		Con_Printf("lanWriteCalls              = %i (%i packets)\n", lanWriteCalls, lanPacketsWritten);
 	}
 	else if (Q_strcmp(Cmd_Argv(1), "*") == 0)
 	{
@@ -491,6 +956,296 @@ static void NET_Stats_f (void)
 }
 
 
+/*
+=============================================================================
+
+SIGNON BENCHMARK
+
+net_signonbench runs the reliable exchange of a sign-on between two lan
+sockets on this machine, through the same code a real connection uses.
+While it runs, the driver's writes go through a queue that holds each
+packet until it has gone out at the given bandwidth and then travelled for
+half the round trip, so loopback behaves like a slow link.
+
+=============================================================================
+*/
+
+#define LAG_PACKETS		256
+
+typedef struct
+{
+	double		time;		// when it arrives
+	sys_socket_t	socket;
+	struct qsockaddr	addr;
+	int			length;
+	byte		*data;
+} lagpacket_t;
+
+static lagpacket_t	lagPackets[LAG_PACKETS];
+static int			lagCount;
+static double		lagLatency, lagBandwidth;
+static sys_socket_t	lagSockets[2];
+static double		lagLinkFree[2];		// each way, busy sending until then
+static int			(*lagWrite) (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr);
+
+static int Lag_Write (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr)
+{
+	lagpacket_t	*p;
+	int			way;
+
+	if (lagCount == LAG_PACKETS)
+		return 0;	// like a full send buffer
+
+	way = (socketid == lagSockets[1]);
+	lagLinkFree[way] = q_max(lagLinkFree[way], Sys_DoubleTime ()) + len / lagBandwidth;
+
+	p = &lagPackets[lagCount++];
+	p->time = lagLinkFree[way] + lagLatency;
+	p->socket = socketid;
+	p->addr = *addr;
+	p->length = len;
+	p->data = (byte *) malloc (len);
+	Q_memcpy (p->data, buf, len);
+	return len;
+}
+
+/*
+================
+Lag_Flush
+
+Sends the packets that have arrived, or drops them all. Each way's packets
+are queued in the order they arrive, so they stay in order.
+================
+*/
+static void Lag_Flush (qboolean drop)
+{
+	double	now = Sys_DoubleTime ();
+	int		i, j;
+
+	for (i = j = 0; i < lagCount; i++)
+	{
+		if (drop || lagPackets[i].time <= now)
+		{
+			if (!drop)
+				lagWrite (lagPackets[i].socket, lagPackets[i].data, lagPackets[i].length, &lagPackets[i].addr);
+			free (lagPackets[i].data);
+			continue;
+		}
+		lagPackets[j++] = lagPackets[i];
+	}
+	lagCount = j;
+}
+
+static void Bench_InitSocket (qsocket_t *sock, int landriver, sys_socket_t socketid, struct qsockaddr *peer, qboolean windowed, qboolean compress)
+{
+	memset (sock, 0, sizeof(*sock));
+	sock->landriver = landriver;
+	sock->socket = socketid;
+	sock->canSend = true;
+	sock->rto = NET_MAXRTO;
+	sock->windowed = windowed;
+	sock->compress = compress;
+	sock->addr = *peer;
+	sock->connecttime = sock->lastMessageTime = net_time;
+	q_strlcpy (sock->address, sfunc.AddrToString (peer), sizeof(sock->address));
+}
+
+/*
+================
+Bench_Step
+
+Lets due packets arrive and reads sock. -1 on error or timeout.
+================
+*/
+static int Bench_Step (qsocket_t *sock, double timeout)
+{
+	Sys_Sleep (1);
+	Lag_Flush (false);
+	if (SetNetTime () > timeout)
+		return -1;
+	return Datagram_GetMessage (sock);
+}
+
+/*
+================
+Bench_Send
+
+Sends data from one socket to the other, unreliably if type is 2, and
+waits until it has arrived intact
+================
+*/
+static qboolean Bench_Send (qsocket_t *from, qsocket_t *to, sizebuf_t *data, int type, double timeout)
+{
+	int	ret;
+
+	if (type == 2)
+		ret = Datagram_SendUnreliableMessage (from, data);
+	else
+	{
+		// its previous message has to be acked first
+		while (!Datagram_CanSendMessage (from))
+			if (Bench_Step (from, timeout) == -1)
+				return false;
+		ret = Datagram_SendMessage (from, data);
+	}
+	if (ret == -1)
+		return false;
+
+	while ((ret = Bench_Step (to, timeout)) != type)
+	{
+		if (ret == -1 || (type == 1 && Datagram_GetMessage (from) == -1))
+			return false;
+		if (type == 1)
+			Datagram_CanSendMessage (from);
+	}
+	return net_message.cursize == data->cursize && !memcmp (net_message.data, data->data, data->cursize);
+}
+
+/*
+================
+Bench_ClientCmd
+================
+*/
+static qboolean Bench_ClientCmd (qsocket_t *bench, sizebuf_t *buf, const char *cmd, double timeout)
+{
+	SZ_Clear (buf);
+	MSG_WriteByte (buf, clc_stringcmd);
+	MSG_WriteString (buf, cmd);
+	return Bench_Send (&bench[1], &bench[0], buf, 1, timeout);
+}
+
+/*
+================
+NET_SignonBench_f
+
+Times the connect request and accept, then serverinfo, prespawn, spawn and
+begin with the running map's serverinfo and signon messages, for both
+reliable channels with and without compression. The spawn reply stands in
+for the client state the server sends there.
+================
+*/
+static void NET_SignonBench_f (void)
+{
+	static byte	buffers[5][NET_MAXMESSAGE];
+	static byte	packed[NET_MAXMESSAGE];
+	static qsocket_t	bench[2];	// server, client
+	sizebuf_t	msg[5];		// serverinfo, prespawn, spawn reply, request, accept
+	struct qsockaddr	addr[2];
+	double		rtt, bandwidth, start, timeout, times[2][2];	// [windowed][compressed]
+	int			packets[2][2];
+	int			i, w, c, landriver;
+	qboolean	ok;
+
+	if (!sv.active)
+	{
+		Con_Printf ("no server running\n");
+		return;
+	}
+
+	rtt = (Cmd_Argc() > 1) ? Q_atof(Cmd_Argv(1)) / 1000.0 : 0.2;
+	bandwidth = (Cmd_Argc() > 2) ? Q_atof(Cmd_Argv(2)) * 1024.0 : 256.0 * 1024.0;
+	if (rtt < 0 || bandwidth <= 0)
+	{
+		Con_Printf ("usage: net_signonbench [rtt ms] [KB/s]\n");
+		return;
+	}
+
+	for (landriver = 0; landriver < net_numlandrivers; landriver++)
+		if (net_landrivers[landriver].initialized)
+			break;
+	if (landriver == net_numlandrivers)
+	{
+		Con_Printf ("no lan driver\n");
+		return;
+	}
+
+	for (i = 0; i < 5; i++)
+	{
+		memset (&msg[i], 0, sizeof(msg[i]));
+		msg[i].data = buffers[i];
+		msg[i].maxsize = NET_MAXMESSAGE;
+		msg[i].allowoverflow = true;
+	}
+	SV_WriteServerinfo (&msg[0], EDICT_NUM(1));
+	SZ_Write (&msg[1], sv.signon.data, sv.signon.cursize);
+	MSG_WriteByte (&msg[1], svc_signonnum);
+	MSG_WriteByte (&msg[1], 2);
+	MSG_WriteByte (&msg[2], svc_signonnum);
+	MSG_WriteByte (&msg[2], 3);
+	MSG_WriteString (&msg[4], "accept");
+	for (i = 0; i < 2; i++)
+	{
+		if (msg[i].overflowed)
+		{
+			Con_Printf ("%s: overflowed\n", i ? "prespawn" : "serverinfo");
+			return;
+		}
+		Con_Printf ("%-10s %6i -> %6i bytes compressed\n", i ? "prespawn" : "serverinfo",
+			msg[i].cursize, LZ_Compress (msg[i].data, msg[i].cursize, packed, NET_MAXMESSAGE));
+	}
+
+	lagLatency = rtt / 2;
+	lagBandwidth = bandwidth;
+	lagWrite = net_landrivers[landriver].Write;
+	net_landrivers[landriver].Write = Lag_Write;
+
+	for (w = 0, ok = true; w < 2 && ok; w++)
+	{
+		for (c = 0; c < 2 && ok; c++)
+		{
+			lagSockets[0] = net_landrivers[landriver].Open_Socket (0);
+			lagSockets[1] = net_landrivers[landriver].Open_Socket (0);
+			ok = (lagSockets[0] != INVALID_SOCKET && lagSockets[1] != INVALID_SOCKET);
+			for (i = 0; i < 2 && ok; i++)
+				ok = (net_landrivers[landriver].GetSocketAddr (lagSockets[i], &addr[i]) == 0);
+			if (!ok)
+				Con_Printf ("couldn't open sockets\n");
+
+			if (ok)
+			{
+				Bench_InitSocket (&bench[0], landriver, lagSockets[0], &addr[1], w, c);
+				Bench_InitSocket (&bench[1], landriver, lagSockets[1], &addr[0], w, c);
+				lagLinkFree[0] = lagLinkFree[1] = 0;
+				packets[w][c] = packetsSent + packetsReSent;
+				start = SetNetTime ();
+				timeout = start + 30.0;
+
+				SZ_Clear (&msg[3]);
+				MSG_WriteString (&msg[3], "connect");
+				ok = Bench_Send (&bench[1], &bench[0], &msg[3], 2, timeout)
+					&& Bench_Send (&bench[0], &bench[1], &msg[4], 2, timeout)
+					&& Bench_Send (&bench[0], &bench[1], &msg[0], 1, timeout)
+					&& Bench_ClientCmd (bench, &msg[3], "prespawn", timeout)
+					&& Bench_Send (&bench[0], &bench[1], &msg[1], 1, timeout)
+					&& Bench_ClientCmd (bench, &msg[3], "spawn", timeout)
+					&& Bench_Send (&bench[0], &bench[1], &msg[2], 1, timeout)
+					&& Bench_ClientCmd (bench, &msg[3], "begin", timeout);
+
+				times[w][c] = SetNetTime () - start;
+				packets[w][c] = packetsSent + packetsReSent - packets[w][c];
+				if (!ok)
+					Con_Printf ("%s%s sign-on failed\n", w ? "windowed" : "stop and wait", c ? " compressed" : "");
+			}
+
+			Lag_Flush (true);
+			for (i = 0; i < 2; i++)
+				if (lagSockets[i] != INVALID_SOCKET)
+					net_landrivers[landriver].Close_Socket (lagSockets[i]);
+		}
+	}
+
+	net_landrivers[landriver].Write = lagWrite;
+	if (!ok)
+		return;
+
+	Con_Printf ("%.0f ms round trip, %.0f KB/s\n", rtt * 1000.0, bandwidth / 1024.0);
+	Con_Printf ("%-17s%20s%20s\n", "connect to spawn:", "uncompressed", "compressed");
+	for (w = 0; w < 2; w++)
+		Con_Printf ("  %-13s  %7.0f ms %4i pkts  %7.0f ms %4i pkts\n", w ? "windowed" : "stop and wait",
+			times[w][0] * 1000.0, packets[w][0], times[w][1] * 1000.0, packets[w][1]);
+}
+
+
 // recognize ip:port (based on ProQuake)
 static const char *Strip_Port (const char *host)
 {
@@ -791,6 +1546,8 @@ int Datagram_Init (void)
 	myDriverLevel = net_driverlevel;
 
 	Cmd_AddCommand ("net_stats", NET_Stats_f);
+	Cmd_AddCommand ("net_signonbench", NET_SignonBench_f);
+	Cvar_RegisterVariable (&net_compress);
 
 	if (safemode || COM_CheckParm("-nolan"))
 		return -1;
@@ -867,6 +1624,8 @@ static qsocket_t *_Datagram_CheckNewConnections (void)
 	int			command;
 	int			control;
 	int			ret;
+	int			magic;
+	qboolean	windowed, compress;
 
 	acceptsock = dfunc.CheckNewConnections();
 	if (acceptsock == INVALID_SOCKET)
@@ -997,6 +1756,19 @@ static qsocket_t *_Datagram_CheckNewConnections (void)
 		return NULL;
 	}
 
+	// newer clients ask for the windowed reliable channel and compression
+	windowed = compress = false;
+	while (1)
+	{
+		magic = MSG_ReadLong();
+		if (msg_badread)
+			break;
+		if (magic == NET_WINDOWMAGIC)
+			windowed = true;
+		else if (magic == NET_COMPRESSMAGIC)
+			compress = (net_compress.value != 0);
+	}
+
 #ifdef BAN_TEST
 	// check for a ban
 	if (clientaddr.qsa_family == AF_INET)
@@ -1036,6 +1808,10 @@ static qsocket_t *_Datagram_CheckNewConnections (void)
 				MSG_WriteByte(&net_message, CCREP_ACCEPT);
 				dfunc.GetSocketAddr(s->socket, &newaddr);
 				MSG_WriteLong(&net_message, dfunc.GetSocketPort(&newaddr));
+				if (s->windowed)
+					MSG_WriteLong(&net_message, NET_WINDOWMAGIC);
+				if (s->compress)
+					MSG_WriteLong(&net_message, NET_COMPRESSMAGIC);
 				*((int *)net_message.data) = BigLong(NETFLAG_CTL | (net_message.cursize & NETFLAG_LENGTH_MASK));
 				dfunc.Write (acceptsock, net_message.data, net_message.cursize, &clientaddr);
 				SZ_Clear(&net_message);
@@ -1084,6 +1860,8 @@ static qsocket_t *_Datagram_CheckNewConnections (void)
 	sock->socket = newsock;
 	sock->landriver = net_landriverlevel;
 	sock->addr = clientaddr;
+	sock->windowed = windowed;
+	sock->compress = compress;
 	Q_strcpy(sock->address, dfunc.AddrToString(&clientaddr));
 
 	// send him back the info about the server connection he has been allocated
@@ -1093,6 +1871,10 @@ static qsocket_t *_Datagram_CheckNewConnections (void)
 	MSG_WriteByte(&net_message, CCREP_ACCEPT);
 	dfunc.GetSocketAddr(newsock, &newaddr);
 	MSG_WriteLong(&net_message, dfunc.GetSocketPort(&newaddr));
+	if (windowed)
+		MSG_WriteLong(&net_message, NET_WINDOWMAGIC);
+	if (compress)
+		MSG_WriteLong(&net_message, NET_COMPRESSMAGIC);
 //	MSG_WriteString(&net_message, dfunc.AddrToString(&newaddr));
 	*((int *)net_message.data) = BigLong(NETFLAG_CTL | (net_message.cursize & NETFLAG_LENGTH_MASK));
 	dfunc.Write (acceptsock, net_message.data, net_message.cursize, &clientaddr);
@@ -1239,6 +2021,7 @@ static qsocket_t *_Datagram_Connect (const char *host)
 	sys_socket_t		newsock;
 	int			ret;
 	int			reps;
+	int			magic;
 	double		start_time;
 	int			control;
 	const char		*reason;
@@ -1277,6 +2060,9 @@ static qsocket_t *_Datagram_Connect (const char *host)
 		MSG_WriteByte(&net_message, CCREQ_CONNECT);
 		MSG_WriteString(&net_message, "QUAKE");
 		MSG_WriteByte(&net_message, NET_PROTOCOL_VERSION);
+		MSG_WriteLong(&net_message, NET_WINDOWMAGIC);
+		if (net_compress.value)
+			MSG_WriteLong(&net_message, NET_COMPRESSMAGIC);
 		*((int *)net_message.data) = BigLong(NETFLAG_CTL | (net_message.cursize & NETFLAG_LENGTH_MASK));
 		dfunc.Write (newsock, net_message.data, net_message.cursize, &sendaddr);
 		SZ_Clear(&net_message);
@@ -1364,6 +2150,17 @@ static qsocket_t *_Datagram_Connect (const char *host)
 	{
 		Q_memcpy(&sock->addr, &sendaddr, sizeof(struct qsockaddr));
 		dfunc.SetSocketPort (&sock->addr, MSG_ReadLong());
+		// older servers don't send the magics and stay stop-and-wait
+		while (1)
+		{
+			magic = MSG_ReadLong();
+			if (msg_badread)
+				break;
+			if (magic == NET_WINDOWMAGIC)
+				sock->windowed = true;
+			else if (magic == NET_COMPRESSMAGIC)
+				sock->compress = true;
+		}
 	}
 	else
 	{
@@ -59,6 +59,11 @@ int		messagesReceived		= 0;
 int		unreliableMessagesSent		= 0;
 int		unreliableMessagesReceived	= 0;
 
+int		lanReadCalls			= 0;
+int		lanPacketsRead			= 0;
+int		lanWriteCalls			= 0;
+int		lanPacketsWritten		= 0;
+
 static	cvar_t	net_messagetimeout = {"net_messagetimeout","300",CVAR_NONE};
 cvar_t	hostname = {"hostname", "UNNAMED", CVAR_NONE};
 
@@ -120,6 +125,18 @@ qsocket_t *NET_NewQSocket (void)
 	sock->receiveSequence = 0;
 	sock->unreliableReceiveSequence = 0;
 	sock->receiveMessageLength = 0;
+	sock->windowed = false;
+	sock->sendFragments = 0;
+	sock->rtt = sock->rttvar = 0;
+	sock->rto = NET_MAXRTO;
+	sock->rttSamples = 0;
+	sock->retransmits = 0;
+	sock->receiveWindow = 0;
+	sock->receiveEndSequence = 0;
+	sock->compress = false;
+	sock->sendCompressed = false;
+	sock->uncompressRead = 0;
+	sock->uncompressLength = 0;
 
 	return sock;
 }
@@ -863,6 +880,33 @@ void NET_Shutdown (void)
 }
 
 
+/*
+====================
+NET_BeginBatch
+
+Lan drivers that can may hold back the packets written until NET_EndBatch
+and send them with fewer system calls
+====================
+*/
+void NET_BeginBatch (void)
+{
+	int	i;
+
+	for (i = 0; i < net_numlandrivers; i++)
+		if (net_landrivers[i].initialized && net_landrivers[i].Batch)
+			net_landrivers[i].Batch (true);
+}
+
+void NET_EndBatch (void)
+{
+	int	i;
+
+	for (i = 0; i < net_numlandrivers; i++)
+		if (net_landrivers[i].initialized && net_landrivers[i].Batch)
+			net_landrivers[i].Batch (false);
+}
+
+
 static PollProcedure *pollProcedureList = NULL;
 
 void NET_Poll(void)
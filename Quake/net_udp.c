@@ -20,6 +20,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 */
 
+#if defined(__linux__)
+#define UDP_MMSG	/* batched reads and writes with recvmmsg and sendmmsg */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
+
 #include "q_stdinc.h"
 #include "arch_def.h"
 #include "net_sys.h"
@@ -35,6 +42,54 @@ static in_addr_t	myAddr;
 
 #include "net_udp.h"
 
+#ifdef UDP_MMSG
+/*
+Reads fill a queue for the socket with one recvmmsg and hand the packets
+out one at a time. The Datagram code reads a socket until it is empty or a
+message is complete, so only a few queues are ever in use; a socket that
+finds none free reads a packet at a time.
+
+Writes made during a batch are kept in order and go out with one sendmmsg
+per socket when it ends. Each client has a socket of its own, so that is
+one system call per client instead of one per packet. A queued write has
+sent nothing yet, so it returns 0 like a write that would block; a socket
+whose packet then fails to go out gets -1 from its next write.
+*/
+#define UDP_MMSGPACKETS		16
+#define UDP_MMSGQUEUES		4
+#define UDP_MMSGWRITES		64
+#define UDP_MMSGWRITEBYTES	0x40000
+
+typedef struct
+{
+	sys_socket_t	socket;
+	int		count, next;
+	int		length[UDP_MMSGPACKETS];
+	struct qsockaddr	addr[UDP_MMSGPACKETS];
+	byte		data[UDP_MMSGPACKETS][NET_DATAGRAMSIZE];
+} udpqueue_t;
+
+typedef struct
+{
+	sys_socket_t	socket;
+	int		offset, length;
+	struct qsockaddr	addr;
+} udpwrite_t;
+
+static udpqueue_t	udp_queues[UDP_MMSGQUEUES];
+
+static qboolean		udp_batching;
+static udpwrite_t	udp_writes[UDP_MMSGWRITES];
+static int		udp_numwrites;
+static byte		udp_writebuf[UDP_MMSGWRITEBYTES];
+static int		udp_writebytes;
+static sys_socket_t	udp_writeerrors[UDP_MMSGWRITES];	// sockets with a failed batched write
+static int		udp_numwriteerrors;
+
+static void UDP_FlushWrites (void);
+static qboolean UDP_TakeWriteError (sys_socket_t socketid);
+#endif
+
 //=============================================================================
 
 sys_socket_t UDP_Init (void)
@@ -101,6 +156,9 @@ sys_socket_t UDP_Init (void)
 
 void UDP_Shutdown (void)
 {
+#ifdef UDP_MMSG
+	udp_batching = false;
+#endif
 	UDP_Listen (false);
 	UDP_CloseSocket (net_controlsocket);
 }
@@ -163,6 +221,17 @@ ErrorReturn:
 
 int UDP_CloseSocket (sys_socket_t socketid)
 {
+#ifdef UDP_MMSG
+	int	i;
+
+	// the descriptor can come back for a new socket
+	if (udp_numwrites)
+		UDP_FlushWrites ();
+	for (i = 0; i < UDP_MMSGQUEUES; i++)
+		if (udp_queues[i].count && udp_queues[i].socket == socketid)
+			udp_queues[i].count = udp_queues[i].next = 0;
+	UDP_TakeWriteError (socketid);
+#endif
 	if (socketid == net_broadcastsocket)
 		net_broadcastsocket = 0;
 	return closesocket (socketid);
@@ -239,10 +308,18 @@ sys_socket_t UDP_CheckNewConnections (void)
 	struct sockaddr_in	from;
 	socklen_t	fromlen;
 	char		buff[1];
+#ifdef UDP_MMSG
+	int		i;
+#endif
 
 	if (net_acceptsocket == INVALID_SOCKET)
 		return INVALID_SOCKET;
 
+#ifdef UDP_MMSG
+	for (i = 0; i < UDP_MMSGQUEUES; i++)
+		if (udp_queues[i].next < udp_queues[i].count && udp_queues[i].socket == net_acceptsocket)
+			return net_acceptsocket;
+#endif
 	if (ioctl (net_acceptsocket, FIONREAD, &available) == -1)
 	{
 		int err = SOCKETERRNO;
@@ -257,11 +334,94 @@ sys_socket_t UDP_CheckNewConnections (void)
 
 //=============================================================================
 
+#ifdef UDP_MMSG
+/*
+============
+UDP_ReadQueue
+
+Returns the queue holding packets for the socket, refilling a free one if
+there is none. NULL means read the socket directly.
+============
+*/
+static udpqueue_t *UDP_ReadQueue (sys_socket_t socketid, int *ret)
+{
+	struct mmsghdr	msgs[UDP_MMSGPACKETS];
+	struct iovec	iov[UDP_MMSGPACKETS];
+	udpqueue_t		*q, *empty = NULL;
+	int				i, count;
+
+	*ret = 0;
+	for (i = 0, q = udp_queues; i < UDP_MMSGQUEUES; i++, q++)
+	{
+		if (q->next < q->count)
+		{
+			if (q->socket == socketid)
+				return q;
+		}
+		else if (!empty)
+			empty = q;
+	}
+	if (!empty)
+		return NULL;
+
+	q = empty;
+	memset (msgs, 0, sizeof(msgs));
+	for (i = 0; i < UDP_MMSGPACKETS; i++)
+	{
+		iov[i].iov_base = q->data[i];
+		iov[i].iov_len = NET_DATAGRAMSIZE;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &q->addr[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(struct qsockaddr);
+	}
+
+	lanReadCalls++;
+	count = recvmmsg (socketid, msgs, UDP_MMSGPACKETS, MSG_DONTWAIT, NULL);
+	if (count == SOCKET_ERROR)
+	{
+		int err = SOCKETERRNO;
+		if (err != NET_EWOULDBLOCK && err != NET_ECONNREFUSED)
+		{
+			Con_SafePrintf ("UDP_Read, recvmmsg: %s\n", socketerror(err));
+			*ret = -1;
+		}
+		return q;	// empty
+	}
+
+	lanPacketsRead += count;
+	for (i = 0; i < count; i++)
+		q->length[i] = msgs[i].msg_len;
+	q->socket = socketid;
+	q->count = count;
+	q->next = 0;
+	return q;
+}
+#endif
+
 int UDP_Read (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr)
 {
 	socklen_t addrlen = sizeof(struct qsockaddr);
 	int ret;
 
+#ifdef UDP_MMSG
+	udpqueue_t	*q;
+
+	q = UDP_ReadQueue (socketid, &ret);
+	if (q)
+	{
+		if (q->next == q->count)
+			return ret;
+		ret = q_min(len, q->length[q->next]);
+		memcpy (buf, q->data[q->next], ret);
+		*addr = q->addr[q->next];
+		if (++q->next == q->count)
+			q->count = q->next = 0;
+		return ret;
+	}
+#endif
+
+	lanReadCalls++;
 	ret = recvfrom (socketid, buf, len, 0, (struct sockaddr *)addr, &addrlen);
 	if (ret == SOCKET_ERROR)
 	{
@@ -270,6 +430,8 @@ int UDP_Read (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr)
 			return 0;
 		Con_SafePrintf ("UDP_Read, recvfrom: %s\n", socketerror(err));
 	}
+	else
+		lanPacketsRead++;
 	return ret;
 }
 
@@ -319,6 +481,28 @@ int UDP_Write (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr
 {
 	int	ret;
 
+#ifdef UDP_MMSG
+	udpwrite_t	*w;
+
+	if (udp_numwriteerrors && UDP_TakeWriteError (socketid))
+		return -1;
+
+	if (udp_batching && len <= UDP_MMSGWRITEBYTES)
+	{
+		if (udp_numwrites == UDP_MMSGWRITES || udp_writebytes + len > UDP_MMSGWRITEBYTES)
+			UDP_FlushWrites ();
+		w = &udp_writes[udp_numwrites++];
+		w->socket = socketid;
+		w->offset = udp_writebytes;
+		w->length = len;
+		w->addr = *addr;
+		memcpy (udp_writebuf + udp_writebytes, buf, len);
+		udp_writebytes += len;
+		return 0;
+	}
+#endif
+
+	lanWriteCalls++;
 	ret = sendto (socketid, buf, len, 0, (struct sockaddr *)addr,
 							sizeof(struct qsockaddr));
 	if (ret == SOCKET_ERROR)
@@ -328,9 +512,118 @@ int UDP_Write (sys_socket_t socketid, byte *buf, int len, struct qsockaddr *addr
 			return 0;
 		Con_SafePrintf ("UDP_Write, sendto: %s\n", socketerror(err));
 	}
+	else
+		lanPacketsWritten++;
 	return ret;
 }
 
+#ifdef UDP_MMSG
+/*
+============
+UDP_AddWriteError / UDP_TakeWriteError
+============
+*/
+static void UDP_AddWriteError (sys_socket_t socketid)
+{
+	int	i;
+
+	for (i = 0; i < udp_numwriteerrors; i++)
+		if (udp_writeerrors[i] == socketid)
+			return;
+	if (udp_numwriteerrors < UDP_MMSGWRITES)
+		udp_writeerrors[udp_numwriteerrors++] = socketid;
+}
+
+static qboolean UDP_TakeWriteError (sys_socket_t socketid)
+{
+	int	i;
+
+	for (i = 0; i < udp_numwriteerrors; i++)
+	{
+		if (udp_writeerrors[i] == socketid)
+		{
+			udp_writeerrors[i] = udp_writeerrors[--udp_numwriteerrors];
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+============
+UDP_FlushWrites
+
+Sends the batched writes with a sendmmsg per socket, each socket's in the
+order they were made. Like a plain write, a packet that can't go out is
+dropped; if that was an error rather than a full buffer, the socket's next
+write reports it.
+============
+*/
+static void UDP_FlushWrites (void)
+{
+	struct mmsghdr	msgs[UDP_MMSGWRITES];
+	struct iovec	iov[UDP_MMSGWRITES];
+	qboolean		done[UDP_MMSGWRITES];
+	udpwrite_t		*w;
+	sys_socket_t	socketid;
+	int				i, j, count, sent, ret;
+
+	memset (done, 0, sizeof(done));
+	for (i = 0; i < udp_numwrites; i++)
+	{
+		if (done[i])
+			continue;
+
+		socketid = udp_writes[i].socket;
+		memset (msgs, 0, sizeof(msgs));
+		for (j = i, count = 0; j < udp_numwrites; j++)
+		{
+			w = &udp_writes[j];
+			if (done[j] || w->socket != socketid)
+				continue;
+			done[j] = true;
+			iov[count].iov_base = udp_writebuf + w->offset;
+			iov[count].iov_len = w->length;
+			msgs[count].msg_hdr.msg_iov = &iov[count];
+			msgs[count].msg_hdr.msg_iovlen = 1;
+			msgs[count].msg_hdr.msg_name = &w->addr;
+			msgs[count].msg_hdr.msg_namelen = sizeof(struct qsockaddr);
+			count++;
+		}
+
+		for (sent = 0; sent < count; sent += ret)
+		{
+			lanWriteCalls++;
+			ret = sendmmsg (socketid, msgs + sent, count - sent, 0);
+			if (ret == SOCKET_ERROR)
+			{
+				int err = SOCKETERRNO;
+				if (err != NET_EWOULDBLOCK)
+				{
+					Con_SafePrintf ("UDP_Write, sendmmsg: %s\n", socketerror(err));
+					UDP_AddWriteError (socketid);
+				}
+				ret = 1;	// skip the packet that failed
+				continue;
+			}
+			lanPacketsWritten += ret;
+		}
+	}
+
+	udp_numwrites = 0;
+	udp_writebytes = 0;
+}
+#endif
+
+void UDP_Batch (qboolean state)
+{
+#ifdef UDP_MMSG
+	udp_batching = state;
+	if (!state && udp_numwrites)
+		UDP_FlushWrites ();
+#endif
+}
+
 //=============================================================================
 
 const char *UDP_AddrToString (struct qsockaddr *addr)
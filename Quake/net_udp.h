@@ -40,6 +40,7 @@ int  UDP_GetAddrFromName (const char *name, struct qsockaddr *addr);
 int  UDP_AddrCompare (struct qsockaddr *addr1, struct qsockaddr *addr2);
 int  UDP_GetSocketPort (struct qsockaddr *addr);
 int  UDP_SetSocketPort (struct qsockaddr *addr, int port);
+void UDP_Batch (qboolean state);
 
 #endif	/* __net_udp_h */
 
@@ -925,33 +925,62 @@ Returns a chain of entities that have origins within a spherical area
 findradius (origin, radius)
 =================
 */
+static edict_t *PF_FindRadiusCheck (edict_t *ent, const float *org, float rad, edict_t *chain)
+{
+	vec3_t	eorg;
+	int	j;
+
+	if (ent->free)
+		return chain;
+	if (ent->v.solid == SOLID_NOT)
+		return chain;
+	for (j = 0; j < 3; j++)
+		eorg[j] = org[j] - (ent->v.origin[j] + (ent->v.mins[j] + ent->v.maxs[j]) * 0.5);
+	if (VectorLength(eorg) > rad)
+		return chain;
+
+	ent->v.chain = EDICT_TO_PROG(chain);
+	return ent;
+}
+
 static void PF_findradius (void)
 {
-	edict_t	*ent, *chain;
+	static int	*list;
+	static int	listsize;
+	edict_t	*chain;
 	float	rad;
 	float	*org;
-	vec3_t	eorg;
-	int	i, j;
+	vec3_t	mins, maxs;
+	int	i, count;
 
 	chain = (edict_t *)sv.edicts;
 
 	org = G_VECTOR(OFS_PARM0);
 	rad = G_FLOAT(OFS_PARM1);
 
-	ent = NEXT_EDICT(sv.edicts);
-	for (i = 1; i < sv.num_edicts; i++, ent = NEXT_EDICT(ent))
+	if (SV_UsingAreaGrid ())
+	{	// only look at the edicts linked near the sphere, in edict order.
+		// The grid has them where they were last linked, so an edict whose
+		// origin or solid the progs changed without a setorigin or relink
+		// can be missed, or found, where walking them all wouldn't.
+		if (listsize < sv.max_edicts)
+		{
+			listsize = sv.max_edicts;
+			list = (int *) Z_Realloc (list, listsize * sizeof(int));
+		}
+		for (i = 0; i < 3; i++)
+		{
+			mins[i] = org[i] - rad;
+			maxs[i] = org[i] + rad;
+		}
+		count = SV_AreaEdicts (mins, maxs, list, listsize);
+		for (i = 0; i < count; i++)
+			chain = PF_FindRadiusCheck (EDICT_NUM(list[i]), org, rad, chain);
+	}
+	else
 	{
-		if (ent->free)
-			continue;
-		if (ent->v.solid == SOLID_NOT)
-			continue;
-		for (j = 0; j < 3; j++)
-			eorg[j] = org[j] - (ent->v.origin[j] + (ent->v.mins[j] + ent->v.maxs[j]) * 0.5);
-		if (VectorLength(eorg) > rad)
-			continue;
-
-		ent->v.chain = EDICT_TO_PROG(chain);
-		chain = ent;
+		for (i = 1; i < sv.num_edicts; i++)
+			chain = PF_FindRadiusCheck (EDICT_NUM(i), org, rad, chain);
 	}
 
 	RETURN_EDICT(chain);
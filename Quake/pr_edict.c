@@ -32,7 +32,7 @@ static	const char	**pr_knownstrings;
 static	int		pr_maxknownstrings;
 static	int		pr_numknownstrings;
 static	ddef_t		*pr_fielddefs;
-static	ddef_t		*pr_globaldefs;
+ddef_t			*pr_globaldefs;
 
 qboolean	pr_alpha_supported; //johnfitz
 
@@ -56,20 +56,20 @@ int		type_size[8] = {
 
 static ddef_t	*ED_FieldAtOfs (int ofs);
 static qboolean	ED_ParseEpair (void *base, ddef_t *key, const char *s);
+static void	PR_ClearStrings (void);
+static void	PR_Strings_f (void);
 
-#define	MAX_FIELD_LEN	64
-#define	GEFV_CACHESIZE	2
+// name lookups, built by PR_LoadProgs on the hunk
+typedef struct
+{
+	int		*heads;		// first def of each bucket, -1 when empty
+	int		*next;		// per def
+	int		mask;
+} prnamehash_t;
 
-typedef struct {
-	ddef_t	*pcache;
-	char	field[MAX_FIELD_LEN];
-} gefv_cache;
+static prnamehash_t	pr_fieldhash, pr_globalhash, pr_functionhash;
 
-static gefv_cache	gefvCache[GEFV_CACHESIZE] =
-{
-		{ NULL,	"" },
-		{ NULL,	"" }
-};
+extfields_t	pr_extfields;
 
 cvar_t	nomonsters = {"nomonsters", "0", CVAR_NONE};
 cvar_t	gamecfg = {"gamecfg", "0", CVAR_NONE};
@@ -94,6 +94,7 @@ void ED_ClearEdict (edict_t *e)
 {
 	memset (&e->v, 0, progs->entityfields * 4);
 	e->free = false;
+	SV_SetEdictActive (NUM_FOR_EDICT(e));
 }
 
 /*
@@ -105,6 +106,9 @@ Try to avoid reusing an entity that was recently freed, because it
 can cause the client to think the entity morphed into something else
 instead of being removed and recreated, which can cause interpolated
 angles and bad trails.
+
+Freed edicts wait in sv.freeedicts in the order they were freed, so only
+the oldest one needs checking: if it is too recent, so are all the others.
 =================
 */
 edict_t *ED_Alloc (void)
@@ -112,28 +116,95 @@ edict_t *ED_Alloc (void)
 	int			i;
 	edict_t		*e;
 
-	for (i = svs.maxclients + 1; i < sv.num_edicts; i++)
+	sv.edict_allocs++;
+	e = NULL;
+	if (sv.freeedicts_count)
 	{
-		e = EDICT_NUM(i);
+		e = EDICT_NUM(sv.freeedicts[sv.freeedicts_head]);
 		// the first couple seconds of server time can involve a lot of
 		// freeing and allocating, so relax the replacement policy
-		if (e->free && ( e->freetime < 2 || sv.time - e->freetime > 0.5 ) )
+		if (e->freetime < 2 || sv.time - e->freetime > 0.5)
 		{
-			ED_ClearEdict (e);
-			return e;
+			sv.freeedicts_head = (sv.freeedicts_head + 1) % sv.max_edicts;
+			sv.freeedicts_count--;
+			sv.edict_reuses++;
 		}
+		else
+			e = NULL;
 	}
 
-	if (i == sv.max_edicts) //johnfitz -- use sv.max_edicts instead of MAX_EDICTS
-		Host_Error ("ED_Alloc: no free edicts (max_edicts is %i)", sv.max_edicts);
+	if (!e)
+	{
+		i = sv.num_edicts;
+		if (i == sv.max_edicts) //johnfitz -- use sv.max_edicts instead of MAX_EDICTS
+			Host_Error ("ED_Alloc: no free edicts (max_edicts is %i)", sv.max_edicts);
+
+		sv.num_edicts++;
+		e = EDICT_NUM(i);
+	}
 
-	sv.num_edicts++;
-	e = EDICT_NUM(i);
+	sv.edict_peak = q_max (sv.edict_peak, sv.num_edicts - sv.freeedicts_count);
 	ED_ClearEdict (e);
 
 	return e;
 }
 
+/*
+=================
+ED_QueueFree
+=================
+*/
+static void ED_QueueFree (int num)
+{
+	sv.freeedicts[(sv.freeedicts_head + sv.freeedicts_count) % sv.max_edicts] = num;
+	sv.freeedicts_count++;
+}
+
+/*
+=================
+ED_FreeQueued
+
+Only needed for edicts that are already marked free, which is rare: a
+double remove(), or an empty entity from ED_ParseEdict
+=================
+*/
+static qboolean ED_FreeQueued (int num)
+{
+	int		i;
+
+	for (i = 0; i < sv.freeedicts_count; i++)
+		if (sv.freeedicts[(sv.freeedicts_head + i) % sv.max_edicts] == num)
+			return true;
+	return false;
+}
+
+/*
+=================
+ED_RebuildEdictLists
+
+Rebuilds the free queue and the active edict bits, for when the edicts
+have been filled in directly, as by a savegame load
+=================
+*/
+void ED_RebuildEdictLists (void)
+{
+	int		i;
+
+	sv.freeedicts_head = sv.freeedicts_count = 0;
+	for (i = 0; i < sv.num_edicts; i++)
+	{
+		if (!EDICT_NUM(i)->free)
+			SV_SetEdictActive (i);
+		else
+		{
+			SV_ClearEdictActive (i);
+			if (i > svs.maxclients)
+				ED_QueueFree (i);
+		}
+	}
+	sv.edict_peak = q_max (sv.edict_peak, sv.num_edicts - sv.freeedicts_count);
+}
+
 /*
 =================
 ED_Free
@@ -144,9 +215,18 @@ FIXME: walk all entities and NULL out references to this entity
 */
 void ED_Free (edict_t *ed)
 {
+	int		num;
+
 	SV_UnlinkEdict (ed);		// unlink from world bsp
 
+	// the client slots are never handed out by ED_Alloc, and an edict
+	// freed twice keeps its place in the queue
+	num = NUM_FOR_EDICT(ed);
+	if (num > svs.maxclients && (!ed->free || !ED_FreeQueued (num)))
+		ED_QueueFree (num);
+
 	ed->free = true;
+	SV_ClearEdictActive (num);
 	ed->v.model = 0;
 	ed->v.takedamage = 0;
 	ed->v.modelindex = 0;
@@ -204,21 +284,52 @@ static ddef_t *ED_FieldAtOfs (int ofs)
 
 /*
 ============
-ED_FindField
+PR_BuildNameHash
+
+defs is an array of count structs of the given size, with the string_t
+name at nameofs. Chains are built from the end, so a lookup finds the
+first of several defs with the same name, like a linear search would.
 ============
 */
-static ddef_t *ED_FindField (const char *name)
+static void PR_BuildNameHash (prnamehash_t *hash, const void *defs, int count, int size, int nameofs)
 {
-	ddef_t		*def;
-	int			i;
+	int	i, buckets, h;
 
-	for (i = 0; i < progs->numfielddefs; i++)
+	for (buckets = 64; buckets < count; buckets <<= 1)
+		;
+	hash->mask = buckets - 1;
+	hash->heads = (int *) Hunk_AllocName (buckets * sizeof(int), "progshash");
+	hash->next = (int *) Hunk_AllocName (q_max(count, 1) * sizeof(int), "progshash");
+	memset (hash->heads, -1, buckets * sizeof(int));
+
+	for (i = count - 1; i >= 0; i--)
 	{
-		def = &pr_fielddefs[i];
-		if ( !strcmp(PR_GetString(def->s_name), name) )
-			return def;
+		h = COM_HashString (PR_GetString (*(const int *)((const byte *)defs + i * size + nameofs))) & hash->mask;
+		hash->next[i] = hash->heads[h];
+		hash->heads[h] = i;
 	}
-	return NULL;
+}
+
+static int PR_FindName (const prnamehash_t *hash, const void *defs, int size, int nameofs, const char *name)
+{
+	int	i;
+
+	for (i = hash->heads[COM_HashString (name) & hash->mask]; i != -1; i = hash->next[i])
+		if (!strcmp (PR_GetString (*(const int *)((const byte *)defs + i * size + nameofs)), name))
+			return i;
+	return -1;
+}
+
+/*
+============
+ED_FindField
+============
+*/
+static ddef_t *ED_FindField (const char *name)
+{
+	int	i = PR_FindName (&pr_fieldhash, pr_fielddefs, sizeof(ddef_t), offsetof(ddef_t, s_name), name);
+
+	return (i != -1) ? &pr_fielddefs[i] : NULL;
 }
 
 
@@ -229,16 +340,9 @@ ED_FindGlobal
 */
 static ddef_t *ED_FindGlobal (const char *name)
 {
-	ddef_t		*def;
-	int			i;
+	int	i = PR_FindName (&pr_globalhash, pr_globaldefs, sizeof(ddef_t), offsetof(ddef_t, s_name), name);
 
-	for (i = 0; i < progs->numglobaldefs; i++)
-	{
-		def = &pr_globaldefs[i];
-		if ( !strcmp(PR_GetString(def->s_name), name) )
-			return def;
-	}
-	return NULL;
+	return (i != -1) ? &pr_globaldefs[i] : NULL;
 }
 
 
@@ -247,50 +351,39 @@ static ddef_t *ED_FindGlobal (const char *name)
 ED_FindFunction
 ============
 */
-static dfunction_t *ED_FindFunction (const char *fn_name)
+dfunction_t *ED_FindFunction (const char *fn_name)
 {
-	dfunction_t		*func;
-	int				i;
+	int	i = PR_FindName (&pr_functionhash, pr_functions, sizeof(dfunction_t), offsetof(dfunction_t, s_name), fn_name);
 
-	for (i = 0; i < progs->numfunctions; i++)
-	{
-		func = &pr_functions[i];
-		if ( !strcmp(PR_GetString(func->s_name), fn_name) )
-			return func;
-	}
-	return NULL;
+	return (i != -1) ? &pr_functions[i] : NULL;
 }
 
 /*
 ============
-GetEdictFieldValue
+ED_FindFieldOffset
+
+Offset of a field for GetEdictFieldValueOfs, -1 if the progs don't have it
 ============
 */
-eval_t *GetEdictFieldValue(edict_t *ed, const char *field)
+static int ED_FindFieldOffset (const char *name)
 {
-	ddef_t			*def = NULL;
-	int				i;
-	static int		rep = 0;
+	ddef_t	*def = ED_FindField (name);
 
-	for (i = 0; i < GEFV_CACHESIZE; i++)
-	{
-		if (!strcmp(field, gefvCache[i].field))
-		{
-			def = gefvCache[i].pcache;
-			goto Done;
-		}
-	}
+	return def ? def->ofs : -1;
+}
 
-	def = ED_FindField (field);
+/*
+============
+GetEdictFieldValue
 
-	if (strlen(field) < MAX_FIELD_LEN)
-	{
-		gefvCache[rep].pcache = def;
-		strcpy (gefvCache[rep].field, field);
-		rep ^= 1;
-	}
+For the fields that get looked up all the time, see pr_extfields
+============
+*/
+eval_t *GetEdictFieldValue(edict_t *ed, const char *field)
+{
+	ddef_t			*def;
 
-Done:
+	def = ED_FindField (field);
 	if (!def)
 		return NULL;
 
@@ -643,6 +736,8 @@ static void ED_Count (void)
 	Con_Printf ("view      :%3i\n", models);
 	Con_Printf ("touch     :%3i\n", solid);
 	Con_Printf ("step      :%3i\n", step);
+	Con_Printf ("peak      :%3i\n", sv.edict_peak);
+	Con_Printf ("allocs    :%3i (%i reused)\n", sv.edict_allocs, sv.edict_reuses);
 }
 
 
@@ -761,6 +856,33 @@ static string_t ED_NewString (const char *string)
 	return num;
 }
 
+/*
+=============
+ED_FreeStrings
+
+Gives back the strings ED_ParseEdict made for an entity that is dropped
+before its spawn function ran, so nothing else can point at them
+=============
+*/
+static void ED_FreeStrings (edict_t *ed)
+{
+	ddef_t	*d;
+	int	i, *v;
+
+	for (i = 1; i < progs->numfielddefs; i++)
+	{
+		d = &pr_fielddefs[i];
+		if ((d->type & ~DEF_SAVEGLOBAL) != ev_string)
+			continue;
+		v = (int *)&ed->v + d->ofs;
+		if (*v < 0)
+		{
+			PR_FreeString (*v);
+			*v = 0;
+		}
+	}
+}
+
 
 /*
 =============
@@ -934,7 +1056,10 @@ const char *ED_ParseEdict (const char *data, edict_t *ent)
 	}
 
 	if (!init)
+	{
 		ent->free = true;
+		SV_ClearEdictActive (NUM_FOR_EDICT(ent));
+	}
 
 	return data;
 }
@@ -984,6 +1109,7 @@ void ED_LoadFromFile (const char *data)
 		{
 			if (((int)ent->v.spawnflags & SPAWNFLAG_NOT_DEATHMATCH))
 			{
+				ED_FreeStrings (ent);
 				ED_Free (ent);
 				inhibit++;
 				continue;
@@ -993,6 +1119,7 @@ void ED_LoadFromFile (const char *data)
 				|| (current_skill == 1 && ((int)ent->v.spawnflags & SPAWNFLAG_NOT_MEDIUM))
 				|| (current_skill >= 2 && ((int)ent->v.spawnflags & SPAWNFLAG_NOT_HARD)) )
 		{
+			ED_FreeStrings (ent);
 			ED_Free (ent);
 			inhibit++;
 			continue;
@@ -1005,6 +1132,7 @@ void ED_LoadFromFile (const char *data)
 		{
 			Con_SafePrintf ("No classname for:\n"); //johnfitz -- was Con_Printf
 			ED_Print (ent);
+			ED_FreeStrings (ent);
 			ED_Free (ent);
 			continue;
 		}
@@ -1016,6 +1144,7 @@ void ED_LoadFromFile (const char *data)
 		{
 			Con_SafePrintf ("No spawn function for:\n"); //johnfitz -- was Con_Printf
 			ED_Print (ent);
+			ED_FreeStrings (ent);
 			ED_Free (ent);
 			continue;
 		}
@@ -1037,10 +1166,6 @@ void PR_LoadProgs (void)
 {
 	int			i;
 
-	// flush the non-C variable lookup cache
-	for (i = 0; i < GEFV_CACHESIZE; i++)
-		gefvCache[i].field[0] = 0;
-
 	CRC_Init (&pr_crc);
 
 	progs = (dprograms_t *)COM_LoadHunkFile ("progs.dat", NULL);
@@ -1066,12 +1191,8 @@ void PR_LoadProgs (void)
 		Host_Error ("progs.dat strings go past end of file\n");
 
 	// initialize the strings
-	pr_numknownstrings = 0;
-	pr_maxknownstrings = 0;
 	pr_stringssize = progs->numstrings;
-	if (pr_knownstrings)
-		Z_Free ((void *)pr_knownstrings);
-	pr_knownstrings = NULL;
+	PR_ClearStrings ();
 	PR_SetEngineString("");
 
 	pr_globaldefs = (ddef_t *)((byte *)progs + progs->ofs_globaldefs);
@@ -1089,6 +1210,8 @@ void PR_LoadProgs (void)
 		pr_statements[i].b = LittleShort(pr_statements[i].b);
 		pr_statements[i].c = LittleShort(pr_statements[i].c);
 	}
+	PR_FuseStatements ();
+	PR_ProfileClear ();
 
 	for (i = 0; i < progs->numfunctions; i++)
 	{
@@ -1107,8 +1230,6 @@ void PR_LoadProgs (void)
 		pr_globaldefs[i].s_name = LittleLong (pr_globaldefs[i].s_name);
 	}
 
-	pr_alpha_supported = false; //johnfitz
-
 	for (i = 0; i < progs->numfielddefs; i++)
 	{
 		pr_fielddefs[i].type = LittleShort (pr_fielddefs[i].type);
@@ -1116,13 +1237,17 @@ void PR_LoadProgs (void)
 			Host_Error ("PR_LoadProgs: pr_fielddefs[i].type & DEF_SAVEGLOBAL");
 		pr_fielddefs[i].ofs = LittleShort (pr_fielddefs[i].ofs);
 		pr_fielddefs[i].s_name = LittleLong (pr_fielddefs[i].s_name);
-
-		//johnfitz -- detect alpha support in progs.dat
-		if (!strcmp(pr_strings + pr_fielddefs[i].s_name,"alpha"))
-			pr_alpha_supported = true;
-		//johnfitz
 	}
 
+	PR_BuildNameHash (&pr_fieldhash, pr_fielddefs, progs->numfielddefs, sizeof(ddef_t), offsetof(ddef_t, s_name));
+	PR_BuildNameHash (&pr_globalhash, pr_globaldefs, progs->numglobaldefs, sizeof(ddef_t), offsetof(ddef_t, s_name));
+	PR_BuildNameHash (&pr_functionhash, pr_functions, progs->numfunctions, sizeof(dfunction_t), offsetof(dfunction_t, s_name));
+
+	pr_extfields.alpha = ED_FindFieldOffset ("alpha");
+	pr_extfields.items2 = ED_FindFieldOffset ("items2");
+	pr_extfields.gravity = ED_FindFieldOffset ("gravity");
+	pr_alpha_supported = (pr_extfields.alpha != -1); //johnfitz
+
 	for (i = 0; i < progs->numglobals; i++)
 		((int *)pr_globals)[i] = LittleLong (((int *)pr_globals)[i]);
 
@@ -1132,6 +1257,8 @@ void PR_LoadProgs (void)
 	// properly aligned
 	pr_edict_size += sizeof(void *) - 1;
 	pr_edict_size &= ~(sizeof(void *) - 1);
+
+	PR_TranslateProgs ();
 }
 
 
@@ -1146,6 +1273,12 @@ void PR_Init (void)
 	Cmd_AddCommand ("edicts", ED_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+	Cmd_AddCommand ("pr_profile", PR_Profile_Cmd_f);
+	Cmd_AddCommand ("pr_strings", PR_Strings_f);
+	Cmd_AddCommand ("pr_bench", PR_Bench_f);
+	Cvar_RegisterVariable (&pr_superinstructions);
+	Cvar_RegisterVariable (&pr_translate);
+	Cmd_AddCommand ("pr_irstats", PR_TranslateStats_f);
 	Cvar_RegisterVariable (&nomonsters);
 	Cvar_RegisterVariable (&gamecfg);
 	Cvar_RegisterVariable (&scratch1);
@@ -1182,13 +1315,213 @@ int NUM_FOR_EDICT(edict_t *e)
 //===========================================================================
 
 
+/*
+=============================================================================
+
+STRINGS
+
+Strings outside the progs string table live in numbered slots, and the
+string_t -1 - slot refers to one. A slot holds either an engine string the
+progs only point at, or a string heap block handed out by PR_AllocString.
+A hash from pointer to slot saves PR_SetEngineString from searching all
+slots, and freed slots are chained for reuse.
+
+The heap hands out power of two blocks from 16 to 4096 bytes, cut from hunk
+chunks, with one free list per size. Longer strings get a hunk allocation
+of their own, which goes to a first fit list when it is freed. All of it
+goes away with the hunk when the next progs are loaded.
+
+=============================================================================
+*/
+
 #define	PR_STRING_ALLOCSLOTS	256
 
+#define	STRHEAP_MINSHIFT	4
+#define	STRHEAP_CLASSES		9	// 16 to 4096 bytes
+#define	STRHEAP_MAXBLOCK	(1 << (STRHEAP_MINSHIFT + STRHEAP_CLASSES - 1))
+#define	STRHEAP_CHUNK		0x10000
+
+typedef struct
+{
+	int		size;		// heap block size, 0 for an engine string, -1 when free
+	int		nextfree;
+} prstringslot_t;
+
+typedef struct strblock_s
+{
+	struct strblock_s	*next;
+	int			size;	// only kept for the large blocks
+} strblock_t;
+
+static	prstringslot_t	*pr_stringslots;
+static	int		pr_freestringslot;	// -1 when there is none
+static	int		*pr_stringhash;		// slot of a pointer, -1 when empty
+static	int		pr_stringhashsize;
+
+static	strblock_t	*strheap_free[STRHEAP_CLASSES];
+static	strblock_t	*strheap_freelarge;
+static	byte		*strheap_chunk;
+static	int		strheap_chunkleft;
+static	int		strheap_chunkbytes, strheap_largebytes;
+static	int		strheap_allocs, strheap_frees, strheap_reused;
+
 static void PR_AllocStringSlots (void)
 {
 	pr_maxknownstrings += PR_STRING_ALLOCSLOTS;
 	Con_DPrintf2("PR_AllocStringSlots: realloc'ing for %d slots\n", pr_maxknownstrings);
 	pr_knownstrings = (const char **) Z_Realloc ((void *)pr_knownstrings, pr_maxknownstrings * sizeof(char *));
+	pr_stringslots = (prstringslot_t *) Z_Realloc (pr_stringslots, pr_maxknownstrings * sizeof(prstringslot_t));
+}
+
+static int PR_StringHashKey (const char *s)
+{
+	uintptr_t	p = (uintptr_t) s;
+
+	return (int)(((unsigned int)(p ^ (p >> 16)) * 2654435761u) & (pr_stringhashsize - 1));
+}
+
+static void PR_StringHashInsert (const char *s, int slot)
+{
+	int	h;
+
+	for (h = PR_StringHashKey (s); pr_stringhash[h] != -1; h = (h + 1) & (pr_stringhashsize - 1))
+		;
+	pr_stringhash[h] = slot;
+}
+
+static void PR_StringHashGrow (void)
+{
+	int	i;
+
+	pr_stringhashsize = pr_stringhashsize ? pr_stringhashsize * 2 : 1024;
+	if (pr_stringhash)
+		Z_Free (pr_stringhash);
+	pr_stringhash = (int *) Z_Malloc (pr_stringhashsize * sizeof(int));
+	memset (pr_stringhash, -1, pr_stringhashsize * sizeof(int));
+	for (i = 0; i < pr_numknownstrings; i++)
+		if (pr_knownstrings[i])
+			PR_StringHashInsert (pr_knownstrings[i], i);
+}
+
+static int PR_StringHashFind (const char *s)
+{
+	int	h;
+
+	if (!pr_stringhash)
+		return -1;
+	for (h = PR_StringHashKey (s); pr_stringhash[h] != -1; h = (h + 1) & (pr_stringhashsize - 1))
+		if (pr_knownstrings[pr_stringhash[h]] == s)
+			return pr_stringhash[h];
+	return -1;
+}
+
+/*
+============
+PR_StringHashRemove
+
+Moves the rest of the run back over the hole, so lookups never have to
+step over deleted entries
+============
+*/
+static void PR_StringHashRemove (int slot)
+{
+	int	h, next, home, mask = pr_stringhashsize - 1;
+
+	for (h = PR_StringHashKey (pr_knownstrings[slot]); pr_stringhash[h] != slot; h = (h + 1) & mask)
+		;
+	for (next = (h + 1) & mask; pr_stringhash[next] != -1; next = (next + 1) & mask)
+	{
+		home = PR_StringHashKey (pr_knownstrings[pr_stringhash[next]]);
+		if (((next - home) & mask) >= ((next - h) & mask))
+		{
+			pr_stringhash[h] = pr_stringhash[next];
+			h = next;
+		}
+	}
+	pr_stringhash[h] = -1;
+}
+
+/*
+============
+PR_NewStringSlot
+
+Puts s in a free slot and in the hash
+============
+*/
+static int PR_NewStringSlot (const char *s, int size)
+{
+	int	i;
+
+	if (pr_freestringslot != -1)
+	{
+		i = pr_freestringslot;
+		pr_freestringslot = pr_stringslots[i].nextfree;
+	}
+	else
+	{
+		i = pr_numknownstrings;
+		if (i >= pr_maxknownstrings)
+			PR_AllocStringSlots();
+		pr_numknownstrings++;
+	}
+	pr_knownstrings[i] = s;
+	pr_stringslots[i].size = size;
+
+	if (pr_numknownstrings * 2 > pr_stringhashsize)
+		PR_StringHashGrow ();
+	else
+		PR_StringHashInsert (s, i);
+	return i;
+}
+
+/*
+============
+PR_ClearStrings
+
+Called by PR_LoadProgs, after the hunk the heap was in has been freed
+============
+*/
+static void PR_ClearStrings (void)
+{
+	int	i;
+
+	pr_numknownstrings = 0;
+	pr_maxknownstrings = 0;
+	pr_freestringslot = -1;
+	if (pr_knownstrings)
+		Z_Free ((void *)pr_knownstrings);
+	pr_knownstrings = NULL;
+	if (pr_stringslots)
+		Z_Free (pr_stringslots);
+	pr_stringslots = NULL;
+	if (pr_stringhash)
+		Z_Free (pr_stringhash);
+	pr_stringhash = NULL;
+	pr_stringhashsize = 0;
+
+	for (i = 0; i < STRHEAP_CLASSES; i++)
+		strheap_free[i] = NULL;
+	strheap_freelarge = NULL;
+	strheap_chunk = NULL;
+	strheap_chunkleft = 0;
+	strheap_chunkbytes = strheap_largebytes = 0;
+	strheap_allocs = strheap_frees = strheap_reused = 0;
+}
+
+/*
+============
+PR_FindString
+
+PR_GetString without the Host_Error, for job threads. NULL for a bad index.
+============
+*/
+const char *PR_FindString (int num)
+{
+	if (num >= 0 && num < pr_stringssize)
+		return pr_strings + num;
+	if (num < 0 && num >= -pr_numknownstrings)
+		return pr_knownstrings[-1 - num];
+	return NULL;
 }
 
 const char *PR_GetString (int num)
@@ -1224,50 +1557,172 @@ int PR_SetEngineString (const char *s)
 	if (s >= pr_strings && s <= pr_strings + pr_stringssize - 2)
 		return (int)(s - pr_strings);
 #endif
-	for (i = 0; i < pr_numknownstrings; i++)
+	i = PR_StringHashFind (s);
+	if (i == -1)
+	{	// new unknown engine string
+		//Con_DPrintf ("PR_SetEngineString: new engine string %p\n", s);
+		i = PR_NewStringSlot (s, 0);
+	}
+	return -1 - i;
+}
+
+static int PR_StringHeapClass (int size)
+{
+	int	c;
+
+	for (c = 0; (1 << (STRHEAP_MINSHIFT + c)) < size; c++)
+		;
+	return c;
+}
+
+/*
+============
+PR_StringHeapAlloc
+============
+*/
+static char *PR_StringHeapAlloc (int size, int *blocksize)
+{
+	strblock_t	*b, **link;
+	int		c;
+
+	if (size > STRHEAP_MAXBLOCK)
 	{
-		if (pr_knownstrings[i] == s)
-			return -1 - i;
+		for (link = &strheap_freelarge; *link; link = &(*link)->next)
+		{
+			if ((*link)->size >= size)
+			{
+				b = *link;
+				*link = b->next;
+				*blocksize = b->size;
+				strheap_reused++;
+				return (char *) b;
+			}
+		}
+		*blocksize = (size + 15) & ~15;
+		strheap_largebytes += *blocksize;
+		return (char *) Hunk_AllocName (*blocksize, "string");
 	}
-	// new unknown engine string
-	//Con_DPrintf ("PR_SetEngineString: new engine string %p\n", s);
-#if 0
-	for (i = 0; i < pr_numknownstrings; i++)
+
+	c = PR_StringHeapClass (size);
+	*blocksize = 1 << (STRHEAP_MINSHIFT + c);
+	if (strheap_free[c])
 	{
-		if (!pr_knownstrings[i])
-			break;
+		b = strheap_free[c];
+		strheap_free[c] = b->next;
+		strheap_reused++;
+		return (char *) b;
 	}
-#endif
-//	if (i >= pr_numknownstrings)
-//	{
-		if (i >= pr_maxknownstrings)
-			PR_AllocStringSlots();
-		pr_numknownstrings++;
-//	}
-	pr_knownstrings[i] = s;
-	return -1 - i;
+
+	if (strheap_chunkleft < *blocksize)
+	{	// what is left of the old chunk is too small to bother with
+		strheap_chunk = (byte *) Hunk_AllocName (STRHEAP_CHUNK, "strings");
+		strheap_chunkleft = STRHEAP_CHUNK;
+		strheap_chunkbytes += STRHEAP_CHUNK;
+	}
+	b = (strblock_t *) strheap_chunk;
+	strheap_chunk += *blocksize;
+	strheap_chunkleft -= *blocksize;
+	return (char *) b;
 }
 
 int PR_AllocString (int size, char **ptr)
 {
-	int		i;
+	char	*s;
+	int	i, blocksize;
 
 	if (!size)
 		return 0;
-	for (i = 0; i < pr_numknownstrings; i++)
-	{
-		if (!pr_knownstrings[i])
-			break;
-	}
-//	if (i >= pr_numknownstrings)
-//	{
-		if (i >= pr_maxknownstrings)
-			PR_AllocStringSlots();
-		pr_numknownstrings++;
-//	}
-	pr_knownstrings[i] = (char *)Hunk_AllocName(size, "string");
+	s = PR_StringHeapAlloc (size, &blocksize);
+	i = PR_NewStringSlot (s, blocksize);
+	strheap_allocs++;
 	if (ptr)
-		*ptr = (char *) pr_knownstrings[i];
+		*ptr = s;
 	return -1 - i;
 }
 
+/*
+============
+PR_FreeString
+
+Gives back a string from PR_AllocString. Anything else is left alone, so
+callers can pass whatever string_t they have.
+============
+*/
+void PR_FreeString (int num)
+{
+	strblock_t	*b;
+	int		i, c, size;
+
+	i = -1 - num;
+	if (num >= 0 || i >= pr_numknownstrings || !pr_knownstrings[i] || pr_stringslots[i].size <= 0)
+		return;
+
+	size = pr_stringslots[i].size;
+	b = (strblock_t *) pr_knownstrings[i];
+	if (size > STRHEAP_MAXBLOCK)
+	{
+		b->size = size;
+		b->next = strheap_freelarge;
+		strheap_freelarge = b;
+	}
+	else
+	{
+		c = PR_StringHeapClass (size);
+		b->next = strheap_free[c];
+		strheap_free[c] = b;
+	}
+
+	PR_StringHashRemove (i);
+	pr_knownstrings[i] = NULL;
+	pr_stringslots[i].size = -1;
+	pr_stringslots[i].nextfree = pr_freestringslot;
+	pr_freestringslot = i;
+	strheap_frees++;
+}
+
+/*
+============
+PR_Strings_f
+============
+*/
+static void PR_Strings_f (void)
+{
+	strblock_t	*b;
+	int		i, engine, heap, freeslots, used, freebytes, longest;
+
+	if (!progs)
+	{
+		Con_Printf ("no progs loaded\n");
+		return;
+	}
+
+	engine = heap = freeslots = used = 0;
+	for (i = 0; i < pr_numknownstrings; i++)
+	{
+		if (pr_stringslots[i].size < 0)
+			freeslots++;
+		else if (pr_stringslots[i].size == 0)
+			engine++;
+		else
+		{
+			heap++;
+			used += pr_stringslots[i].size;
+		}
+	}
+	for (i = 0, freebytes = 0; i < STRHEAP_CLASSES; i++)
+		for (b = strheap_free[i]; b; b = b->next)
+			freebytes += 1 << (STRHEAP_MINSHIFT + i);
+	for (b = strheap_freelarge; b; b = b->next)
+		freebytes += b->size;
+
+	for (i = 0, longest = 0; i < pr_stringhashsize; i++)
+		if (pr_stringhash[i] != -1)
+			longest = q_max (longest, ((i - PR_StringHashKey (pr_knownstrings[pr_stringhash[i]])) & (pr_stringhashsize - 1)) + 1);
+
+	Con_Printf ("%i bytes of progs strings\n", pr_stringssize);
+	Con_Printf ("%i slots: %i engine strings, %i allocated, %i free\n", pr_numknownstrings, engine, heap, freeslots);
+	Con_Printf ("heap: %i KB in chunks, %i KB large, %i KB in use, %i KB free\n",
+		strheap_chunkbytes / 1024, strheap_largebytes / 1024, used / 1024, freebytes / 1024);
+	Con_Printf ("%i allocations, %i frees, %i blocks reused\n", strheap_allocs, strheap_frees, strheap_reused);
+	Con_Printf ("pointer hash: %i buckets, longest probe %i\n", pr_stringhashsize, longest);
+}
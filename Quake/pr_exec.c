@@ -40,6 +40,67 @@ dfunction_t	*pr_xfunction;
 int		pr_xstatement;
 int		pr_argc;
 
+cvar_t	pr_superinstructions = {"pr_superinstructions", "1", CVAR_NONE};
+
+// engine only opcodes, written over the first statement of a fused pair
+enum
+{
+	OP_FIRSTFUSED = OP_BITOR + 1,
+	OP_ADDRESS_STOREP = OP_FIRSTFUSED,	// ADDRESS + STOREP_F/S/ENT/FLD/FNC
+	OP_ADDRESS_STOREP_V,
+	OP_LOAD_F_EQ,
+	OP_LOAD_F_NE,
+	OP_LOAD_F_LE,
+	OP_LOAD_F_GE,
+	OP_LOAD_F_LT,
+	OP_LOAD_F_GT,
+	OP_EQ_F_IFNOT,
+	OP_NE_F_IFNOT,
+	OP_LE_IFNOT,
+	OP_GE_IFNOT,
+	OP_LT_IFNOT,
+	OP_GT_IFNOT,
+	OP_NOT_F_IFNOT,
+	OP_IF_GOTO,
+	OP_IFNOT_GOTO,
+	OP_NUMOPS
+};
+
+static const unsigned short pr_fusedbase[OP_NUMOPS - OP_FIRSTFUSED] =
+{
+	OP_ADDRESS,
+	OP_ADDRESS,
+	OP_LOAD_F,
+	OP_LOAD_F,
+	OP_LOAD_F,
+	OP_LOAD_F,
+	OP_LOAD_F,
+	OP_LOAD_F,
+	OP_EQ_F,
+	OP_NE_F,
+	OP_LE,
+	OP_GE,
+	OP_LT,
+	OP_GT,
+	OP_NOT_F,
+	OP_IF,
+	OP_IFNOT
+};
+
+/*
+=================
+PR_BaseOp
+
+The progs opcode a statement had before PR_FuseStatements
+=================
+*/
+int PR_BaseOp (int op)
+{
+	if (op >= OP_FIRSTFUSED && op < OP_NUMOPS)
+		return pr_fusedbase[op - OP_FIRSTFUSED];
+	return op;
+}
+
 static const char *pr_opnames[] =
 {
 	"DONE",
@@ -142,23 +203,24 @@ PR_PrintStatement
 */
 static void PR_PrintStatement (dstatement_t *s)
 {
-	int	i;
+	int	i, op;
 
-	if ((unsigned int)s->op < sizeof(pr_opnames)/sizeof(pr_opnames[0]))
+	op = PR_BaseOp (s->op);
+	if ((unsigned int)op < sizeof(pr_opnames)/sizeof(pr_opnames[0]))
 	{
-		Con_Printf("%s ", pr_opnames[s->op]);
-		i = strlen(pr_opnames[s->op]);
+		Con_Printf("%s ", pr_opnames[op]);
+		i = strlen(pr_opnames[op]);
 		for ( ; i < 10; i++)
 			Con_Printf(" ");
 	}
 
-	if (s->op == OP_IF || s->op == OP_IFNOT)
+	if (op == OP_IF || op == OP_IFNOT)
 		Con_Printf("%sbranch %i", PR_GlobalString(s->a), s->b);
-	else if (s->op == OP_GOTO)
+	else if (op == OP_GOTO)
 	{
 		Con_Printf("branch %i", s->a);
 	}
-	else if ((unsigned int)(s->op-OP_STORE_F) < 6)
+	else if ((unsigned int)(op-OP_STORE_F) < 6)
 	{
 		Con_Printf("%s", PR_GlobalString(s->a));
 		Con_Printf("%s", PR_GlobalStringNoContents(s->b));
@@ -247,6 +309,419 @@ void PR_Profile_f (void)
 }
 
 
+/*
+=============================================================================
+
+CALL STACK PROFILER
+
+"pr_profile start" counts, for every distinct call stack, the calls, the
+statements run in the function itself and the wall clock time including
+callees. Builtins get entries of their own, so time spent in the engine on
+behalf of the progs shows up under the function that asked for it.
+"pr_profile report" sums it up per function, "pr_profile flamegraph" writes
+one line per stack in the collapsed format flamegraph.pl and speedscope
+read:
+
+	StartFrame;CheckRules;walkmove 1234
+
+where the number is what the last function took by itself, in
+microseconds or statements.
+
+=============================================================================
+*/
+
+typedef struct
+{
+	int		func;		// function number, or minus the builtin number
+	int		parent;		// -1 for a call from the engine
+	int		calls;
+	int		statements;	// in the function itself
+	double		time;		// including callees
+} prprofnode_t;
+
+typedef struct
+{
+	int		node;
+	int		resume;		// profile count of the function when it last got control
+	double		start;
+} prprofframe_t;
+
+#define	PROF_MAX_DEPTH		(MAX_STACK_DEPTH * 2 + 2)	// builtins can run progs again
+
+qboolean		pr_profiling;
+static prprofnode_t	*prof_nodes;
+static int		prof_numnodes, prof_maxnodes;
+static int		*prof_hash;		// node of a parent and function, -1 when empty
+static int		prof_hashsize;
+static prprofframe_t	prof_stack[PROF_MAX_DEPTH];
+static int		prof_depth;
+static double		prof_started, prof_elapsed;
+
+static int PR_ProfileHashKey (int parent, int func)
+{
+	return (int)(((unsigned int)parent * 2654435761u ^ (unsigned int)func * 40503u) & (prof_hashsize - 1));
+}
+
+/*
+============
+PR_ProfileNode
+
+The node for func called from parent, made on first use
+============
+*/
+static int PR_ProfileNode (int parent, int func)
+{
+	prprofnode_t	*n;
+	int		i, h;
+
+	if (prof_numnodes * 2 >= prof_hashsize)
+	{
+		prof_hashsize = prof_hashsize ? prof_hashsize * 2 : 1024;
+		prof_hash = (int *) realloc (prof_hash, prof_hashsize * sizeof(int));
+		if (!prof_hash)
+			Sys_Error ("PR_ProfileNode: out of memory");
+		memset (prof_hash, -1, prof_hashsize * sizeof(int));
+		for (i = 0; i < prof_numnodes; i++)
+		{
+			for (h = PR_ProfileHashKey (prof_nodes[i].parent, prof_nodes[i].func); prof_hash[h] != -1; h = (h + 1) & (prof_hashsize - 1))
+				;
+			prof_hash[h] = i;
+		}
+	}
+
+	for (h = PR_ProfileHashKey (parent, func); prof_hash[h] != -1; h = (h + 1) & (prof_hashsize - 1))
+	{
+		n = &prof_nodes[prof_hash[h]];
+		if (n->parent == parent && n->func == func)
+			return prof_hash[h];
+	}
+
+	if (prof_numnodes == prof_maxnodes)
+	{
+		prof_maxnodes = prof_maxnodes ? prof_maxnodes * 2 : 512;
+		prof_nodes = (prprofnode_t *) realloc (prof_nodes, prof_maxnodes * sizeof(prprofnode_t));
+		if (!prof_nodes)
+			Sys_Error ("PR_ProfileNode: out of memory");
+	}
+	n = &prof_nodes[prof_numnodes];
+	memset (n, 0, sizeof(*n));
+	n->func = func;
+	n->parent = parent;
+	prof_hash[h] = prof_numnodes;
+	return prof_numnodes++;
+}
+
+/*
+============
+PR_ProfilePush
+
+Called when a function or builtin starts. The interpreter has already added
+the statements of the caller to its profile count.
+============
+*/
+static void PR_ProfilePush (int func)
+{
+	prprofframe_t	*frame;
+	prprofnode_t	*caller;
+
+	if (prof_depth >= PROF_MAX_DEPTH)
+	{
+		prof_depth++;	// only counted, so the pops still match
+		return;
+	}
+	if (prof_depth)
+	{
+		frame = &prof_stack[prof_depth - 1];
+		caller = &prof_nodes[frame->node];
+		if (caller->func > 0)
+			caller->statements += pr_functions[caller->func].profile - frame->resume;
+	}
+
+	frame = &prof_stack[prof_depth];
+	frame->node = PR_ProfileNode (prof_depth ? prof_stack[prof_depth - 1].node : -1, func);
+	frame->resume = (func > 0) ? pr_functions[func].profile : 0;
+	frame->start = Sys_DoubleTime ();
+	prof_nodes[frame->node].calls++;
+	prof_depth++;
+}
+
+/*
+============
+PR_ProfilePop
+============
+*/
+static void PR_ProfilePop (void)
+{
+	prprofframe_t	*frame;
+	prprofnode_t	*n;
+
+	if (prof_depth > PROF_MAX_DEPTH)
+	{
+		prof_depth--;
+		return;
+	}
+	if (prof_depth <= 0)
+		return;
+
+	frame = &prof_stack[--prof_depth];
+	n = &prof_nodes[frame->node];
+	if (n->func > 0)
+		n->statements += pr_functions[n->func].profile - frame->resume;
+	n->time += Sys_DoubleTime () - frame->start;
+
+	// the caller picks up from here
+	if (prof_depth)
+	{
+		frame = &prof_stack[prof_depth - 1];
+		n = &prof_nodes[frame->node];
+		if (n->func > 0)
+			frame->resume = pr_functions[n->func].profile;
+	}
+}
+
+/*
+============
+PR_ProfileBuiltin
+============
+*/
+void PR_ProfileBuiltin (int num)
+{
+	PR_ProfilePush (-num);
+	pr_builtins[num] ();
+	PR_ProfilePop ();
+}
+
+/*
+============
+PR_ProfileClear
+
+Also called by PR_LoadProgs, the nodes refer to function numbers
+============
+*/
+void PR_ProfileClear (void)
+{
+	prof_numnodes = 0;
+	prof_depth = 0;
+	if (prof_hash)
+		memset (prof_hash, -1, prof_hashsize * sizeof(int));
+	prof_elapsed = 0;
+	prof_started = Sys_DoubleTime ();
+}
+
+static const char *PR_ProfileName (int func)
+{
+	int	i;
+
+	if (func > 0)
+		return PR_GetString (pr_functions[func].s_name);
+	for (i = 1; i < progs->numfunctions; i++)
+		if (pr_functions[i].first_statement == func)
+			return PR_GetString (pr_functions[i].s_name);
+	return va ("builtin#%i", -func);
+}
+
+/*
+============
+PR_ProfileTotals
+
+Exclusive time and inclusive statements of every node. Callers are always
+made before their callees, so one backward pass is enough.
+============
+*/
+static void PR_ProfileTotals (double *selftime, int *totalstatements)
+{
+	int	i;
+
+	for (i = 0; i < prof_numnodes; i++)
+	{
+		selftime[i] = prof_nodes[i].time;
+		totalstatements[i] = prof_nodes[i].statements;
+	}
+	for (i = prof_numnodes - 1; i >= 0; i--)
+	{
+		if (prof_nodes[i].parent < 0)
+			continue;
+		selftime[prof_nodes[i].parent] -= prof_nodes[i].time;
+		totalstatements[prof_nodes[i].parent] += totalstatements[i];
+	}
+}
+
+typedef struct
+{
+	int		func;
+	int		calls, statements, totalstatements;
+	double		selftime, totaltime;
+} prproffunc_t;
+
+static int PR_ProfileFuncCompare (const void *a, const void *b)
+{
+	double	ta = ((const prproffunc_t *)a)->selftime;
+	double	tb = ((const prproffunc_t *)b)->selftime;
+
+	return (ta < tb) ? 1 : (ta > tb) ? -1 : 0;
+}
+
+/*
+============
+PR_ProfileReport
+
+Per function, over all stacks. The totals only count the outermost call of a
+recursive function, or its callees would be counted again.
+============
+*/
+static void PR_ProfileReport (int count)
+{
+	prproffunc_t	*funcs, *pf;
+	double		*selftime;
+	int		*totalstatements;
+	int		i, p, numfuncs, slot, shown;
+
+	numfuncs = progs->numfunctions + pr_numbuiltins;
+	funcs = (prproffunc_t *) calloc (numfuncs, sizeof(prproffunc_t));
+	selftime = (double *) malloc (q_max(prof_numnodes, 1) * sizeof(double));
+	totalstatements = (int *) malloc (q_max(prof_numnodes, 1) * sizeof(int));
+	if (!funcs || !selftime || !totalstatements)
+		Sys_Error ("PR_ProfileReport: out of memory");
+
+	PR_ProfileTotals (selftime, totalstatements);
+	for (i = 0; i < numfuncs; i++)
+		funcs[i].func = (i < progs->numfunctions) ? i : progs->numfunctions - i;
+	for (i = 0; i < prof_numnodes; i++)
+	{
+		slot = (prof_nodes[i].func > 0) ? prof_nodes[i].func : progs->numfunctions - prof_nodes[i].func;
+		if (slot >= numfuncs)
+			continue;
+		pf = &funcs[slot];
+		pf->calls += prof_nodes[i].calls;
+		pf->statements += prof_nodes[i].statements;
+		pf->selftime += selftime[i];
+		for (p = prof_nodes[i].parent; p >= 0; p = prof_nodes[p].parent)
+			if (prof_nodes[p].func == prof_nodes[i].func)
+				break;
+		if (p < 0)
+		{
+			pf->totaltime += prof_nodes[i].time;
+			pf->totalstatements += totalstatements[i];
+		}
+	}
+	qsort (funcs, numfuncs, sizeof(prproffunc_t), PR_ProfileFuncCompare);
+
+	Con_Printf ("%i stacks over %.1f seconds\n", prof_numnodes, prof_elapsed);
+	Con_Printf ("    calls statements   total st  self ms total ms name\n");
+	for (i = 0, shown = 0; i < numfuncs && shown < count; i++)
+	{
+		pf = &funcs[i];
+		if (!pf->calls)
+			continue;
+		shown++;
+		Con_Printf ("%9i %10i %10i %8.2f %8.2f %s\n", pf->calls, pf->statements, pf->totalstatements,
+			pf->selftime * 1000.0, pf->totaltime * 1000.0, PR_ProfileName (pf->func));
+	}
+
+	free (totalstatements);
+	free (selftime);
+	free (funcs);
+}
+
+/*
+============
+PR_ProfileFlamegraph
+============
+*/
+static void PR_ProfileFlamegraph (const char *filename, qboolean statements)
+{
+	char		name[MAX_OSPATH];
+	int		path[PROF_MAX_DEPTH];
+	double		*selftime, value;
+	int		*totalstatements;
+	int		i, n, depth, lines;
+	FILE		*f;
+
+	q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, filename);
+	COM_AddExtension (name, ".folded", sizeof(name));
+	f = fopen (name, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open %s\n", name);
+		return;
+	}
+	COM_FlushDirs ();
+
+	selftime = (double *) malloc (q_max(prof_numnodes, 1) * sizeof(double));
+	totalstatements = (int *) malloc (q_max(prof_numnodes, 1) * sizeof(int));
+	if (!selftime || !totalstatements)
+		Sys_Error ("PR_ProfileFlamegraph: out of memory");
+	PR_ProfileTotals (selftime, totalstatements);
+
+	for (i = 0, lines = 0; i < prof_numnodes; i++)
+	{
+		value = statements ? prof_nodes[i].statements : selftime[i] * 1000000.0;
+		if (value < 0.5)
+			continue;
+		for (n = i, depth = 0; n >= 0 && depth < PROF_MAX_DEPTH; n = prof_nodes[n].parent)
+			path[depth++] = n;
+		while (depth--)
+			fprintf (f, "%s%c", PR_ProfileName (prof_nodes[path[depth]].func), depth ? ';' : ' ');
+		fprintf (f, "%.0f\n", value);
+		lines++;
+	}
+	fclose (f);
+
+	Con_Printf ("wrote %i stacks to %s\n", lines, name);
+	free (totalstatements);
+	free (selftime);
+}
+
+/*
+============
+PR_Profile_Cmd_f
+
+pr_profile start|stop|report [count]|flamegraph [file] [statements]
+============
+*/
+void PR_Profile_Cmd_f (void)
+{
+	const char	*cmd = (Cmd_Argc() > 1) ? Cmd_Argv(1) : "";
+
+	if (!strcmp (cmd, "start"))
+	{
+		PR_ProfileClear ();
+		pr_profiling = true;
+		Con_Printf ("profiling progs calls\n");
+	}
+	else if (!strcmp (cmd, "stop"))
+	{
+		if (pr_profiling)
+			prof_elapsed += Sys_DoubleTime () - prof_started;
+		pr_profiling = false;
+	}
+	else if (!strcmp (cmd, "report") && progs)
+	{
+		if (pr_profiling)
+		{
+			prof_elapsed += Sys_DoubleTime () - prof_started;
+			prof_started = Sys_DoubleTime ();
+		}
+		PR_ProfileReport ((Cmd_Argc() > 2) ? Q_atoi (Cmd_Argv(2)) : 20);
+	}
+	else if (!strcmp (cmd, "flamegraph") && progs)
+	{
+		if (Cmd_Argc() > 2 && strstr (Cmd_Argv(2), ".."))
+		{
+			Con_Printf ("Relative pathnames are not allowed.\n");
+			return;
+		}
+		PR_ProfileFlamegraph ((Cmd_Argc() > 2) ? Cmd_Argv(2) : "progs",
+			Cmd_Argc() > 3 && !strcmp (Cmd_Argv(3), "statements"));
+	}
+	else
+	{
+		Con_Printf ("pr_profile start|stop|report [count]|flamegraph [file] [statements]\n");
+		Con_Printf ("%s, %i stacks recorded\n", pr_profiling ? "running" : "stopped", prof_numnodes);
+	}
+}
+
+
 /*
 ============
 PR_RunError
@@ -290,6 +765,9 @@ static int PR_EnterFunction (dfunction_t *f)
 	if (pr_depth >= MAX_STACK_DEPTH)
 		PR_RunError("stack overflow");
 
+	if (pr_profiling)
+		PR_ProfilePush (f - pr_functions);
+
 	// save off any locals that the new function steps on
 	c = f->locals;
 	if (localstack_used + c > LOCALSTACK_SIZE)
@@ -326,6 +804,9 @@ static int PR_LeaveFunction (void)
 	if (pr_depth <= 0)
 		Host_Error("prog stack underflow");
 
+	if (pr_profiling)
+		PR_ProfilePop ();
+
 	// Restore locals from the stack
 	c = pr_xfunction->locals;
 	localstack_used -= c;
@@ -344,16 +825,56 @@ static int PR_LeaveFunction (void)
 
 /*
 ====================
-PR_ExecuteProgram
+PR_ExecuteBytecode
 
 The interpretation main loop
+
+With gcc and clang every handler jumps straight to the next one through a
+label table (computed goto), elsewhere it falls back to a switch. Tracing
+swaps in a table that sends every statement through the printer first, so
+the untraced path never tests pr_trace. The runaway counter is still
+bumped for every statement, for the profiler, but only tested on taken
+branches and calls, since a runaway loop has to pass through one of those.
 ====================
 */
 #define OPA ((eval_t *)&pr_globals[(unsigned short)st->a])
 #define OPB ((eval_t *)&pr_globals[(unsigned short)st->b])
 #define OPC ((eval_t *)&pr_globals[(unsigned short)st->c])
 
-void PR_ExecuteProgram (func_t fnum)
+#if defined(__GNUC__) && !defined(PR_SWITCH_DISPATCH)
+#define PR_COMPUTED_GOTO
+#endif
+
+#ifdef PR_COMPUTED_GOTO
+#define OPCASE(op)	lbl_##op:
+#define OPNEXT		do { st++; profile++; goto *dispatch[st->op]; } while (0)
+#define OPDISPATCH()	(dispatch = pr_trace ? trace_table : op_table)
+#else
+#define OPCASE(op)	case op:
+#define OPNEXT		break
+#define OPDISPATCH()
+#endif
+
+// second half of a superinstruction, see PR_FuseStatements
+#define OPFUSED		do { st++; profile++; } while (0)
+
+#ifdef PARANOID
+#define PR_CHECK_EDICT(ed)	NUM_FOR_EDICT(ed)	// Make sure it's in range
+#else
+#define PR_CHECK_EDICT(ed)
+#endif
+
+#define STNUM	(st - pr_statements)
+#define PR_CHECK_RUNAWAY()							\
+	do {									\
+		if (profile > 100000)						\
+		{								\
+			pr_xstatement = STNUM;					\
+			PR_RunError("runaway loop error");			\
+		}								\
+	} while (0)
+
+void PR_ExecuteBytecode (func_t fnum)
 {
 	eval_t		*ptr;
 	dstatement_t	*st;
@@ -361,13 +882,45 @@ void PR_ExecuteProgram (func_t fnum)
 	int profile, startprofile;
 	edict_t		*ed;
 	int		exitdepth;
-
-	if (!fnum || fnum >= progs->numfunctions)
+#ifdef PR_COMPUTED_GOTO
+	static const void *const op_table[OP_NUMOPS] =
 	{
-		if (pr_global_struct->self)
-			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
-		Host_Error ("PR_ExecuteProgram: NULL function");
-	}
+		[0 ... OP_NUMOPS - 1] = &&lbl_bad,
+#define OPLABEL(op)	[op] = &&lbl_##op
+		OPLABEL(OP_DONE), OPLABEL(OP_MUL_F), OPLABEL(OP_MUL_V), OPLABEL(OP_MUL_FV),
+		OPLABEL(OP_MUL_VF), OPLABEL(OP_DIV_F), OPLABEL(OP_ADD_F), OPLABEL(OP_ADD_V),
+		OPLABEL(OP_SUB_F), OPLABEL(OP_SUB_V),
+		OPLABEL(OP_EQ_F), OPLABEL(OP_EQ_V), OPLABEL(OP_EQ_S), OPLABEL(OP_EQ_E), OPLABEL(OP_EQ_FNC),
+		OPLABEL(OP_NE_F), OPLABEL(OP_NE_V), OPLABEL(OP_NE_S), OPLABEL(OP_NE_E), OPLABEL(OP_NE_FNC),
+		OPLABEL(OP_LE), OPLABEL(OP_GE), OPLABEL(OP_LT), OPLABEL(OP_GT),
+		OPLABEL(OP_LOAD_F), OPLABEL(OP_LOAD_V), OPLABEL(OP_LOAD_S), OPLABEL(OP_LOAD_ENT),
+		OPLABEL(OP_LOAD_FLD), OPLABEL(OP_LOAD_FNC),
+		OPLABEL(OP_ADDRESS),
+		OPLABEL(OP_STORE_F), OPLABEL(OP_STORE_V), OPLABEL(OP_STORE_S), OPLABEL(OP_STORE_ENT),
+		OPLABEL(OP_STORE_FLD), OPLABEL(OP_STORE_FNC),
+		OPLABEL(OP_STOREP_F), OPLABEL(OP_STOREP_V), OPLABEL(OP_STOREP_S), OPLABEL(OP_STOREP_ENT),
+		OPLABEL(OP_STOREP_FLD), OPLABEL(OP_STOREP_FNC),
+		OPLABEL(OP_RETURN),
+		OPLABEL(OP_NOT_F), OPLABEL(OP_NOT_V), OPLABEL(OP_NOT_S), OPLABEL(OP_NOT_ENT), OPLABEL(OP_NOT_FNC),
+		OPLABEL(OP_IF), OPLABEL(OP_IFNOT),
+		OPLABEL(OP_CALL0), OPLABEL(OP_CALL1), OPLABEL(OP_CALL2), OPLABEL(OP_CALL3), OPLABEL(OP_CALL4),
+		OPLABEL(OP_CALL5), OPLABEL(OP_CALL6), OPLABEL(OP_CALL7), OPLABEL(OP_CALL8),
+		OPLABEL(OP_STATE), OPLABEL(OP_GOTO), OPLABEL(OP_AND), OPLABEL(OP_OR),
+		OPLABEL(OP_BITAND), OPLABEL(OP_BITOR),
+		OPLABEL(OP_ADDRESS_STOREP), OPLABEL(OP_ADDRESS_STOREP_V),
+		OPLABEL(OP_LOAD_F_EQ), OPLABEL(OP_LOAD_F_NE), OPLABEL(OP_LOAD_F_LE),
+		OPLABEL(OP_LOAD_F_GE), OPLABEL(OP_LOAD_F_LT), OPLABEL(OP_LOAD_F_GT),
+		OPLABEL(OP_EQ_F_IFNOT), OPLABEL(OP_NE_F_IFNOT), OPLABEL(OP_LE_IFNOT),
+		OPLABEL(OP_GE_IFNOT), OPLABEL(OP_LT_IFNOT), OPLABEL(OP_GT_IFNOT),
+		OPLABEL(OP_NOT_F_IFNOT), OPLABEL(OP_IF_GOTO), OPLABEL(OP_IFNOT_GOTO)
+#undef OPLABEL
+	};
+	static const void *const trace_table[OP_NUMOPS] =
+	{
+		[0 ... OP_NUMOPS - 1] = &&lbl_trace
+	};
+	const void *const *dispatch;
+#endif
 
 	f = &pr_functions[fnum];
 
@@ -379,170 +932,182 @@ void PR_ExecuteProgram (func_t fnum)
 	st = &pr_statements[PR_EnterFunction(f)];
 	startprofile = profile = 0;
 
+#ifdef PR_COMPUTED_GOTO
+	OPDISPATCH();
+	OPNEXT;
+
+lbl_trace:
+	PR_PrintStatement(st);
+	if (st->op >= OP_FIRSTFUSED)
+		PR_PrintStatement(st + 1);
+	goto *op_table[st->op];
+#else
     while (1)
     {
 	st++;	/* next statement */
-
-	if (++profile > 100000)
-	{
-		pr_xstatement = st - pr_statements;
-		PR_RunError("runaway loop error");
-	}
+	profile++;
 
 	if (pr_trace)
+	{
 		PR_PrintStatement(st);
+		if (st->op >= OP_FIRSTFUSED)
+			PR_PrintStatement(st + 1);
+	}
 
 	switch (st->op)
 	{
-	case OP_ADD_F:
+#endif
+	OPCASE(OP_ADD_F)
 		OPC->_float = OPA->_float + OPB->_float;
-		break;
-	case OP_ADD_V:
+		OPNEXT;
+	OPCASE(OP_ADD_V)
 		OPC->vector[0] = OPA->vector[0] + OPB->vector[0];
 		OPC->vector[1] = OPA->vector[1] + OPB->vector[1];
 		OPC->vector[2] = OPA->vector[2] + OPB->vector[2];
-		break;
+		OPNEXT;
 
-	case OP_SUB_F:
+	OPCASE(OP_SUB_F)
 		OPC->_float = OPA->_float - OPB->_float;
-		break;
-	case OP_SUB_V:
+		OPNEXT;
+	OPCASE(OP_SUB_V)
 		OPC->vector[0] = OPA->vector[0] - OPB->vector[0];
 		OPC->vector[1] = OPA->vector[1] - OPB->vector[1];
 		OPC->vector[2] = OPA->vector[2] - OPB->vector[2];
-		break;
+		OPNEXT;
 
-	case OP_MUL_F:
+	OPCASE(OP_MUL_F)
 		OPC->_float = OPA->_float * OPB->_float;
-		break;
-	case OP_MUL_V:
+		OPNEXT;
+	OPCASE(OP_MUL_V)
 		OPC->_float = OPA->vector[0] * OPB->vector[0] +
 			      OPA->vector[1] * OPB->vector[1] +
 			      OPA->vector[2] * OPB->vector[2];
-		break;
-	case OP_MUL_FV:
+		OPNEXT;
+	OPCASE(OP_MUL_FV)
 		OPC->vector[0] = OPA->_float * OPB->vector[0];
 		OPC->vector[1] = OPA->_float * OPB->vector[1];
 		OPC->vector[2] = OPA->_float * OPB->vector[2];
-		break;
-	case OP_MUL_VF:
+		OPNEXT;
+	OPCASE(OP_MUL_VF)
 		OPC->vector[0] = OPB->_float * OPA->vector[0];
 		OPC->vector[1] = OPB->_float * OPA->vector[1];
 		OPC->vector[2] = OPB->_float * OPA->vector[2];
-		break;
+		OPNEXT;
 
-	case OP_DIV_F:
+	OPCASE(OP_DIV_F)
 		OPC->_float = OPA->_float / OPB->_float;
-		break;
+		OPNEXT;
 
-	case OP_BITAND:
+	OPCASE(OP_BITAND)
 		OPC->_float = (int)OPA->_float & (int)OPB->_float;
-		break;
+		OPNEXT;
 
-	case OP_BITOR:
+	OPCASE(OP_BITOR)
 		OPC->_float = (int)OPA->_float | (int)OPB->_float;
-		break;
+		OPNEXT;
 
-	case OP_GE:
+	OPCASE(OP_GE)
 		OPC->_float = OPA->_float >= OPB->_float;
-		break;
-	case OP_LE:
+		OPNEXT;
+	OPCASE(OP_LE)
 		OPC->_float = OPA->_float <= OPB->_float;
-		break;
-	case OP_GT:
+		OPNEXT;
+	OPCASE(OP_GT)
 		OPC->_float = OPA->_float > OPB->_float;
-		break;
-	case OP_LT:
+		OPNEXT;
+	OPCASE(OP_LT)
 		OPC->_float = OPA->_float < OPB->_float;
-		break;
-	case OP_AND:
+		OPNEXT;
+	OPCASE(OP_AND)
 		OPC->_float = OPA->_float && OPB->_float;
-		break;
-	case OP_OR:
+		OPNEXT;
+	OPCASE(OP_OR)
 		OPC->_float = OPA->_float || OPB->_float;
-		break;
+		OPNEXT;
 
-	case OP_NOT_F:
+	OPCASE(OP_NOT_F)
 		OPC->_float = !OPA->_float;
-		break;
-	case OP_NOT_V:
+		OPNEXT;
+	OPCASE(OP_NOT_V)
 		OPC->_float = !OPA->vector[0] && !OPA->vector[1] && !OPA->vector[2];
-		break;
-	case OP_NOT_S:
+		OPNEXT;
+	OPCASE(OP_NOT_S)
 		OPC->_float = !OPA->string || !*PR_GetString(OPA->string);
-		break;
-	case OP_NOT_FNC:
+		OPNEXT;
+	OPCASE(OP_NOT_FNC)
 		OPC->_float = !OPA->function;
-		break;
-	case OP_NOT_ENT:
+		OPNEXT;
+	OPCASE(OP_NOT_ENT)
 		OPC->_float = (PROG_TO_EDICT(OPA->edict) == sv.edicts);
-		break;
+		OPNEXT;
 
-	case OP_EQ_F:
+	OPCASE(OP_EQ_F)
 		OPC->_float = OPA->_float == OPB->_float;
-		break;
-	case OP_EQ_V:
+		OPNEXT;
+	OPCASE(OP_EQ_V)
 		OPC->_float = (OPA->vector[0] == OPB->vector[0]) &&
 			      (OPA->vector[1] == OPB->vector[1]) &&
 			      (OPA->vector[2] == OPB->vector[2]);
-		break;
-	case OP_EQ_S:
+		OPNEXT;
+	OPCASE(OP_EQ_S)
 		OPC->_float = !strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
-		break;
-	case OP_EQ_E:
+		OPNEXT;
+	OPCASE(OP_EQ_E)
 		OPC->_float = OPA->_int == OPB->_int;
-		break;
-	case OP_EQ_FNC:
+		OPNEXT;
+	OPCASE(OP_EQ_FNC)
 		OPC->_float = OPA->function == OPB->function;
-		break;
+		OPNEXT;
 
-	case OP_NE_F:
+	OPCASE(OP_NE_F)
 		OPC->_float = OPA->_float != OPB->_float;
-		break;
-	case OP_NE_V:
+		OPNEXT;
+	OPCASE(OP_NE_V)
 		OPC->_float = (OPA->vector[0] != OPB->vector[0]) ||
 			      (OPA->vector[1] != OPB->vector[1]) ||
 			      (OPA->vector[2] != OPB->vector[2]);
-		break;
-	case OP_NE_S:
+		OPNEXT;
+	OPCASE(OP_NE_S)
 		OPC->_float = strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
-		break;
-	case OP_NE_E:
+		OPNEXT;
+	OPCASE(OP_NE_E)
 		OPC->_float = OPA->_int != OPB->_int;
-		break;
-	case OP_NE_FNC:
+		OPNEXT;
+	OPCASE(OP_NE_FNC)
 		OPC->_float = OPA->function != OPB->function;
-		break;
+		OPNEXT;
 
-	case OP_STORE_F:
-	case OP_STORE_ENT:
-	case OP_STORE_FLD:	// integers
-	case OP_STORE_S:
-	case OP_STORE_FNC:	// pointers
+	OPCASE(OP_STORE_F)
+	OPCASE(OP_STORE_ENT)
+	OPCASE(OP_STORE_FLD)	// integers
+	OPCASE(OP_STORE_S)
+	OPCASE(OP_STORE_FNC)	// pointers
 		OPB->_int = OPA->_int;
-		break;
-	case OP_STORE_V:
+		OPNEXT;
+	OPCASE(OP_STORE_V)
 		OPB->vector[0] = OPA->vector[0];
 		OPB->vector[1] = OPA->vector[1];
 		OPB->vector[2] = OPA->vector[2];
-		break;
-
-	case OP_STOREP_F:
-	case OP_STOREP_ENT:
-	case OP_STOREP_FLD:	// integers
-	case OP_STOREP_S:
-	case OP_STOREP_FNC:	// pointers
+		OPNEXT;
+
+	OPCASE(OP_STOREP_F)
+	OPCASE(OP_STOREP_ENT)
+	OPCASE(OP_STOREP_FLD)	// integers
+	OPCASE(OP_STOREP_S)
+	OPCASE(OP_STOREP_FNC)	// pointers
+	storep:
 		ptr = (eval_t *)((byte *)sv.edicts + OPB->_int);
 		ptr->_int = OPA->_int;
-		break;
-	case OP_STOREP_V:
+		OPNEXT;
+	OPCASE(OP_STOREP_V)
+	storep_v:
 		ptr = (eval_t *)((byte *)sv.edicts + OPB->_int);
 		ptr->vector[0] = OPA->vector[0];
 		ptr->vector[1] = OPA->vector[1];
 		ptr->vector[2] = OPA->vector[2];
-		break;
+		OPNEXT;
 
-	case OP_ADDRESS:
+	OPCASE(OP_ADDRESS)
 		ed = PROG_TO_EDICT(OPA->edict);
 #ifdef PARANOID
 		NUM_FOR_EDICT(ed);	// Make sure it's in range
@@ -553,21 +1118,21 @@ void PR_ExecuteProgram (func_t fnum)
 			PR_RunError("assignment to world entity");
 		}
 		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)sv.edicts;
-		break;
+		OPNEXT;
 
-	case OP_LOAD_F:
-	case OP_LOAD_FLD:
-	case OP_LOAD_ENT:
-	case OP_LOAD_S:
-	case OP_LOAD_FNC:
+	OPCASE(OP_LOAD_F)
+	OPCASE(OP_LOAD_FLD)
+	OPCASE(OP_LOAD_ENT)
+	OPCASE(OP_LOAD_S)
+	OPCASE(OP_LOAD_FNC)
 		ed = PROG_TO_EDICT(OPA->edict);
 #ifdef PARANOID
 		NUM_FOR_EDICT(ed);	// Make sure it's in range
 #endif
 		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
-		break;
+		OPNEXT;
 
-	case OP_LOAD_V:
+	OPCASE(OP_LOAD_V)
 		ed = PROG_TO_EDICT(OPA->edict);
 #ifdef PARANOID
 		NUM_FOR_EDICT(ed);	// Make sure it's in range
@@ -576,31 +1141,41 @@ void PR_ExecuteProgram (func_t fnum)
 		OPC->vector[0] = ptr->vector[0];
 		OPC->vector[1] = ptr->vector[1];
 		OPC->vector[2] = ptr->vector[2];
-		break;
+		OPNEXT;
 
-	case OP_IFNOT:
+	OPCASE(OP_IFNOT)
+	ifnot:
 		if (!OPA->_int)
+		{
+			PR_CHECK_RUNAWAY();
 			st += st->b - 1;	/* -1 to offset the st++ */
-		break;
+		}
+		OPNEXT;
 
-	case OP_IF:
+	OPCASE(OP_IF)
 		if (OPA->_int)
+		{
+			PR_CHECK_RUNAWAY();
 			st += st->b - 1;	/* -1 to offset the st++ */
-		break;
+		}
+		OPNEXT;
 
-	case OP_GOTO:
+	OPCASE(OP_GOTO)
+	jump:
+		PR_CHECK_RUNAWAY();
 		st += st->a - 1;		/* -1 to offset the st++ */
-		break;
-
-	case OP_CALL0:
-	case OP_CALL1:
-	case OP_CALL2:
-	case OP_CALL3:
-	case OP_CALL4:
-	case OP_CALL5:
-	case OP_CALL6:
-	case OP_CALL7:
-	case OP_CALL8:
+		OPNEXT;
+
+	OPCASE(OP_CALL0)
+	OPCASE(OP_CALL1)
+	OPCASE(OP_CALL2)
+	OPCASE(OP_CALL3)
+	OPCASE(OP_CALL4)
+	OPCASE(OP_CALL5)
+	OPCASE(OP_CALL6)
+	OPCASE(OP_CALL7)
+	OPCASE(OP_CALL8)
+		PR_CHECK_RUNAWAY();
 		pr_xfunction->profile += profile - startprofile;
 		startprofile = profile;
 		pr_xstatement = st - pr_statements;
@@ -613,15 +1188,21 @@ void PR_ExecuteProgram (func_t fnum)
 			int i = -newf->first_statement;
 			if (i >= pr_numbuiltins)
 				PR_RunError("Bad builtin call number %d", i);
-			pr_builtins[i]();
-			break;
+			if (pr_irverify == IRVERIFY_RECORD)
+				PR_RecordBuiltin (i);
+			else if (pr_profiling)
+				PR_ProfileBuiltin (i);
+			else
+				pr_builtins[i]();
+			OPDISPATCH();	// traceon/traceoff, or a nested PR_ExecuteProgram
+			OPNEXT;
 		}
 		// Normal function
 		st = &pr_statements[PR_EnterFunction(newf)];
-		break;
+		OPNEXT;
 
-	case OP_DONE:
-	case OP_RETURN:
+	OPCASE(OP_DONE)
+	OPCASE(OP_RETURN)
 		pr_xfunction->profile += profile - startprofile;
 		startprofile = profile;
 		pr_xstatement = st - pr_statements;
@@ -633,22 +1214,739 @@ void PR_ExecuteProgram (func_t fnum)
 		{ // Done
 			return;
 		}
-		break;
+		OPNEXT;
 
-	case OP_STATE:
+	OPCASE(OP_STATE)
 		ed = PROG_TO_EDICT(pr_global_struct->self);
 		ed->v.nextthink = pr_global_struct->time + 0.1;
 		ed->v.frame = OPA->_float;
 		ed->v.think = OPB->function;
-		break;
+		OPNEXT;
 
-	default:
-		pr_xstatement = st - pr_statements;
-		PR_RunError("Bad opcode %i", st->op);
-	}
-    }	/* end of while(1) loop */
-}
-#undef OPA
-#undef OPB
-#undef OPC
+// superinstructions: the first statement, then the second one in place
+	OPCASE(OP_ADDRESS_STOREP)
+	OPCASE(OP_ADDRESS_STOREP_V)
+		ed = PROG_TO_EDICT(OPA->edict);
+		PR_CHECK_EDICT(ed);
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+		{
+			pr_xstatement = st - pr_statements;
+			PR_RunError("assignment to world entity");
+		}
+		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)sv.edicts;
+		if (st->op == OP_ADDRESS_STOREP_V)
+		{
+			OPFUSED;
+			goto storep_v;
+		}
+		OPFUSED;
+		goto storep;
+
+	OPCASE(OP_LOAD_F_EQ)
+		ed = PROG_TO_EDICT(OPA->edict);
+		PR_CHECK_EDICT(ed);
+		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
+		OPFUSED;
+		OPC->_float = OPA->_float == OPB->_float;
+		OPNEXT;
+	OPCASE(OP_LOAD_F_NE)
+		ed = PROG_TO_EDICT(OPA->edict);
+		PR_CHECK_EDICT(ed);
+		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
+		OPFUSED;
+		OPC->_float = OPA->_float != OPB->_float;
+		OPNEXT;
+	OPCASE(OP_LOAD_F_LE)
+		ed = PROG_TO_EDICT(OPA->edict);
+		PR_CHECK_EDICT(ed);
+		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
+		OPFUSED;
+		OPC->_float = OPA->_float <= OPB->_float;
+		OPNEXT;
+	OPCASE(OP_LOAD_F_GE)
+		ed = PROG_TO_EDICT(OPA->edict);
+		PR_CHECK_EDICT(ed);
+		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
+		OPFUSED;
+		OPC->_float = OPA->_float >= OPB->_float;
+		OPNEXT;
+	OPCASE(OP_LOAD_F_LT)
+		ed = PROG_TO_EDICT(OPA->edict);
+		PR_CHECK_EDICT(ed);
+		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
+		OPFUSED;
+		OPC->_float = OPA->_float < OPB->_float;
+		OPNEXT;
+	OPCASE(OP_LOAD_F_GT)
+		ed = PROG_TO_EDICT(OPA->edict);
+		PR_CHECK_EDICT(ed);
+		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
+		OPFUSED;
+		OPC->_float = OPA->_float > OPB->_float;
+		OPNEXT;
 
+	OPCASE(OP_EQ_F_IFNOT)
+		OPC->_float = OPA->_float == OPB->_float;
+		OPFUSED;
+		goto ifnot;
+	OPCASE(OP_NE_F_IFNOT)
+		OPC->_float = OPA->_float != OPB->_float;
+		OPFUSED;
+		goto ifnot;
+	OPCASE(OP_LE_IFNOT)
+		OPC->_float = OPA->_float <= OPB->_float;
+		OPFUSED;
+		goto ifnot;
+	OPCASE(OP_GE_IFNOT)
+		OPC->_float = OPA->_float >= OPB->_float;
+		OPFUSED;
+		goto ifnot;
+	OPCASE(OP_LT_IFNOT)
+		OPC->_float = OPA->_float < OPB->_float;
+		OPFUSED;
+		goto ifnot;
+	OPCASE(OP_GT_IFNOT)
+		OPC->_float = OPA->_float > OPB->_float;
+		OPFUSED;
+		goto ifnot;
+	OPCASE(OP_NOT_F_IFNOT)
+		OPC->_float = !OPA->_float;
+		OPFUSED;
+		goto ifnot;
+
+	OPCASE(OP_IF_GOTO)
+		if (OPA->_int)
+		{
+			PR_CHECK_RUNAWAY();
+			st += st->b - 1;	/* -1 to offset the st++ */
+			OPNEXT;
+		}
+		OPFUSED;
+		goto jump;
+	OPCASE(OP_IFNOT_GOTO)
+		if (!OPA->_int)
+		{
+			PR_CHECK_RUNAWAY();
+			st += st->b - 1;	/* -1 to offset the st++ */
+			OPNEXT;
+		}
+		OPFUSED;
+		goto jump;
+
+#ifdef PR_COMPUTED_GOTO
+lbl_bad:
+#else
+	default:
+#endif
+		pr_xstatement = st - pr_statements;
+		PR_RunError("Bad opcode %i", st->op);
+#ifndef PR_COMPUTED_GOTO
+	}
+    }	/* end of while(1) loop */
+#endif
+}
+#undef OPA
+#undef OPB
+#undef OPC
+
+/*
+====================
+PR_ExecuteIR
+
+Runs the translated form of the progs, see pr_ir.c. Same handlers as the
+bytecode loop, but operands index the globals directly, branch targets are
+absolute and calls may already be bound to their function or builtin.
+====================
+*/
+#define OPA ((eval_t *)&pr_globals[st->a])
+#define OPB ((eval_t *)&pr_globals[st->b])
+#define OPC ((eval_t *)&pr_globals[st->c])
+#undef STNUM
+#define STNUM	(pr_irsource[st - pr_ir])
+
+static int	ir_stack[MAX_STACK_DEPTH];	// return instruction of each frame
+
+void PR_ExecuteIR (func_t fnum)
+{
+	eval_t		*ptr;
+	irstatement_t	*st;
+	dfunction_t	*f, *newf;
+	int profile, startprofile;
+	edict_t		*ed;
+	int		exitdepth, i;
+#ifdef PR_COMPUTED_GOTO
+	static const void *const op_table[IR_NUMOPS] =
+	{
+		[0 ... IR_NUMOPS - 1] = &&lbl_bad,
+#define OPLABEL(op)	[op] = &&lbl_##op
+		OPLABEL(OP_DONE), OPLABEL(OP_MUL_F), OPLABEL(OP_MUL_V), OPLABEL(OP_MUL_FV),
+		OPLABEL(OP_MUL_VF), OPLABEL(OP_DIV_F), OPLABEL(OP_ADD_F), OPLABEL(OP_ADD_V),
+		OPLABEL(OP_SUB_F), OPLABEL(OP_SUB_V),
+		OPLABEL(OP_EQ_F), OPLABEL(OP_EQ_V), OPLABEL(OP_EQ_S), OPLABEL(OP_EQ_E), OPLABEL(OP_EQ_FNC),
+		OPLABEL(OP_NE_F), OPLABEL(OP_NE_V), OPLABEL(OP_NE_S), OPLABEL(OP_NE_E), OPLABEL(OP_NE_FNC),
+		OPLABEL(OP_LE), OPLABEL(OP_GE), OPLABEL(OP_LT), OPLABEL(OP_GT),
+		OPLABEL(OP_LOAD_F), OPLABEL(OP_LOAD_V), OPLABEL(OP_LOAD_S), OPLABEL(OP_LOAD_ENT),
+		OPLABEL(OP_LOAD_FLD), OPLABEL(OP_LOAD_FNC),
+		OPLABEL(OP_ADDRESS),
+		OPLABEL(OP_STORE_F), OPLABEL(OP_STORE_V), OPLABEL(OP_STORE_S), OPLABEL(OP_STORE_ENT),
+		OPLABEL(OP_STORE_FLD), OPLABEL(OP_STORE_FNC),
+		OPLABEL(OP_STOREP_F), OPLABEL(OP_STOREP_V), OPLABEL(OP_STOREP_S), OPLABEL(OP_STOREP_ENT),
+		OPLABEL(OP_STOREP_FLD), OPLABEL(OP_STOREP_FNC),
+		OPLABEL(OP_RETURN),
+		OPLABEL(OP_NOT_F), OPLABEL(OP_NOT_V), OPLABEL(OP_NOT_S), OPLABEL(OP_NOT_ENT), OPLABEL(OP_NOT_FNC),
+		OPLABEL(OP_IF), OPLABEL(OP_IFNOT),
+		OPLABEL(OP_STATE), OPLABEL(OP_GOTO), OPLABEL(OP_AND), OPLABEL(OP_OR),
+		OPLABEL(OP_BITAND), OPLABEL(OP_BITOR),
+		OPLABEL(IR_STORE_IMM), OPLABEL(IR_CALL), OPLABEL(IR_CALL_FUNC), OPLABEL(IR_CALL_BUILTIN),
+		OPLABEL(IR_STATE_IMM)
+#undef OPLABEL
+	};
+	static const void *const trace_table[IR_NUMOPS] =
+	{
+		[0 ... IR_NUMOPS - 1] = &&lbl_trace
+	};
+	const void *const *dispatch;
+#endif
+
+	f = &pr_functions[fnum];
+
+	pr_trace = false;
+
+// make a stack frame
+	exitdepth = pr_depth;
+
+	PR_EnterFunction(f);
+	st = pr_ir + pr_irfunctions[fnum] - 1;
+	startprofile = profile = 0;
+
+#ifdef PR_COMPUTED_GOTO
+	OPDISPATCH();
+	OPNEXT;
+
+lbl_trace:
+	PR_PrintStatement(pr_statements + STNUM);
+	goto *op_table[st->op];
+#else
+    while (1)
+    {
+	st++;	/* next statement */
+	profile++;
+
+	if (pr_trace)
+		PR_PrintStatement(pr_statements + STNUM);
+
+	switch (st->op)
+	{
+#endif
+	OPCASE(OP_ADD_F)
+		OPC->_float = OPA->_float + OPB->_float;
+		OPNEXT;
+	OPCASE(OP_ADD_V)
+		OPC->vector[0] = OPA->vector[0] + OPB->vector[0];
+		OPC->vector[1] = OPA->vector[1] + OPB->vector[1];
+		OPC->vector[2] = OPA->vector[2] + OPB->vector[2];
+		OPNEXT;
+
+	OPCASE(OP_SUB_F)
+		OPC->_float = OPA->_float - OPB->_float;
+		OPNEXT;
+	OPCASE(OP_SUB_V)
+		OPC->vector[0] = OPA->vector[0] - OPB->vector[0];
+		OPC->vector[1] = OPA->vector[1] - OPB->vector[1];
+		OPC->vector[2] = OPA->vector[2] - OPB->vector[2];
+		OPNEXT;
+
+	OPCASE(OP_MUL_F)
+		OPC->_float = OPA->_float * OPB->_float;
+		OPNEXT;
+	OPCASE(OP_MUL_V)
+		OPC->_float = OPA->vector[0] * OPB->vector[0] +
+			      OPA->vector[1] * OPB->vector[1] +
+			      OPA->vector[2] * OPB->vector[2];
+		OPNEXT;
+	OPCASE(OP_MUL_FV)
+		OPC->vector[0] = OPA->_float * OPB->vector[0];
+		OPC->vector[1] = OPA->_float * OPB->vector[1];
+		OPC->vector[2] = OPA->_float * OPB->vector[2];
+		OPNEXT;
+	OPCASE(OP_MUL_VF)
+		OPC->vector[0] = OPB->_float * OPA->vector[0];
+		OPC->vector[1] = OPB->_float * OPA->vector[1];
+		OPC->vector[2] = OPB->_float * OPA->vector[2];
+		OPNEXT;
+
+	OPCASE(OP_DIV_F)
+		OPC->_float = OPA->_float / OPB->_float;
+		OPNEXT;
+
+	OPCASE(OP_BITAND)
+		OPC->_float = (int)OPA->_float & (int)OPB->_float;
+		OPNEXT;
+
+	OPCASE(OP_BITOR)
+		OPC->_float = (int)OPA->_float | (int)OPB->_float;
+		OPNEXT;
+
+	OPCASE(OP_GE)
+		OPC->_float = OPA->_float >= OPB->_float;
+		OPNEXT;
+	OPCASE(OP_LE)
+		OPC->_float = OPA->_float <= OPB->_float;
+		OPNEXT;
+	OPCASE(OP_GT)
+		OPC->_float = OPA->_float > OPB->_float;
+		OPNEXT;
+	OPCASE(OP_LT)
+		OPC->_float = OPA->_float < OPB->_float;
+		OPNEXT;
+	OPCASE(OP_AND)
+		OPC->_float = OPA->_float && OPB->_float;
+		OPNEXT;
+	OPCASE(OP_OR)
+		OPC->_float = OPA->_float || OPB->_float;
+		OPNEXT;
+
+	OPCASE(OP_NOT_F)
+		OPC->_float = !OPA->_float;
+		OPNEXT;
+	OPCASE(OP_NOT_V)
+		OPC->_float = !OPA->vector[0] && !OPA->vector[1] && !OPA->vector[2];
+		OPNEXT;
+	OPCASE(OP_NOT_S)
+		OPC->_float = !OPA->string || !*PR_GetString(OPA->string);
+		OPNEXT;
+	OPCASE(OP_NOT_FNC)
+		OPC->_float = !OPA->function;
+		OPNEXT;
+	OPCASE(OP_NOT_ENT)
+		OPC->_float = (PROG_TO_EDICT(OPA->edict) == sv.edicts);
+		OPNEXT;
+
+	OPCASE(OP_EQ_F)
+		OPC->_float = OPA->_float == OPB->_float;
+		OPNEXT;
+	OPCASE(OP_EQ_V)
+		OPC->_float = (OPA->vector[0] == OPB->vector[0]) &&
+			      (OPA->vector[1] == OPB->vector[1]) &&
+			      (OPA->vector[2] == OPB->vector[2]);
+		OPNEXT;
+	OPCASE(OP_EQ_S)
+		OPC->_float = !strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
+		OPNEXT;
+	OPCASE(OP_EQ_E)
+		OPC->_float = OPA->_int == OPB->_int;
+		OPNEXT;
+	OPCASE(OP_EQ_FNC)
+		OPC->_float = OPA->function == OPB->function;
+		OPNEXT;
+
+	OPCASE(OP_NE_F)
+		OPC->_float = OPA->_float != OPB->_float;
+		OPNEXT;
+	OPCASE(OP_NE_V)
+		OPC->_float = (OPA->vector[0] != OPB->vector[0]) ||
+			      (OPA->vector[1] != OPB->vector[1]) ||
+			      (OPA->vector[2] != OPB->vector[2]);
+		OPNEXT;
+	OPCASE(OP_NE_S)
+		OPC->_float = strcmp(PR_GetString(OPA->string), PR_GetString(OPB->string));
+		OPNEXT;
+	OPCASE(OP_NE_E)
+		OPC->_float = OPA->_int != OPB->_int;
+		OPNEXT;
+	OPCASE(OP_NE_FNC)
+		OPC->_float = OPA->function != OPB->function;
+		OPNEXT;
+
+	OPCASE(OP_STORE_F)
+	OPCASE(OP_STORE_ENT)
+	OPCASE(OP_STORE_FLD)	// integers
+	OPCASE(OP_STORE_S)
+	OPCASE(OP_STORE_FNC)	// pointers
+		OPB->_int = OPA->_int;
+		OPNEXT;
+	OPCASE(OP_STORE_V)
+		OPB->vector[0] = OPA->vector[0];
+		OPB->vector[1] = OPA->vector[1];
+		OPB->vector[2] = OPA->vector[2];
+		OPNEXT;
+	OPCASE(IR_STORE_IMM)
+		OPB->_int = st->a;
+		OPNEXT;
+
+	OPCASE(OP_STOREP_F)
+	OPCASE(OP_STOREP_ENT)
+	OPCASE(OP_STOREP_FLD)	// integers
+	OPCASE(OP_STOREP_S)
+	OPCASE(OP_STOREP_FNC)	// pointers
+		ptr = (eval_t *)((byte *)sv.edicts + OPB->_int);
+		ptr->_int = OPA->_int;
+		OPNEXT;
+	OPCASE(OP_STOREP_V)
+		ptr = (eval_t *)((byte *)sv.edicts + OPB->_int);
+		ptr->vector[0] = OPA->vector[0];
+		ptr->vector[1] = OPA->vector[1];
+		ptr->vector[2] = OPA->vector[2];
+		OPNEXT;
+
+	OPCASE(OP_ADDRESS)
+		ed = PROG_TO_EDICT(OPA->edict);
+		PR_CHECK_EDICT(ed);
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+		{
+			pr_xstatement = STNUM;
+			PR_RunError("assignment to world entity");
+		}
+		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)sv.edicts;
+		OPNEXT;
+
+	OPCASE(OP_LOAD_F)
+	OPCASE(OP_LOAD_FLD)
+	OPCASE(OP_LOAD_ENT)
+	OPCASE(OP_LOAD_S)
+	OPCASE(OP_LOAD_FNC)
+		ed = PROG_TO_EDICT(OPA->edict);
+		PR_CHECK_EDICT(ed);
+		OPC->_int = ((eval_t *)((int *)&ed->v + OPB->_int))->_int;
+		OPNEXT;
+
+	OPCASE(OP_LOAD_V)
+		ed = PROG_TO_EDICT(OPA->edict);
+		PR_CHECK_EDICT(ed);
+		ptr = (eval_t *)((int *)&ed->v + OPB->_int);
+		OPC->vector[0] = ptr->vector[0];
+		OPC->vector[1] = ptr->vector[1];
+		OPC->vector[2] = ptr->vector[2];
+		OPNEXT;
+
+	OPCASE(OP_IFNOT)
+		if (!OPA->_int)
+		{
+			PR_CHECK_RUNAWAY();
+			st = pr_ir + st->b - 1;	/* -1 to offset the st++ */
+		}
+		OPNEXT;
+
+	OPCASE(OP_IF)
+		if (OPA->_int)
+		{
+			PR_CHECK_RUNAWAY();
+			st = pr_ir + st->b - 1;	/* -1 to offset the st++ */
+		}
+		OPNEXT;
+
+	OPCASE(OP_GOTO)
+		PR_CHECK_RUNAWAY();
+		st = pr_ir + st->a - 1;		/* -1 to offset the st++ */
+		OPNEXT;
+
+	OPCASE(IR_CALL)
+	OPCASE(IR_CALL_FUNC)
+	OPCASE(IR_CALL_BUILTIN)
+		PR_CHECK_RUNAWAY();
+		pr_xfunction->profile += profile - startprofile;
+		startprofile = profile;
+		pr_xstatement = STNUM;
+		if (st->op == IR_CALL_BUILTIN)
+		{
+			pr_argc = st->b;
+			i = st->a;
+		}
+		else
+		{
+			if (st->op == IR_CALL_FUNC)
+			{
+				newf = &pr_functions[st->a];
+				pr_argc = st->b;
+			}
+			else
+			{
+				pr_argc = st->b;
+				if (!OPA->function || !pr_functions[OPA->function].first_statement)
+					PR_RunError("NULL function");	// no translation to jump to
+				newf = &pr_functions[OPA->function];
+			}
+			if (newf->first_statement > 0)
+			{
+				// Normal function
+				ir_stack[pr_depth] = st - pr_ir;
+				PR_EnterFunction(newf);
+				st = pr_ir + pr_irfunctions[newf - pr_functions] - 1;
+				OPNEXT;
+			}
+			i = -newf->first_statement;
+			if (i >= pr_numbuiltins)
+				PR_RunError("Bad builtin call number %d", i);
+		}
+		// Built-in function
+		if (pr_irverify == IRVERIFY_REPLAY)
+			PR_ReplayBuiltin (i);
+		else if (pr_profiling)
+			PR_ProfileBuiltin (i);
+		else
+			pr_builtins[i]();
+		OPDISPATCH();	// traceon/traceoff, or a nested PR_ExecuteProgram
+		OPNEXT;
+
+	OPCASE(OP_DONE)
+	OPCASE(OP_RETURN)
+		pr_xfunction->profile += profile - startprofile;
+		startprofile = profile;
+		pr_xstatement = STNUM;
+		pr_globals[OFS_RETURN] = pr_globals[st->a];
+		pr_globals[OFS_RETURN + 1] = pr_globals[st->a + 1];
+		pr_globals[OFS_RETURN + 2] = pr_globals[st->a + 2];
+		PR_LeaveFunction();
+		if (pr_depth == exitdepth)
+		{ // Done
+			return;
+		}
+		st = pr_ir + ir_stack[pr_depth];
+		OPNEXT;
+
+	OPCASE(OP_STATE)
+		ed = PROG_TO_EDICT(pr_global_struct->self);
+		ed->v.nextthink = pr_global_struct->time + 0.1;
+		ed->v.frame = OPA->_float;
+		ed->v.think = OPB->function;
+		OPNEXT;
+	OPCASE(IR_STATE_IMM)
+		ed = PROG_TO_EDICT(pr_global_struct->self);
+		ed->v.nextthink = pr_global_struct->time + 0.1;
+		ed->v.frame = ((eval_t *)&st->a)->_float;
+		ed->v.think = st->b;
+		OPNEXT;
+
+#ifdef PR_COMPUTED_GOTO
+lbl_bad:
+#else
+	default:
+#endif
+		pr_xstatement = STNUM;
+		PR_RunError("Bad opcode %i", st->op);
+#ifndef PR_COMPUTED_GOTO
+	}
+    }	/* end of while(1) loop */
+#endif
+}
+#undef OPA
+#undef OPB
+#undef OPC
+
+/*
+====================
+PR_ExecuteProgram
+
+Runs a progs function from the engine, as bytecode or translated
+====================
+*/
+void PR_ExecuteProgram (func_t fnum)
+{
+	if (!fnum || fnum >= progs->numfunctions)
+	{
+		if (pr_global_struct->self)
+			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
+		Host_Error ("PR_ExecuteProgram: NULL function");
+	}
+
+	if (pr_depth == 0)
+	{	// left over from a PR_RunError or Host_Error
+		prof_depth = 0;
+		pr_irverify = IRVERIFY_OFF;
+	}
+
+	if (!pr_ir || !pr_translate.value || pr_irverify != IRVERIFY_OFF)
+		PR_ExecuteBytecode (fnum);
+	else if (pr_translate.value >= 2 && pr_depth == 0)
+		PR_VerifyProgram (fnum);
+	else
+		PR_ExecuteIR (fnum);
+}
+
+/*
+====================
+PR_FuseStatements
+
+Called by PR_LoadProgs. Rewrites the first statement of common pairs into a
+superinstruction that runs both with one dispatch, and threads branches
+that land on a GOTO. The second statement is left alone, so a branch into
+the middle of a pair still works, and PR_BaseOp maps the new opcode back
+for printing.
+====================
+*/
+static int	pr_fusedstatements;
+
+void PR_FuseStatements (void)
+{
+	dstatement_t	*st, *next;
+	int		i, target, hops;
+
+	pr_fusedstatements = 0;
+
+	for (i = 0; i < progs->numstatements; i++)
+	{
+		if (pr_statements[i].op >= OP_FIRSTFUSED)
+			Host_Error ("PR_LoadProgs: bad opcode %i in statement %i", pr_statements[i].op, i);
+	}
+
+	if (!pr_superinstructions.value)
+		return;
+
+	// thread jumps to jumps, so a chain of GOTOs costs one dispatch
+	for (i = 0; i < progs->numstatements; i++)
+	{
+		st = &pr_statements[i];
+		if (st->op != OP_GOTO && st->op != OP_IF && st->op != OP_IFNOT)
+			continue;
+		target = i + ((st->op == OP_GOTO) ? st->a : st->b);
+		for (hops = 0; hops < 16; hops++)
+		{
+			if (target <= 0 || target >= progs->numstatements || target == i)
+				break;
+			if (pr_statements[target].op != OP_GOTO || pr_statements[target].a == 0)
+				break;
+			target += pr_statements[target].a;
+		}
+		if (target <= 0 || target >= progs->numstatements || target - i != (short)(target - i))
+			continue;
+		if (st->op == OP_GOTO)
+			st->a = target - i;
+		else
+			st->b = target - i;
+	}
+
+	for (i = 0; i < progs->numstatements - 1; i++)
+	{
+		st = &pr_statements[i];
+		next = st + 1;
+
+		switch (st->op)
+		{
+		case OP_ADDRESS:
+			if (next->op == OP_STOREP_V)
+				st->op = OP_ADDRESS_STOREP_V;
+			else if (next->op >= OP_STOREP_F && next->op <= OP_STOREP_FNC)
+				st->op = OP_ADDRESS_STOREP;
+			break;
+		case OP_LOAD_F:
+			switch (next->op)
+			{
+			case OP_EQ_F:	st->op = OP_LOAD_F_EQ;	break;
+			case OP_NE_F:	st->op = OP_LOAD_F_NE;	break;
+			case OP_LE:	st->op = OP_LOAD_F_LE;	break;
+			case OP_GE:	st->op = OP_LOAD_F_GE;	break;
+			case OP_LT:	st->op = OP_LOAD_F_LT;	break;
+			case OP_GT:	st->op = OP_LOAD_F_GT;	break;
+			}
+			break;
+		case OP_EQ_F:
+		case OP_NE_F:
+		case OP_LE:
+		case OP_GE:
+		case OP_LT:
+		case OP_GT:
+		case OP_NOT_F:
+			if (next->op != OP_IFNOT)
+				break;
+			switch (st->op)
+			{
+			case OP_EQ_F:	st->op = OP_EQ_F_IFNOT;	break;
+			case OP_NE_F:	st->op = OP_NE_F_IFNOT;	break;
+			case OP_LE:	st->op = OP_LE_IFNOT;	break;
+			case OP_GE:	st->op = OP_GE_IFNOT;	break;
+			case OP_LT:	st->op = OP_LT_IFNOT;	break;
+			case OP_GT:	st->op = OP_GT_IFNOT;	break;
+			case OP_NOT_F:	st->op = OP_NOT_F_IFNOT;	break;
+			}
+			break;
+		case OP_IF:
+			if (next->op == OP_GOTO)
+				st->op = OP_IF_GOTO;
+			break;
+		case OP_IFNOT:
+			if (next->op == OP_GOTO)
+				st->op = OP_IFNOT_GOTO;
+			break;
+		}
+
+		if (st->op >= OP_FIRSTFUSED)
+			pr_fusedstatements++;
+	}
+
+	Con_DPrintf ("%i superinstructions in %i statements\n", pr_fusedstatements, progs->numstatements);
+}
+
+/*
+============
+PR_Bench_f
+
+pr_bench <function> [count] [self]
+
+Calls a progs function count times with self set to the given edict
+(world by default) and reports statements per second. The function runs
+for real, so pick one without lasting side effects.
+============
+*/
+void PR_Bench_f (void)
+{
+	dfunction_t	*f;
+	double		time;
+	int		i, count, self, statements;
+
+	if (!sv.active)
+	{
+		Con_Printf ("no server running\n");
+		return;
+	}
+	if (Cmd_Argc() < 2)
+	{
+		Con_Printf ("pr_bench <function> [count] [self]\n");
+		return;
+	}
+
+	f = ED_FindFunction (Cmd_Argv(1));
+	if (!f)
+	{
+		Con_Printf ("no function named %s\n", Cmd_Argv(1));
+		return;
+	}
+	if (f->first_statement < 0)
+	{
+		Con_Printf ("%s is a builtin\n", Cmd_Argv(1));
+		return;
+	}
+	count = (Cmd_Argc() > 2) ? q_max (Q_atoi(Cmd_Argv(2)), 1) : 1000;
+	self = (Cmd_Argc() > 3) ? Q_atoi(Cmd_Argv(3)) : 0;
+	if (self < 0 || self >= sv.num_edicts)
+	{
+		Con_Printf ("edict %i out of range\n", self);
+		return;
+	}
+
+	statements = 0;
+	for (i = 0; i < progs->numfunctions; i++)
+		statements -= pr_functions[i].profile;
+
+	time = Sys_DoubleTime ();
+	for (i = 0; i < count; i++)
+	{
+		pr_global_struct->time = sv.time;
+		pr_global_struct->self = EDICT_TO_PROG(EDICT_NUM(self));
+		pr_global_struct->other = EDICT_TO_PROG(sv.edicts);
+		PR_ExecuteProgram (f - pr_functions);
+	}
+	time = Sys_DoubleTime () - time;
+
+	for (i = 0; i < progs->numfunctions; i++)
+		statements += pr_functions[i].profile;
+
+	Con_Printf ("%i calls, %i statements, %.2f ms, %.1f M statements/s\n",
+		count, statements, time * 1000.0, statements / q_max (time, 1e-9) / 1000000.0);
+	Con_Printf ("%i superinstructions, %s dispatch, %s\n", pr_fusedstatements,
+#ifdef PR_COMPUTED_GOTO
+		"computed goto",
+#else
+		"switch",
+#endif
+		(pr_ir && pr_translate.value) ? "translated" : "bytecode");
+}
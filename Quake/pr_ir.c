@@ -0,0 +1,1226 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// pr_ir.c -- translation of progs functions to a register form, run by PR_ExecuteIR
+
+#include "quakedef.h"
+
+const char *PR_GlobalStringNoContents (int ofs);
+
+/*
+The IR keeps the three address shape of the progs statements, but operands
+are plain global indexes, branch targets are absolute, calls through a
+constant are bound to the function or builtin at load time and constants
+can be carried in the instruction. Each function is translated separately:
+
+- branches to a store of a temporary are retargeted so the producer writes
+  the destination directly
+- stores that are overwritten or never read again inside the function are
+  dropped (only for the function's own locals, which nothing else can see)
+- constants are folded and copies to locals are propagated within a block
+- repeated ADDRESS of the same entity and field reuse the first result
+
+The globals of a function are its "registers". Everything outside the
+function's locals range is assumed to change across a call, and pointer
+stores only ever touch edict fields, never globals.
+*/
+
+cvar_t	pr_translate = {"pr_translate", "0", CVAR_NONE};	// 1 = run the IR, 2 = also check it against the bytecode
+
+irstatement_t	*pr_ir;
+int		*pr_irsource;
+int		*pr_irfunctions;
+int		pr_irverify;
+
+typedef struct
+{
+	byte	ra, rb;		// width of the operands read
+	byte	wc, wb;		// width of the operand written, in c or b
+	byte	pure;		// can be dropped if the result is dead
+} iropinfo_t;
+
+static const iropinfo_t ir_opinfo[IR_NUMOPS] =
+{
+	[OP_DONE] = {3, 0, 0, 0, 0},
+	[OP_MUL_F] = {1, 1, 1, 0, 1},
+	[OP_MUL_V] = {3, 3, 1, 0, 1},
+	[OP_MUL_FV] = {1, 3, 3, 0, 1},
+	[OP_MUL_VF] = {3, 1, 3, 0, 1},
+	[OP_DIV_F] = {1, 1, 1, 0, 1},
+	[OP_ADD_F] = {1, 1, 1, 0, 1},
+	[OP_ADD_V] = {3, 3, 3, 0, 1},
+	[OP_SUB_F] = {1, 1, 1, 0, 1},
+	[OP_SUB_V] = {3, 3, 3, 0, 1},
+	[OP_EQ_F] = {1, 1, 1, 0, 1},
+	[OP_EQ_V] = {3, 3, 1, 0, 1},
+	[OP_EQ_S] = {1, 1, 1, 0, 1},
+	[OP_EQ_E] = {1, 1, 1, 0, 1},
+	[OP_EQ_FNC] = {1, 1, 1, 0, 1},
+	[OP_NE_F] = {1, 1, 1, 0, 1},
+	[OP_NE_V] = {3, 3, 1, 0, 1},
+	[OP_NE_S] = {1, 1, 1, 0, 1},
+	[OP_NE_E] = {1, 1, 1, 0, 1},
+	[OP_NE_FNC] = {1, 1, 1, 0, 1},
+	[OP_LE] = {1, 1, 1, 0, 1},
+	[OP_GE] = {1, 1, 1, 0, 1},
+	[OP_LT] = {1, 1, 1, 0, 1},
+	[OP_GT] = {1, 1, 1, 0, 1},
+	[OP_LOAD_F] = {1, 1, 1, 0, 1},
+	[OP_LOAD_V] = {1, 1, 3, 0, 1},
+	[OP_LOAD_S] = {1, 1, 1, 0, 1},
+	[OP_LOAD_ENT] = {1, 1, 1, 0, 1},
+	[OP_LOAD_FLD] = {1, 1, 1, 0, 1},
+	[OP_LOAD_FNC] = {1, 1, 1, 0, 1},
+	[OP_ADDRESS] = {1, 1, 1, 0, 0},	// errors on the world
+	[OP_STORE_F] = {1, 0, 0, 1, 1},
+	[OP_STORE_V] = {3, 0, 0, 3, 1},
+	[OP_STORE_S] = {1, 0, 0, 1, 1},
+	[OP_STORE_ENT] = {1, 0, 0, 1, 1},
+	[OP_STORE_FLD] = {1, 0, 0, 1, 1},
+	[OP_STORE_FNC] = {1, 0, 0, 1, 1},
+	[OP_STOREP_F] = {1, 1, 0, 0, 0},
+	[OP_STOREP_V] = {3, 1, 0, 0, 0},
+	[OP_STOREP_S] = {1, 1, 0, 0, 0},
+	[OP_STOREP_ENT] = {1, 1, 0, 0, 0},
+	[OP_STOREP_FLD] = {1, 1, 0, 0, 0},
+	[OP_STOREP_FNC] = {1, 1, 0, 0, 0},
+	[OP_RETURN] = {3, 0, 0, 0, 0},
+	[OP_NOT_F] = {1, 0, 1, 0, 1},
+	[OP_NOT_V] = {3, 0, 1, 0, 1},
+	[OP_NOT_S] = {1, 0, 1, 0, 1},
+	[OP_NOT_ENT] = {1, 0, 1, 0, 1},
+	[OP_NOT_FNC] = {1, 0, 1, 0, 1},
+	[OP_IF] = {1, 0, 0, 0, 0},
+	[OP_IFNOT] = {1, 0, 0, 0, 0},
+	[OP_CALL0 ... OP_CALL8] = {1, 0, 0, 0, 0},
+	[OP_STATE] = {1, 1, 0, 0, 0},
+	[OP_GOTO] = {0, 0, 0, 0, 0},
+	[OP_AND] = {1, 1, 1, 0, 1},
+	[OP_OR] = {1, 1, 1, 0, 1},
+	[OP_BITAND] = {1, 1, 1, 0, 1},
+	[OP_BITOR] = {1, 1, 1, 0, 1},
+	[IR_NOP] = {0, 0, 0, 0, 1},
+	[IR_STORE_IMM] = {0, 0, 0, 1, 1},
+	[IR_CALL] = {1, 0, 0, 0, 0},
+	[IR_CALL_FUNC] = {0, 0, 0, 0, 0},
+	[IR_CALL_BUILTIN] = {0, 0, 0, 0, 0},
+	[IR_STATE_IMM] = {0, 0, 0, 0, 0},
+};
+
+#define IR_ISCALL(op)	((op) == IR_CALL || (op) == IR_CALL_FUNC || (op) == IR_CALL_BUILTIN)
+#define IR_ISBRANCH(op)	((op) == OP_IF || (op) == OP_IFNOT || (op) == OP_GOTO)
+#define IR_ENDSFLOW(op)	((op) == OP_GOTO || (op) == OP_RETURN || (op) == OP_DONE)
+
+// translation state, only valid inside PR_TranslateProgs
+static byte		*ir_constant;		// global never written at run time
+static int		*ir_mark;		// per statement, function that reached it
+static int		*ir_order;		// reachable statements of a function
+static irstatement_t	*ir_code;		// the function being translated
+static int		*ir_from;		// statement each instruction came from
+static byte		*ir_leader;		// instruction starts a block
+static int		*ir_target;		// branch target, as an instruction
+static int		ir_count;
+
+static int		ir_localstart, ir_numlocals;
+static unsigned int	*ir_live;		// live locals at block entry
+static int		ir_livewords;
+
+static irstatement_t	*ir_out;		// all functions so far
+static int		*ir_outsource;
+static int		ir_outcount, ir_outsize;
+
+static int		ir_folded, ir_propagated, ir_removed, ir_retargeted, ir_reused;
+
+static byte		*ir_localglobal;	// global is a local of some function, kept for verification
+
+/*
+=================
+IR_IsLocal
+=================
+*/
+static qboolean IR_IsLocal (int ofs, int width)
+{
+	return ofs >= ir_localstart && ofs + width <= ir_localstart + ir_numlocals;
+}
+
+/*
+=================
+IR_Written
+
+The global range an instruction writes, 0 if none
+=================
+*/
+static int IR_Written (const irstatement_t *ir, int *ofs)
+{
+	const iropinfo_t *info = &ir_opinfo[ir->op];
+
+	*ofs = 0;
+	if (info->wc)
+	{
+		*ofs = ir->c;
+		return info->wc;
+	}
+	if (info->wb)
+	{
+		*ofs = ir->b;
+		return info->wb;
+	}
+	return 0;
+}
+
+/*
+=================
+IR_FindConstants
+
+A global is a constant if nothing can write it: no statement stores to it,
+it is not one of the engine's system globals, not a function local and not
+restored from savegames.
+=================
+*/
+static void IR_FindConstants (void)
+{
+	dstatement_t	*st;
+	dfunction_t	*f;
+	int		i, j, op, ofs, width;
+	irstatement_t	ir;
+
+	memset (ir_constant, 1, progs->numglobals);
+	memset (ir_constant, 0, q_min (progs->numglobals, (int)(sizeof(globalvars_t) / 4)));
+
+	for (i = 0; i < progs->numstatements; i++)
+	{
+		st = &pr_statements[i];
+		op = PR_BaseOp (st->op);
+		if (op > OP_BITOR)
+			continue;
+		ir.op = op;
+		ir.b = (unsigned short)st->b;
+		ir.c = (unsigned short)st->c;
+		width = IR_Written (&ir, &ofs);
+		for (j = 0; j < width; j++)
+			if (ofs + j < progs->numglobals)
+				ir_constant[ofs + j] = 0;
+	}
+
+	for (i = 1; i < progs->numfunctions; i++)
+	{
+		f = &pr_functions[i];
+		for (j = f->parm_start; j < f->parm_start + f->locals && j < progs->numglobals; j++)
+			if (j >= 0)
+				ir_constant[j] = 0;
+	}
+
+	for (i = 0; i < progs->numglobaldefs; i++)
+	{
+		if (!(pr_globaldefs[i].type & DEF_SAVEGLOBAL))
+			continue;
+		width = ((pr_globaldefs[i].type & ~DEF_SAVEGLOBAL) == ev_vector) ? 3 : 1;
+		for (j = 0; j < width; j++)
+			if (pr_globaldefs[i].ofs + j < progs->numglobals)
+				ir_constant[pr_globaldefs[i].ofs + j] = 0;
+	}
+}
+
+/*
+=================
+IR_Decode
+
+Collects the statements reachable from the function's entry in address
+order and turns them into instructions. Returns false on a malformed
+function.
+=================
+*/
+static qboolean IR_Decode (int fnum)
+{
+	dfunction_t	*f = &pr_functions[fnum];
+	dstatement_t	*st;
+	irstatement_t	*ir;
+	int		*stack, sp, s, t, op, lo, hi, i, func;
+
+	stack = ir_target;	// free until the instructions exist
+	sp = 0;
+	lo = hi = f->first_statement;
+	stack[sp++] = f->first_statement;
+	ir_mark[f->first_statement] = fnum;
+	while (sp)
+	{
+		s = stack[--sp];
+		op = PR_BaseOp (pr_statements[s].op);
+		if (op > OP_BITOR)
+			return false;
+		lo = q_min (lo, s);
+		hi = q_max (hi, s);
+		for (i = 0; i < 2; i++)
+		{
+			if (i == 0)
+			{
+				if (op == OP_GOTO || op == OP_RETURN || op == OP_DONE)
+					continue;
+				t = s + 1;
+			}
+			else if (op == OP_GOTO)
+				t = s + pr_statements[s].a;
+			else if (op == OP_IF || op == OP_IFNOT)
+				t = s + pr_statements[s].b;
+			else
+				continue;
+			if (t <= 0 || t >= progs->numstatements)
+				return false;
+			if (ir_mark[t] != fnum)
+			{
+				ir_mark[t] = fnum;
+				stack[sp++] = t;
+			}
+		}
+	}
+
+	ir_count = 0;
+	for (s = lo; s <= hi; s++)
+		if (ir_mark[s] == fnum)
+			ir_order[ir_count++] = s;
+
+	for (i = 0; i < ir_count; i++)
+	{
+		s = ir_order[i];
+		st = &pr_statements[s];
+		ir = &ir_code[i];
+		ir->op = PR_BaseOp (st->op);
+		ir->pad = 0;
+		ir->a = (unsigned short)st->a;
+		ir->b = (unsigned short)st->b;
+		ir->c = (unsigned short)st->c;
+		ir_from[i] = s;
+		ir_target[i] = -1;
+
+		if (ir->a + ir_opinfo[ir->op].ra > progs->numglobals || ir->b + ir_opinfo[ir->op].rb > progs->numglobals ||
+		    ir->b + ir_opinfo[ir->op].wb > progs->numglobals || ir->c + ir_opinfo[ir->op].wc > progs->numglobals)
+			return false;
+
+		if (ir->op == OP_GOTO)
+			ir_target[i] = s + st->a;
+		else if (ir->op == OP_IF || ir->op == OP_IFNOT)
+			ir_target[i] = s + st->b;
+		else if (ir->op >= OP_CALL0 && ir->op <= OP_CALL8)
+		{
+			ir->b = ir->op - OP_CALL0;
+			ir->op = IR_CALL;
+			func = ((int *)pr_globals)[ir->a];
+			if (ir_constant[ir->a] && func > 0 && func < progs->numfunctions)
+			{
+				if (pr_functions[func].first_statement < 0)
+				{
+					if (-pr_functions[func].first_statement < pr_numbuiltins)
+					{
+						ir->op = IR_CALL_BUILTIN;
+						ir->a = -pr_functions[func].first_statement;
+					}
+				}
+				else if (pr_functions[func].first_statement > 0)
+				{
+					ir->op = IR_CALL_FUNC;
+					ir->a = func;
+				}
+			}
+		}
+	}
+
+	// statement numbers to instruction numbers, through the marks
+	for (i = 0; i < ir_count; i++)
+		ir_mark[ir_order[i]] = -1 - i;
+	for (i = 0; i < ir_count; i++)
+		if (ir_target[i] >= 0)
+			ir_target[i] = -1 - ir_mark[ir_target[i]];
+	for (i = 0; i < ir_count; i++)
+		ir_mark[ir_order[i]] = fnum;
+
+	if (ir_count <= 0)
+		return false;
+	memset (ir_leader, 0, (size_t)ir_count);
+	ir_leader[0] = 1;
+	for (i = 0; i < ir_count; i++)
+	{
+		if (ir_target[i] >= 0)
+			ir_leader[ir_target[i]] = 1;
+		if ((IR_ISBRANCH(ir_code[i].op) || IR_ENDSFLOW(ir_code[i].op)) && i + 1 < ir_count)
+			ir_leader[i + 1] = 1;
+	}
+
+	return true;
+}
+
+/*
+=================
+IR_Uses
+
+Adds the locals an instruction reads to the set. A call can come back into
+the same function, and that activation sees the locals as they are, so a
+call reads whatever the function may read before writing it.
+=================
+*/
+static void IR_Uses (const irstatement_t *ir, unsigned int *set)
+{
+	const iropinfo_t *info = &ir_opinfo[ir->op];
+	int	i, ofs;
+
+	if (IR_ISCALL(ir->op))
+		for (i = 0; i < ir_livewords; i++)
+			set[i] |= ir_live[i];
+
+	for (i = 0; i < info->ra; i++)
+	{
+		ofs = ir->a + i - ir_localstart;
+		if (ofs >= 0 && ofs < ir_numlocals)
+			set[ofs >> 5] |= 1u << (ofs & 31);
+	}
+	for (i = 0; i < info->rb; i++)
+	{
+		ofs = ir->b + i - ir_localstart;
+		if (ofs >= 0 && ofs < ir_numlocals)
+			set[ofs >> 5] |= 1u << (ofs & 31);
+	}
+}
+
+static void IR_Defs (const irstatement_t *ir, unsigned int *set)
+{
+	int	i, ofs, width;
+
+	width = IR_Written (ir, &ofs);
+	for (i = 0; i < width; i++)
+	{
+		if (ofs + i - ir_localstart >= 0 && ofs + i - ir_localstart < ir_numlocals)
+			set[(ofs + i - ir_localstart) >> 5] &= ~(1u << ((ofs + i - ir_localstart) & 31));
+	}
+}
+
+static qboolean IR_AnyLive (const unsigned int *set, int ofs, int width)
+{
+	int	i;
+
+	for (i = 0; i < width; i++)
+	{
+		if (!IR_IsLocal (ofs + i, 1))
+			return true;
+		if (set[(ofs + i - ir_localstart) >> 5] & (1u << ((ofs + i - ir_localstart) & 31)))
+			return true;
+	}
+	return false;
+}
+
+/*
+=================
+IR_Overlaps
+=================
+*/
+static qboolean IR_Overlaps (int a, int awidth, int b, int bwidth)
+{
+	return a < b + bwidth && b < a + awidth;
+}
+
+/*
+=================
+IR_CanRetarget
+
+Whether the producer can write its result to dst instead. Vector ops work
+one component at a time, so neither the old nor the new destination may
+feed a later component, and the store being replaced must not overlap
+itself either.
+=================
+*/
+static qboolean IR_SafeVectorDest (const irstatement_t *ir, int dst)
+{
+	const iropinfo_t *info = &ir_opinfo[ir->op];
+
+	if (info->ra && dst != ir->a && IR_Overlaps (dst, 3, ir->a, info->ra))
+		return false;
+	if (info->ra == 1 && IR_Overlaps (dst, 3, ir->a, 1))
+		return false;
+	if (info->rb && dst != ir->b && IR_Overlaps (dst, 3, ir->b, info->rb))
+		return false;
+	if (info->rb == 1 && IR_Overlaps (dst, 3, ir->b, 1))
+		return false;
+	return true;
+}
+
+static qboolean IR_CanRetarget (const irstatement_t *ir, int dst, int width)
+{
+	const iropinfo_t *info = &ir_opinfo[ir->op];
+
+	if (ir->op == IR_STORE_IMM || info->wc != width || !info->pure)
+		return false;
+	if (width == 1 || ir->op == OP_LOAD_V)
+		return true;
+	if (dst != ir->c && IR_Overlaps (dst, 3, ir->c, 3))
+		return false;
+	return IR_SafeVectorDest (ir, ir->c) && IR_SafeVectorDest (ir, dst);
+}
+
+/*
+=================
+IR_Liveness
+
+Backward dataflow over the locals of the function, then a backward walk of
+every block that drops dead stores and folds "op -> temp; store temp -> x"
+into "op -> x".
+=================
+*/
+static void IR_Liveness (qboolean retarget)
+{
+	unsigned int	*live, *out;
+	int		i, j, end, width, ofs, succ;
+	qboolean	changed;
+	irstatement_t	*ir, *prev;
+
+	ir_livewords = (ir_numlocals + 31) >> 5;
+	if (!ir_livewords)
+		return;
+	memset (ir_live, 0, ir_count * ir_livewords * sizeof(unsigned int));
+	live = (unsigned int *) malloc (ir_livewords * sizeof(unsigned int) * 2);
+	out = live + ir_livewords;
+
+	// ir_live holds the live set at the entry of each block leader, the
+	// first one is also what calls read
+	do
+	{
+		changed = false;
+		for (end = ir_count; end > 0; )
+		{
+			for (i = end - 1; i > 0 && !ir_leader[i]; i--)
+				;
+			// live out of the block
+			memset (out, 0, ir_livewords * sizeof(unsigned int));
+			ir = &ir_code[end - 1];
+			if (!IR_ENDSFLOW(ir->op) && end < ir_count)
+				for (j = 0; j < ir_livewords; j++)
+					out[j] |= ir_live[end * ir_livewords + j];
+			if (ir_target[end - 1] >= 0)
+			{
+				succ = ir_target[end - 1];
+				for (j = 0; j < ir_livewords; j++)
+					out[j] |= ir_live[succ * ir_livewords + j];
+			}
+			for (j = end - 1; j >= i; j--)
+			{
+				IR_Defs (&ir_code[j], out);
+				IR_Uses (&ir_code[j], out);
+			}
+			for (j = 0; j < ir_livewords; j++)
+			{
+				if (ir_live[i * ir_livewords + j] != out[j])
+				{
+					ir_live[i * ir_livewords + j] = out[j];
+					changed = true;
+				}
+			}
+			end = i;
+		}
+	} while (changed);
+
+	for (end = ir_count; end > 0; )
+	{
+		for (i = end - 1; i > 0 && !ir_leader[i]; i--)
+			;
+		memset (live, 0, ir_livewords * sizeof(unsigned int));
+		ir = &ir_code[end - 1];
+		if (!IR_ENDSFLOW(ir->op) && end < ir_count)
+			for (j = 0; j < ir_livewords; j++)
+				live[j] |= ir_live[end * ir_livewords + j];
+		if (ir_target[end - 1] >= 0)
+		{
+			succ = ir_target[end - 1];
+			for (j = 0; j < ir_livewords; j++)
+				live[j] |= ir_live[succ * ir_livewords + j];
+		}
+		for (j = end - 1; j >= i; j--)
+		{
+			ir = &ir_code[j];
+			if (ir->op == IR_NOP)
+				continue;
+			width = IR_Written (ir, &ofs);
+
+			if (width && ir_opinfo[ir->op].pure && !IR_AnyLive (live, ofs, width))
+			{
+				ir->op = IR_NOP;
+				ir_removed++;
+				continue;
+			}
+
+			if (retarget && j > i && (ir->op == OP_STORE_F || ir->op == OP_STORE_S || ir->op == OP_STORE_ENT ||
+				ir->op == OP_STORE_FLD || ir->op == OP_STORE_FNC || ir->op == OP_STORE_V))
+			{
+				width = ir_opinfo[ir->op].wb;
+				prev = &ir_code[j - 1];
+				if (IR_IsLocal (ir->a, width) && !IR_AnyLive (live, ir->a, width) &&
+					prev->c == ir->a && IR_CanRetarget (prev, ir->b, width))
+				{
+					prev->c = ir->b;
+					ir->op = IR_NOP;
+					ir_retargeted++;
+					continue;
+				}
+			}
+
+			IR_Defs (ir, live);
+			IR_Uses (ir, live);
+		}
+		end = i;
+	}
+
+	free (live);
+}
+
+/*
+=================
+IR_Fold
+
+Folds a float op on two known values, false if it can't
+=================
+*/
+static qboolean IR_Fold (int op, eval_t a, eval_t b, eval_t *c)
+{
+	switch (op)
+	{
+	case OP_ADD_F:	c->_float = a._float + b._float;	break;
+	case OP_SUB_F:	c->_float = a._float - b._float;	break;
+	case OP_MUL_F:	c->_float = a._float * b._float;	break;
+	case OP_DIV_F:	c->_float = a._float / b._float;	break;
+	case OP_EQ_F:	c->_float = a._float == b._float;	break;
+	case OP_NE_F:	c->_float = a._float != b._float;	break;
+	case OP_LE:	c->_float = a._float <= b._float;	break;
+	case OP_GE:	c->_float = a._float >= b._float;	break;
+	case OP_LT:	c->_float = a._float < b._float;	break;
+	case OP_GT:	c->_float = a._float > b._float;	break;
+	case OP_AND:	c->_float = a._float && b._float;	break;
+	case OP_OR:	c->_float = a._float || b._float;	break;
+	case OP_NOT_F:	c->_float = !a._float;	break;
+	case OP_EQ_E:
+	case OP_EQ_FNC:	c->_float = a._int == b._int;	break;
+	case OP_NE_E:
+	case OP_NE_FNC:	c->_float = a._int != b._int;	break;
+	case OP_BITAND:
+	case OP_BITOR:
+		if (!(a._float > -2147483648.0f && a._float < 2147483648.0f) ||
+		    !(b._float > -2147483648.0f && b._float < 2147483648.0f))
+			return false;
+		if (op == OP_BITAND)
+			c->_float = (int)a._float & (int)b._float;
+		else
+			c->_float = (int)a._float | (int)b._float;
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+/*
+=================
+IR_Forward
+
+Constant folding, copy propagation and ADDRESS reuse inside each block.
+What is known about a local is forgotten when it is written; what is known
+about any other global is also forgotten at calls.
+=================
+*/
+#define IR_MAXFACTS	64
+
+typedef struct
+{
+	int	dst;		// local holding a copy of src, or a known value
+	int	src;		// -1 for a known value
+	int	value;
+} irfact_t;
+
+typedef struct
+{
+	int	ent, field, result;
+} iraddr_t;
+
+static void IR_Forward (void)
+{
+	irfact_t	facts[IR_MAXFACTS];
+	iraddr_t	addrs[IR_MAXFACTS];
+	int		numfacts, numaddrs;
+	int		i, j, k, ofs, width;
+	irstatement_t	*ir;
+	eval_t		va, vb, vc;
+	qboolean	ka, kb;
+
+	numfacts = numaddrs = 0;
+	for (i = 0; i < ir_count; i++)
+	{
+		ir = &ir_code[i];
+		if (ir_leader[i])
+			numfacts = numaddrs = 0;
+		if (ir->op == IR_NOP)
+			continue;
+
+		// substitute copies into one wide reads, vector ops read them again
+		// for every component so those must not write over either one
+		for (k = 0; k < numfacts; k++)
+		{
+			if (facts[k].src < 0)
+				continue;
+			if (ir_opinfo[ir->op].wc == 3 &&
+			   (IR_Overlaps (ir->c, 3, facts[k].dst, 1) || IR_Overlaps (ir->c, 3, facts[k].src, 1)))
+				continue;
+			if (ir_opinfo[ir->op].ra == 1 && ir->a == facts[k].dst)
+			{
+				ir->a = facts[k].src;
+				ir_propagated++;
+			}
+			if (ir_opinfo[ir->op].rb == 1 && ir->b == facts[k].dst)
+			{
+				ir->b = facts[k].src;
+				ir_propagated++;
+			}
+		}
+
+		// known operand values
+		ka = kb = false;
+		va._int = vb._int = 0;
+		if (ir_opinfo[ir->op].ra == 1)
+		{
+			if (ir_constant[ir->a])
+			{
+				va._int = ((int *)pr_globals)[ir->a];
+				ka = true;
+			}
+			for (k = 0; k < numfacts && !ka; k++)
+				if (facts[k].src < 0 && facts[k].dst == ir->a)
+				{
+					va._int = facts[k].value;
+					ka = true;
+				}
+		}
+		if (ir_opinfo[ir->op].rb == 1)
+		{
+			if (ir_constant[ir->b])
+			{
+				vb._int = ((int *)pr_globals)[ir->b];
+				kb = true;
+			}
+			for (k = 0; k < numfacts && !kb; k++)
+				if (facts[k].src < 0 && facts[k].dst == ir->b)
+				{
+					vb._int = facts[k].value;
+					kb = true;
+				}
+		}
+
+		if (ka && (kb || !ir_opinfo[ir->op].rb) && ir_opinfo[ir->op].wc == 1 && IR_Fold (ir->op, va, vb, &vc))
+		{
+			ir->op = IR_STORE_IMM;
+			ir->b = ir->c;
+			ir->a = vc._int;
+			ir->c = 0;
+			ir_folded++;
+		}
+		else if (ka && (ir->op == OP_IF || ir->op == OP_IFNOT))
+		{
+			if (!va._int == (ir->op == OP_IFNOT))
+				ir->op = OP_GOTO;
+			else
+			{
+				ir->op = IR_NOP;
+				ir_target[i] = -1;
+			}
+			ir_folded++;
+		}
+		else if (ka && kb && ir->op == OP_STATE)
+		{
+			ir->op = IR_STATE_IMM;
+			ir->a = va._int;
+			ir->b = vb._int;
+			ir_folded++;
+		}
+		else if (ir->op == OP_ADDRESS)
+		{
+			for (k = 0; k < numaddrs; k++)
+				if (addrs[k].ent == ir->a && addrs[k].field == ir->b)
+					break;
+			if (k < numaddrs && addrs[k].result != ir->c)
+			{
+				ir->op = OP_STORE_F;
+				ir->a = addrs[k].result;
+				ir->b = ir->c;
+				ir->c = 0;
+				ir_reused++;
+			}
+		}
+
+		// forget whatever the instruction overwrote
+		width = IR_Written (ir, &ofs);
+		for (k = 0; k < numfacts; )
+		{
+			if (IR_Overlaps (ofs, width, facts[k].dst, 1) ||
+			   (facts[k].src >= 0 && IR_Overlaps (ofs, width, facts[k].src, 1)) ||
+			   (IR_ISCALL(ir->op) && (!IR_IsLocal (facts[k].dst, 1) ||
+			   (facts[k].src >= 0 && !IR_IsLocal (facts[k].src, 1) && !ir_constant[facts[k].src]))))
+				facts[k] = facts[--numfacts];
+			else
+				k++;
+		}
+		for (k = 0; k < numaddrs; )
+		{
+			if (IR_Overlaps (ofs, width, addrs[k].ent, 1) || IR_Overlaps (ofs, width, addrs[k].field, 1) ||
+			    IR_Overlaps (ofs, width, addrs[k].result, 1) ||
+			   (IR_ISCALL(ir->op) && (!IR_IsLocal (addrs[k].result, 1) ||
+			   (!IR_IsLocal (addrs[k].ent, 1) && !ir_constant[addrs[k].ent]) ||
+			   (!IR_IsLocal (addrs[k].field, 1) && !ir_constant[addrs[k].field]))))
+				addrs[k] = addrs[--numaddrs];
+			else
+				k++;
+		}
+
+		// and learn from it
+		if (ir->op == IR_STORE_IMM && IR_IsLocal (ir->b, 1) && numfacts < IR_MAXFACTS)
+		{
+			facts[numfacts].dst = ir->b;
+			facts[numfacts].src = -1;
+			facts[numfacts].value = ir->a;
+			numfacts++;
+		}
+		else if ((ir->op == OP_STORE_F || ir->op == OP_STORE_S || ir->op == OP_STORE_ENT ||
+			  ir->op == OP_STORE_FLD || ir->op == OP_STORE_FNC) &&
+			  IR_IsLocal (ir->b, 1) && ir->a != ir->b && numfacts < IR_MAXFACTS)
+		{
+			facts[numfacts].dst = ir->b;
+			facts[numfacts].src = ir->a;
+			facts[numfacts].value = 0;
+			for (j = 0; j < numfacts; j++)	// a copy of a known value is known
+				if (facts[j].src < 0 && facts[j].dst == ir->a)
+				{
+					facts[numfacts].src = -1;
+					facts[numfacts].value = facts[j].value;
+				}
+			numfacts++;
+		}
+		else if (ir->op == OP_ADDRESS && ir->c != ir->a && ir->c != ir->b && numaddrs < IR_MAXFACTS)
+		{
+			addrs[numaddrs].ent = ir->a;
+			addrs[numaddrs].field = ir->b;
+			addrs[numaddrs].result = ir->c;
+			numaddrs++;
+		}
+	}
+}
+
+/*
+=================
+IR_Emit
+
+Appends the function to the output, dropping the removed instructions
+=================
+*/
+static void IR_Emit (int fnum)
+{
+	int	i, n, *map;
+
+	map = ir_order;	// statement list is no longer needed
+	for (i = 0, n = ir_outcount; i < ir_count; i++)
+	{
+		map[i] = n;
+		if (ir_code[i].op != IR_NOP)
+			n++;
+	}
+
+	if (n > ir_outsize)
+	{
+		ir_outsize = q_max (n, ir_outsize * 2);
+		ir_out = (irstatement_t *) realloc (ir_out, ir_outsize * sizeof(irstatement_t));
+		ir_outsource = (int *) realloc (ir_outsource, ir_outsize * sizeof(int));
+		if (!ir_out || !ir_outsource)
+			Sys_Error ("IR_Emit: out of memory");
+	}
+
+	pr_irfunctions[fnum] = ir_outcount;
+	for (i = 0; i < ir_count; i++)
+	{
+		if (ir_code[i].op == IR_NOP)
+			continue;
+		ir_out[ir_outcount] = ir_code[i];
+		ir_outsource[ir_outcount] = ir_from[i];
+		// a branch to a removed instruction falls through to the next one
+		if (ir_code[i].op == OP_GOTO)
+			ir_out[ir_outcount].a = map[ir_target[i]];
+		else if (ir_code[i].op == OP_IF || ir_code[i].op == OP_IFNOT)
+			ir_out[ir_outcount].b = map[ir_target[i]];
+		ir_outcount++;
+	}
+}
+
+/*
+=================
+PR_TranslateProgs
+
+Called by PR_LoadProgs when pr_translate is set. Leaves pr_ir NULL if any
+function can't be translated, so everything runs as bytecode.
+=================
+*/
+void PR_TranslateProgs (void)
+{
+	dfunction_t	*f;
+	int		i, n, total;
+	double		time;
+
+	pr_ir = NULL;
+	pr_irsource = NULL;
+	pr_irfunctions = NULL;
+	pr_irverify = IRVERIFY_OFF;
+
+	if (!pr_translate.value)
+		return;
+
+	time = Sys_DoubleTime ();
+	n = progs->numstatements;
+	ir_constant = (byte *) malloc (progs->numglobals);
+	ir_mark = (int *) malloc (n * sizeof(int));
+	ir_order = (int *) malloc (n * sizeof(int));
+	ir_code = (irstatement_t *) malloc (n * sizeof(irstatement_t));
+	ir_from = (int *) malloc (n * sizeof(int));
+	ir_leader = (byte *) malloc (n);
+	ir_target = (int *) malloc (n * sizeof(int));
+	ir_live = NULL;
+	ir_out = NULL;
+	ir_outsource = NULL;
+	ir_outcount = ir_outsize = 0;
+	ir_folded = ir_propagated = ir_removed = ir_retargeted = ir_reused = 0;
+	if (!ir_constant || !ir_mark || !ir_order || !ir_code || !ir_from || !ir_leader || !ir_target)
+		Sys_Error ("PR_TranslateProgs: out of memory");
+
+	for (i = 0; i < n; i++)
+		ir_mark[i] = -1;
+	IR_FindConstants ();
+
+	pr_irfunctions = (int *) Hunk_AllocName (progs->numfunctions * sizeof(int), "progsir");
+	ir_localglobal = (byte *) Hunk_AllocName (progs->numglobals, "progsir");
+	total = 0;
+	for (i = 1; i < progs->numfunctions; i++)
+	{
+		f = &pr_functions[i];
+		pr_irfunctions[i] = -1;
+		if (f->first_statement <= 0)
+			continue;
+		if (f->first_statement >= n || !IR_Decode (i))
+		{
+			Con_Printf ("PR_TranslateProgs: can't translate %s, using bytecode\n", PR_GetString (f->s_name));
+			goto done;
+		}
+		total += ir_count;
+
+		ir_localstart = f->parm_start;
+		ir_numlocals = q_max (f->locals, 0);
+		if (ir_localstart >= 0 && ir_localstart + ir_numlocals <= progs->numglobals)
+			memset (ir_localglobal + ir_localstart, 1, ir_numlocals);
+		ir_live = (unsigned int *) realloc (ir_live, (ir_count * ((ir_numlocals + 31) >> 5) + 1) * sizeof(unsigned int));
+		if (!ir_live)
+			Sys_Error ("PR_TranslateProgs: out of memory");
+
+		IR_Liveness (true);
+		IR_Forward ();
+		IR_Liveness (false);
+		IR_Emit (i);
+	}
+
+	pr_ir = (irstatement_t *) Hunk_AllocName (ir_outcount * sizeof(irstatement_t), "progsir");
+	pr_irsource = (int *) Hunk_AllocName (ir_outcount * sizeof(int), "progsir");
+	memcpy (pr_ir, ir_out, ir_outcount * sizeof(irstatement_t));
+	memcpy (pr_irsource, ir_outsource, ir_outcount * sizeof(int));
+
+	Con_DPrintf ("translated %i statements to %i in %.1f ms: %i folded, %i copies, %i stores removed, %i retargeted, %i addresses reused\n",
+		total, ir_outcount, (Sys_DoubleTime () - time) * 1000.0,
+		ir_folded, ir_propagated, ir_removed, ir_retargeted, ir_reused);
+
+done:
+	free (ir_constant);
+	free (ir_mark);
+	free (ir_order);
+	free (ir_code);
+	free (ir_from);
+	free (ir_leader);
+	free (ir_target);
+	free (ir_live);
+	free (ir_out);
+	free (ir_outsource);
+}
+
+/*
+=============================================================================
+
+VERIFICATION
+
+With pr_translate 2 every call from the engine runs twice. The bytecode
+goes first, for real, and each builtin it calls is recorded as a hash of
+the state before the call and the list of values the call changed. Then
+the state is put back and the IR runs; instead of calling builtins it
+checks the hash and replays the recorded changes, so nothing happens
+twice. "State" is the globals plus the fields of every edict in use. The
+hash leaves out function locals, which the IR is allowed to keep
+differently, but they are restored by the time the call returns and are
+compared at the end like everything else.
+Whatever the IR ends with is compared to what the bytecode ended with,
+and the bytecode result is what is kept.
+
+=============================================================================
+*/
+
+typedef struct
+{
+	unsigned int	hash;
+	int		numcells;	// state size before the call
+	int		firstchange, numchanges;	// firstchange indexes ir_changes
+} irbuiltin_t;
+
+typedef struct
+{
+	int		*cells;
+	int		numcells, maxcells;
+} irstate_t;
+
+static irstate_t	ir_start, ir_end, ir_scratch;
+static irbuiltin_t	*ir_calls;
+static int		ir_numcalls, ir_maxcalls, ir_replayed;
+static int		*ir_changes;	// pairs of cell, value
+static int		ir_numchanges, ir_maxchanges;
+static qboolean		ir_failed;
+static int		ir_verified, ir_mismatches;
+
+static int IR_NumCells (void)
+{
+	return progs->numglobals + sv.num_edicts * progs->entityfields;
+}
+
+static int *IR_Cell (int cell)
+{
+	if (cell < progs->numglobals)
+		return (int *)pr_globals + cell;
+	cell -= progs->numglobals;
+	return (int *)&EDICT_NUM(cell / progs->entityfields)->v + cell % progs->entityfields;
+}
+
+static void IR_Capture (irstate_t *state)
+{
+	int	e, n;
+
+	n = IR_NumCells ();
+	if (n > state->maxcells)
+	{
+		state->maxcells = n + 1024;
+		state->cells = (int *) realloc (state->cells, state->maxcells * sizeof(int));
+		if (!state->cells)
+			Sys_Error ("IR_Capture: out of memory");
+	}
+	state->numcells = n;
+	memcpy (state->cells, pr_globals, progs->numglobals * sizeof(int));
+	for (e = 0; e < sv.num_edicts; e++)
+		memcpy (state->cells + progs->numglobals + e * progs->entityfields, &EDICT_NUM(e)->v, progs->entityfields * sizeof(int));
+}
+
+static void IR_Restore (const irstate_t *state)
+{
+	int	e, numedicts;
+
+	memcpy (pr_globals, state->cells, progs->numglobals * sizeof(int));
+	numedicts = (state->numcells - progs->numglobals) / progs->entityfields;
+	for (e = 0; e < numedicts; e++)
+		memcpy (&EDICT_NUM(e)->v, state->cells + progs->numglobals + e * progs->entityfields, progs->entityfields * sizeof(int));
+}
+
+static unsigned int IR_Hash (int numcells)
+{
+	unsigned int	hash = 2166136261u;
+	int		i, e, *cells;
+
+	cells = (int *)pr_globals;
+	for (i = 0; i < progs->numglobals; i++)
+		if (!ir_localglobal[i])
+			hash = (hash ^ (unsigned int)cells[i]) * 16777619u;
+	for (e = 0; e < (numcells - progs->numglobals) / progs->entityfields; e++)
+	{
+		cells = (int *)&EDICT_NUM(e)->v;
+		for (i = 0; i < progs->entityfields; i++)
+			hash = (hash ^ (unsigned int)cells[i]) * 16777619u;
+	}
+	return hash;
+}
+
+static void IR_DescribeCell (int cell, char *out, size_t size)
+{
+	if (cell < progs->numglobals)
+		q_snprintf (out, size, "global %i%s", cell, PR_GlobalStringNoContents (cell));
+	else
+	{
+		cell -= progs->numglobals;
+		q_snprintf (out, size, "edict %i field %i", cell / progs->entityfields, cell % progs->entityfields);
+	}
+}
+
+/*
+=================
+PR_RecordBuiltin
+
+Builtin call from the bytecode during the first run
+=================
+*/
+void PR_RecordBuiltin (int num)
+{
+	irbuiltin_t	*call;
+	int		i, n, value, *cells;
+
+	if (ir_numcalls == ir_maxcalls)
+	{
+		ir_maxcalls = ir_maxcalls * 2 + 64;
+		ir_calls = (irbuiltin_t *) realloc (ir_calls, ir_maxcalls * sizeof(irbuiltin_t));
+		if (!ir_calls)
+			Sys_Error ("PR_RecordBuiltin: out of memory");
+	}
+	call = &ir_calls[ir_numcalls++];
+
+	IR_Capture (&ir_scratch);
+	call->numcells = ir_scratch.numcells;
+	call->hash = IR_Hash (call->numcells);
+
+	pr_irverify = IRVERIFY_BUILTIN;
+	pr_builtins[num] ();
+	pr_irverify = IRVERIFY_RECORD;
+
+	call->firstchange = ir_numchanges;
+	n = IR_NumCells ();
+	for (i = 0, cells = NULL; i < n; i++)
+	{
+		if (i < progs->numglobals)
+			value = ((int *)pr_globals)[i];
+		else
+		{
+			if ((i - progs->numglobals) % progs->entityfields == 0)
+				cells = (int *)&EDICT_NUM((i - progs->numglobals) / progs->entityfields)->v;
+			value = cells[(i - progs->numglobals) % progs->entityfields];
+		}
+		if (i < ir_scratch.numcells && ir_scratch.cells[i] == value)
+			continue;
+		if (ir_numchanges + 2 > ir_maxchanges)
+		{
+			ir_maxchanges = ir_maxchanges * 2 + 1024;
+			ir_changes = (int *) realloc (ir_changes, ir_maxchanges * sizeof(int));
+			if (!ir_changes)
+				Sys_Error ("PR_RecordBuiltin: out of memory");
+		}
+		ir_changes[ir_numchanges++] = i;
+		ir_changes[ir_numchanges++] = value;
+	}
+	call->numchanges = (ir_numchanges - call->firstchange) / 2;
+}
+
+/*
+=================
+PR_ReplayBuiltin
+
+Builtin call from the IR during the second run
+=================
+*/
+void PR_ReplayBuiltin (int num)
+{
+	irbuiltin_t	*call;
+	int		i;
+
+	if (ir_failed)
+		return;
+	if (ir_replayed >= ir_numcalls)
+	{
+		Con_Printf ("pr_translate: %s calls more builtins than the bytecode\n", PR_GetString (pr_xfunction->s_name));
+		ir_failed = true;
+		return;
+	}
+
+	call = &ir_calls[ir_replayed++];
+	if (IR_Hash (call->numcells) != call->hash)
+	{
+		Con_Printf ("pr_translate: %s differs before builtin call %i (statement %i)\n",
+			PR_GetString (pr_xfunction->s_name), ir_replayed, pr_xstatement);
+		ir_failed = true;
+		return;
+	}
+	for (i = 0; i < call->numchanges; i++)
+		*IR_Cell (ir_changes[call->firstchange + i * 2]) = ir_changes[call->firstchange + i * 2 + 1];
+}
+
+/*
+=================
+PR_VerifyProgram
+=================
+*/
+void PR_VerifyProgram (func_t fnum)
+{
+	char	where[128];
+	int	i;
+
+	IR_Capture (&ir_start);
+	ir_numcalls = ir_numchanges = 0;
+
+	pr_irverify = IRVERIFY_RECORD;
+	PR_ExecuteBytecode (fnum);
+	IR_Capture (&ir_end);
+
+	IR_Restore (&ir_start);
+	ir_replayed = 0;
+	ir_failed = false;
+	pr_irverify = IRVERIFY_REPLAY;
+	PR_ExecuteIR (fnum);
+	pr_irverify = IRVERIFY_OFF;
+
+	ir_verified++;
+	if (!ir_failed)
+	{
+		if (ir_replayed != ir_numcalls)
+		{
+			Con_Printf ("pr_translate: %s calls %i builtins, bytecode %i\n",
+				PR_GetString (pr_functions[fnum].s_name), ir_replayed, ir_numcalls);
+			ir_failed = true;
+		}
+		for (i = 0; i < ir_end.numcells && !ir_failed; i++)
+		{
+			if (*IR_Cell (i) != ir_end.cells[i])
+			{
+				IR_DescribeCell (i, where, sizeof(where));
+				Con_Printf ("pr_translate: %s leaves %s different\n", PR_GetString (pr_functions[fnum].s_name), where);
+				ir_failed = true;
+			}
+		}
+	}
+	if (ir_failed)
+		ir_mismatches++;
+
+	IR_Restore (&ir_end);
+}
+
+/*
+=================
+PR_TranslateStats_f
+=================
+*/
+void PR_TranslateStats_f (void)
+{
+	if (!pr_ir)
+	{
+		Con_Printf ("progs are not translated (pr_translate 0 at map load)\n");
+		return;
+	}
+	Con_Printf ("%i IR instructions, %i calls verified, %i mismatches\n", pr_irfunctions ? ir_outcount : 0, ir_verified, ir_mismatches);
+}
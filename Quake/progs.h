@@ -62,6 +62,7 @@ typedef struct edict_s
 extern	dprograms_t	*progs;
 extern	dfunction_t	*pr_functions;
 extern	dstatement_t	*pr_statements;
+extern	ddef_t		*pr_globaldefs;
 extern	globalvars_t	*pr_global_struct;
 extern	float		*pr_globals;	/* same as pr_global_struct */
 
@@ -74,13 +75,66 @@ void PR_ExecuteProgram (func_t fnum);
 void PR_LoadProgs (void);
 
 const char *PR_GetString (int num);
+const char *PR_FindString (int num);
 int PR_SetEngineString (const char *s);
 int PR_AllocString (int bufferlength, char **ptr);
+void PR_FreeString (int num);
 
 void PR_Profile_f (void);
+void PR_Profile_Cmd_f (void);
+void PR_ProfileBuiltin (int num);
+void PR_ProfileClear (void);
+extern	qboolean	pr_profiling;
+void PR_Bench_f (void);
+void PR_FuseStatements (void);
+int PR_BaseOp (int op);
+
+// translated progs, see pr_ir.c
+enum
+{
+	IR_NOP = OP_BITOR + 1,
+	IR_STORE_IMM,		// b = a, a holds the value
+	IR_CALL,		// through the function in global a, b = argc
+	IR_CALL_FUNC,		// progs function a
+	IR_CALL_BUILTIN,	// builtin a
+	IR_STATE_IMM,		// OP_STATE with the frame and think function in a and b
+	IR_NUMOPS
+};
+
+typedef struct
+{
+	unsigned short	op;
+	unsigned short	pad;
+	int		a, b, c;
+} irstatement_t;
+
+enum
+{
+	IRVERIFY_OFF,
+	IRVERIFY_RECORD,	// bytecode run, builtins are recorded
+	IRVERIFY_BUILTIN,	// inside a recorded builtin
+	IRVERIFY_REPLAY		// IR run, builtins are replayed
+};
+
+extern	cvar_t		pr_translate;
+extern	irstatement_t	*pr_ir;		// NULL when the progs are not translated
+extern	int		*pr_irsource;	// statement each instruction came from
+extern	int		*pr_irfunctions;	// first instruction of each function
+extern	int		pr_irverify;
+
+void PR_TranslateProgs (void);
+void PR_ExecuteBytecode (func_t fnum);
+void PR_ExecuteIR (func_t fnum);
+void PR_VerifyProgram (func_t fnum);
+void PR_RecordBuiltin (int num);
+void PR_ReplayBuiltin (int num);
+void PR_TranslateStats_f (void);
+
+dfunction_t *ED_FindFunction (const char *fn_name);
 
 edict_t *ED_Alloc (void);
 void ED_Free (edict_t *ed);
+void ED_RebuildEdictLists (void);
 
 void ED_Print (edict_t *ed);
 void ED_Write (FILE *f, edict_t *ed);
@@ -125,6 +179,7 @@ extern	int		pr_numbuiltins;
 extern	int		pr_argc;
 
 extern	qboolean	pr_trace;
+extern	cvar_t		pr_superinstructions;
 extern	dfunction_t	*pr_xfunction;
 extern	int		pr_xstatement;
 
@@ -137,5 +192,21 @@ void ED_PrintNum (int ent);
 
 eval_t *GetEdictFieldValue(edict_t *ed, const char *field);
 
+// fields the engine checks every frame that not all progs have, resolved
+// to offsets by PR_LoadProgs, -1 when missing
+typedef struct
+{
+	int	alpha;
+	int	items2;
+	int	gravity;
+} extfields_t;
+
+extern	extfields_t	pr_extfields;
+
+static inline eval_t *GetEdictFieldValueOfs (edict_t *ed, int fieldofs)
+{
+	return (fieldofs < 0) ? NULL : (eval_t *)((int *)&ed->v + fieldofs);
+}
+
 #endif	/* _QUAKE_PROGS_H */
 
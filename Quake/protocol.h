@@ -27,6 +27,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #define	PROTOCOL_NETQUAKE	15 //johnfitz -- standard quake protocol
 #define PROTOCOL_FITZQUAKE	666 //johnfitz -- added new protocol for fitzquake 0.85
+#define PROTOCOL_DELTA		667 // PROTOCOL_FITZQUAKE with entities sent as svc_deltaentities
 
 // if the high bit of the servercmd is set, the low bits are fast update flags:
 #define	U_MOREBITS		(1<<0)
@@ -189,6 +190,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define svc_spawnstatic2		43	// support for large modelindex, large framenum, alpha, using flags
 #define	svc_spawnstaticsound2	44	// [coord3] [short] samp [byte] vol [byte] aten
 //johnfitz
+#define	svc_deltaentities		45	// [long] frame [long] delta frame, then <see code>, PROTOCOL_DELTA
 
 //
 // client to server
@@ -198,6 +200,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define	clc_disconnect	2
 #define	clc_move		3		// [usercmd_t]
 #define	clc_stringcmd	4		// [string] message
+#define	clc_deltaack	5		// [long] last svc_deltaentities frame, PROTOCOL_DELTA
 
 //
 // temp entity events
@@ -232,6 +235,90 @@ typedef struct
 	int		effects;
 } entity_state_t;
 
+//
+// PROTOCOL_DELTA
+//
+// svc_deltaentities holds all the entities a client can see, as changes
+// from a frame the client acknowledged or from the baselines. Each entity
+// that changed is a [short] number and U_ bits followed by the fields that
+// differ, in the order CL_ReadDeltaEntity reads them. U_STEP toggles the
+// step flag. An entity that went away is [short] number | DELTA_REMOVE, and
+// [short] 0 ends the list. Entities that aren't mentioned keep the state
+// they had in the old frame, including the ones after the last entry, so a
+// frame that runs out of room is still whole.
+//
+#define DELTA_FRAMES		64		// frames kept by both ends
+#define DELTA_POOL			16384	// entity states kept by both ends
+#define DELTA_MAXENTITIES	2048	// in one frame
+#define DELTA_MAXENTRY		23		// bytes for one entity
+#define DELTA_REMOVE		0x8000
+
+#define DE_STEP				1
+
+// entity state the way it goes over the wire, so both ends compare the same values
+typedef struct
+{
+	unsigned short	num;
+	unsigned short	modelindex;
+	unsigned short	frame;
+	short			origin[3];	// 13.3 fixed point, as MSG_WriteCoord
+	byte			angles[3];	// as MSG_WriteAngle
+	byte			colormap;
+	byte			skin;
+	byte			effects;
+	byte			alpha;
+	byte			flags;		// DE_STEP
+} deltaent_t;
+
+typedef struct
+{
+	int		sequence;
+	int		first;		// index in deltahistory_t pool
+	int		count;
+} deltaframe_t;
+
+typedef struct
+{
+	deltaframe_t	frames[DELTA_FRAMES];	// by sequence & (DELTA_FRAMES-1)
+	deltaent_t		pool[DELTA_POOL];		// by index & (DELTA_POOL-1)
+	int				poolhead;				// states ever stored
+} deltahistory_t;
+
+static inline deltaent_t *Delta_PoolEnt (deltahistory_t *h, int index)
+{
+	return &h->pool[index & (DELTA_POOL-1)];
+}
+
+// the frame with the sequence, if frame next can still be built from it
+static inline deltaframe_t *Delta_FindFrame (deltahistory_t *h, int sequence, int next)
+{
+	deltaframe_t *f = &h->frames[sequence & (DELTA_FRAMES-1)];
+
+	if (sequence <= 0 || next - sequence >= DELTA_FRAMES || f->sequence != sequence
+	|| h->poolhead + DELTA_MAXENTITIES - f->first > DELTA_POOL)
+		return NULL;
+	return f;
+}
+
+static inline void Delta_PackState (const entity_state_t *s, int num, int flags, deltaent_t *to)
+{
+	int i;
+
+	to->num = num;
+	to->modelindex = s->modelindex;
+	to->frame = s->frame;
+	for (i = 0; i < 3; i++)
+	{
+		to->origin[i] = Q_rint(s->origin[i] * 8);
+		to->angles[i] = Q_rint(s->angles[i] * 256.0 / 360.0) & 255;
+	}
+	to->colormap = s->colormap;
+	to->skin = s->skin;
+	to->effects = s->effects;
+	to->alpha = s->alpha;
+	to->flags = flags;
+}
+
 typedef struct
 {
 	vec3_t	viewangles;
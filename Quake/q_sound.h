@@ -104,6 +104,7 @@ void S_BlockSound (void);
 void S_UnblockSound (void);
 
 sfx_t *S_PrecacheSound (const char *sample);
+void S_QueuePrecache (const char *sample);
 void S_TouchSound (const char *sample);
 void S_ClearPrecache (void);
 void S_BeginPrecaching (void);
@@ -181,6 +182,7 @@ extern	cvar_t		bgmvolume;
 
 void S_LocalSound (const char *name);
 sfxcache_t *S_LoadSound (sfx_t *s);
+sfxcache_t *S_DecodeSound (byte *data, int length, int *size);
 
 wavinfo_t GetWavinfo (const char *name, byte *wav, int wavlength);
 
@@ -250,6 +250,8 @@ typedef struct
 #include "world.h"
 
 #include "image.h"	//johnfitz
+#include "jobs.h"
+#include "loader.h"
 #include "gl_texmgr.h"	//johnfitz
 #include "input.h"
 #include "keys.h"
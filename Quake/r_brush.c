@@ -42,9 +42,14 @@ typedef struct glRect_s {
 	unsigned char l,t,w,h;
 } glRect_t;
 
+// each page keeps a few separate dirty rectangles, so that lights at
+// opposite corners of a page don't upload everything in between
+#define	MAX_LIGHTMAP_RECTS	8
+
 glpoly_t	*lightmap_polys[MAX_LIGHTMAPS];
 qboolean	lightmap_modified[MAX_LIGHTMAPS];
-glRect_t	lightmap_rectchange[MAX_LIGHTMAPS];
+glRect_t	lightmap_rectchange[MAX_LIGHTMAPS][MAX_LIGHTMAP_RECTS];
+int			lightmap_numrects[MAX_LIGHTMAPS];
 
 int			allocated[MAX_LIGHTMAPS][BLOCK_WIDTH];
 int			last_lightmap_allocated; //ericw -- optimization: remember the index of the last lightmap AllocBlock stored a surf in
@@ -55,6 +60,8 @@ byte		lightmaps[4*MAX_LIGHTMAPS*BLOCK_WIDTH*BLOCK_HEIGHT];
 
 static VkDeviceMemory	bmodel_memory;
 VkBuffer				bmodel_vertex_buffer;
+static VkDeviceMemory	bmodel_index_memory;
+VkBuffer				bmodel_index_buffer;
 
 /*
 ===============
@@ -308,6 +315,77 @@ void R_DrawBrushModel_ShowTris (entity_t *e)
 =============================================================
 */
 
+/*
+================
+R_AddLightmapRect
+
+Adds a changed area to the dirty rectangles of a lightmap page. Rectangles
+that touch are merged, and when the page runs out of rectangles the new one
+is merged into the one that grows the least
+================
+*/
+static void R_AddLightmapRect (int lmap, int l, int t, int w, int h)
+{
+	glRect_t	*rects = lightmap_rectchange[lmap];
+	glRect_t	*r;
+	int			i, r0, r1, b0, b1, best, bestgrowth, growth;
+	int			*numrects = &lightmap_numrects[lmap];
+
+	lightmap_modified[lmap] = true;
+
+	for (;;)
+	{
+		best = -1;
+		for (i=0, r=rects ; i<*numrects ; i++, r++)
+			if (l <= r->l + r->w && r->l <= l + w && t <= r->t + r->h && r->t <= t + h)
+			{
+				best = i;
+				break;
+			}
+
+		if (best < 0)
+		{
+			if (*numrects < MAX_LIGHTMAP_RECTS)
+			{
+				r = &rects[(*numrects)++];
+				r->l = l;
+				r->t = t;
+				r->w = w;
+				r->h = h;
+				return;
+			}
+
+			// full, take the cheapest merge
+			bestgrowth = INT_MAX;
+			for (i=0, r=rects ; i<*numrects ; i++, r++)
+			{
+				r0 = q_min(l, r->l);
+				r1 = q_max(l + w, r->l + r->w);
+				b0 = q_min(t, r->t);
+				b1 = q_max(t + h, r->t + r->h);
+				growth = (r1 - r0) * (b1 - b0) - r->w * r->h;
+				if (growth < bestgrowth)
+				{
+					bestgrowth = growth;
+					best = i;
+				}
+			}
+		}
+
+		// take the rectangle out and merge it, the result may touch others
+		r = &rects[best];
+		r0 = q_min(l, r->l);
+		r1 = q_max(l + w, r->l + r->w);
+		b0 = q_min(t, r->t);
+		b1 = q_max(t + h, r->t + r->h);
+		l = r0;
+		w = r1 - r0;
+		t = b0;
+		h = b1 - b0;
+		*r = rects[--(*numrects)];
+	}
+}
+
 /*
 ================
 R_RenderDynamicLightmaps
@@ -318,7 +396,6 @@ void R_RenderDynamicLightmaps (msurface_t *fa)
 {
 	byte		*base;
 	int			maps;
-	glRect_t    *theRect;
 	int smax, tmax;
 
 	if (fa->flags & SURF_DRAWTILED) //johnfitz -- not a lightmapped surface
@@ -339,24 +416,9 @@ void R_RenderDynamicLightmaps (msurface_t *fa)
 dynamic:
 		if (r_dynamic.value)
 		{
-			lightmap_modified[fa->lightmaptexturenum] = true;
-			theRect = &lightmap_rectchange[fa->lightmaptexturenum];
-			if (fa->light_t < theRect->t) {
-				if (theRect->h)
-					theRect->h += theRect->t - fa->light_t;
-				theRect->t = fa->light_t;
-			}
-			if (fa->light_s < theRect->l) {
-				if (theRect->w)
-					theRect->w += theRect->l - fa->light_s;
-				theRect->l = fa->light_s;
-			}
 			smax = (fa->extents[0]>>4)+1;
 			tmax = (fa->extents[1]>>4)+1;
-			if ((theRect->w + theRect->l) < (fa->light_s + smax))
-				theRect->w = (fa->light_s-theRect->l)+smax;
-			if ((theRect->h + theRect->t) < (fa->light_t + tmax))
-				theRect->h = (fa->light_t-theRect->t)+tmax;
+			R_AddLightmapRect (fa->lightmaptexturenum, fa->light_s, fa->light_t, smax, tmax);
 			base = lightmaps + fa->lightmaptexturenum*lightmap_bytes*BLOCK_WIDTH*BLOCK_HEIGHT;
 			base += fa->light_t * BLOCK_WIDTH * lightmap_bytes + fa->light_s * lightmap_bytes;
 			R_BuildLightMap (fa, base, BLOCK_WIDTH*lightmap_bytes);
@@ -568,10 +630,7 @@ void GL_BuildLightmaps (void)
 		if (!allocated[i][0])
 			break;		// no more used
 		lightmap_modified[i] = false;
-		lightmap_rectchange[i].l = BLOCK_WIDTH;
-		lightmap_rectchange[i].t = BLOCK_HEIGHT;
-		lightmap_rectchange[i].w = 0;
-		lightmap_rectchange[i].h = 0;
+		lightmap_numrects[i] = 0;
 
 		//johnfitz -- use texture manager
 		sprintf(name, "lightmap%03i",i);
@@ -601,6 +660,94 @@ void GL_DeleteBModelVertexBuffer (void)
 
 	vkDestroyBuffer(vulkan_globals.device, bmodel_vertex_buffer, NULL);
 	vkFreeMemory(vulkan_globals.device, bmodel_memory, NULL);
+	vkDestroyBuffer(vulkan_globals.device, bmodel_index_buffer, NULL);
+	vkFreeMemory(vulkan_globals.device, bmodel_index_memory, NULL);
+}
+
+/*
+==================
+GL_CreateStaticBuffer
+
+Creates a device local buffer and copies data into it through the staging
+buffer, a few MB at a time
+==================
+*/
+#define STATIC_BUFFER_UPLOAD_CHUNK	(4 * 1024 * 1024)
+
+void GL_CreateStaticBuffer (const void *data, unsigned int size, VkBufferUsageFlags usage, VkBuffer *buffer, VkDeviceMemory *memory)
+{
+	VkResult err;
+
+	VkBufferCreateInfo buffer_create_info;
+	memset(&buffer_create_info, 0, sizeof(buffer_create_info));
+	buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_create_info.size = size;
+	buffer_create_info.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	err = vkCreateBuffer(vulkan_globals.device, &buffer_create_info, NULL, buffer);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkCreateBuffer failed");
+
+	VkMemoryRequirements memory_requirements;
+	vkGetBufferMemoryRequirements(vulkan_globals.device, *buffer, &memory_requirements);
+
+	const int align_mod = memory_requirements.size % memory_requirements.alignment;
+	const int aligned_size = ((memory_requirements.size % memory_requirements.alignment) == 0 ) 
+		? memory_requirements.size 
+		: (memory_requirements.size + memory_requirements.alignment - align_mod);
+
+	VkMemoryAllocateInfo memory_allocate_info;
+	memset(&memory_allocate_info, 0, sizeof(memory_allocate_info));
+	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memory_allocate_info.allocationSize = aligned_size;
+	memory_allocate_info.memoryTypeIndex = GL_MemoryTypeFromProperties(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	err = vkAllocateMemory(vulkan_globals.device, &memory_allocate_info, NULL, memory);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkAllocateMemory failed");
+
+	err = vkBindBufferMemory(vulkan_globals.device, *buffer, *memory, 0);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkBindBufferMemory failed");
+
+	for (unsigned int done = 0; done < size; )
+	{
+		const unsigned int chunk = q_min(size - done, STATIC_BUFFER_UPLOAD_CHUNK);
+
+		VkBuffer staging_buffer;
+		VkCommandBuffer command_buffer;
+		int staging_offset;
+		unsigned char * staging_memory = R_StagingAllocate(chunk, &command_buffer, &staging_buffer, &staging_offset);
+
+		memcpy(staging_memory, (const byte *)data + done, chunk);
+
+		VkBufferCopy region;
+		region.srcOffset = staging_offset;
+		region.dstOffset = done;
+		region.size = chunk;
+		vkCmdCopyBuffer(command_buffer, staging_buffer, *buffer, 1, &region);
+
+		done += chunk;
+	}
+}
+
+/*
+==================
+GL_SurfaceBucketCompare
+
+Orders surfaces by texture, then lightmap, so the indices of each bucket end
+up next to each other and the draws of neighbouring surfaces can be merged
+==================
+*/
+static int GL_SurfaceBucketCompare (const void *a, const void *b)
+{
+	const msurface_t *s1 = *(const msurface_t **)a;
+	const msurface_t *s2 = *(const msurface_t **)b;
+
+	if (s1->texinfo->texture != s2->texinfo->texture)
+		return (s1->texinfo->texture < s2->texinfo->texture) ? -1 : 1;
+	if (s1->lightmaptexturenum != s2->lightmaptexturenum)
+		return s1->lightmaptexturenum - s2->lightmaptexturenum;
+	return (s1 < s2) ? -1 : (s1 > s2);
 }
 
 /*
@@ -608,18 +755,25 @@ void GL_DeleteBModelVertexBuffer (void)
 GL_BuildBModelVertexBuffer
 
 Deletes gl_bmodel_vbo if it already exists, then rebuilds it with all
-surfaces from world + all brush models
+surfaces from world + all brush models. The triangle indices of every
+surface are built here too, so drawing a surface only needs its
+vbo_firstindex and vbo_numindices
 ==================
 */
 void GL_BuildBModelVertexBuffer (void)
 {
-	unsigned int	numverts, varray_bytes, varray_index;
-	int		i, j;
+	unsigned int	numverts, numindices, numsurfaces, maxsurfaces, varray_bytes, varray_index, iarray_index;
+	int		i, j, k;
 	qmodel_t	*m;
 	float		*varray;
+	uint32_t	*iarray;
+	msurface_t	**sorted;
 
 	// count all verts in all models
 	numverts = 0;
+	numindices = 0;
+	numsurfaces = 0;
+	maxsurfaces = 0;
 	for (j=1 ; j<MAX_MODELS ; j++)
 	{
 		m = cl.model_precache[j];
@@ -629,8 +783,16 @@ void GL_BuildBModelVertexBuffer (void)
 		for (i=0 ; i<m->numsurfaces ; i++)
 		{
 			numverts += m->surfaces[i].numedges;
+			if (m->surfaces[i].numedges >= 3)
+				numindices += 3 * (m->surfaces[i].numedges - 2);
 		}
+		numsurfaces += m->numsurfaces;
+		if (maxsurfaces < m->numsurfaces)
+			maxsurfaces = m->numsurfaces;
 	}
+
+	// at worst every surface is its own indirect command
+	R_ReserveIndirectCommands (numsurfaces);
 	
 	// build vertex array
 	varray_bytes = VERTEXSIZE * sizeof(float) * numverts;
@@ -652,53 +814,42 @@ void GL_BuildBModelVertexBuffer (void)
 		}
 	}
 
-	// Allocate & upload to GPU
-	VkResult err;
+	// build index array, grouped by texture and lightmap
+	iarray = (uint32_t *) malloc (q_max(numindices, 1) * sizeof(uint32_t));
+	sorted = (msurface_t **) malloc (q_max(maxsurfaces, 1) * sizeof(msurface_t *));
+	iarray_index = 0;
 
-	VkBufferCreateInfo buffer_create_info;
-	memset(&buffer_create_info, 0, sizeof(buffer_create_info));
-	buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	buffer_create_info.size = varray_bytes;
-	buffer_create_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-	err = vkCreateBuffer(vulkan_globals.device, &buffer_create_info, NULL, &bmodel_vertex_buffer);
-	if (err != VK_SUCCESS)
-		Sys_Error("vkCreateBuffer failed");
-
-	VkMemoryRequirements memory_requirements;
-	vkGetBufferMemoryRequirements(vulkan_globals.device, bmodel_vertex_buffer, &memory_requirements);
-
-	const int align_mod = memory_requirements.size % memory_requirements.alignment;
-	const int aligned_size = ((memory_requirements.size % memory_requirements.alignment) == 0 ) 
-		? memory_requirements.size 
-		: (memory_requirements.size + memory_requirements.alignment - align_mod);
-
-	VkMemoryAllocateInfo memory_allocate_info;
-	memset(&memory_allocate_info, 0, sizeof(memory_allocate_info));
-	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memory_allocate_info.allocationSize = aligned_size;
-	memory_allocate_info.memoryTypeIndex = GL_MemoryTypeFromProperties(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-	err = vkAllocateMemory(vulkan_globals.device, &memory_allocate_info, NULL, &bmodel_memory);
-	if (err != VK_SUCCESS)
-		Sys_Error("vkAllocateMemory failed");
-
-	err = vkBindBufferMemory(vulkan_globals.device, bmodel_vertex_buffer, bmodel_memory, 0);
-	if (err != VK_SUCCESS)
-		Sys_Error("vkBindImageMemory failed");
+	for (j=1 ; j<MAX_MODELS ; j++)
+	{
+		m = cl.model_precache[j];
+		if (!m || m->name[0] == '*' || m->type != mod_brush)
+			continue;
 
-	VkBuffer staging_buffer;
-	VkCommandBuffer command_buffer;
-	int staging_offset;
-	unsigned char * staging_memory = R_StagingAllocate(varray_bytes, &command_buffer, &staging_buffer, &staging_offset);
+		for (i=0 ; i<m->numsurfaces ; i++)
+			sorted[i] = &m->surfaces[i];
+		qsort (sorted, m->numsurfaces, sizeof(msurface_t *), GL_SurfaceBucketCompare);
 
-	memcpy(staging_memory, varray, varray_bytes);
+		for (i=0 ; i<m->numsurfaces ; i++)
+		{
+			msurface_t *s = sorted[i];
+			s->vbo_firstindex = iarray_index;
+			s->vbo_numindices = 0;
+			for (k=2 ; k<s->numedges ; k++)
+			{
+				iarray[iarray_index++] = s->vbo_firstvert;
+				iarray[iarray_index++] = s->vbo_firstvert + k - 1;
+				iarray[iarray_index++] = s->vbo_firstvert + k;
+				s->vbo_numindices += 3;
+			}
+		}
+	}
 
-	VkBufferCopy region;
-	region.srcOffset = staging_offset;
-	region.dstOffset = 0;
-	region.size = varray_bytes;
-	vkCmdCopyBuffer(command_buffer, staging_buffer, bmodel_vertex_buffer, 1, &region);
+	// Allocate & upload to GPU
+	GL_CreateStaticBuffer (varray, varray_bytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &bmodel_vertex_buffer, &bmodel_memory);
+	GL_CreateStaticBuffer (iarray, q_max(numindices, 1) * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &bmodel_index_buffer, &bmodel_index_memory);
 
+	free (sorted);
+	free (iarray);
 	free (varray);
 }
 
@@ -710,17 +861,12 @@ R_AddDynamicLights
 void R_AddDynamicLights (msurface_t *surf)
 {
 	int			lnum;
-	int			sd, td;
 	float		dist, rad, minlight;
 	vec3_t		impact, local;
-	int			s, t;
 	int			i;
 	int			smax, tmax;
 	mtexinfo_t	*tex;
-	//johnfitz -- lit support via lordhavoc
-	float		cred, cgreen, cblue, brightness;
-	unsigned	*bl;
-	//johnfitz
+	float		color[3]; //johnfitz -- lit support via lordhavoc
 
 	smax = (surf->extents[0]>>4)+1;
 	tmax = (surf->extents[1]>>4)+1;
@@ -753,37 +899,11 @@ void R_AddDynamicLights (msurface_t *surf)
 		local[1] -= surf->texturemins[1];
 
 		//johnfitz -- lit support via lordhavoc
-		bl = blocklights;
-		cred = cl_dlights[lnum].color[0] * 256.0f;
-		cgreen = cl_dlights[lnum].color[1] * 256.0f;
-		cblue = cl_dlights[lnum].color[2] * 256.0f;
+		color[0] = cl_dlights[lnum].color[0] * 256.0f;
+		color[1] = cl_dlights[lnum].color[1] * 256.0f;
+		color[2] = cl_dlights[lnum].color[2] * 256.0f;
 		//johnfitz
-		for (t = 0 ; t<tmax ; t++)
-		{
-			td = local[1] - t*16;
-			if (td < 0)
-				td = -td;
-			for (s=0 ; s<smax ; s++)
-			{
-				sd = local[0] - s*16;
-				if (sd < 0)
-					sd = -sd;
-				if (sd > td)
-					dist = sd + (td>>1);
-				else
-					dist = td + (sd>>1);
-				if (dist < minlight)
-				//johnfitz -- lit support via lordhavoc
-				{
-					brightness = rad - dist;
-					bl[0] += (int) (brightness * cred);
-					bl[1] += (int) (brightness * cgreen);
-					bl[2] += (int) (brightness * cblue);
-				}
-				bl += 3;
-				//johnfitz
-			}
-		}
+		lightkernels->adddlight (blocklights, smax, tmax, local, rad, minlight, color);
 	}
 }
 
@@ -798,12 +918,10 @@ Combine and scale multiple lightmaps into the 8.8 format in blocklights
 void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
 {
 	int			smax, tmax;
-	int			r,g,b;
-	int			i, j, size;
+	int			size;
 	byte		*lightmap;
 	unsigned	scale;
 	int			maps;
-	unsigned	*bl;
 
 	surf->cached_dlight = (surf->dlightframe == r_framecount);
 
@@ -824,15 +942,8 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
 			{
 				scale = d_lightstylevalue[surf->styles[maps]];
 				surf->cached_light[maps] = scale;	// 8.8 fraction
-				//johnfitz -- lit support via lordhavoc
-				bl = blocklights;
-				for (i=0 ; i<size ; i++)
-				{
-					*bl++ += *lightmap++ * scale;
-					*bl++ += *lightmap++ * scale;
-					*bl++ += *lightmap++ * scale;
-				}
-				//johnfitz
+				lightkernels->addstyle (blocklights, lightmap, size, scale); //johnfitz -- lit support via lordhavoc
+				lightmap += size * 3;
 			}
 
 	// add all the dynamic lights
@@ -847,104 +958,134 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
 
 // bound, invert, and shift
 // store:
-	stride -= smax * 4;
-	bl = blocklights;
-	for (i=0 ; i<tmax ; i++, dest += stride)
-	{
-		for (j=0 ; j<smax ; j++)
-		{
-			r = *bl++ >> 8;
-			g = *bl++ >> 8;
-			b = *bl++ >> 8;
-			if (r > 255) r = 255; *dest++ = r;
-			if (g > 255) g = 255; *dest++ = g;
-			if (b > 255) b = 255; *dest++ = b;
-			*dest++ = 255;
-		}
-	}
+	lightkernels->store (blocklights, smax, tmax, dest, stride);
 }
 
 /*
 ===============
-R_UploadLightmap -- johnfitz -- uploads the modified lightmap to opengl if necessary
+R_UploadLightmapBatch
 
-assumes lightmap texture is already bound
+Copies the dirty rectangles of a batch of pages out of one staging
+allocation, with one region per rectangle and one copy per page
 ===============
 */
-static void R_UploadLightmap(int lmap, gltexture_t * lightmap)
+static VkImageMemoryBarrier	lightmap_barriers[MAX_LIGHTMAPS];
+static VkBufferImageCopy	lightmap_regions[MAX_LIGHTMAP_RECTS];
+
+static void R_UploadLightmapBatch (const int *pages, int numpages, int size)
 {
+	int			i, j, row, lmap, numregions;
+	int			offset;
 	glRect_t	*theRect;
-
-	if (!lightmap_modified[lmap])
-		return;
-
-	lightmap_modified[lmap] = false;
-
-	theRect = &lightmap_rectchange[lmap];
-	const int staging_size = BLOCK_WIDTH * theRect->h * 4;
+	byte		*src;
 
 	VkBuffer staging_buffer;
 	VkCommandBuffer command_buffer;
 	int staging_offset;
-	unsigned char * staging_memory = R_StagingAllocate(staging_size, &command_buffer, &staging_buffer, &staging_offset);
-
-	byte * data = lightmaps + (lmap * BLOCK_HEIGHT + theRect->t) * BLOCK_WIDTH * lightmap_bytes;
-	memcpy(staging_memory, data, staging_size);
-
-	VkBufferImageCopy region;
-	memset(&region, 0, sizeof(region));
-	region.bufferOffset = staging_offset;
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.layerCount = 1;
-	region.imageSubresource.mipLevel = 0;
-	region.imageExtent.width = BLOCK_WIDTH;
-	region.imageExtent.height = theRect->h;
-	region.imageExtent.depth = 1;
-	region.imageOffset.y = theRect->t;
-
-	VkImageMemoryBarrier image_memory_barrier;
-	memset(&image_memory_barrier, 0, sizeof(image_memory_barrier));
-	image_memory_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	image_memory_barrier.srcAccessMask = 0;
-	image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-	image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	image_memory_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	image_memory_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	image_memory_barrier.image = lightmap->image;
-	image_memory_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	image_memory_barrier.subresourceRange.baseMipLevel = 0;
-	image_memory_barrier.subresourceRange.levelCount = 1;
-	image_memory_barrier.subresourceRange.baseArrayLayer = 0;
-	image_memory_barrier.subresourceRange.layerCount = 1;
-
-	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &image_memory_barrier);
-
-	vkCmdCopyBufferToImage(command_buffer, staging_buffer, lightmap->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-	image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &image_memory_barrier);
-
-	theRect->l = BLOCK_WIDTH;
-	theRect->t = BLOCK_HEIGHT;
-	theRect->h = 0;
-	theRect->w = 0;
-
-	rs_dynamiclightmaps++;
+	unsigned char * staging_memory = R_StagingAllocate(size, &command_buffer, &staging_buffer, &staging_offset);
+
+	for (i = 0; i < numpages; i++)
+	{
+		VkImageMemoryBarrier * image_memory_barrier = &lightmap_barriers[i];
+		memset(image_memory_barrier, 0, sizeof(*image_memory_barrier));
+		image_memory_barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		image_memory_barrier->srcAccessMask = 0;
+		image_memory_barrier->dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		image_memory_barrier->oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		image_memory_barrier->newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		image_memory_barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		image_memory_barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		image_memory_barrier->image = lightmap_textures[pages[i]]->image;
+		image_memory_barrier->subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		image_memory_barrier->subresourceRange.baseMipLevel = 0;
+		image_memory_barrier->subresourceRange.levelCount = 1;
+		image_memory_barrier->subresourceRange.baseArrayLayer = 0;
+		image_memory_barrier->subresourceRange.layerCount = 1;
+	}
+
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, numpages, lightmap_barriers);
+
+	offset = 0;
+	for (i = 0; i < numpages; i++)
+	{
+		lmap = pages[i];
+		numregions = lightmap_numrects[lmap];
+
+		for (j = 0, theRect = lightmap_rectchange[lmap]; j < numregions; j++, theRect++)
+		{
+			// rows of the rectangle are packed, the region row length says how
+			src = lightmaps + ((lmap * BLOCK_HEIGHT + theRect->t) * BLOCK_WIDTH + theRect->l) * lightmap_bytes;
+			for (row = 0; row < theRect->h; row++)
+				memcpy(staging_memory + offset + row * theRect->w * lightmap_bytes, src + row * BLOCK_WIDTH * lightmap_bytes, theRect->w * lightmap_bytes);
+
+			VkBufferImageCopy * region = &lightmap_regions[j];
+			memset(region, 0, sizeof(*region));
+			region->bufferOffset = staging_offset + offset;
+			region->bufferRowLength = theRect->w;
+			region->imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region->imageSubresource.layerCount = 1;
+			region->imageSubresource.mipLevel = 0;
+			region->imageExtent.width = theRect->w;
+			region->imageExtent.height = theRect->h;
+			region->imageExtent.depth = 1;
+			region->imageOffset.x = theRect->l;
+			region->imageOffset.y = theRect->t;
+
+			offset += theRect->w * theRect->h * lightmap_bytes;
+		}
+
+		vkCmdCopyBufferToImage(command_buffer, staging_buffer, lightmap_textures[lmap]->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, numregions, lightmap_regions);
+
+		rs_lightmaprects += numregions;
+		lightmap_numrects[lmap] = 0;
+		lightmap_modified[lmap] = false;
+	}
+
+	for (i = 0; i < numpages; i++)
+	{
+		lightmap_barriers[i].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		lightmap_barriers[i].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, numpages, lightmap_barriers);
+
+	rs_dynamiclightmaps += numpages;
+	rs_lightmapbytes += size;
 }
 
+/*
+===============
+R_UploadLightmaps -- uploads all modified lightmap pages, a batch at a time
+===============
+*/
+#define LIGHTMAP_UPLOAD_BATCH	(4 * 1024 * 1024)
+
 void R_UploadLightmaps (void)
 {
-	int lmap;
+	int		lmap, i, size;
+	int		pages[MAX_LIGHTMAPS];
+	int		numpages = 0, batchsize = 0;
+	glRect_t	*theRect;
 
 	for (lmap = 0; lmap < MAX_LIGHTMAPS; lmap++)
 	{
 		if (!lightmap_modified[lmap])
 			continue;
 
-		R_UploadLightmap(lmap, lightmap_textures[lmap]);
+		for (i = 0, size = 0, theRect = lightmap_rectchange[lmap]; i < lightmap_numrects[lmap]; i++, theRect++)
+			size += theRect->w * theRect->h * lightmap_bytes;
+
+		if (numpages && batchsize + size > LIGHTMAP_UPLOAD_BATCH)
+		{
+			R_UploadLightmapBatch (pages, numpages, batchsize);
+			numpages = batchsize = 0;
+		}
+
+		pages[numpages++] = lmap;
+		batchsize += size;
 	}
+
+	if (numpages)
+		R_UploadLightmapBatch (pages, numpages, batchsize);
 }
 
 /*
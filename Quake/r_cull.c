@@ -0,0 +1,565 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// r_cull.c -- world surface culling in a compute shader
+
+// Every world surface the multitexture path draws gets a record with its
+// bounds, plane, index range and the leafs it's in, in bmodel_index_buffer
+// order. Each frame the PVS is uploaded and Shaders/cull.comp writes one
+// VkDrawIndexedIndirectCommand per record, with a zero index count if the
+// surface is outside the PVS, the frustum or facing away. Records sharing a
+// texture and lightmap are next to each other, so the world is drawn with
+// one vkCmdDrawIndexedIndirect per bucket without the CPU looking at single
+// surfaces. The texture chains are still built for lightmaps, water and sky.
+
+#include "quakedef.h"
+
+extern cvar_t gl_fullbrights, r_oldskyleaf;
+extern VkBuffer bmodel_vertex_buffer;
+extern VkBuffer bmodel_index_buffer;
+
+// 1 = cull world surfaces on the GPU, 2 = also check the results against the CPU path
+cvar_t	r_gpuculling = {"r_gpuculling", "0", CVAR_ARCHIVE};
+
+#define CULL_GROUP_SIZE		64	// local_size_x in cull.comp
+#define NUM_CULL_FRAMES		NUM_COMMAND_BUFFERS	// one set per command buffer
+
+typedef struct
+{
+	float		mins[4];
+	float		maxs[4];
+	float		plane[4];	// normal, dist
+	uint32_t	info[4];	// first index, num indices, first leaf, num leafs | planeback << 31
+} cullsurface_t;
+
+typedef struct
+{
+	texture_t	*texture;
+	int			lightmap;
+	int			first, count;	// records
+} cullbucket_t;
+
+static qmodel_t			*cull_model;		// world the buffers were built for
+static int				num_cull_surfaces;	// padded to CULL_GROUP_SIZE
+static msurface_t		**cull_surfaces;	// NULL for the padding
+static int				num_cull_buckets;
+static cullbucket_t		*cull_buckets;
+static int				cull_vis_words;
+static uint32_t			*cull_leafmask;		// bits of all leafs
+static uint32_t			*cull_skymask;		// bits of the leafs that aren't sky
+
+static VkBuffer			cull_surface_buffer;
+static VkDeviceMemory	cull_surface_memory;
+static VkBuffer			cull_leaf_buffer;
+static VkDeviceMemory	cull_leaf_memory;
+
+static VkBuffer			cull_vis_buffers[NUM_CULL_FRAMES];
+static VkDeviceMemory	cull_vis_memory;
+static uint32_t			*cull_vis_data[NUM_CULL_FRAMES];
+static VkBuffer			cull_command_buffers[NUM_CULL_FRAMES];
+static VkDeviceMemory	cull_command_memory;
+static VkDrawIndexedIndirectCommand	*cull_command_data[NUM_CULL_FRAMES];
+static VkDescriptorSet	cull_descriptor_sets[NUM_CULL_FRAMES];
+
+// the buffers of the command buffer being recorded. GL_BeginRendering has
+// waited for its last use to finish before anything here touches them
+static int				cull_frame;
+static qboolean			cull_frame_used;	// at most one dispatch per frame
+static qboolean			cull_dispatched;
+
+// r_gpuculling 2
+static byte				*cull_expected[NUM_CULL_FRAMES];
+static qboolean			cull_verify_pending[NUM_CULL_FRAMES];
+
+/*
+================
+R_CullSurfaceCompare
+================
+*/
+static int R_CullSurfaceCompare (const void *a, const void *b)
+{
+	const msurface_t *s1 = *(const msurface_t **)a;
+	const msurface_t *s2 = *(const msurface_t **)b;
+
+	return s1->vbo_firstindex - s2->vbo_firstindex;
+}
+
+/*
+================
+R_CreateCullFrameBuffers
+
+One host visible buffer per frame, like the dynamic buffers in gl_rmisc.c
+================
+*/
+static void R_CreateCullFrameBuffers (int size, VkBufferUsageFlags usage, VkBuffer *buffers, VkDeviceMemory *memory, void **data)
+{
+	VkResult err;
+
+	VkBufferCreateInfo buffer_create_info;
+	memset(&buffer_create_info, 0, sizeof(buffer_create_info));
+	buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_create_info.size = size;
+	buffer_create_info.usage = usage;
+
+	for(int i = 0; i < NUM_CULL_FRAMES; ++i)
+	{
+		err = vkCreateBuffer(vulkan_globals.device, &buffer_create_info, NULL, &buffers[i]);
+		if (err != VK_SUCCESS)
+			Sys_Error("vkCreateBuffer failed");
+	}
+
+	VkMemoryRequirements memory_requirements;
+	vkGetBufferMemoryRequirements(vulkan_globals.device, buffers[0], &memory_requirements);
+
+	const int align_mod = memory_requirements.size % memory_requirements.alignment;
+	const int aligned_size = ((memory_requirements.size % memory_requirements.alignment) == 0)
+		? memory_requirements.size
+		: (memory_requirements.size + memory_requirements.alignment - align_mod);
+
+	// coherent so r_gpuculling 2 can read the results back
+	VkMemoryAllocateInfo memory_allocate_info;
+	memset(&memory_allocate_info, 0, sizeof(memory_allocate_info));
+	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memory_allocate_info.allocationSize = NUM_CULL_FRAMES * aligned_size;
+	memory_allocate_info.memoryTypeIndex = GL_MemoryTypeFromProperties(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+	err = vkAllocateMemory(vulkan_globals.device, &memory_allocate_info, NULL, memory);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkAllocateMemory failed");
+
+	for(int i = 0; i < NUM_CULL_FRAMES; ++i)
+	{
+		err = vkBindBufferMemory(vulkan_globals.device, buffers[i], *memory, i * aligned_size);
+		if (err != VK_SUCCESS)
+			Sys_Error("vkBindBufferMemory failed");
+	}
+
+	unsigned char * mapped;
+	err = vkMapMemory(vulkan_globals.device, *memory, 0, NUM_CULL_FRAMES * aligned_size, 0, (void **)&mapped);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkMapMemory failed");
+
+	for(int i = 0; i < NUM_CULL_FRAMES; ++i)
+		data[i] = mapped + (i * aligned_size);
+}
+
+/*
+================
+R_DeleteCullBuffers
+================
+*/
+void R_DeleteCullBuffers (void)
+{
+	int i;
+
+	if (!cull_model)
+		return;
+
+	GL_WaitForDeviceIdle();
+
+	vkDestroyBuffer(vulkan_globals.device, cull_surface_buffer, NULL);
+	vkFreeMemory(vulkan_globals.device, cull_surface_memory, NULL);
+	vkDestroyBuffer(vulkan_globals.device, cull_leaf_buffer, NULL);
+	vkFreeMemory(vulkan_globals.device, cull_leaf_memory, NULL);
+	for (i = 0; i < NUM_CULL_FRAMES; i++)
+	{
+		vkDestroyBuffer(vulkan_globals.device, cull_vis_buffers[i], NULL);
+		vkDestroyBuffer(vulkan_globals.device, cull_command_buffers[i], NULL);
+		free (cull_expected[i]);
+		cull_expected[i] = NULL;
+		cull_verify_pending[i] = false;
+	}
+	vkFreeMemory(vulkan_globals.device, cull_vis_memory, NULL);
+	vkFreeMemory(vulkan_globals.device, cull_command_memory, NULL);
+
+	free (cull_surfaces);
+	free (cull_buckets);
+	free (cull_leafmask);
+	free (cull_skymask);
+	cull_surfaces = NULL;
+	cull_buckets = NULL;
+	cull_leafmask = cull_skymask = NULL;
+	num_cull_surfaces = num_cull_buckets = 0;
+	cull_dispatched = false;
+	cull_model = NULL;
+}
+
+/*
+================
+R_BuildCullBuffers
+
+Called after GL_BuildBModelVertexBuffer, which sets the index ranges
+================
+*/
+void R_BuildCullBuffers (void)
+{
+	qmodel_t		*m = cl.worldmodel;
+	mleaf_t			*leaf;
+	mnode_t			*node;
+	msurface_t		*surf, **mark;
+	byte			*drawn;
+	cullsurface_t	*records;
+	cullbucket_t	*bucket;
+	int				*record_for_surf, *leafcounts;
+	uint32_t		*leafs;
+	int				i, j, k, count, numleafrefs;
+
+	R_DeleteCullBuffers ();
+
+	if (!vulkan_globals.compute_culling_able || !m)
+		return;
+
+	// only surfaces that are in a leaf can ever be seen
+	record_for_surf = (int *) malloc (m->numsurfaces * sizeof(int));
+	leafcounts = (int *) calloc (m->numsurfaces, sizeof(int));
+	for (i = 0, leaf = &m->leafs[1]; i < m->numleafs; i++, leaf++)
+		for (j = 0, mark = leaf->firstmarksurface; j < leaf->nummarksurfaces; j++, mark++)
+			leafcounts[*mark - m->surfaces]++;
+
+	// R_MarkSurfaces only draws the surfaces of the nodes, leaving out the
+	// ones skip removal tools leave in the leafs' marksurfaces
+	drawn = (byte *) calloc (m->numsurfaces, 1);
+	for (i = 0, node = m->nodes; i < m->numnodes; i++, node++)
+		for (j = 0, surf = &m->surfaces[node->firstsurface]; j < (int)node->numsurfaces; j++, surf++)
+			if (leafcounts[surf - m->surfaces] && !(surf->flags & (SURF_DRAWTILED | SURF_NOTEXTURE)) && surf->texinfo->texture)
+				drawn[surf - m->surfaces] = true;
+
+	// the surfaces the multitexture path draws, in index buffer order
+	cull_surfaces = (msurface_t **) malloc ((m->numsurfaces + CULL_GROUP_SIZE) * sizeof(msurface_t *));
+	count = 0;
+	for (i = 0, surf = m->surfaces; i < m->numsurfaces; i++, surf++)
+		if (drawn[i])
+			cull_surfaces[count++] = surf;
+	qsort (cull_surfaces, count, sizeof(msurface_t *), R_CullSurfaceCompare);
+
+	num_cull_surfaces = (count + CULL_GROUP_SIZE - 1) & ~(CULL_GROUP_SIZE - 1);
+	if (!num_cull_surfaces)
+	{
+		free (cull_surfaces);
+		free (record_for_surf);
+		free (leafcounts);
+		free (drawn);
+		cull_surfaces = NULL;
+		return;
+	}
+	for (i = count; i < num_cull_surfaces; i++)
+		cull_surfaces[i] = NULL;
+
+	// buckets of records sharing a texture and lightmap
+	cull_buckets = (cullbucket_t *) malloc (count * sizeof(cullbucket_t));
+	num_cull_buckets = 0;
+	bucket = NULL;
+	for (i = 0; i < count; i++)
+	{
+		surf = cull_surfaces[i];
+		record_for_surf[surf - m->surfaces] = i;
+		if (!bucket || bucket->texture != surf->texinfo->texture || bucket->lightmap != surf->lightmaptexturenum)
+		{
+			bucket = &cull_buckets[num_cull_buckets++];
+			bucket->texture = surf->texinfo->texture;
+			bucket->lightmap = surf->lightmaptexturenum;
+			bucket->first = i;
+			bucket->count = 0;
+		}
+		bucket->count++;
+	}
+
+	// records
+	records = (cullsurface_t *) calloc (num_cull_surfaces, sizeof(cullsurface_t));
+	numleafrefs = 0;
+	for (i = 0; i < count; i++)
+	{
+		surf = cull_surfaces[i];
+		VectorCopy (surf->mins, records[i].mins);
+		VectorCopy (surf->maxs, records[i].maxs);
+		VectorCopy (surf->plane->normal, records[i].plane);
+		records[i].plane[3] = surf->plane->dist;
+		records[i].info[0] = surf->vbo_firstindex;
+		records[i].info[1] = surf->vbo_numindices;
+		records[i].info[2] = numleafrefs;
+		records[i].info[3] = (surf->flags & SURF_PLANEBACK) ? 0x80000000u : 0;
+		numleafrefs += leafcounts[surf - m->surfaces];
+	}
+
+	// leafs of each record, as vis bit numbers
+	leafs = (uint32_t *) malloc (q_max(numleafrefs, 1) * sizeof(uint32_t));
+	for (i = 0, leaf = &m->leafs[1]; i < m->numleafs; i++, leaf++)
+		for (j = 0, mark = leaf->firstmarksurface; j < leaf->nummarksurfaces; j++, mark++)
+		{
+			surf = *mark;
+			if (!drawn[surf - m->surfaces])
+				continue;
+			k = record_for_surf[surf - m->surfaces];
+			leafs[records[k].info[2] + (records[k].info[3] & 0x7FFFFFFF)] = i;
+			records[k].info[3]++;
+		}
+
+	cull_vis_words = (m->numleafs + 31) >> 5;
+	cull_leafmask = (uint32_t *) calloc (cull_vis_words, sizeof(uint32_t));
+	cull_skymask = (uint32_t *) calloc (cull_vis_words, sizeof(uint32_t));
+	for (i = 0, leaf = &m->leafs[1]; i < m->numleafs; i++, leaf++)
+	{
+		cull_leafmask[i >> 5] |= 1u << (i & 31);
+		if (leaf->contents != CONTENTS_SKY)
+			cull_skymask[i >> 5] |= 1u << (i & 31);
+	}
+
+	GL_CreateStaticBuffer (records, num_cull_surfaces * sizeof(cullsurface_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &cull_surface_buffer, &cull_surface_memory);
+	GL_CreateStaticBuffer (leafs, q_max(numleafrefs, 1) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, &cull_leaf_buffer, &cull_leaf_memory);
+	R_CreateCullFrameBuffers (cull_vis_words * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, cull_vis_buffers, &cull_vis_memory, (void **)cull_vis_data);
+	R_CreateCullFrameBuffers (num_cull_surfaces * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		cull_command_buffers, &cull_command_memory, (void **)cull_command_data);
+
+	free (leafs);
+	free (records);
+	free (leafcounts);
+	free (record_for_surf);
+	free (drawn);
+
+	for (i = 0; i < NUM_CULL_FRAMES; i++)
+		cull_expected[i] = (byte *) malloc (num_cull_surfaces);
+
+	// descriptor sets are kept across maps
+	if (cull_descriptor_sets[0] == VK_NULL_HANDLE)
+	{
+		VkDescriptorSetAllocateInfo descriptor_set_allocate_info;
+		memset(&descriptor_set_allocate_info, 0, sizeof(descriptor_set_allocate_info));
+		descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		descriptor_set_allocate_info.descriptorPool = vulkan_globals.descriptor_pool;
+		descriptor_set_allocate_info.descriptorSetCount = 1;
+		descriptor_set_allocate_info.pSetLayouts = &vulkan_globals.cull_set_layout;
+
+		for (i = 0; i < NUM_CULL_FRAMES; i++)
+			vkAllocateDescriptorSets(vulkan_globals.device, &descriptor_set_allocate_info, &cull_descriptor_sets[i]);
+	}
+
+	for (i = 0; i < NUM_CULL_FRAMES; i++)
+	{
+		VkDescriptorBufferInfo buffer_infos[4];
+		memset(buffer_infos, 0, sizeof(buffer_infos));
+		buffer_infos[0].buffer = cull_surface_buffer;
+		buffer_infos[1].buffer = cull_leaf_buffer;
+		buffer_infos[2].buffer = cull_vis_buffers[i];
+		buffer_infos[3].buffer = cull_command_buffers[i];
+		for (j = 0; j < 4; j++)
+			buffer_infos[j].range = VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet storage_writes[4];
+		memset(storage_writes, 0, sizeof(storage_writes));
+		for (j = 0; j < 4; j++)
+		{
+			storage_writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			storage_writes[j].dstSet = cull_descriptor_sets[i];
+			storage_writes[j].dstBinding = j;
+			storage_writes[j].descriptorCount = 1;
+			storage_writes[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			storage_writes[j].pBufferInfo = &buffer_infos[j];
+		}
+
+		vkUpdateDescriptorSets(vulkan_globals.device, 4, storage_writes, 0, NULL);
+	}
+
+	cull_model = m;
+	Con_DPrintf ("GPU culling: %i surfaces in %i buckets, %i leaf refs\n", count, num_cull_buckets, numleafrefs);
+}
+
+/*
+================
+R_GPUCullingActive
+================
+*/
+qboolean R_GPUCullingActive (void)
+{
+	return r_gpuculling.value && cull_model && cull_model == cl.worldmodel;
+}
+
+/*
+================
+R_VerifyGPUCulling
+
+Compares a finished frame's commands with what the CPU path would have drawn
+================
+*/
+static void R_VerifyGPUCulling (int frame)
+{
+	int		i, mismatches = 0, visible = 0;
+	uint32_t	expected;
+
+	cull_verify_pending[frame] = false;
+
+	for (i = 0; i < num_cull_surfaces; i++)
+	{
+		if (!cull_surfaces[i])
+			continue;
+		expected = cull_expected[frame][i] ? cull_surfaces[i]->vbo_numindices : 0;
+		if (cull_command_data[frame][i].indexCount != expected)
+		{
+			if (mismatches < 4)
+				Con_Printf ("GPU culling: surface %i drew %u indices, expected %u\n",
+					(int)(cull_surfaces[i] - cull_model->surfaces), cull_command_data[frame][i].indexCount, expected);
+			mismatches++;
+		}
+		if (cull_expected[frame][i])
+			visible++;
+	}
+
+	if (mismatches)
+		Con_Printf ("GPU culling: %i of %i surfaces differ from the CPU path (%i visible)\n", mismatches, num_cull_surfaces, visible);
+}
+
+/*
+================
+R_BeginCullFrame
+
+Called from GL_BeginRendering with the command buffer the frame goes into
+================
+*/
+void R_BeginCullFrame (int command_buffer_index)
+{
+	cull_frame = command_buffer_index;
+	cull_frame_used = false;
+	cull_dispatched = false;
+}
+
+/*
+================
+R_GPUCullSurfaces
+
+Records the cull dispatch for this frame. Has to happen outside of the render
+pass, after R_SetFrustum and R_MarkSurfaces. vis is the PVS R_MarkSurfaces used
+================
+*/
+void R_GPUCullSurfaces (byte *vis)
+{
+	int			i, frame, bytes;
+	uint32_t	word, *mask;
+	float		push_constants[20];
+
+	// the dispatch reads the vis words when the command buffer runs, so a
+	// second view in the same frame would change the first one's; it is
+	// drawn by the CPU path instead
+	if (cull_frame_used)
+		return;
+	cull_frame_used = true;
+	frame = cull_frame;
+
+	if (cull_verify_pending[frame])
+		R_VerifyGPUCulling (frame);
+
+	// the vis data isn't padded to whole words
+	mask = r_oldskyleaf.value ? cull_leafmask : cull_skymask;
+	bytes = (cull_model->numleafs + 7) >> 3;
+	for (i = 0; i < cull_vis_words; i++, bytes -= 4)
+	{
+		word = 0;
+		memcpy (&word, vis + i * 4, q_min(bytes, 4));
+		cull_vis_data[frame][i] = LittleLong (word) & mask[i];
+	}
+
+	if (r_gpuculling.value >= 2)
+	{
+		for (i = 0; i < num_cull_surfaces; i++)
+		{
+			msurface_t *surf = cull_surfaces[i];
+			cull_expected[frame][i] = surf && surf->visframe == r_visframecount && !R_CullBox (surf->mins, surf->maxs) && !R_BackFaceCull (surf);
+		}
+		cull_verify_pending[frame] = true;
+	}
+
+	for (i = 0; i < 4; i++)
+	{
+		VectorCopy (frustum[i].normal, (push_constants + i * 4));
+		push_constants[i * 4 + 3] = frustum[i].dist;
+	}
+	VectorCopy (r_refdef.vieworg, (push_constants + 16));
+	push_constants[19] = 0.0f;
+
+	VkCommandBuffer command_buffer = vulkan_globals.command_buffer;
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, vulkan_globals.cull_pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, vulkan_globals.cull_pipeline_layout, 0, 1, &cull_descriptor_sets[frame], 0, NULL);
+	vkCmdPushConstants(command_buffer, vulkan_globals.cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), push_constants);
+	vkCmdDispatch(command_buffer, num_cull_surfaces / CULL_GROUP_SIZE, 1, 1);
+
+	VkMemoryBarrier memory_barrier;
+	memset(&memory_barrier, 0, sizeof(memory_barrier));
+	memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memory_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &memory_barrier, 0, NULL, 0, NULL);
+
+	cull_dispatched = true;
+}
+
+/*
+================
+R_DrawWorldGPUCulled
+
+Draws what the cull shader left visible, one indirect draw per bucket.
+Returns false if there was no dispatch this frame
+================
+*/
+qboolean R_DrawWorldGPUCulled (VkCommandBuffer command_buffer)
+{
+	int				i;
+	cullbucket_t	*bucket;
+	texture_t		*lasttexture = NULL;
+	gltexture_t		*fullbright = NULL;
+
+	if (!cull_dispatched)
+		return false;
+	cull_dispatched = false;
+
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(command_buffer, 0, 1, &bmodel_vertex_buffer, &offset);
+	vkCmdBindIndexBuffer(command_buffer, bmodel_index_buffer, 0, VK_INDEX_TYPE_UINT32);
+	VkPipeline current_pipeline = VK_NULL_HANDLE;
+
+	for (i = 0, bucket = cull_buckets; i < num_cull_buckets; i++, bucket++)
+	{
+		if (bucket->texture != lasttexture)
+		{
+			texture_t * texture = R_TextureAnimation(bucket->texture, 0);
+			VkPipeline pipeline = vulkan_globals.world_pipeline;
+
+			if (gl_fullbrights.value && (fullbright = texture->fullbright))
+				pipeline = vulkan_globals.world_fullbright_pipeline;
+			if (current_pipeline != pipeline)
+			{
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				current_pipeline = pipeline;
+			}
+			if (pipeline == vulkan_globals.world_fullbright_pipeline)
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline_layout, 3, 1, &fullbright->descriptor_set, 0, NULL);
+
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline_layout, 0, 1, texture->gltexture->sampler_set, 0, NULL);
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline_layout, 1, 1, &texture->gltexture->descriptor_set, 0, NULL);
+			lasttexture = bucket->texture;
+		}
+
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline_layout, 2, 1, &lightmap_textures[bucket->lightmap]->descriptor_set, 0, NULL);
+		R_DrawIndirect (command_buffer, cull_command_buffers[cull_frame], bucket->first * sizeof(VkDrawIndexedIndirectCommand), bucket->count);
+	}
+
+	rs_brushpasses += num_cull_buckets;
+	return true;
+}
@@ -0,0 +1,583 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// r_lightmap.c -- the inner loops of lightmap building
+
+// R_BuildLightMap and R_AddDynamicLights go through the kernels here. There
+// is a plain C version of each, and SSE2 and NEON versions that produce
+// exactly the same bytes: the same float operations happen in the same
+// order, only four luxels at a time. The fastest kernels the CPU supports
+// are picked at startup, r_lightmap_simd 0 goes back to the C ones.
+
+#include "quakedef.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#define SSE2_FUNC
+#elif defined(__i386__) && defined(__GNUC__)
+// built for plain x86, the SSE2 kernels are only used if SDL finds SSE2
+#define USE_SSE2
+#define SSE2_FUNC	__attribute__((target("sse2")))
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define USE_NEON
+#endif
+
+#ifdef USE_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef USE_NEON
+#include <arm_neon.h>
+#endif
+
+cvar_t	r_lightmap_simd = {"r_lightmap_simd", "1", CVAR_NONE};
+
+const lightkernels_t	*lightkernels;
+
+/*
+=============================================================
+
+	C
+
+=============================================================
+*/
+
+static void R_AddLightStyle_C (unsigned *bl, const byte *lightmap, int size, unsigned scale)
+{
+	int	i;
+
+	for (i=0 ; i<size ; i++)
+	{
+		*bl++ += *lightmap++ * scale;
+		*bl++ += *lightmap++ * scale;
+		*bl++ += *lightmap++ * scale;
+	}
+}
+
+// also finishes the rows of the other kernels, from column first on
+static void R_AddDynamicLightRow_C (unsigned *bl, int first, int smax, float local, int td, float rad, float minlight, const float *color)
+{
+	int		s, sd;
+	float	dist, brightness;
+
+	for (s=first ; s<smax ; s++)
+	{
+		sd = local - s*16;
+		if (sd < 0)
+			sd = -sd;
+		if (sd > td)
+			dist = sd + (td>>1);
+		else
+			dist = td + (sd>>1);
+		if (dist < minlight)
+		{
+			brightness = rad - dist;
+			bl[0] += (int) (brightness * color[0]);
+			bl[1] += (int) (brightness * color[1]);
+			bl[2] += (int) (brightness * color[2]);
+		}
+		bl += 3;
+	}
+}
+
+static void R_AddDynamicLight_C (unsigned *bl, int smax, int tmax, const float *local, float rad, float minlight, const float *color)
+{
+	int		t, td;
+
+	for (t = 0 ; t<tmax ; t++, bl += smax * 3)
+	{
+		td = local[1] - t*16;
+		if (td < 0)
+			td = -td;
+		R_AddDynamicLightRow_C (bl, 0, smax, local[0], td, rad, minlight, color);
+	}
+}
+
+static void R_StoreLightmap_C (const unsigned *bl, int smax, int tmax, byte *dest, int stride)
+{
+	int	i, j, r, g, b;
+
+	stride -= smax * 4;
+	for (i=0 ; i<tmax ; i++, dest += stride)
+	{
+		for (j=0 ; j<smax ; j++)
+		{
+			r = *bl++ >> 8;
+			g = *bl++ >> 8;
+			b = *bl++ >> 8;
+			*dest++ = q_min (r, 255);
+			*dest++ = q_min (g, 255);
+			*dest++ = q_min (b, 255);
+			*dest++ = 255;
+		}
+	}
+}
+
+static const lightkernels_t lightkernels_c =
+{
+	"C",
+	R_AddLightStyle_C,
+	R_AddDynamicLight_C,
+	R_StoreLightmap_C
+};
+
+/*
+=============================================================
+
+	SSE2
+
+=============================================================
+*/
+
+#ifdef USE_SSE2
+
+SSE2_FUNC static void R_AddLightStyle_SSE2 (unsigned *bl, const byte *lightmap, int size, unsigned scale)
+{
+	int		i, count = size * 3;
+	__m128i	zero, vscale, b, lo, hi, pl, ph;
+
+	// the products are put together from 16 bit halves
+	if (scale > 0xffff)
+	{
+		R_AddLightStyle_C (bl, lightmap, size, scale);
+		return;
+	}
+
+	zero = _mm_setzero_si128 ();
+	vscale = _mm_set1_epi16 ((short) scale);
+	for (i = 0; i + 16 <= count; i += 16, bl += 16, lightmap += 16)
+	{
+		b = _mm_loadu_si128 ((const __m128i *) lightmap);
+		lo = _mm_unpacklo_epi8 (b, zero);
+		hi = _mm_unpackhi_epi8 (b, zero);
+
+		pl = _mm_mullo_epi16 (lo, vscale);
+		ph = _mm_mulhi_epu16 (lo, vscale);
+		_mm_storeu_si128 ((__m128i *) (bl + 0), _mm_add_epi32 (_mm_loadu_si128 ((const __m128i *) (bl + 0)), _mm_unpacklo_epi16 (pl, ph)));
+		_mm_storeu_si128 ((__m128i *) (bl + 4), _mm_add_epi32 (_mm_loadu_si128 ((const __m128i *) (bl + 4)), _mm_unpackhi_epi16 (pl, ph)));
+
+		pl = _mm_mullo_epi16 (hi, vscale);
+		ph = _mm_mulhi_epu16 (hi, vscale);
+		_mm_storeu_si128 ((__m128i *) (bl + 8), _mm_add_epi32 (_mm_loadu_si128 ((const __m128i *) (bl + 8)), _mm_unpacklo_epi16 (pl, ph)));
+		_mm_storeu_si128 ((__m128i *) (bl + 12), _mm_add_epi32 (_mm_loadu_si128 ((const __m128i *) (bl + 12)), _mm_unpackhi_epi16 (pl, ph)));
+	}
+
+	for ( ; i < count; i++)
+		*bl++ += *lightmap++ * scale;
+}
+
+#define SHUFFLE_PS(a, b, imm)	_mm_castps_si128 (_mm_shuffle_ps (_mm_castsi128_ps (a), _mm_castsi128_ps (b), imm))
+
+SSE2_FUNC static void R_AddDynamicLight_SSE2 (unsigned *bl, int smax, int tmax, const float *local, float rad, float minlight, const float *color)
+{
+	int		s, t, td;
+	__m128	step, vlocal, vrad, vminlight, vr, vg, vb, distf, brightness;
+	__m128i	vtd, vtdhalf, sd, sign, gt, dist, mask, r, g, b, rg, gb, t0, t1;
+
+	step = _mm_set_ps (48.0f, 32.0f, 16.0f, 0.0f);
+	vlocal = _mm_set1_ps (local[0]);
+	vrad = _mm_set1_ps (rad);
+	vminlight = _mm_set1_ps (minlight);
+	vr = _mm_set1_ps (color[0]);
+	vg = _mm_set1_ps (color[1]);
+	vb = _mm_set1_ps (color[2]);
+
+	for (t = 0 ; t<tmax ; t++)
+	{
+		td = local[1] - t*16;
+		if (td < 0)
+			td = -td;
+		vtd = _mm_set1_epi32 (td);
+		vtdhalf = _mm_set1_epi32 (td >> 1);
+
+		for (s = 0; s + 4 <= smax; s += 4, bl += 12)
+		{
+			sd = _mm_cvttps_epi32 (_mm_sub_ps (vlocal, _mm_add_ps (_mm_set1_ps ((float)(s*16)), step)));
+			sign = _mm_srai_epi32 (sd, 31);
+			sd = _mm_sub_epi32 (_mm_xor_si128 (sd, sign), sign);
+
+			gt = _mm_cmpgt_epi32 (sd, vtd);
+			dist = _mm_or_si128 (_mm_and_si128 (gt, _mm_add_epi32 (sd, vtdhalf)),
+				_mm_andnot_si128 (gt, _mm_add_epi32 (vtd, _mm_srai_epi32 (sd, 1))));
+			distf = _mm_cvtepi32_ps (dist);
+			mask = _mm_castps_si128 (_mm_cmplt_ps (distf, vminlight));
+			brightness = _mm_sub_ps (vrad, distf);
+
+			r = _mm_and_si128 (mask, _mm_cvttps_epi32 (_mm_mul_ps (brightness, vr)));
+			g = _mm_and_si128 (mask, _mm_cvttps_epi32 (_mm_mul_ps (brightness, vg)));
+			b = _mm_and_si128 (mask, _mm_cvttps_epi32 (_mm_mul_ps (brightness, vb)));
+
+			// r0 g0 b0 r1 | g1 b1 r2 g2 | b2 r3 g3 b3
+			rg = _mm_unpacklo_epi32 (r, g);
+			gb = _mm_unpacklo_epi32 (g, b);
+			t0 = SHUFFLE_PS (b, r, _MM_SHUFFLE (1, 1, 0, 0));
+			_mm_storeu_si128 ((__m128i *) (bl + 0), _mm_add_epi32 (_mm_loadu_si128 ((const __m128i *) (bl + 0)), SHUFFLE_PS (rg, t0, _MM_SHUFFLE (2, 0, 1, 0))));
+			rg = _mm_unpackhi_epi32 (r, g);
+			_mm_storeu_si128 ((__m128i *) (bl + 4), _mm_add_epi32 (_mm_loadu_si128 ((const __m128i *) (bl + 4)), SHUFFLE_PS (gb, rg, _MM_SHUFFLE (1, 0, 3, 2))));
+			gb = _mm_unpackhi_epi32 (g, b);
+			t1 = SHUFFLE_PS (b, r, _MM_SHUFFLE (3, 3, 2, 2));
+			_mm_storeu_si128 ((__m128i *) (bl + 8), _mm_add_epi32 (_mm_loadu_si128 ((const __m128i *) (bl + 8)), SHUFFLE_PS (t1, gb, _MM_SHUFFLE (3, 2, 2, 0))));
+		}
+
+		if (s < smax)
+		{
+			R_AddDynamicLightRow_C (bl, s, smax, local[0], td, rad, minlight, color);
+			bl += (smax - s) * 3;
+		}
+	}
+}
+
+SSE2_FUNC static void R_StoreLightmap_SSE2 (const unsigned *bl, int smax, int tmax, byte *dest, int stride)
+{
+	int		i, j;
+	__m128i	alpha, in0, in1, in2, l1, l2, l3, out;
+
+	alpha = _mm_set1_epi32 ((int) 0xff000000);
+	for (i=0 ; i<tmax ; i++, dest += stride)
+	{
+		byte *out_dest = dest;
+
+		for (j = 0; j + 4 <= smax; j += 4, bl += 12, out_dest += 16)
+		{
+			in0 = _mm_srli_epi32 (_mm_loadu_si128 ((const __m128i *) (bl + 0)), 8);
+			in1 = _mm_srli_epi32 (_mm_loadu_si128 ((const __m128i *) (bl + 4)), 8);
+			in2 = _mm_srli_epi32 (_mm_loadu_si128 ((const __m128i *) (bl + 8)), 8);
+
+			// one luxel per register, the fourth lane gets replaced by alpha
+			l1 = _mm_shuffle_epi32 (SHUFFLE_PS (in0, in1, _MM_SHUFFLE (1, 0, 3, 3)), _MM_SHUFFLE (3, 3, 2, 0));
+			l2 = SHUFFLE_PS (in1, in2, _MM_SHUFFLE (0, 0, 3, 2));
+			l3 = _mm_shuffle_epi32 (in2, _MM_SHUFFLE (3, 3, 2, 1));
+
+			// the values are below 1 << 24, so the signed saturation can't go wrong
+			out = _mm_packus_epi16 (_mm_packs_epi32 (in0, l1), _mm_packs_epi32 (l2, l3));
+			_mm_storeu_si128 ((__m128i *) out_dest, _mm_or_si128 (out, alpha));
+		}
+
+		if (j < smax)
+		{
+			R_StoreLightmap_C (bl, smax - j, 1, out_dest, stride);
+			bl += (smax - j) * 3;
+		}
+	}
+}
+
+static const lightkernels_t lightkernels_sse2 =
+{
+	"SSE2",
+	R_AddLightStyle_SSE2,
+	R_AddDynamicLight_SSE2,
+	R_StoreLightmap_SSE2
+};
+
+#endif	/* USE_SSE2 */
+
+/*
+=============================================================
+
+	NEON
+
+=============================================================
+*/
+
+#ifdef USE_NEON
+
+static void R_AddLightStyle_NEON (unsigned *bl, const byte *lightmap, int size, unsigned scale)
+{
+	int			i, count = size * 3;
+	uint8x16_t	b;
+	uint16x8_t	lo, hi;
+
+	for (i = 0; i + 16 <= count; i += 16, bl += 16, lightmap += 16)
+	{
+		b = vld1q_u8 (lightmap);
+		lo = vmovl_u8 (vget_low_u8 (b));
+		hi = vmovl_u8 (vget_high_u8 (b));
+		vst1q_u32 (bl + 0, vmlaq_n_u32 (vld1q_u32 (bl + 0), vmovl_u16 (vget_low_u16 (lo)), scale));
+		vst1q_u32 (bl + 4, vmlaq_n_u32 (vld1q_u32 (bl + 4), vmovl_u16 (vget_high_u16 (lo)), scale));
+		vst1q_u32 (bl + 8, vmlaq_n_u32 (vld1q_u32 (bl + 8), vmovl_u16 (vget_low_u16 (hi)), scale));
+		vst1q_u32 (bl + 12, vmlaq_n_u32 (vld1q_u32 (bl + 12), vmovl_u16 (vget_high_u16 (hi)), scale));
+	}
+
+	for ( ; i < count; i++)
+		*bl++ += *lightmap++ * scale;
+}
+
+static void R_AddDynamicLight_NEON (unsigned *bl, int smax, int tmax, const float *local, float rad, float minlight, const float *color)
+{
+	static const float	steps[4] = {0.0f, 16.0f, 32.0f, 48.0f};
+	int				s, t, td;
+	float32x4_t		step, distf, brightness;
+	int32x4_t		vtd, vtdhalf, sd, dist;
+	uint32x4_t		mask;
+	uint32x4x3_t	v;
+
+	step = vld1q_f32 (steps);
+	for (t = 0 ; t<tmax ; t++)
+	{
+		td = local[1] - t*16;
+		if (td < 0)
+			td = -td;
+		vtd = vdupq_n_s32 (td);
+		vtdhalf = vdupq_n_s32 (td >> 1);
+
+		for (s = 0; s + 4 <= smax; s += 4, bl += 12)
+		{
+			sd = vcvtq_s32_f32 (vsubq_f32 (vdupq_n_f32 (local[0]), vaddq_f32 (vdupq_n_f32 ((float)(s*16)), step)));
+			sd = vabsq_s32 (sd);
+			dist = vbslq_s32 (vcgtq_s32 (sd, vtd), vaddq_s32 (sd, vtdhalf), vaddq_s32 (vtd, vshrq_n_s32 (sd, 1)));
+			distf = vcvtq_f32_s32 (dist);
+			mask = vcltq_f32 (distf, vdupq_n_f32 (minlight));
+			brightness = vsubq_f32 (vdupq_n_f32 (rad), distf);
+
+			v = vld3q_u32 (bl);
+			v.val[0] = vaddq_u32 (v.val[0], vandq_u32 (mask, vreinterpretq_u32_s32 (vcvtq_s32_f32 (vmulq_n_f32 (brightness, color[0])))));
+			v.val[1] = vaddq_u32 (v.val[1], vandq_u32 (mask, vreinterpretq_u32_s32 (vcvtq_s32_f32 (vmulq_n_f32 (brightness, color[1])))));
+			v.val[2] = vaddq_u32 (v.val[2], vandq_u32 (mask, vreinterpretq_u32_s32 (vcvtq_s32_f32 (vmulq_n_f32 (brightness, color[2])))));
+			vst3q_u32 (bl, v);
+		}
+
+		if (s < smax)
+		{
+			R_AddDynamicLightRow_C (bl, s, smax, local[0], td, rad, minlight, color);
+			bl += (smax - s) * 3;
+		}
+	}
+}
+
+static void R_StoreLightmap_NEON (const unsigned *bl, int smax, int tmax, byte *dest, int stride)
+{
+	int				i, j;
+	uint32x4x3_t	a, b;
+	uint8x8x4_t		out;
+
+	out.val[3] = vdup_n_u8 (255);
+	for (i=0 ; i<tmax ; i++, dest += stride)
+	{
+		byte *out_dest = dest;
+
+		for (j = 0; j + 8 <= smax; j += 8, bl += 24, out_dest += 32)
+		{
+			a = vld3q_u32 (bl);
+			b = vld3q_u32 (bl + 12);
+			out.val[0] = vqmovn_u16 (vcombine_u16 (vqmovn_u32 (vshrq_n_u32 (a.val[0], 8)), vqmovn_u32 (vshrq_n_u32 (b.val[0], 8))));
+			out.val[1] = vqmovn_u16 (vcombine_u16 (vqmovn_u32 (vshrq_n_u32 (a.val[1], 8)), vqmovn_u32 (vshrq_n_u32 (b.val[1], 8))));
+			out.val[2] = vqmovn_u16 (vcombine_u16 (vqmovn_u32 (vshrq_n_u32 (a.val[2], 8)), vqmovn_u32 (vshrq_n_u32 (b.val[2], 8))));
+			vst4_u8 (out_dest, out);
+		}
+
+		if (j < smax)
+		{
+			R_StoreLightmap_C (bl, smax - j, 1, out_dest, stride);
+			bl += (smax - j) * 3;
+		}
+	}
+}
+
+static const lightkernels_t lightkernels_neon =
+{
+	"NEON",
+	R_AddLightStyle_NEON,
+	R_AddDynamicLight_NEON,
+	R_StoreLightmap_NEON
+};
+
+#endif	/* USE_NEON */
+
+//==============================================================================
+
+/*
+================
+R_BestLightKernels
+================
+*/
+static const lightkernels_t *R_BestLightKernels (void)
+{
+#ifdef USE_SSE2
+	if (SDL_HasSSE2 ())
+		return &lightkernels_sse2;
+#endif
+#ifdef USE_NEON
+#if SDL_VERSION_ATLEAST(2,0,6)
+	if (SDL_HasNEON ())
+#endif
+		return &lightkernels_neon;
+#endif
+	return &lightkernels_c;
+}
+
+/*
+================
+R_LightmapSimd_f -- called when r_lightmap_simd changes
+================
+*/
+static void R_LightmapSimd_f (cvar_t *var)
+{
+	lightkernels = var->value ? R_BestLightKernels () : &lightkernels_c;
+}
+
+//==============================================================================
+//
+// BENCHMARK
+//
+//==============================================================================
+
+#define	BENCH_MAX_SIZE	(18*18)	// luxels of the largest standard surface
+
+typedef struct
+{
+	int			smax, tmax;
+	const byte	*samples;
+	int			numstyles;
+	unsigned	scales[MAXLIGHTMAPS];
+	float		local[2];	// made up light at the surface
+	float		rad, minlight;
+} benchsurf_t;
+
+static unsigned	bench_blocklights[BENCH_MAX_SIZE * 3 + 16];
+
+/*
+================
+R_BenchBuildLightmap -- what R_BuildLightMap does with the given kernels
+================
+*/
+static void R_BenchBuildLightmap (const lightkernels_t *kernels, const benchsurf_t *bs, byte *dest)
+{
+	static const float	color[3] = {256.0f, 204.8f, 153.6f};
+	const byte			*lightmap = bs->samples;
+	int					size = bs->smax * bs->tmax;
+	int					maps;
+
+	memset (bench_blocklights, 0, size * 3 * sizeof(unsigned));
+	for (maps = 0 ; maps < bs->numstyles ; maps++, lightmap += size * 3)
+		kernels->addstyle (bench_blocklights, lightmap, size, bs->scales[maps]);
+	kernels->adddlight (bench_blocklights, bs->smax, bs->tmax, bs->local, bs->rad, bs->minlight, color);
+	kernels->store (bench_blocklights, bs->smax, bs->tmax, dest, bs->smax * 4);
+}
+
+/*
+================
+R_LightmapBench_f
+
+Builds the lightmaps of all surfaces of the current map, each with a dynamic
+light on it, with the C kernels and the ones in use, and compares the time
+and the output
+================
+*/
+static void R_LightmapBench_f (void)
+{
+	qmodel_t		*m = cl.worldmodel;
+	msurface_t		*surf;
+	benchsurf_t		*surfs, *bs;
+	byte			*out_c, *out_simd;
+	int				*offsets;
+	int				i, j, count, rounds, round, size, total, mismatches;
+	double			time, time_c, time_simd;
+	const lightkernels_t	*kernels = R_BestLightKernels ();
+
+	if (!m || !m->lightdata)
+	{
+		Con_Printf ("r_lightmap_bench: no lit map loaded\n");
+		return;
+	}
+
+	rounds = (Cmd_Argc () > 1) ? q_max (Q_atoi (Cmd_Argv (1)), 1) : 100;
+
+	// record the inputs of every lit surface
+	surfs = (benchsurf_t *) malloc (m->numsurfaces * sizeof(benchsurf_t));
+	offsets = (int *) malloc (m->numsurfaces * sizeof(int));
+	for (i = 0, count = 0, total = 0, surf = m->surfaces; i < m->numsurfaces; i++, surf++)
+	{
+		if (!surf->samples || (surf->flags & SURF_DRAWTILED))
+			continue;
+
+		bs = &surfs[count];
+		bs->smax = (surf->extents[0]>>4)+1;
+		bs->tmax = (surf->extents[1]>>4)+1;
+		if (bs->smax * bs->tmax > BENCH_MAX_SIZE)
+			continue;
+		bs->samples = surf->samples;
+		for (j = 0; j < MAXLIGHTMAPS && surf->styles[j] != 255; j++)
+			bs->scales[j] = d_lightstylevalue[surf->styles[j]];
+		bs->numstyles = j;
+
+		// a light in the middle of the surface, a bit off the plane
+		bs->local[0] = surf->extents[0] * 0.5f + 3.3f;
+		bs->local[1] = surf->extents[1] * 0.5f - 5.7f;
+		bs->rad = 100.0f + (i % 200);
+		bs->minlight = bs->rad - 8.0f;
+
+		offsets[count++] = total;
+		total += bs->smax * bs->tmax * 4;
+	}
+
+	out_c = (byte *) malloc (q_max(total, 1));
+	out_simd = (byte *) malloc (q_max(total, 1));
+
+	time_c = time_simd = 0;
+	for (round = 0; round < rounds; round++)
+	{
+		time = Sys_DoubleTime ();
+		for (i = 0; i < count; i++)
+			R_BenchBuildLightmap (&lightkernels_c, &surfs[i], out_c + offsets[i]);
+		time_c += Sys_DoubleTime () - time;
+
+		time = Sys_DoubleTime ();
+		for (i = 0; i < count; i++)
+			R_BenchBuildLightmap (kernels, &surfs[i], out_simd + offsets[i]);
+		time_simd += Sys_DoubleTime () - time;
+	}
+
+	for (i = 0, mismatches = 0; i < count; i++)
+	{
+		size = surfs[i].smax * surfs[i].tmax * 4;
+		if (memcmp (out_c + offsets[i], out_simd + offsets[i], size))
+			mismatches++;
+	}
+
+	Con_Printf ("%i surfaces, %i KB of lightmap, %i rounds\n", count, total / 1024, rounds);
+	Con_Printf ("C    %7.3f ms per round\n", time_c * 1000.0 / rounds);
+	Con_Printf ("%-4s %7.3f ms per round, %.2fx\n", kernels->name, time_simd * 1000.0 / rounds, time_simd > 0 ? time_c / time_simd : 0);
+	if (mismatches)
+		Con_Printf ("%i surfaces differ from the C kernels\n", mismatches);
+	else
+		Con_Printf ("output is identical\n");
+
+	free (out_simd);
+	free (out_c);
+	free (offsets);
+	free (surfs);
+}
+
+/*
+================
+R_InitLightKernels
+================
+*/
+void R_InitLightKernels (void)
+{
+	Cvar_RegisterVariable (&r_lightmap_simd);
+	Cvar_SetCallback (&r_lightmap_simd, R_LightmapSimd_f);
+	Cmd_AddCommand ("r_lightmap_bench", R_LightmapBench_f);
+
+	R_LightmapSimd_f (&r_lightmap_simd);
+	Con_Printf ("Lightmap kernels: %s\n", lightkernels->name);
+}
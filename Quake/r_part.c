@@ -819,29 +819,21 @@ void CL_RunParticles (void)
 
 /*
 ===============
-R_DrawParticles -- johnfitz -- moved all non-drawing code to CL_RunParticles
+R_RecordParticles -- runs on the record threads
 ===============
 */
-void R_DrawParticles (void)
+static void R_RecordParticles (VkCommandBuffer command_buffer, void *data, int index)
 {
 	particle_t		*p;
 	float			scale;
 	vec3_t			up, right, p_up, p_right; //johnfitz -- p_ vectors
-	extern	cvar_t	r_particles; //johnfitz
-
-	if (!r_particles.value)
-		return;
-
-	//ericw -- avoid empty glBegin(),glEnd() pair below; causes issues on AMD
-	if (!active_particles)
-		return;
 
 	VectorScale (vup, 1.5, up);
 	VectorScale (vright, 1.5, right);
 
-	vkCmdBindPipeline(vulkan_globals.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.particle_pipeline);
-	vkCmdBindDescriptorSets(vulkan_globals.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.basic_pipeline_layout, 0, 1, particletexture->sampler_set, 0, NULL);
-	vkCmdBindDescriptorSets(vulkan_globals.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.basic_pipeline_layout, 1, 1, &particletexture->descriptor_set, 0, NULL);
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.particle_pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.basic_pipeline_layout, 0, 1, particletexture->sampler_set, 0, NULL);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.basic_pipeline_layout, 1, 1, &particletexture->descriptor_set, 0, NULL);
 
 	int num_triangles = 0;
 	for (p=active_particles ; p ; p=p->next)
@@ -902,11 +894,33 @@ void R_DrawParticles (void)
 		vertices[current_vertex].color[3] = 255;
 		current_vertex++;
 
-		rs_particles++;
 	}
 
-	vkCmdBindVertexBuffers(vulkan_globals.command_buffer, 0, 1, &vertex_buffer, &vertex_buffer_offset);
-	vkCmdDraw(vulkan_globals.command_buffer, num_triangles * 3, 1, 0, 0);
+	vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffer, &vertex_buffer_offset);
+	vkCmdDraw(command_buffer, num_triangles * 3, 1, 0, 0);
+}
+
+/*
+===============
+R_DrawParticles -- johnfitz -- moved all non-drawing code to CL_RunParticles
+===============
+*/
+void R_DrawParticles (void)
+{
+	particle_t		*p;
+	extern	cvar_t	r_particles; //johnfitz
+
+	if (!r_particles.value)
+		return;
+
+	//ericw -- avoid empty glBegin(),glEnd() pair below; causes issues on AMD
+	if (!active_particles)
+		return;
+
+	for (p=active_particles ; p ; p=p->next)
+		rs_particles++;
+
+	GL_RecordParallel (R_RecordParticles, NULL, 1);
 }
 
 /*
@@ -34,6 +34,7 @@ extern byte mod_novis[MAX_MAP_LEAFS/8];
 int vis_changed; //if true, force pvs to be refreshed
 
 extern VkBuffer bmodel_vertex_buffer;
+extern VkBuffer bmodel_index_buffer;
 
 //==============================================================================
 //
@@ -113,6 +114,8 @@ void R_MarkSurfaces (void)
 			if (vis[i>>3] & (1<<(i&7)))
 				if (leaf->efrags)
 					R_StoreEfrags (&leaf->efrags);
+		if (R_GPUCullingActive ())
+			R_GPUCullSurfaces (vis);
 		return;
 	}
 
@@ -165,6 +168,9 @@ void R_MarkSurfaces (void)
 		}
 	}
 #endif
+
+	if (R_GPUCullingActive ())
+		R_GPUCullSurfaces (vis);
 }
 
 /*
@@ -214,6 +220,8 @@ void R_CullSurfaces (void)
 
 // ericw -- instead of testing (s->visframe == r_visframecount) on all world
 // surfaces, use the chained surfaces, which is exactly the same set of sufaces
+// the frustum test is done here even with r_gpuculling, so the lightmap chains
+// and r_speeds only see what is on screen; the cull shader only decides the draw
 	for (i=0 ; i<cl.worldmodel->numtextures ; i++)
 	{
 		t = cl.worldmodel->textures[i];
@@ -402,89 +410,51 @@ void R_DrawTextureChains_Glow (qmodel_t *model, entity_t *ent, texchain_t chain)
 //
 //==============================================================================
 
-static unsigned int R_NumTriangleIndicesForSurf (msurface_t *s)
-{
-	return 3 * (s->numedges - 2);
-}
-
 /*
 ================
-R_TriangleIndicesForSurf
+R_EmitRun
 
-Writes out the triangle indices needed to draw s as a triangle list.
-The number of indices it will write is given by R_NumTriangleIndicesForSurf.
+Appends an indirect command for a run of indices, or draws it right
+away when there is no indirect space
 ================
 */
-static void R_TriangleIndicesForSurf (msurface_t *s, uint32_t *dest)
+static void R_EmitRun (VkCommandBuffer command_buffer, VkDrawIndexedIndirectCommand *commands, uint32_t *num_commands, uint32_t first, uint32_t count)
 {
-	int i;
-	for (i=2; i<s->numedges; i++)
+	VkDrawIndexedIndirectCommand	*cmd;
+
+	if (!commands)
 	{
-		*dest++ = s->vbo_firstvert;
-		*dest++ = s->vbo_firstvert + i - 1;
-		*dest++ = s->vbo_firstvert + i;
+		vkCmdDrawIndexed(command_buffer, count, 1, first, 0, 0);
+		return;
 	}
-}
-
-#define MAX_BATCH_SIZE 4096
-
-static uint32_t vbo_indices[MAX_BATCH_SIZE];
-static unsigned int num_vbo_indices;
 
-/*
-================
-R_ClearBatch
-================
-*/
-static void R_ClearBatch ()
-{
-	num_vbo_indices = 0;
+	cmd = &commands[(*num_commands)++];
+	cmd->indexCount = count;
+	cmd->instanceCount = 1;
+	cmd->firstIndex = first;
+	cmd->vertexOffset = 0;
+	cmd->firstInstance = 0;
 }
 
 /*
 ================
-R_FlushBatch
+R_DrawIndirect
 
-Draw the current batch if non-empty and clears it, ready for more R_BatchSurface calls.
+Draws count indirect commands, in one call if the device allows it
 ================
 */
-static void R_FlushBatch ()
+void R_DrawIndirect (VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset, uint32_t count)
 {
-	if (num_vbo_indices > 0)
-	{
-		VkBuffer buffer;
-		VkDeviceSize buffer_offset;
-		byte * indices = R_IndexAllocate(num_vbo_indices * sizeof(uint32_t), &buffer, &buffer_offset);
-		memcpy(indices, vbo_indices, num_vbo_indices * sizeof(uint32_t));
-
-		vkCmdBindIndexBuffer(vulkan_globals.command_buffer, buffer, buffer_offset, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(vulkan_globals.command_buffer, num_vbo_indices, 1, 0, 0, 0);
+	uint32_t	i, batch;
+	const uint32_t	max_count = vulkan_globals.multi_draw_indirect ? vulkan_globals.device_properties.limits.maxDrawIndirectCount : 1;
 
-		num_vbo_indices = 0;
+	for (i = 0; i < count; i += batch)
+	{
+		batch = q_min(count - i, max_count);
+		vkCmdDrawIndexedIndirect(command_buffer, buffer, offset + i * sizeof(VkDrawIndexedIndirectCommand), batch, sizeof(VkDrawIndexedIndirectCommand));
 	}
 }
 
-/*
-================
-R_BatchSurface
-
-Add the surface to the current batch, or just draw it immediately if we're not
-using VBOs.
-================
-*/
-static void R_BatchSurface (msurface_t *s)
-{
-	int num_surf_indices;
-
-	num_surf_indices = R_NumTriangleIndicesForSurf (s);
-	
-	if (num_vbo_indices + num_surf_indices > MAX_BATCH_SIZE)
-		R_FlushBatch();
-	
-	R_TriangleIndicesForSurf (s, &vbo_indices[num_vbo_indices]);
-	num_vbo_indices += num_surf_indices;
-}
-
 /*
 ================
 R_DrawTextureChains_NoTexture -- johnfitz
@@ -698,28 +668,63 @@ void R_DrawLightmapChains (void)
 
 /*
 ================
-R_DrawTextureChains_Multitexture
+R_NumMultitextureSurfaces
+
+The number of surfaces R_DrawTextureChains_MultitextureRange would draw for t
 ================
 */
-void R_DrawTextureChains_Multitexture (qmodel_t *model, entity_t *ent, texchain_t chain)
+static int R_NumMultitextureSurfaces (texture_t *t, texchain_t chain)
 {
-	int			i;
+	msurface_t	*s;
+	int			count = 0;
+
+	if (!t || !t->texturechains[chain] || t->texturechains[chain]->flags & (SURF_DRAWTILED | SURF_NOTEXTURE))
+		return 0;
+
+	for (s = t->texturechains[chain]; s; s = s->texturechain)
+		if (!s->culled)
+			count++;
+
+	return count;
+}
+
+/*
+================
+R_DrawTextureChains_MultitextureRange
+
+Draws the chains of textures first through last-1 and returns the number of
+surfaces drawn. The triangle indices are all in bmodel_index_buffer already,
+so every visible surface just adds a range of it to the indirect commands of
+its texture, merged with the previous one where they touch. Each run of
+surfaces sharing a lightmap is one indirect draw
+================
+*/
+static int R_DrawTextureChains_MultitextureRange (VkCommandBuffer command_buffer, qmodel_t *model, entity_t *ent, texchain_t chain, int first, int last)
+{
+	int			i, count;
 	msurface_t	*s;
 	texture_t	*t;
-	qboolean	bound;
 	int		lastlightmap;
+	int		passes = 0;
 	gltexture_t	*fullbright = NULL;
+	VkBuffer	indirect_buffer;
+	VkDeviceSize	indirect_offset;
+	VkDrawIndexedIndirectCommand	*commands;
+	uint32_t	num_commands, first_command;
+	uint32_t	run_first, run_count;
 	
 	VkDeviceSize offset = 0;
-	vkCmdBindVertexBuffers(vulkan_globals.command_buffer, 0, 1, &bmodel_vertex_buffer, &offset);
-	vkCmdBindPipeline(vulkan_globals.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline);
+	vkCmdBindVertexBuffers(command_buffer, 0, 1, &bmodel_vertex_buffer, &offset);
+	vkCmdBindIndexBuffer(command_buffer, bmodel_index_buffer, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline);
 	VkPipeline current_pipeline = vulkan_globals.world_pipeline;
 
-	for (i=0 ; i<model->numtextures ; i++)
+	for (i=first ; i<last ; i++)
 	{
 		t = model->textures[i];
 
-		if (!t || !t->texturechains[chain] || t->texturechains[chain]->flags & (SURF_DRAWTILED | SURF_NOTEXTURE))
+		count = R_NumMultitextureSurfaces (t, chain);
+		if (!count)
 			continue;
 
 	// Enable/disable TMU 2 (fullbrights)
@@ -727,56 +732,139 @@ void R_DrawTextureChains_Multitexture (qmodel_t *model, entity_t *ent, texchain_
 		{
 			if (current_pipeline != vulkan_globals.world_fullbright_pipeline)
 			{
-				vkCmdBindPipeline(vulkan_globals.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_fullbright_pipeline);
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_fullbright_pipeline);
 				current_pipeline = vulkan_globals.world_fullbright_pipeline;
 			}
 
-			vkCmdBindDescriptorSets(vulkan_globals.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline_layout, 3, 1, &fullbright->descriptor_set, 0, NULL);
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline_layout, 3, 1, &fullbright->descriptor_set, 0, NULL);
 		}
 		else if (current_pipeline != vulkan_globals.world_pipeline)
 		{
-			vkCmdBindPipeline(vulkan_globals.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline);
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline);
 			current_pipeline = vulkan_globals.world_pipeline;
 		}
 
-		R_ClearBatch ();
-
-		bound = false;
-		lastlightmap = 0; // avoid compiler warning
+		texture_t * texture = R_TextureAnimation(t, ent != NULL ? ent->frame : 0);
+		gltexture_t * gl_texture = texture->gltexture;
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline_layout, 0, 1, gl_texture->sampler_set, 0, NULL);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline_layout, 1, 1, &gl_texture->descriptor_set, 0, NULL);
+
+		// the indirect buffer is write combined memory, so the open run is
+		// kept in run_first / run_count and each command is written into
+		// the mapped buffer once, in order, and never read back. If the
+		// buffer is full this frame, commands is NULL and runs draw directly
+		commands = R_IndirectAllocate (count, &indirect_buffer, &indirect_offset);
+		num_commands = first_command = 0;
+		run_first = run_count = 0;
+		lastlightmap = -1;
 		for (s = t->texturechains[chain]; s; s = s->texturechain)
-			if (!s->culled)
+		{
+			if (s->culled)
+				continue;
+
+			if (s->lightmaptexturenum != lastlightmap || run_first + run_count != s->vbo_firstindex)
 			{
-				if (!bound) //only bind once we are sure we need this texture
-				{
-					texture_t * texture = R_TextureAnimation(t, ent != NULL ? ent->frame : 0);
-					gltexture_t * gl_texture = texture->gltexture;
-					vkCmdBindDescriptorSets(vulkan_globals.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline_layout, 0, 1, gl_texture->sampler_set, 0, NULL);
-					vkCmdBindDescriptorSets(vulkan_globals.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline_layout, 1, 1, &gl_texture->descriptor_set, 0, NULL);
-
-					//if (t->texturechains[chain]->flags & SURF_DRAWFENCE)
-					//	glEnable (GL_ALPHA_TEST); // Flip alpha test back on
-										
-					bound = true;
-					lastlightmap = s->lightmaptexturenum;
-				}
-				
-				if (s->lightmaptexturenum != lastlightmap)
-					R_FlushBatch ();
+				if (run_count)
+					R_EmitRun (command_buffer, commands, &num_commands, run_first, run_count);
+				run_first = s->vbo_firstindex;
+				run_count = 0;
+			}
 
-				gltexture_t * lightmap_texture = lightmap_textures[s->lightmaptexturenum];
-				vkCmdBindDescriptorSets(vulkan_globals.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline_layout, 2, 1, &lightmap_texture->descriptor_set, 0, NULL);
+			if (s->lightmaptexturenum != lastlightmap)
+			{
+				if (num_commands > first_command)
+					R_DrawIndirect (command_buffer, indirect_buffer, indirect_offset + first_command * sizeof(VkDrawIndexedIndirectCommand), num_commands - first_command);
+				first_command = num_commands;
 
+				gltexture_t * lightmap_texture = lightmap_textures[s->lightmaptexturenum];
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.world_pipeline_layout, 2, 1, &lightmap_texture->descriptor_set, 0, NULL);
 				lastlightmap = s->lightmaptexturenum;
-				R_BatchSurface (s);
-
-				rs_brushpasses++;
 			}
 
-		R_FlushBatch ();
+			run_count += s->vbo_numindices;
+			passes++;
+		}
 
-		//if (bound && t->texturechains[chain]->flags & SURF_DRAWFENCE)
-		//	glDisable (GL_ALPHA_TEST); // Flip alpha test back off
+		if (run_count)
+			R_EmitRun (command_buffer, commands, &num_commands, run_first, run_count);
+		if (num_commands > first_command)
+			R_DrawIndirect (command_buffer, indirect_buffer, indirect_offset + first_command * sizeof(VkDrawIndexedIndirectCommand), num_commands - first_command);
 	}
+
+	return passes;
+}
+
+#define MAX_WORLD_SLICES		8
+#define MIN_WORLD_SLICE_SURFS	256	// not worth a command buffer below this
+
+typedef struct
+{
+	int			first, last;	// texture range
+} worldslice_t;
+
+static worldslice_t world_slices[MAX_WORLD_SLICES];
+
+/*
+================
+R_RecordWorldSlice -- runs on the record threads
+================
+*/
+static void R_RecordWorldSlice (VkCommandBuffer command_buffer, void *data, int index)
+{
+	worldslice_t *slice = &world_slices[index];
+
+	R_DrawTextureChains_MultitextureRange (command_buffer, (qmodel_t *)data, NULL, chain_world, slice->first, slice->last);
+}
+
+/*
+================
+R_DrawTextureChains_Multitexture
+
+The world is cut into slices of textures with about the same number of
+surfaces, which are recorded on the record threads while the main thread
+goes on with the entities
+================
+*/
+void R_DrawTextureChains_Multitexture (qmodel_t *model, entity_t *ent, texchain_t chain)
+{
+	int		i, total, count, slice, num_slices;
+
+	if (ent == NULL && model == cl.worldmodel && chain == chain_world && R_GPUCullingActive ()
+		&& R_DrawWorldGPUCulled (vulkan_globals.command_buffer))
+		return;
+
+	num_slices = (ent == NULL && model == cl.worldmodel) ? GL_ParallelRecordThreads () : 0;
+	if (num_slices > MAX_WORLD_SLICES)
+		num_slices = MAX_WORLD_SLICES;
+
+	if (num_slices > 0)
+	{
+		for (i=0, total=0 ; i<model->numtextures ; i++)
+			total += R_NumMultitextureSurfaces (model->textures[i], chain);
+		if (num_slices > total / MIN_WORLD_SLICE_SURFS)
+			num_slices = total / MIN_WORLD_SLICE_SURFS;
+	}
+
+	if (num_slices < 1)
+	{
+		rs_brushpasses += R_DrawTextureChains_MultitextureRange (vulkan_globals.command_buffer, model, ent, chain, 0, model->numtextures);
+		return;
+	}
+
+	world_slices[0].first = 0;
+	for (i=0, count=0, slice=0 ; i<model->numtextures && slice<num_slices-1 ; i++)
+	{
+		count += R_NumMultitextureSurfaces (model->textures[i], chain);
+		if (count >= total * (slice + 1) / num_slices)
+		{
+			world_slices[slice].last = i + 1;
+			world_slices[++slice].first = i + 1;
+		}
+	}
+	world_slices[slice].last = model->numtextures;
+
+	rs_brushpasses += total;
+	GL_RecordParallel (R_RecordWorldSlice, model, slice + 1);
 }
 
 /*
@@ -62,6 +62,13 @@ typedef struct
 	edict_t		*edicts;			// can NOT be array indexed, because
 									// edict_t is variable sized, but can
 									// be used to reference the world ent
+	unsigned int	*activeedicts;	// bit per edict that is not free
+	int			*freeedicts;		// ring of freed edict numbers, oldest first
+	int			freeedicts_head;
+	int			freeedicts_count;
+	int			edict_allocs;		// for ED_Count
+	int			edict_reuses;
+	int			edict_peak;
 	server_state_t	state;			// some actions are only valid during load
 
 	sizebuf_t	datagram;
@@ -188,6 +195,34 @@ extern	client_t	*host_client;
 
 extern	edict_t		*sv_player;
 
+#define	SV_SetEdictActive(n)	(sv.activeedicts[(n) >> 5] |= 1u << ((n) & 31))
+#define	SV_ClearEdictActive(n)	(sv.activeedicts[(n) >> 5] &= ~(1u << ((n) & 31)))
+
+/*
+SV_NextActiveEdict
+
+The first edict at or after num that is not free, or sv.num_edicts. Walking
+the edicts with this visits the live ones in the same order as checking
+every slot, including edicts spawned or removed along the way.
+*/
+static inline int SV_NextActiveEdict (int num)
+{
+	unsigned int	bits;
+	int		word;
+
+	for (word = num >> 5; (word << 5) < sv.num_edicts; word++, num = word << 5)
+	{
+		bits = sv.activeedicts[word] >> (num & 31);
+		if (bits)
+		{
+			for ( ; !(bits & 1); bits >>= 1)
+				num++;
+			return q_min (num, sv.num_edicts);
+		}
+	}
+	return sv.num_edicts;
+}
+
 //===========================================================
 
 void SV_Init (void);
@@ -219,6 +254,8 @@ qboolean SV_CheckBottom (edict_t *ent);
 qboolean SV_movestep (edict_t *ent, vec3_t move, qboolean relink);
 
 void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg);
+void SV_WriteServerinfo (sizebuf_t *msg, edict_t *viewent);
+void SV_DeltaAck (client_t *client, int sequence);
 
 void SV_MoveToGoal (void);
 
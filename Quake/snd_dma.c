@@ -339,6 +339,31 @@ sfx_t *S_PrecacheSound (const char *name)
 }
 
 
+/*
+==================
+S_QueuePrecache
+
+Starts decoding a sound in the background if S_PrecacheSound is going to
+load it
+==================
+*/
+void S_QueuePrecache (const char *name)
+{
+	sfx_t	*sfx;
+	char	namebuffer[256];
+
+	if (!sound_started || nosound.value || !precache.value)
+		return;
+
+	sfx = S_FindName (name);
+	if (Cache_Check (&sfx->cache))
+		return;
+
+	q_snprintf (namebuffer, sizeof(namebuffer), "sound/%s", name);
+	Loader_QueueSound (namebuffer);
+}
+
+
 //=============================================================================
 
 /*
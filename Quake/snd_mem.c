@@ -22,23 +22,20 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+static wavinfo_t WAV_ParseInfo (const char *name, byte *wav, int wavlength);
+
 /*
 ================
 ResampleSfx
 ================
 */
-static void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
+static void ResampleSfx (sfxcache_t *sc, int inrate, int inwidth, byte *data)
 {
 	int		outcount;
 	int		srcsample;
 	float	stepscale;
 	int		i;
 	int		sample, samplefrac, fracstep;
-	sfxcache_t	*sc;
-
-	sc = (sfxcache_t *) Cache_Check (&sfx->cache);
-	if (!sc)
-		return;
 
 	stepscale = (float)inrate / shm->speed;	// this is usually 0.5, 1, or 2
 
@@ -83,8 +80,77 @@ static void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 	}
 }
 
+/*
+================
+S_SfxCacheLength
+
+bytes of sample data to allocate for a sound resampled to the output rate
+================
+*/
+static int S_SfxCacheLength (const wavinfo_t *info)
+{
+	float	stepscale;
+	int		len;
+
+	stepscale = (float)info->rate / shm->speed;
+	len = info->samples / stepscale;
+
+	return len * info->width * info->channels;
+}
+
+/*
+================
+S_FillSfxCache
+================
+*/
+static void S_FillSfxCache (sfxcache_t *sc, const wavinfo_t *info, byte *data)
+{
+	sc->length = info->samples;
+	sc->loopstart = info->loopstart;
+	sc->speed = info->rate;
+	sc->width = info->width;
+	sc->stereo = info->channels;
+
+	ResampleSfx (sc, sc->speed, sc->width, data + info->dataofs);
+}
+
 //=============================================================================
 
+/*
+==============
+S_DecodeSound
+
+Parses and resamples a wav file into a malloc'd sfxcache_t for the
+loader threads. Returns NULL for anything S_LoadSound would complain
+about, so that it can do that on the main thread.
+==============
+*/
+sfxcache_t *S_DecodeSound (byte *data, int length, int *size)
+{
+	wavinfo_t	info;
+	sfxcache_t	*sc;
+	int		len;
+
+	if (!shm)
+		return NULL;
+
+	info = WAV_ParseInfo (NULL, data, length);
+	if (info.channels != 1 || (info.width != 1 && info.width != 2))
+		return NULL;
+
+	len = S_SfxCacheLength (&info);
+	if (info.samples == 0 || len == 0)
+		return NULL;
+
+	*size = len + sizeof(sfxcache_t);
+	sc = (sfxcache_t *) malloc (*size);
+	if (!sc)
+		return NULL;
+
+	S_FillSfxCache (sc, &info, data);
+	return sc;
+}
+
 /*
 ==============
 S_LoadSound
@@ -96,8 +162,7 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	byte	*data;
 	wavinfo_t	info;
 	int		len;
-	float	stepscale;
-	sfxcache_t	*sc;
+	sfxcache_t	*sc, *decoded;
 	byte	stackbuf[1*1024];		// avoid dirtying the cache heap
 
 // see if still in memory
@@ -113,7 +178,18 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 
 //	Con_Printf ("loading %s\n",namebuffer);
 
-	data = COM_LoadStackFile(namebuffer, stackbuf, sizeof(stackbuf), NULL);
+// see if a loader thread decoded it already
+	decoded = (sfxcache_t *) Loader_TakeSound (namebuffer, &len);
+	if (decoded)
+	{
+		sc = (sfxcache_t *) Cache_Alloc (&s->cache, len, s->name);
+		if (sc)
+			memcpy (sc, decoded, len);
+		free (decoded);
+		return sc;
+	}
+
+	data = (byte *) COM_LoadMappedFile(namebuffer, stackbuf, sizeof(stackbuf), NULL);
 
 	if (!data)
 	{
@@ -134,10 +210,7 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 		return NULL;
 	}
 
-	stepscale = (float)info.rate / shm->speed;
-	len = info.samples / stepscale;
-
-	len = len * info.width * info.channels;
+	len = S_SfxCacheLength (&info);
 
 	if (info.samples == 0 || len == 0)
 	{
@@ -149,13 +222,7 @@ sfxcache_t *S_LoadSound (sfx_t *s)
 	if (!sc)
 		return NULL;
 
-	sc->length = info.samples;
-	sc->loopstart = info.loopstart;
-	sc->speed = info.rate;
-	sc->width = info.width;
-	sc->stereo = info.channels;
-
-	ResampleSfx (s, sc->speed, sc->width, data + info.dataofs);
+	S_FillSfxCache (sc, &info, data);
 
 	return sc;
 }
@@ -170,89 +237,98 @@ WAV loading
 ===============================================================================
 */
 
-static byte	*data_p;
-static byte	*iff_end;
-static byte	*last_chunk;
-static byte	*iff_data;
-static int	iff_chunk_len;
-
-static short GetLittleShort (void)
+/* parser state, kept on the stack so that loader threads can parse too */
+typedef struct
+{
+	byte	*data_p;
+	byte	*iff_end;
+	byte	*last_chunk;
+	byte	*iff_data;
+	int	iff_chunk_len;
+	qboolean	verbose;
+} wavparse_t;
+
+static short GetLittleShort (wavparse_t *wp)
 {
 	short val = 0;
-	val = *data_p;
-	val = val + (*(data_p+1)<<8);
-	data_p += 2;
+	val = *wp->data_p;
+	val = val + (*(wp->data_p+1)<<8);
+	wp->data_p += 2;
 	return val;
 }
 
-static int GetLittleLong (void)
+static int GetLittleLong (wavparse_t *wp)
 {
 	int val = 0;
-	val = *data_p;
-	val = val + (*(data_p+1)<<8);
-	val = val + (*(data_p+2)<<16);
-	val = val + (*(data_p+3)<<24);
-	data_p += 4;
+	val = *wp->data_p;
+	val = val + (*(wp->data_p+1)<<8);
+	val = val + (*(wp->data_p+2)<<16);
+	val = val + (*(wp->data_p+3)<<24);
+	wp->data_p += 4;
 	return val;
 }
 
-static void FindNextChunk (const char *name)
+static void FindNextChunk (wavparse_t *wp, const char *name)
 {
 	while (1)
 	{
 	// Need at least 8 bytes for a chunk
-		if (last_chunk + 8 >= iff_end)
+		if (wp->last_chunk + 8 >= wp->iff_end)
 		{
-			data_p = NULL;
+			wp->data_p = NULL;
 			return;
 		}
 
-		data_p = last_chunk + 4;
-		iff_chunk_len = GetLittleLong();
-		if (iff_chunk_len < 0 || iff_chunk_len > iff_end - data_p)
+		wp->data_p = wp->last_chunk + 4;
+		wp->iff_chunk_len = GetLittleLong(wp);
+		if (wp->iff_chunk_len < 0 || wp->iff_chunk_len > wp->iff_end - wp->data_p)
 		{
-			data_p = NULL;
-			Con_DPrintf2("bad \"%s\" chunk length (%d)\n", name, iff_chunk_len);
+			wp->data_p = NULL;
+			if (wp->verbose)
+				Con_DPrintf2("bad \"%s\" chunk length (%d)\n", name, wp->iff_chunk_len);
 			return;
 		}
-		last_chunk = data_p + ((iff_chunk_len + 1) & ~1);
-		data_p -= 8;
-		if (!Q_strncmp((char *)data_p, name, 4))
+		wp->last_chunk = wp->data_p + ((wp->iff_chunk_len + 1) & ~1);
+		wp->data_p -= 8;
+		if (!Q_strncmp((char *)wp->data_p, name, 4))
 			return;
 	}
 }
 
-static void FindChunk (const char *name)
+static void FindChunk (wavparse_t *wp, const char *name)
 {
-	last_chunk = iff_data;
-	FindNextChunk (name);
+	wp->last_chunk = wp->iff_data;
+	FindNextChunk (wp, name);
 }
 
 #if 0
-static void DumpChunks (void)
+static void DumpChunks (wavparse_t *wp)
 {
 	char	str[5];
 
 	str[4] = 0;
-	data_p = iff_data;
+	wp->data_p = wp->iff_data;
 	do
 	{
-		memcpy (str, data_p, 4);
-		data_p += 4;
-		iff_chunk_len = GetLittleLong();
-		Con_Printf ("0x%x : %s (%d)\n", (int)(data_p - 4), str, iff_chunk_len);
-		data_p += (iff_chunk_len + 1) & ~1;
-	} while (data_p < iff_end);
+		memcpy (str, wp->data_p, 4);
+		wp->data_p += 4;
+		wp->iff_chunk_len = GetLittleLong(wp);
+		Con_Printf ("0x%x : %s (%d)\n", (int)(wp->data_p - 4), str, wp->iff_chunk_len);
+		wp->data_p += (wp->iff_chunk_len + 1) & ~1;
+	} while (wp->data_p < wp->iff_end);
 }
 #endif
 
 /*
 ============
-GetWavinfo
+WAV_ParseInfo
+
+name is only used for messages, a NULL name parses quietly
 ============
 */
-wavinfo_t GetWavinfo (const char *name, byte *wav, int wavlength)
+static wavinfo_t WAV_ParseInfo (const char *name, byte *wav, int wavlength)
 {
+	wavparse_t	wp;
 	wavinfo_t	info;
 	int	i;
 	int	format;
@@ -263,61 +339,65 @@ wavinfo_t GetWavinfo (const char *name, byte *wav, int wavlength)
 	if (!wav)
 		return info;
 
-	iff_data = wav;
-	iff_end = wav + wavlength;
+	wp.iff_data = wav;
+	wp.iff_end = wav + wavlength;
+	wp.verbose = (name != NULL);
 
 // find "RIFF" chunk
-	FindChunk("RIFF");
-	if (!(data_p && !Q_strncmp((char *)data_p + 8, "WAVE", 4)))
+	FindChunk(&wp, "RIFF");
+	if (!(wp.data_p && !Q_strncmp((char *)wp.data_p + 8, "WAVE", 4)))
 	{
-		Con_Printf("%s missing RIFF/WAVE chunks\n", name);
+		if (name)
+			Con_Printf("%s missing RIFF/WAVE chunks\n", name);
 		return info;
 	}
 
 // get "fmt " chunk
-	iff_data = data_p + 12;
+	wp.iff_data = wp.data_p + 12;
 #if 0
-	DumpChunks ();
+	DumpChunks (&wp);
 #endif
 
-	FindChunk("fmt ");
-	if (!data_p)
+	FindChunk(&wp, "fmt ");
+	if (!wp.data_p)
 	{
-		Con_Printf("%s is missing fmt chunk\n", name);
+		if (name)
+			Con_Printf("%s is missing fmt chunk\n", name);
 		return info;
 	}
-	data_p += 8;
-	format = GetLittleShort();
+	wp.data_p += 8;
+	format = GetLittleShort(&wp);
 	if (format != WAV_FORMAT_PCM)
 	{
-		Con_Printf("%s is not Microsoft PCM format\n", name);
+		if (name)
+			Con_Printf("%s is not Microsoft PCM format\n", name);
 		return info;
 	}
 
-	info.channels = GetLittleShort();
-	info.rate = GetLittleLong();
-	data_p += 4 + 2;
-	i = GetLittleShort();
+	info.channels = GetLittleShort(&wp);
+	info.rate = GetLittleLong(&wp);
+	wp.data_p += 4 + 2;
+	i = GetLittleShort(&wp);
 	if (i != 8 && i != 16)
 		return info;
 	info.width = i / 8;
 
 // get cue chunk
-	FindChunk("cue ");
-	if (data_p)
+	FindChunk(&wp, "cue ");
+	if (wp.data_p)
 	{
-		data_p += 32;
-		info.loopstart = GetLittleLong();
+		wp.data_p += 32;
+		info.loopstart = GetLittleLong(&wp);
 	//	Con_Printf("loopstart=%d\n", sfx->loopstart);
 
 	// if the next chunk is a LIST chunk, look for a cue length marker
-		FindNextChunk ("LIST");
-		if (data_p)
+		FindNextChunk (&wp, "LIST");
+		if (wp.data_p)
 		{
-			if (!strncmp((char *)data_p + 28, "mark", 4))
+			if (!strncmp((char *)wp.data_p + 28, "mark", 4))
 			{	// this is not a proper parse, but it works with cooledit...
-				data_p += 24;
-				i = GetLittleLong();	// samples in loop
+				wp.data_p += 24;
+				i = GetLittleLong(&wp);	// samples in loop
 				info.samples = info.loopstart + i;
 		//		Con_Printf("looped length: %i\n", i);
 			}
@@ -327,26 +407,44 @@ wavinfo_t GetWavinfo (const char *name, byte *wav, int wavlength)
 		info.loopstart = -1;
 
 // find data chunk
-	FindChunk("data");
-	if (!data_p)
+	FindChunk(&wp, "data");
+	if (!wp.data_p)
 	{
-		Con_Printf("%s is missing data chunk\n", name);
+		if (name)
+			Con_Printf("%s is missing data chunk\n", name);
 		return info;
 	}
 
-	data_p += 4;
-	samples = GetLittleLong() / info.width;
+	wp.data_p += 4;
+	samples = GetLittleLong(&wp) / info.width;
 
 	if (info.samples)
 	{
 		if (samples < info.samples)
+		{
+			if (!name)
+			{	// leave the error to the main thread
+				info.channels = 0;
+				return info;
+			}
 			Sys_Error ("%s has a bad loop length", name);
+		}
 	}
 	else
 		info.samples = samples;
 
-	info.dataofs = data_p - wav;
+	info.dataofs = wp.data_p - wav;
 
 	return info;
 }
 
+/*
+============
+GetWavinfo
+============
+*/
+wavinfo_t GetWavinfo (const char *name, byte *wav, int wavlength)
+{
+	return WAV_ParseInfo (name, wav, wavlength);
+}
+
@@ -32,6 +32,9 @@ int		sv_protocol = PROTOCOL_FITZQUAKE; //johnfitz
 
 extern qboolean	pr_alpha_supported; //johnfitz
 
+static void SV_SnapshotBench_f (void);
+static void SV_ClearDeltas (int clientnum);
+
 //============================================================================
 
 /*
@@ -50,8 +53,8 @@ void SV_Protocol_f (void)
 		break;
 	case 2:
 		i = atoi(Cmd_Argv(1));
-		if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE)
-			Con_Printf ("sv_protocol must be %i or %i\n", PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE);
+		if (i != PROTOCOL_NETQUAKE && i != PROTOCOL_FITZQUAKE && i != PROTOCOL_DELTA)
+			Con_Printf ("sv_protocol must be %i, %i or %i\n", PROTOCOL_NETQUAKE, PROTOCOL_FITZQUAKE, PROTOCOL_DELTA);
 		else
 		{
 			sv_protocol = i;
@@ -85,6 +88,7 @@ void SV_Init (void)
 	extern	cvar_t	sv_idealpitchscale;
 	extern	cvar_t	sv_aim;
 	extern	cvar_t	sv_altnoclip; //johnfitz
+	extern	cvar_t	sv_parallelsnapshots;
 
 	Cvar_RegisterVariable (&sv_maxvelocity);
 	Cvar_RegisterVariable (&sv_gravity);
@@ -101,8 +105,16 @@ void SV_Init (void)
 	Cvar_RegisterVariable (&sv_nostep);
 	Cvar_RegisterVariable (&sv_freezenonclients);
 	Cvar_RegisterVariable (&sv_altnoclip); //johnfitz
+	Cvar_RegisterVariable (&sv_areagrid);
+	Cvar_SetCallback (&sv_areagrid, SV_AreaGrid_f);
+	Cvar_RegisterVariable (&sv_tracecache);
+	Cvar_RegisterVariable (&sv_parallelsnapshots);
 
 	Cmd_AddCommand ("sv_protocol", &SV_Protocol_f); //johnfitz
+	Cmd_AddCommand ("sv_areabench", SV_AreaBench_f);
+	Cmd_AddCommand ("sv_tracebench", SV_TraceBench_f);
+	Cmd_AddCommand ("sv_snapshotbench", SV_SnapshotBench_f);
+	Cmd_AddCommand ("sv_tracecachestats", SV_TraceCacheStats_f);
 
 	for (i=0 ; i<MAX_MODELS ; i++)
 		sprintf (localmodels[i], "*%i", i);
@@ -252,56 +264,68 @@ CLIENT SPAWNING
 
 /*
 ================
-SV_SendServerinfo
+SV_WriteServerinfo
 
-Sends the first message from the server to a connected client.
-This will be sent on the initial connection and upon each server load.
+Writes the serverinfo message for a client viewing from viewent
 ================
 */
-void SV_SendServerinfo (client_t *client)
+void SV_WriteServerinfo (sizebuf_t *msg, edict_t *viewent)
 {
 	const char		**s;
 	char			message[2048];
 	int				i; //johnfitz
 
-	MSG_WriteByte (&client->message, svc_print);
+	MSG_WriteByte (msg, svc_print);
 	sprintf (message, "%c\nFITZQUAKE %1.2f SERVER (%i CRC)\n", 2, FITZQUAKE_VERSION, pr_crc); //johnfitz -- include fitzquake version
-	MSG_WriteString (&client->message,message);
+	MSG_WriteString (msg,message);
 
-	MSG_WriteByte (&client->message, svc_serverinfo);
-	MSG_WriteLong (&client->message, sv.protocol); //johnfitz -- sv.protocol instead of PROTOCOL_VERSION
-	MSG_WriteByte (&client->message, svs.maxclients);
+	MSG_WriteByte (msg, svc_serverinfo);
+	MSG_WriteLong (msg, sv.protocol); //johnfitz -- sv.protocol instead of PROTOCOL_VERSION
+	MSG_WriteByte (msg, svs.maxclients);
 
 	if (!coop.value && deathmatch.value)
-		MSG_WriteByte (&client->message, GAME_DEATHMATCH);
+		MSG_WriteByte (msg, GAME_DEATHMATCH);
 	else
-		MSG_WriteByte (&client->message, GAME_COOP);
+		MSG_WriteByte (msg, GAME_COOP);
 
-	MSG_WriteString (&client->message, PR_GetString(sv.edicts->v.message));
+	MSG_WriteString (msg, PR_GetString(sv.edicts->v.message));
 
 	//johnfitz -- only send the first 256 model and sound precaches if protocol is 15
 	for (i=0,s = sv.model_precache+1 ; *s; s++,i++)
 		if (sv.protocol != PROTOCOL_NETQUAKE || i < 256)
-			MSG_WriteString (&client->message, *s);
-	MSG_WriteByte (&client->message, 0);
+			MSG_WriteString (msg, *s);
+	MSG_WriteByte (msg, 0);
 
 	for (i=0,s = sv.sound_precache+1 ; *s ; s++,i++)
 		if (sv.protocol != PROTOCOL_NETQUAKE || i < 256)
-			MSG_WriteString (&client->message, *s);
-	MSG_WriteByte (&client->message, 0);
+			MSG_WriteString (msg, *s);
+	MSG_WriteByte (msg, 0);
 	//johnfitz
 
 // send music
-	MSG_WriteByte (&client->message, svc_cdtrack);
-	MSG_WriteByte (&client->message, sv.edicts->v.sounds);
-	MSG_WriteByte (&client->message, sv.edicts->v.sounds);
+	MSG_WriteByte (msg, svc_cdtrack);
+	MSG_WriteByte (msg, sv.edicts->v.sounds);
+	MSG_WriteByte (msg, sv.edicts->v.sounds);
 
 // set view
-	MSG_WriteByte (&client->message, svc_setview);
-	MSG_WriteShort (&client->message, NUM_FOR_EDICT(client->edict));
+	MSG_WriteByte (msg, svc_setview);
+	MSG_WriteShort (msg, NUM_FOR_EDICT(viewent));
+
+	MSG_WriteByte (msg, svc_signonnum);
+	MSG_WriteByte (msg, 1);
+}
 
-	MSG_WriteByte (&client->message, svc_signonnum);
-	MSG_WriteByte (&client->message, 1);
+/*
+================
+SV_SendServerinfo
+
+Sends the first message from the server to a connected client.
+This will be sent on the initial connection and upon each server load.
+================
+*/
+void SV_SendServerinfo (client_t *client)
+{
+	SV_WriteServerinfo (&client->message, client->edict);
 
 	client->sendsignon = true;
 	client->spawned = false;		// need prespawn, spawn, etc
@@ -347,6 +371,7 @@ void SV_ConnectClient (int clientnum)
 	client->message.data = client->msgbuf;
 	client->message.maxsize = sizeof(client->msgbuf);
 	client->message.allowoverflow = true;		// we can catch it
+	SV_ClearDeltas (clientnum);
 
 	if (sv.loadgame)
 		memcpy (client->spawn_parms, spawn_parms, sizeof(spawn_parms));
@@ -431,8 +456,17 @@ crosses a waterline.
 
 int		fatbytes;
 byte	fatpvs[MAX_MAP_LEAFS/8];
+static byte	fatscratch[MAX_MAP_LEAFS/8];
 
-void SV_AddToFatPVS (vec3_t org, mnode_t *node, qmodel_t *worldmodel) //johnfitz -- added worldmodel as a parameter
+/*
+=============
+SV_AddToFatPVSTo
+
+Ors the PVS of the leafs near org into fat, decompressing them in scratch,
+so that threads with buffers of their own can call it
+=============
+*/
+static void SV_AddToFatPVSTo (vec3_t org, mnode_t *node, qmodel_t *worldmodel, byte *fat, int fatsize, byte *scratch)
 {
 	int		i;
 	byte	*pvs;
@@ -446,9 +480,9 @@ void SV_AddToFatPVS (vec3_t org, mnode_t *node, qmodel_t *worldmodel) //johnfitz
 		{
 			if (node->contents != CONTENTS_SOLID)
 			{
-				pvs = Mod_LeafPVS ( (mleaf_t *)node, worldmodel); //johnfitz -- worldmodel as a parameter
-				for (i=0 ; i<fatbytes ; i++)
-					fatpvs[i] |= pvs[i];
+				pvs = Mod_LeafPVSTo ( (mleaf_t *)node, worldmodel, scratch); //johnfitz -- worldmodel as a parameter
+				for (i=0 ; i<fatsize ; i++)
+					fat[i] |= pvs[i];
 			}
 			return;
 		}
@@ -461,12 +495,17 @@ void SV_AddToFatPVS (vec3_t org, mnode_t *node, qmodel_t *worldmodel) //johnfitz
 			node = node->children[1];
 		else
 		{	// go down both
-			SV_AddToFatPVS (org, node->children[0], worldmodel); //johnfitz -- worldmodel as a parameter
+			SV_AddToFatPVSTo (org, node->children[0], worldmodel, fat, fatsize, scratch); //johnfitz -- worldmodel as a parameter
 			node = node->children[1];
 		}
 	}
 }
 
+void SV_AddToFatPVS (vec3_t org, mnode_t *node, qmodel_t *worldmodel) //johnfitz -- added worldmodel as a parameter
+{
+	SV_AddToFatPVSTo (org, node, worldmodel, fatpvs, fatbytes, fatscratch);
+}
+
 /*
 =============
 SV_FatPVS
@@ -508,6 +547,228 @@ qboolean SV_VisibleToClient (edict_t *client, edict_t *test, qmodel_t *worldmode
 
 //=============================================================================
 
+/*
+=============
+SV_EntityAlpha -- johnfitz
+
+The alpha an entity is sent with
+=============
+*/
+static int SV_EntityAlpha (edict_t *ent)
+{
+	eval_t	*val;
+
+	if (pr_alpha_supported)
+	{
+		// TODO: find a cleaner place to put this code
+		val = GetEdictFieldValueOfs(ent, pr_extfields.alpha);
+		if (val)
+			return ENTALPHA_ENCODE(val->_float);
+	}
+	return ent->alpha;
+}
+
+/*
+=============
+SV_WriteEntityUpdate
+
+Writes the update for entity number e with the given alpha, at most 24 bytes
+=============
+*/
+static void SV_WriteEntityUpdate (sizebuf_t *msg, edict_t *ent, int e, int alpha)
+{
+	int		i;
+	int		bits;
+	float	miss;
+
+	bits = 0;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		miss = ent->v.origin[i] - ent->baseline.origin[i];
+		if ( miss < -0.1 || miss > 0.1 )
+			bits |= U_ORIGIN1<<i;
+	}
+
+	if ( ent->v.angles[0] != ent->baseline.angles[0] )
+		bits |= U_ANGLE1;
+
+	if ( ent->v.angles[1] != ent->baseline.angles[1] )
+		bits |= U_ANGLE2;
+
+	if ( ent->v.angles[2] != ent->baseline.angles[2] )
+		bits |= U_ANGLE3;
+
+	if (ent->v.movetype == MOVETYPE_STEP)
+		bits |= U_STEP;	// don't mess up the step animation
+
+	if (ent->baseline.colormap != ent->v.colormap)
+		bits |= U_COLORMAP;
+
+	if (ent->baseline.skin != ent->v.skin)
+		bits |= U_SKIN;
+
+	if (ent->baseline.frame != ent->v.frame)
+		bits |= U_FRAME;
+
+	if (ent->baseline.effects != ent->v.effects)
+		bits |= U_EFFECTS;
+
+	if (ent->baseline.modelindex != ent->v.modelindex)
+		bits |= U_MODEL;
+
+	//johnfitz -- PROTOCOL_FITZQUAKE
+	if (sv.protocol != PROTOCOL_NETQUAKE)
+	{
+
+		if (ent->baseline.alpha != alpha) bits |= U_ALPHA;
+		if (bits & U_FRAME && (int)ent->v.frame & 0xFF00) bits |= U_FRAME2;
+		if (bits & U_MODEL && (int)ent->v.modelindex & 0xFF00) bits |= U_MODEL2;
+		if (ent->sendinterval) bits |= U_LERPFINISH;
+		if (bits >= 65536) bits |= U_EXTEND1;
+		if (bits >= 16777216) bits |= U_EXTEND2;
+	}
+	//johnfitz
+
+	if (e >= 256)
+		bits |= U_LONGENTITY;
+
+	if (bits >= 256)
+		bits |= U_MOREBITS;
+
+//
+// write the message
+//
+	MSG_WriteByte (msg, bits | U_SIGNAL);
+
+	if (bits & U_MOREBITS)
+		MSG_WriteByte (msg, bits>>8);
+
+	//johnfitz -- PROTOCOL_FITZQUAKE
+	if (bits & U_EXTEND1)
+		MSG_WriteByte(msg, bits>>16);
+	if (bits & U_EXTEND2)
+		MSG_WriteByte(msg, bits>>24);
+	//johnfitz
+
+	if (bits & U_LONGENTITY)
+		MSG_WriteShort (msg,e);
+	else
+		MSG_WriteByte (msg,e);
+
+	if (bits & U_MODEL)
+		MSG_WriteByte (msg,	ent->v.modelindex);
+	if (bits & U_FRAME)
+		MSG_WriteByte (msg, ent->v.frame);
+	if (bits & U_COLORMAP)
+		MSG_WriteByte (msg, ent->v.colormap);
+	if (bits & U_SKIN)
+		MSG_WriteByte (msg, ent->v.skin);
+	if (bits & U_EFFECTS)
+		MSG_WriteByte (msg, ent->v.effects);
+	if (bits & U_ORIGIN1)
+		MSG_WriteCoord (msg, ent->v.origin[0]);
+	if (bits & U_ANGLE1)
+		MSG_WriteAngle(msg, ent->v.angles[0]);
+	if (bits & U_ORIGIN2)
+		MSG_WriteCoord (msg, ent->v.origin[1]);
+	if (bits & U_ANGLE2)
+		MSG_WriteAngle(msg, ent->v.angles[1]);
+	if (bits & U_ORIGIN3)
+		MSG_WriteCoord (msg, ent->v.origin[2]);
+	if (bits & U_ANGLE3)
+		MSG_WriteAngle(msg, ent->v.angles[2]);
+
+	//johnfitz -- PROTOCOL_FITZQUAKE
+	if (bits & U_ALPHA)
+		MSG_WriteByte(msg, alpha);
+	if (bits & U_FRAME2)
+		MSG_WriteByte(msg, (int)ent->v.frame >> 8);
+	if (bits & U_MODEL2)
+		MSG_WriteByte(msg, (int)ent->v.modelindex >> 8);
+	if (bits & U_LERPFINISH)
+		MSG_WriteByte(msg, (byte)(Q_rint((ent->v.nextthink-sv.time)*255)));
+	//johnfitz
+}
+
+/*
+=============
+SV_EntityHasModel
+
+Entities without a model that can be sent are skipped, unless they are the
+client's own
+=============
+*/
+static qboolean SV_EntityHasModel (edict_t *ent)
+{
+	// ignore ents without visible models
+	if (!ent->v.modelindex || !PR_GetString(ent->v.model)[0])
+		return false;
+
+	//johnfitz -- don't send model>255 entities if protocol is 15
+	if (sv.protocol == PROTOCOL_NETQUAKE && (int)ent->v.modelindex & 0xFF00)
+		return false;
+
+	return true;
+}
+
+/*
+=============
+SV_EntityInPVS
+=============
+*/
+static qboolean SV_EntityInPVS (edict_t *ent, const byte *pvs)
+{
+	int		i;
+
+	// ignore if not touching a PV leaf
+	for (i=0 ; i < ent->num_leafs ; i++)
+		if (pvs[ent->leafnums[i] >> 3] & (1 << (ent->leafnums[i]&7) ))
+			break;
+
+	// ericw -- added ent->num_leafs < MAX_ENT_LEAFS condition.
+	//
+	// if ent->num_leafs == MAX_ENT_LEAFS, the ent is visible from too many leafs
+	// for us to say whether it's in the PVS, so don't try to vis cull it.
+	// this commonly happens with rotators, because they often have huge bboxes
+	// spanning the entire map, or really tall lifts, etc.
+	if (i == ent->num_leafs && ent->num_leafs < MAX_ENT_LEAFS)
+		return false;		// not visible
+
+	return true;
+}
+
+/*
+=============
+SV_PacketOverflow
+=============
+*/
+static void SV_PacketOverflow (void)
+{
+	//johnfitz -- less spammy overflow message
+	if (!dev_overflows.packetsize || dev_overflows.packetsize + CONSOLE_RESPAM_TIME < realtime )
+	{
+		Con_Printf ("Packet overflow!\n");
+		dev_overflows.packetsize = realtime;
+	}
+	//johnfitz
+}
+
+/*
+=============
+SV_PacketStats
+=============
+*/
+static void SV_PacketStats (sizebuf_t *msg)
+{
+	//johnfitz -- devstats
+	if (msg->cursize > 1024 && dev_peakstats.packetsize <= 1024)
+		Con_DWarning ("%i byte packet exceeds standard limit of 1024.\n", msg->cursize);
+	dev_stats.packetsize = msg->cursize;
+	dev_peakstats.packetsize = q_max(msg->cursize, dev_peakstats.packetsize);
+	//johnfitz
+}
+
 /*
 =============
 SV_WriteEntitiesToClient
@@ -516,11 +777,9 @@ SV_WriteEntitiesToClient
 */
 void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 {
-	int		e, i;
-	int		bits;
+	int		e;
 	byte	*pvs;
 	vec3_t	org;
-	float	miss;
 	edict_t	*ent;
 
 // find the client's PVS
@@ -528,182 +787,657 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 	pvs = SV_FatPVS (org, sv.worldmodel);
 	
 // send over all entities (excpet the client) that touch the pvs
-	ent = NEXT_EDICT(sv.edicts);
-	for (e=1 ; e<sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
+	for (e = SV_NextActiveEdict (1); e < sv.num_edicts; e = SV_NextActiveEdict (e + 1))
 	{
+		ent = EDICT_NUM(e);
 
 		if (ent != clent)	// clent is ALLWAYS sent
 		{
-			// ignore ents without visible models
-			if (!ent->v.modelindex || !PR_GetString(ent->v.model)[0])
+			if (!SV_EntityHasModel (ent) || !SV_EntityInPVS (ent, pvs))
 				continue;
-
-			//johnfitz -- don't send model>255 entities if protocol is 15
-			if (sv.protocol == PROTOCOL_NETQUAKE && (int)ent->v.modelindex & 0xFF00)
-				continue;
-
-			// ignore if not touching a PV leaf
-			for (i=0 ; i < ent->num_leafs ; i++)
-				if (pvs[ent->leafnums[i] >> 3] & (1 << (ent->leafnums[i]&7) ))
-					break;
-			
-			// ericw -- added ent->num_leafs < MAX_ENT_LEAFS condition.
-			//
-			// if ent->num_leafs == MAX_ENT_LEAFS, the ent is visible from too many leafs
-			// for us to say whether it's in the PVS, so don't try to vis cull it.
-			// this commonly happens with rotators, because they often have huge bboxes
-			// spanning the entire map, or really tall lifts, etc.
-			if (i == ent->num_leafs && ent->num_leafs < MAX_ENT_LEAFS)
-				continue;		// not visible
 		}
 
 		//johnfitz -- max size for protocol 15 is 18 bytes, not 16 as originally
 		//assumed here.  And, for protocol 85 the max size is actually 24 bytes.
 		if (msg->cursize + 24 > msg->maxsize)
 		{
-			//johnfitz -- less spammy overflow message
-			if (!dev_overflows.packetsize || dev_overflows.packetsize + CONSOLE_RESPAM_TIME < realtime )
+			SV_PacketOverflow ();
+			break;
+		}
+
+		//johnfitz -- alpha
+		ent->alpha = SV_EntityAlpha (ent);
+
+		//don't send invisible entities unless they have effects
+		if (ent->alpha == ENTALPHA_ZERO && !ent->v.effects)
+			continue;
+		//johnfitz
+
+		SV_WriteEntityUpdate (msg, ent, e, ent->alpha);
+	}
+
+	SV_PacketStats (msg);
+}
+
+/*
+=============================================================================
+
+PARALLEL SNAPSHOTS
+
+With sv_parallelsnapshots set and more than one client in the game, every
+entity update is encoded once a frame, and the PVS checks for all the
+clients run on the job workers, each leaving a list of the entities its
+client can see. The datagrams are then put together in client order on the
+main thread, copying the encoded updates, so packet overflows and the alpha
+updates happen where they would in SV_WriteEntitiesToClient, and the bytes
+sent are the same.
+
+=============================================================================
+*/
+
+typedef struct
+{
+	byte	data[24];	// the update SV_WriteEntityUpdate writes
+	byte	size;
+	byte	alpha;		// what ent->alpha becomes when it is sent
+	byte	flags;
+} entsnap_t;
+
+#define	ENTSNAP_ACTIVE		1
+#define	ENTSNAP_MODEL		2	// passes SV_EntityHasModel
+#define	ENTSNAP_INVISIBLE	4	// alpha zero and no effects
+#define	ENTSNAP_BADMODEL	8	// model string PR_GetString would stop on
+
+typedef struct
+{
+	edict_t	*clent;
+	int		*ents;		// what the client may be sent, in edict order
+	int		numents;
+	byte	fatpvs[MAX_MAP_LEAFS/8];
+	byte	scratch[MAX_MAP_LEAFS/8];
+} clientsnap_t;
+
+cvar_t	sv_parallelsnapshots = {"sv_parallelsnapshots", "1", CVAR_NONE};
+
+static	entsnap_t		*sv_entsnaps;			// sv.max_edicts, on the hunk
+static	int				*sv_snapents;			// svs.maxclients * sv.max_edicts
+static	clientsnap_t	sv_clientsnaps[MAX_SCOREBOARD];
+
+/*
+=============
+SV_AllocSnapshots -- called by SV_SpawnServer
+=============
+*/
+static void SV_AllocSnapshots (void)
+{
+	sv_entsnaps = (entsnap_t *) Hunk_AllocName (sv.max_edicts * sizeof(entsnap_t), "entsnaps");
+	sv_snapents = (int *) Hunk_AllocName (svs.maxclients * sv.max_edicts * sizeof(int), "entsnaps");
+}
+
+/*
+=============
+SV_EncodeEntities
+
+Job range over the edicts; ent->alpha isn't touched here. With a NULL data
+only the flags are set, which is all PROTOCOL_DELTA uses. Nothing here may
+Host_Error, so a bad model string is only flagged.
+=============
+*/
+static void SV_EncodeEntities (void *data, int first, int last)
+{
+	entsnap_t	*snap;
+	sizebuf_t	msg;
+	edict_t		*ent;
+	const char	*model;
+	int			e;
+
+	for (e = q_max (first, 1); e < last; e++)
+	{
+		snap = &sv_entsnaps[e];
+		ent = EDICT_NUM(e);
+		if (ent->free)
+		{
+			snap->flags = 0;
+			continue;
+		}
+
+		snap->flags = ENTSNAP_ACTIVE;
+		if (ent->v.modelindex)
+		{	// SV_EntityHasModel
+			model = PR_FindString (ent->v.model);
+			if (!model)
 			{
-				Con_Printf ("Packet overflow!\n");
-				dev_overflows.packetsize = realtime;
+				snap->flags |= ENTSNAP_BADMODEL;
+				continue;
 			}
-			goto stats;
-			//johnfitz
+			if (model[0] && !(sv.protocol == PROTOCOL_NETQUAKE && (int)ent->v.modelindex & 0xFF00))
+				snap->flags |= ENTSNAP_MODEL;
 		}
+		snap->alpha = SV_EntityAlpha (ent);
+		if (snap->alpha == ENTALPHA_ZERO && !ent->v.effects)
+		{
+			snap->flags |= ENTSNAP_INVISIBLE;
+			continue;
+		}
+		if (!data)
+			continue;
 
-// send an update
-		bits = 0;
+		memset (&msg, 0, sizeof(msg));
+		msg.data = snap->data;
+		msg.maxsize = sizeof(snap->data);
+		SV_WriteEntityUpdate (&msg, ent, e, snap->alpha);
+		snap->size = msg.cursize;
+	}
+}
 
-		for (i=0 ; i<3 ; i++)
+/*
+=============
+SV_FindClientEntities
+
+Job range over sv_clientsnaps, the same tests as SV_WriteEntitiesToClient
+=============
+*/
+static void SV_FindClientEntities (void *data, int first, int last)
+{
+	clientsnap_t	*cs;
+	vec3_t			org;
+	int				c, e, fatsize;
+
+	fatsize = (sv.worldmodel->numleafs+31)>>3;
+	for (c = first; c < last; c++)
+	{
+		cs = &sv_clientsnaps[c];
+		VectorAdd (cs->clent->v.origin, cs->clent->v.view_ofs, org);
+		memset (cs->fatpvs, 0, fatsize);
+		SV_AddToFatPVSTo (org, sv.worldmodel->nodes, sv.worldmodel, cs->fatpvs, fatsize, cs->scratch);
+
+		cs->numents = 0;
+		for (e = SV_NextActiveEdict (1); e < sv.num_edicts; e = SV_NextActiveEdict (e + 1))
 		{
-			miss = ent->v.origin[i] - ent->baseline.origin[i];
-			if ( miss < -0.1 || miss > 0.1 )
-				bits |= U_ORIGIN1<<i;
+			if (EDICT_NUM(e) != cs->clent)
+			{
+				if (!(sv_entsnaps[e].flags & ENTSNAP_MODEL) || !SV_EntityInPVS (EDICT_NUM(e), cs->fatpvs))
+					continue;
+			}
+			cs->ents[cs->numents++] = e;
 		}
+	}
+}
 
-		if ( ent->v.angles[0] != ent->baseline.angles[0] )
-			bits |= U_ANGLE1;
-
-		if ( ent->v.angles[1] != ent->baseline.angles[1] )
-			bits |= U_ANGLE2;
+/*
+=============
+SV_BuildSnapshots
 
-		if ( ent->v.angles[2] != ent->baseline.angles[2] )
-			bits |= U_ANGLE3;
+Encodes the entities and finds what each spawned client sees. Returns the
+number of clients set up in sv_clientsnaps, in svs.clients order, or 0 to
+leave an entity with a bad model to the serial path.
+=============
+*/
+static int SV_BuildSnapshots (qboolean encode)
+{
+	client_t	*client;
+	int			i, count;
 
-		if (ent->v.movetype == MOVETYPE_STEP)
-			bits |= U_STEP;	// don't mess up the step animation
+	Jobs_ParallelFor (SV_EncodeEntities, encode ? sv_entsnaps : NULL, sv.num_edicts, 64);
+	for (i = 1; i < sv.num_edicts; i++)
+		if (sv_entsnaps[i].flags & ENTSNAP_BADMODEL)
+			return 0;
 
-		if (ent->baseline.colormap != ent->v.colormap)
-			bits |= U_COLORMAP;
+	for (i = count = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+	{
+		if (!client->active || !client->spawned)
+			continue;
+		sv_clientsnaps[count].clent = client->edict;
+		sv_clientsnaps[count].ents = sv_snapents + count * sv.max_edicts;
+		count++;
+	}
 
-		if (ent->baseline.skin != ent->v.skin)
-			bits |= U_SKIN;
+	Jobs_ParallelFor (SV_FindClientEntities, NULL, count, 1);
+	return count;
+}
 
-		if (ent->baseline.frame != ent->v.frame)
-			bits |= U_FRAME;
+/*
+=============
+SV_WriteSnapshotToClient
 
-		if (ent->baseline.effects != ent->v.effects)
-			bits |= U_EFFECTS;
+What SV_WriteEntitiesToClient does, from the snapshot
+=============
+*/
+static void SV_WriteSnapshotToClient (clientsnap_t *cs, sizebuf_t *msg)
+{
+	entsnap_t	*snap;
+	int			i, e;
 
-		if (ent->baseline.modelindex != ent->v.modelindex)
-			bits |= U_MODEL;
+	for (i = 0; i < cs->numents; i++)
+	{
+		e = cs->ents[i];
+		snap = &sv_entsnaps[e];
 
-		//johnfitz -- alpha
-		if (pr_alpha_supported)
+		if (msg->cursize + 24 > msg->maxsize)
 		{
-			// TODO: find a cleaner place to put this code
-			eval_t	*val;
-			val = GetEdictFieldValue(ent, "alpha");
-			if (val)
-				ent->alpha = ENTALPHA_ENCODE(val->_float);
+			SV_PacketOverflow ();
+			break;
 		}
 
-		//don't send invisible entities unless they have effects
-		if (ent->alpha == ENTALPHA_ZERO && !ent->v.effects)
+		EDICT_NUM(e)->alpha = snap->alpha;
+		if (snap->flags & ENTSNAP_INVISIBLE)
 			continue;
-		//johnfitz
 
-		//johnfitz -- PROTOCOL_FITZQUAKE
-		if (sv.protocol != PROTOCOL_NETQUAKE)
+		SZ_Write (msg, snap->data, snap->size);
+	}
+
+	SV_PacketStats (msg);
+}
+
+/*
+=============
+SV_SnapshotsValid
+
+Dropping a client runs ClientDisconnect, after which the snapshots may no
+longer match the edicts
+=============
+*/
+static qboolean SV_SnapshotsValid (int numactive)
+{
+	client_t	*client;
+	int			i;
+
+	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+		if (client->active)
+			numactive--;
+	return numactive == 0;
+}
+
+/*
+=============
+SV_FindClientSnapshot
+=============
+*/
+static clientsnap_t *SV_FindClientSnapshot (client_t *client, int numsnaps)
+{
+	int		i;
+
+	for (i = 0; i < numsnaps; i++)
+		if (sv_clientsnaps[i].clent == client->edict)
+			return &sv_clientsnaps[i];
+	return NULL;
+}
+
+/*
+=============
+SV_SnapshotBench_f
+
+Times a frame of entity updates for all spawned clients both ways and
+checks they come out the same
+=============
+*/
+static void SV_SnapshotBench_f (void)
+{
+	static byte	serialbuf[MAX_SCOREBOARD][MAX_DATAGRAM], snapbuf[MAX_SCOREBOARD][MAX_DATAGRAM];
+	sizebuf_t	serial[MAX_SCOREBOARD], snap[MAX_SCOREBOARD];
+	client_t	*client;
+	double		serialtime, snaptime;
+	int			i, n, frames, frame, count, bytes, diffs;
+
+	if (!sv.active)
+	{
+		Con_Printf ("no server running\n");
+		return;
+	}
+
+	frames = (Cmd_Argc () >= 2) ? q_max (1, atoi (Cmd_Argv (1))) : 100;
+	for (i = 0, client = svs.clients, count = 0; i < svs.maxclients; i++, client++)
+	{
+		if (!client->active || !client->spawned)
+			continue;
+		memset (&serial[count], 0, sizeof(sizebuf_t));
+		serial[count].data = serialbuf[count];
+		serial[count].maxsize = sizeof(serialbuf[count]);
+		if (Q_strcmp(NET_QSocketGetAddressString(client->netconnection), "LOCAL") != 0)
+			serial[count].maxsize = DATAGRAM_MTU;
+		snap[count] = serial[count];
+		snap[count].data = snapbuf[count];
+		count++;
+	}
+	if (!count)
+	{
+		Con_Printf ("no clients in the game\n");
+		return;
+	}
+
+	serialtime = Sys_DoubleTime ();
+	for (frame = 0; frame < frames; frame++)
+	{
+		for (i = 0, client = svs.clients, n = 0; i < svs.maxclients; i++, client++)
 		{
+			if (!client->active || !client->spawned)
+				continue;
+			SZ_Clear (&serial[n]);
+			SV_WriteEntitiesToClient (client->edict, &serial[n++]);
+		}
+	}
+	serialtime = Sys_DoubleTime () - serialtime;
 
-			if (ent->baseline.alpha != ent->alpha) bits |= U_ALPHA;
-			if (bits & U_FRAME && (int)ent->v.frame & 0xFF00) bits |= U_FRAME2;
-			if (bits & U_MODEL && (int)ent->v.modelindex & 0xFF00) bits |= U_MODEL2;
-			if (ent->sendinterval) bits |= U_LERPFINISH;
-			if (bits >= 65536) bits |= U_EXTEND1;
-			if (bits >= 16777216) bits |= U_EXTEND2;
+	snaptime = Sys_DoubleTime ();
+	for (frame = 0; frame < frames; frame++)
+	{
+		n = SV_BuildSnapshots (true);
+		if (n != count)
+		{
+			Con_Printf ("an entity has a bad model string\n");
+			return;
 		}
-		//johnfitz
+		for (i = 0; i < n; i++)
+		{
+			SZ_Clear (&snap[i]);
+			SV_WriteSnapshotToClient (&sv_clientsnaps[i], &snap[i]);
+		}
+	}
+	snaptime = Sys_DoubleTime () - snaptime;
 
-		if (e >= 256)
-			bits |= U_LONGENTITY;
+	for (i = 0, bytes = 0, diffs = 0; i < count; i++)
+	{
+		bytes += serial[i].cursize;
+		if (serial[i].cursize != snap[i].cursize || memcmp (serial[i].data, snap[i].data, serial[i].cursize))
+			diffs++;
+	}
 
-		if (bits >= 256)
-			bits |= U_MOREBITS;
+	Con_Printf ("%i clients, %i edicts, %i bytes a frame, %i frames\n", count, sv.num_edicts, bytes, frames);
+	Con_Printf ("serial:    %7.3f ms per frame\n", serialtime * 1000.0 / frames);
+	Con_Printf ("snapshots: %7.3f ms per frame (%i workers)\n", snaptime * 1000.0 / frames, Jobs_NumWorkers ());
+	if (diffs)
+		Con_Printf ("%i clients got different updates\n", diffs);
+}
 
-	//
-	// write the message
-	//
-		MSG_WriteByte (msg, bits | U_SIGNAL);
+/*
+=============================================================================
 
-		if (bits & U_MOREBITS)
-			MSG_WriteByte (msg, bits>>8);
+DELTA ENTITIES
 
-		//johnfitz -- PROTOCOL_FITZQUAKE
-		if (bits & U_EXTEND1)
-			MSG_WriteByte(msg, bits>>16);
-		if (bits & U_EXTEND2)
-			MSG_WriteByte(msg, bits>>24);
-		//johnfitz
+With PROTOCOL_DELTA the entity updates go out as one svc_deltaentities
+message against the last frame the client acknowledged with clc_deltaack,
+so entities that haven't changed cost nothing. The client keeps the frames
+it got the same way the server keeps the ones it sent, see protocol.h.
 
-		if (bits & U_LONGENTITY)
-			MSG_WriteShort (msg,e);
-		else
-			MSG_WriteByte (msg,e);
-
-		if (bits & U_MODEL)
-			MSG_WriteByte (msg,	ent->v.modelindex);
-		if (bits & U_FRAME)
-			MSG_WriteByte (msg, ent->v.frame);
-		if (bits & U_COLORMAP)
-			MSG_WriteByte (msg, ent->v.colormap);
-		if (bits & U_SKIN)
-			MSG_WriteByte (msg, ent->v.skin);
-		if (bits & U_EFFECTS)
-			MSG_WriteByte (msg, ent->v.effects);
-		if (bits & U_ORIGIN1)
-			MSG_WriteCoord (msg, ent->v.origin[0]);
-		if (bits & U_ANGLE1)
-			MSG_WriteAngle(msg, ent->v.angles[0]);
-		if (bits & U_ORIGIN2)
-			MSG_WriteCoord (msg, ent->v.origin[1]);
-		if (bits & U_ANGLE2)
-			MSG_WriteAngle(msg, ent->v.angles[1]);
-		if (bits & U_ORIGIN3)
-			MSG_WriteCoord (msg, ent->v.origin[2]);
-		if (bits & U_ANGLE3)
-			MSG_WriteAngle(msg, ent->v.angles[2]);
+=============================================================================
+*/
 
-		//johnfitz -- PROTOCOL_FITZQUAKE
-		if (bits & U_ALPHA)
-			MSG_WriteByte(msg, ent->alpha);
-		if (bits & U_FRAME2)
-			MSG_WriteByte(msg, (int)ent->v.frame >> 8);
-		if (bits & U_MODEL2)
-			MSG_WriteByte(msg, (int)ent->v.modelindex >> 8);
-		if (bits & U_LERPFINISH)
-			MSG_WriteByte(msg, (byte)(Q_rint((ent->v.nextthink-sv.time)*255)));
-		//johnfitz
+typedef struct
+{
+	deltahistory_t	history;
+	int				sequence;	// of the last frame sent
+	int				acked;		// last frame the client said it has
+} clientdelta_t;
+
+static	clientdelta_t	*sv_clientdeltas;	// svs.maxclients, only with PROTOCOL_DELTA
+static	int				*sv_deltaents;		// visible edicts, when there is no snapshot
+
+/*
+=============
+SV_AllocDeltas -- called by SV_SpawnServer
+=============
+*/
+static void SV_AllocDeltas (void)
+{
+	if (sv.protocol != PROTOCOL_DELTA)
+	{
+		sv_clientdeltas = NULL;
+		return;
 	}
+	sv_clientdeltas = (clientdelta_t *) Hunk_AllocName (svs.maxclients * sizeof(clientdelta_t), "deltas");
+	sv_deltaents = (int *) Hunk_AllocName (sv.max_edicts * sizeof(int), "deltas");
+}
 
-	//johnfitz -- devstats
-stats:
-	if (msg->cursize > 1024 && dev_peakstats.packetsize <= 1024)
-		Con_DWarning ("%i byte packet exceeds standard limit of 1024.\n", msg->cursize);
-	dev_stats.packetsize = msg->cursize;
-	dev_peakstats.packetsize = q_max(msg->cursize, dev_peakstats.packetsize);
-	//johnfitz
+/*
+=============
+SV_ClearDeltas -- called by SV_ConnectClient
+=============
+*/
+static void SV_ClearDeltas (int clientnum)
+{
+	if (sv_clientdeltas)
+		memset (&sv_clientdeltas[clientnum], 0, sizeof(clientdelta_t));
+}
+
+/*
+=============
+SV_DeltaAck
+
+The newest frame the client has. Zero asks for a frame from the baselines.
+=============
+*/
+void SV_DeltaAck (client_t *client, int sequence)
+{
+	clientdelta_t	*cd;
+
+	if (!sv_clientdeltas)
+		return;
+	cd = &sv_clientdeltas[client - svs.clients];
+	if (sequence >= 0 && sequence <= cd->sequence)
+		cd->acked = sequence;
+}
+
+/*
+=============
+SV_PackEdict
+=============
+*/
+static void SV_PackEdict (edict_t *ent, int num, deltaent_t *to)
+{
+	entity_state_t	state;
+
+	VectorCopy (ent->v.origin, state.origin);
+	VectorCopy (ent->v.angles, state.angles);
+	state.modelindex = ent->v.modelindex;
+	state.frame = ent->v.frame;
+	state.colormap = ent->v.colormap;
+	state.skin = ent->v.skin;
+	state.alpha = ent->alpha;
+	state.effects = ent->v.effects;
+	Delta_PackState (&state, num, (ent->v.movetype == MOVETYPE_STEP) ? DE_STEP : 0, to);
+}
+
+/*
+=============
+SV_WriteDeltaEntity
+
+Writes what changed from from to to, if anything did or the entity is new
+to the frame
+=============
+*/
+static void SV_WriteDeltaEntity (sizebuf_t *msg, const deltaent_t *from, const deltaent_t *to, edict_t *lerpent, qboolean added)
+{
+	int		i, bits;
+
+	bits = 0;
+	for (i = 0; i < 3; i++)
+		if (to->origin[i] != from->origin[i])
+			bits |= U_ORIGIN1<<i;
+	if (to->angles[0] != from->angles[0])
+		bits |= U_ANGLE1;
+	if (to->angles[1] != from->angles[1])
+		bits |= U_ANGLE2;
+	if (to->angles[2] != from->angles[2])
+		bits |= U_ANGLE3;
+	if ((to->flags ^ from->flags) & DE_STEP)
+		bits |= U_STEP;
+	if (to->modelindex != from->modelindex)
+		bits |= (to->modelindex & 0xFF00) ? U_MODEL | U_MODEL2 : U_MODEL;
+	if (to->frame != from->frame)
+		bits |= (to->frame & 0xFF00) ? U_FRAME | U_FRAME2 : U_FRAME;
+	if (to->colormap != from->colormap)
+		bits |= U_COLORMAP;
+	if (to->skin != from->skin)
+		bits |= U_SKIN;
+	if (to->effects != from->effects)
+		bits |= U_EFFECTS;
+	if (to->alpha != from->alpha)
+		bits |= U_ALPHA;
+	if (lerpent)
+		bits |= U_LERPFINISH;
+
+	if (!bits && !added)	// the client only adds the entities it reads
+		return;
+	if (bits >= 65536)
+		bits |= U_EXTEND1;
+	if (bits >= 256)
+		bits |= U_MOREBITS;
+
+	MSG_WriteShort (msg, to->num);
+	MSG_WriteByte (msg, bits);
+	if (bits & U_MOREBITS)
+		MSG_WriteByte (msg, bits>>8);
+	if (bits & U_EXTEND1)
+		MSG_WriteByte (msg, bits>>16);
+
+	if (bits & U_MODEL)
+		MSG_WriteByte (msg, to->modelindex);
+	if (bits & U_FRAME)
+		MSG_WriteByte (msg, to->frame);
+	if (bits & U_COLORMAP)
+		MSG_WriteByte (msg, to->colormap);
+	if (bits & U_SKIN)
+		MSG_WriteByte (msg, to->skin);
+	if (bits & U_EFFECTS)
+		MSG_WriteByte (msg, to->effects);
+	for (i = 0; i < 3; i++)
+		if (bits & (U_ORIGIN1<<i))
+			MSG_WriteShort (msg, to->origin[i]);
+	if (bits & U_ANGLE1)
+		MSG_WriteByte (msg, to->angles[0]);
+	if (bits & U_ANGLE2)
+		MSG_WriteByte (msg, to->angles[1]);
+	if (bits & U_ANGLE3)
+		MSG_WriteByte (msg, to->angles[2]);
+	if (bits & U_ALPHA)
+		MSG_WriteByte (msg, to->alpha);
+	if (bits & U_FRAME2)
+		MSG_WriteByte (msg, to->frame >> 8);
+	if (bits & U_MODEL2)
+		MSG_WriteByte (msg, to->modelindex >> 8);
+	if (bits & U_LERPFINISH)
+		MSG_WriteByte (msg, (byte)(Q_rint((lerpent->v.nextthink-sv.time)*255)));
+}
+
+/*
+=============
+SV_FindVisibleEntities
+
+The edicts SV_WriteEntitiesToClient would look at, in order
+=============
+*/
+static int SV_FindVisibleEntities (edict_t *clent, int *ents)
+{
+	int		e, count;
+	byte	*pvs;
+	vec3_t	org;
+	edict_t	*ent;
+
+	VectorAdd (clent->v.origin, clent->v.view_ofs, org);
+	pvs = SV_FatPVS (org, sv.worldmodel);
+
+	for (e = SV_NextActiveEdict (1), count = 0; e < sv.num_edicts; e = SV_NextActiveEdict (e + 1))
+	{
+		ent = EDICT_NUM(e);
+		if (ent != clent && (!SV_EntityHasModel (ent) || !SV_EntityInPVS (ent, pvs)))
+			continue;
+		ents[count++] = e;
+	}
+	return count;
+}
+
+/*
+=============
+SV_WriteDeltaEntitiesToClient
+
+Walks the new entities and the old frame together, like CL_ParseDeltaEntities
+=============
+*/
+static void SV_WriteDeltaEntitiesToClient (client_t *client, clientsnap_t *cs, sizebuf_t *msg)
+{
+	clientdelta_t	*cd = &sv_clientdeltas[client - svs.clients];
+	deltahistory_t	*h = &cd->history;
+	deltaframe_t	*from, *to;
+	deltaent_t		state, base;
+	edict_t			*ent;
+	int				*ents, numents;
+	int				i, oldfirst, oldindex, oldcount, newnum, oldnum;
+
+	if (cs)
+	{
+		ents = cs->ents;
+		numents = cs->numents;
+	}
+	else
+	{
+		ents = sv_deltaents;
+		numents = SV_FindVisibleEntities (client->edict, ents);
+	}
+
+	cd->sequence++;
+	from = Delta_FindFrame (h, cd->acked, cd->sequence);
+	oldfirst = from ? from->first : 0;
+	oldcount = from ? from->count : 0;
+
+	MSG_WriteByte (msg, svc_deltaentities);
+	MSG_WriteLong (msg, cd->sequence);
+	MSG_WriteLong (msg, from ? from->sequence : 0);
+
+	to = &h->frames[cd->sequence & (DELTA_FRAMES-1)];
+	to->sequence = cd->sequence;
+	to->first = h->poolhead;
+	to->count = 0;
+
+	for (i = oldindex = 0; ; )
+	{
+		//don't send invisible entities unless they have effects
+		for ( ; i < numents; i++)
+		{
+			ent = EDICT_NUM(ents[i]);
+			ent->alpha = SV_EntityAlpha (ent);
+			if (ent->alpha != ENTALPHA_ZERO || ent->v.effects)
+				break;
+		}
+
+		newnum = (i < numents) ? ents[i] : MAX_EDICTS;
+		oldnum = (oldindex < oldcount) ? Delta_PoolEnt (h, oldfirst + oldindex)->num : MAX_EDICTS;
+		if (newnum == MAX_EDICTS && oldnum == MAX_EDICTS)
+			break;
+
+		if (msg->cursize + DELTA_MAXENTRY + 2 > msg->maxsize)
+		{	// the client keeps the rest of the old frame
+			SV_PacketOverflow ();
+			break;
+		}
+
+		if (oldnum < newnum)
+		{	// not in the new frame
+			MSG_WriteShort (msg, oldnum | DELTA_REMOVE);
+			oldindex++;
+			continue;
+		}
+
+		if (oldnum != newnum && to->count + oldcount - oldindex >= DELTA_MAXENTITIES)
+			break;
+
+		ent = EDICT_NUM(newnum);
+		SV_PackEdict (ent, newnum, &state);
+		if (oldnum == newnum)
+			base = *Delta_PoolEnt (h, oldfirst + oldindex++);
+		else
+			Delta_PackState (&ent->baseline, newnum, 0, &base);
+		SV_WriteDeltaEntity (msg, &base, &state, ent->sendinterval ? ent : NULL, oldnum != newnum);
+		*Delta_PoolEnt (h, to->first + to->count++) = state;
+		i++;
+	}
+
+	for ( ; oldindex < oldcount; oldindex++)
+		*Delta_PoolEnt (h, to->first + to->count++) = *Delta_PoolEnt (h, oldfirst + oldindex);
+	h->poolhead += to->count;
+
+	MSG_WriteShort (msg, 0);
+
+	SV_PacketStats (msg);
 }
 
 /*
@@ -717,9 +1451,9 @@ void SV_CleanupEnts (void)
 	int		e;
 	edict_t	*ent;
 
-	ent = NEXT_EDICT(sv.edicts);
-	for (e=1 ; e<sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
+	for (e = SV_NextActiveEdict (1); e < sv.num_edicts; e = SV_NextActiveEdict (e + 1))
 	{
+		ent = EDICT_NUM(e);
 		ent->v.effects = (int)ent->v.effects & ~EF_MUZZLEFLASH;
 	}
 }
@@ -778,7 +1512,7 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 
 // stuff the sigil bits into the high bits of items for sbar, or else
 // mix in items2
-	val = GetEdictFieldValue(ent, "items2");
+	val = GetEdictFieldValueOfs(ent, pr_extfields.items2);
 
 	if (val)
 		items = (int)ent->v.items | ((int)val->_float << 23);
@@ -911,7 +1645,7 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 SV_SendClientDatagram
 =======================
 */
-qboolean SV_SendClientDatagram (client_t *client)
+static qboolean SV_SendClientSnapshot (client_t *client, clientsnap_t *cs)
 {
 	byte		buf[MAX_DATAGRAM];
 	sizebuf_t	msg;
@@ -931,7 +1665,12 @@ qboolean SV_SendClientDatagram (client_t *client)
 // add the client specific data to the datagram
 	SV_WriteClientdataToMessage (client->edict, &msg);
 
-	SV_WriteEntitiesToClient (client->edict, &msg);
+	if (sv_clientdeltas)
+		SV_WriteDeltaEntitiesToClient (client, cs, &msg);
+	else if (cs)
+		SV_WriteSnapshotToClient (cs, &msg);
+	else
+		SV_WriteEntitiesToClient (client->edict, &msg);
 
 // copy the server datagram if there is space
 	if (msg.cursize + sv.datagram.cursize < msg.maxsize)
@@ -947,6 +1686,11 @@ qboolean SV_SendClientDatagram (client_t *client)
 	return true;
 }
 
+qboolean SV_SendClientDatagram (client_t *client)
+{
+	return SV_SendClientSnapshot (client, NULL);
+}
+
 /*
 =======================
 SV_UpdateToReliableMessages
@@ -1017,11 +1761,30 @@ SV_SendClientMessages
 */
 void SV_SendClientMessages (void)
 {
-	int			i;
+	clientsnap_t	*cs;
+	int				i, numsnaps, numactive;
 
 // update frags, names, etc
 	SV_UpdateToReliableMessages ();
 
+// send what goes to each client together once they are all written
+	NET_BeginBatch ();
+
+// with several clients in the game, work out their entity updates together
+	numsnaps = numactive = 0;
+	if (sv_parallelsnapshots.value)
+	{
+		for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
+		{
+			numactive += host_client->active;
+			numsnaps += host_client->active && host_client->spawned;
+		}
+		if (numsnaps >= 2)
+			numsnaps = SV_BuildSnapshots (sv.protocol != PROTOCOL_DELTA);
+		else
+			numsnaps = 0;
+	}
+
 // build individual updates
 	for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
 	{
@@ -1030,7 +1793,10 @@ void SV_SendClientMessages (void)
 
 		if (host_client->spawned)
 		{
-			if (!SV_SendClientDatagram (host_client))
+			cs = NULL;
+			if (numsnaps && SV_SnapshotsValid (numactive))
+				cs = SV_FindClientSnapshot (host_client, numsnaps);
+			if (!SV_SendClientSnapshot (host_client, cs))
 				continue;
 		}
 		else
@@ -1080,6 +1846,7 @@ void SV_SendClientMessages (void)
 		}
 	}
 
+	NET_EndBatch ();
 
 // clear muzzle flashes
 	SV_CleanupEnts ();
@@ -1127,12 +1894,10 @@ void SV_CreateBaseline (void)
 	int			entnum;
 	int			bits; //johnfitz -- PROTOCOL_FITZQUAKE
 
-	for (entnum = 0; entnum < sv.num_edicts ; entnum++)
+	for (entnum = SV_NextActiveEdict (0); entnum < sv.num_edicts; entnum = SV_NextActiveEdict (entnum + 1))
 	{
 	// get the current server version
 		svent = EDICT_NUM(entnum);
-		if (svent->free)
-			continue;
 		if (entnum > svs.maxclients && !svent->v.modelindex)
 			continue;
 
@@ -1323,6 +2088,11 @@ void SV_SpawnServer (const char *server)
 	Host_ClearMemory ();
 
 	q_strlcpy (sv.name, server, sizeof(sv.name));
+	q_snprintf (sv.modelname, sizeof(sv.modelname), "maps/%s.bsp", server);
+
+// start reading the map while the progs load
+	Loader_BeginStage ("progs");
+	Mod_QueueLoad (sv.modelname);
 
 	sv.protocol = sv_protocol; // johnfitz
 
@@ -1333,6 +2103,10 @@ void SV_SpawnServer (const char *server)
 	/* Host_ClearMemory() called above already cleared the whole sv structure */
 	sv.max_edicts = CLAMP (MIN_EDICTS,(int)max_edicts.value,MAX_EDICTS); //johnfitz -- max_edicts cvar
 	sv.edicts = (edict_t *) Hunk_AllocName (sv.max_edicts*pr_edict_size, "edicts");
+	sv.freeedicts = (int *) Hunk_AllocName (sv.max_edicts*sizeof(int), "freeedicts");
+	SV_AllocSnapshots ();
+	SV_AllocDeltas ();
+	sv.activeedicts = (unsigned int *) Hunk_AllocName (((sv.max_edicts + 31) >> 5)*sizeof(unsigned int), "activeedicts");
 
 	sv.datagram.maxsize = sizeof(sv.datagram_buf);
 	sv.datagram.cursize = 0;
@@ -1353,19 +2127,22 @@ void SV_SpawnServer (const char *server)
 		ent = EDICT_NUM(i+1);
 		svs.clients[i].edict = ent;
 	}
+	// the world and the client slots start out in use
+	for (i=0 ; i<sv.num_edicts ; i++)
+		SV_SetEdictActive (i);
 
 	sv.state = ss_loading;
 	sv.paused = false;
 
 	sv.time = 1.0;
 
-	q_strlcpy (sv.name, server, sizeof(sv.name));
-	q_snprintf (sv.modelname, sizeof(sv.modelname), "maps/%s.bsp", server);
+	Loader_BeginStage ("world");
 	sv.worldmodel = Mod_ForName (sv.modelname, false);
 	if (!sv.worldmodel)
 	{
 		Con_Printf ("Couldn't spawn server %s\n", sv.modelname);
 		sv.active = false;
+		Loader_Finish ("failed server spawn");
 		return;
 	}
 	sv.models[1] = sv.worldmodel;
@@ -1405,6 +2182,7 @@ void SV_SpawnServer (const char *server)
 // serverflags are for cross level information (sigils)
 	pr_global_struct->serverflags = svs.serverflags;
 
+	Loader_BeginStage ("entities");
 	ED_LoadFromFile (sv.worldmodel->entities);
 
 	sv.active = true;
@@ -1413,6 +2191,7 @@ void SV_SpawnServer (const char *server)
 	sv.state = ss_active;
 
 // run two frames to allow everything to settle
+	Loader_BeginStage ("physics");
 	host_frametime = 0.1;
 	SV_Physics ();
 	SV_Physics ();
@@ -1425,6 +2204,8 @@ void SV_SpawnServer (const char *server)
 		Con_DWarning ("%i byte signon buffer exceeds standard limit of 7998.\n", sv.signon.cursize);
 	//johnfitz
 
+	Loader_Finish ("server spawn");
+
 // send serverinfo to all connected clients
 	for (i=0,host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
 		if (host_client->active)
@@ -64,11 +64,9 @@ void SV_CheckAllEnts (void)
 	edict_t		*check;
 
 // see if any solid entities are inside the final position
-	check = NEXT_EDICT(sv.edicts);
-	for (e=1 ; e<sv.num_edicts ; e++, check = NEXT_EDICT(check))
+	for (e = SV_NextActiveEdict (1); e < sv.num_edicts; e = SV_NextActiveEdict (e + 1))
 	{
-		if (check->free)
-			continue;
+		check = EDICT_NUM(e);
 		if (check->v.movetype == MOVETYPE_PUSH
 		|| check->v.movetype == MOVETYPE_NONE
 		|| check->v.movetype == MOVETYPE_NOCLIP)
@@ -388,7 +386,7 @@ void SV_AddGravity (edict_t *ent)
 	float	ent_gravity;
 	eval_t	*val;
 
-	val = GetEdictFieldValue(ent, "gravity");
+	val = GetEdictFieldValueOfs(ent, pr_extfields.gravity);
 	if (val && val->_float)
 		ent_gravity = val->_float;
 	else
@@ -483,11 +481,9 @@ void SV_PushMove (edict_t *pusher, float movetime)
 
 // see if any solid entities are inside the final position
 	num_moved = 0;
-	check = NEXT_EDICT(sv.edicts);
-	for (e=1 ; e<sv.num_edicts ; e++, check = NEXT_EDICT(check))
+	for (e = SV_NextActiveEdict (1); e < sv.num_edicts; e = SV_NextActiveEdict (e + 1))
 	{
-		if (check->free)
-			continue;
+		check = EDICT_NUM(e);
 		if (check->v.movetype == MOVETYPE_PUSH
 		|| check->v.movetype == MOVETYPE_NONE
 		|| check->v.movetype == MOVETYPE_NOCLIP)
@@ -1176,6 +1172,8 @@ void SV_Physics (void)
 	int	entity_cap; // For sv_freezenonclients 
 	edict_t	*ent;
 
+	SV_FlushTraceCache ();
+
 // let the progs know that a new frame has started
 	pr_global_struct->self = EDICT_TO_PROG(sv.edicts);
 	pr_global_struct->other = EDICT_TO_PROG(sv.edicts);
@@ -1187,18 +1185,16 @@ void SV_Physics (void)
 //
 // treat each object in turn
 //
-	ent = sv.edicts;
-
 	if (sv_freezenonclients.value)
 	  entity_cap = svs.maxclients + 1; // Only run physics on clients and the world
 	else
 	  entity_cap = sv.num_edicts; 
 
 	//for (i=0 ; i<sv.num_edicts ; i++, ent = NEXT_EDICT(ent))
-	for (i=0 ; i<entity_cap ; i++, ent = NEXT_EDICT(ent))
+	// edicts removed by earlier ones are skipped, as with a walk over every slot
+	for (i = SV_NextActiveEdict (0); i < entity_cap; i = SV_NextActiveEdict (i + 1))
 	{
-		if (ent->free)
-			continue;
+		ent = EDICT_NUM(i);
 
 		if (pr_global_struct->force_retouch)
 		{
@@ -583,6 +583,10 @@ nextmsg:
 			case clc_move:
 				SV_ReadClientMove (&host_client->cmd);
 				break;
+
+			case clc_deltaack:
+				SV_DeltaAck (host_client, MSG_ReadLong ());
+				break;
 			}
 		}
 	} while (ret == 1);
@@ -42,6 +42,11 @@ int Sys_FileWrite (int handle,const void *data, int count);
 int Sys_FileTime (const char *path);
 void Sys_mkdir (const char *path);
 
+// maps a whole file read-only into memory, returns NULL if the file
+// can't be mapped or the platform doesn't support it.
+void *Sys_MapFile (const char *path, long *size);
+void Sys_UnmapFile (void *data, long size);
+
 //
 // system IO
 //
@@ -34,6 +34,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <sys/time.h>
 #include <fcntl.h>
 #include <time.h>
+#include <sys/mman.h>
 #ifdef DO_USERDIRS
 #include <pwd.h>
 #endif
@@ -155,6 +156,36 @@ int Sys_FileTime (const char *path)
 	return -1;
 }
 
+void *Sys_MapFile (const char *path, long *size)
+{
+	struct stat	st;
+	void	*data;
+	int	fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+
+	if (fstat(fd, &st) == -1 || st.st_size <= 0)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);	/* the mapping keeps its own reference */
+	if (data == MAP_FAILED)
+		return NULL;
+
+	*size = st.st_size;
+	return data;
+}
+
+void Sys_UnmapFile (void *data, long size)
+{
+	munmap(data, size);
+}
+
 
 #if defined(__linux__) || defined(__sun) || defined(sun) || defined(_AIX)
 static int Sys_NumCPUs (void)
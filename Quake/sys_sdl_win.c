@@ -150,6 +150,15 @@ int Sys_FileTime (const char *path)
 	return -1;
 }
 
+void *Sys_MapFile (const char *path, long *size)
+{
+	return NULL;	/* not implemented, pak files are read through stdio */
+}
+
+void Sys_UnmapFile (void *data, long size)
+{
+}
+
 static char	cwd[1024];
 
 static void Sys_GetBasedir (char *argv0, char *dst, size_t dstsize)
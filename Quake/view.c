@@ -854,7 +854,7 @@ void V_RenderView (void)
 {
 	if (con_forcedup)
 	{
-		vkCmdBeginRenderPass(vulkan_globals.command_buffer, &vulkan_globals.main_render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+		GL_BeginMainRenderPass ();
 		return;
 	}
 
@@ -24,6 +24,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
 /*
 
 entities never clip against themselves, or their owner
@@ -178,6 +183,16 @@ hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
 
 ENTITY AREA CHECKING
 
+Linked edicts are kept either in a fixed depth binary tree of areanodes, or
+with sv_areagrid set, in a loose uniform grid over the world's x and y.
+
+An edict goes into the grid cell holding its absmin, so a cell's edicts
+can reach up to a cell size past it; queries take that into account by
+starting a cell early. Edicts wider than a cell go in one extra list that
+every query checks, like the top areanode.
+
+Either way an edict sits on exactly one link list, through ent->area.
+
 ===============================================================================
 */
 
@@ -196,6 +211,43 @@ typedef struct areanode_s
 static	areanode_t	sv_areanodes[AREA_NODES];
 static	int			sv_numareanodes;
 
+typedef struct
+{
+	link_t	trigger_edicts;
+	link_t	solid_edicts;
+} areacell_t;
+
+#define	AREAGRID_MINCELL	128
+#define	AREAGRID_MAXCELLS	128	// per axis
+
+static	areacell_t	*sv_areacells;		// gridsize[0] * gridsize[1], then the large edicts
+static	int			sv_areagridsize[2];
+static	vec3_t		sv_areagridorg;
+static	float		sv_areacellsize;
+static	qboolean	sv_usegrid;			// what the edicts are linked into now
+
+cvar_t	sv_areagrid = {"sv_areagrid", "0", CVAR_NONE};
+
+static void SV_LinkToArea (edict_t *ent);
+
+// SV_Move calls kept for sv_areabench
+typedef struct
+{
+	vec3_t	start, mins, maxs, end;
+	int		type;
+	int		passent;	// -1 for none
+} areamove_t;
+
+static struct
+{
+	areamove_t	*moves;
+	int			count, max;
+} sv_arearecord;
+
+static	qboolean	sv_benchmarking;	// no recording or trace cache while replaying
+
+static void SV_RecordMove (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict);
+
 /*
 ===============
 SV_CreateAreaNode
@@ -241,6 +293,65 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 	return anode;
 }
 
+/*
+===============
+SV_CreateAreaGrid
+
+Cells are at least AREAGRID_MINCELL units, and grow on big maps to keep
+the grid at AREAGRID_MAXCELLS a side
+===============
+*/
+static void SV_CreateAreaGrid (vec3_t mins, vec3_t maxs)
+{
+	float	extent;
+	int		i, count;
+
+	extent = q_max (maxs[0] - mins[0], maxs[1] - mins[1]);
+	sv_areacellsize = q_max ((float)AREAGRID_MINCELL, extent / AREAGRID_MAXCELLS);
+	VectorCopy (mins, sv_areagridorg);
+	for (i = 0; i < 2; i++)
+		sv_areagridsize[i] = CLAMP (1, (int)ceil ((maxs[i] - mins[i]) / sv_areacellsize), AREAGRID_MAXCELLS);
+
+	count = sv_areagridsize[0] * sv_areagridsize[1] + 1;
+	sv_areacells = (areacell_t *) Hunk_AllocName (count * sizeof(areacell_t), "areagrid");
+	for (i = 0; i < count; i++)
+	{
+		ClearLink (&sv_areacells[i].trigger_edicts);
+		ClearLink (&sv_areacells[i].solid_edicts);
+	}
+}
+
+static int SV_AreaGridCoord (float v, int axis)
+{
+	int		c = (int)floor ((v - sv_areagridorg[axis]) / sv_areacellsize);
+
+	return CLAMP (0, c, sv_areagridsize[axis] - 1);
+}
+
+/*
+===============
+SV_AreaGridRange
+
+The cells that can hold edicts touching the box, as x0, y0, x1, y1
+===============
+*/
+static void SV_AreaGridRange (const vec3_t mins, const vec3_t maxs, int *range)
+{
+	range[0] = SV_AreaGridCoord (mins[0] - sv_areacellsize, 0);
+	range[1] = SV_AreaGridCoord (mins[1] - sv_areacellsize, 1);
+	range[2] = SV_AreaGridCoord (maxs[0], 0);
+	range[3] = SV_AreaGridCoord (maxs[1], 1);
+}
+
+static areacell_t *SV_AreaGridCell (edict_t *ent)
+{
+	if (ent->v.absmax[0] - ent->v.absmin[0] > sv_areacellsize
+	|| ent->v.absmax[1] - ent->v.absmin[1] > sv_areacellsize)
+		return &sv_areacells[sv_areagridsize[0] * sv_areagridsize[1]];
+
+	return &sv_areacells[SV_AreaGridCoord (ent->v.absmin[1], 1) * sv_areagridsize[0] + SV_AreaGridCoord (ent->v.absmin[0], 0)];
+}
+
 /*
 ===============
 SV_ClearWorld
@@ -254,6 +365,46 @@ void SV_ClearWorld (void)
 	memset (sv_areanodes, 0, sizeof(sv_areanodes));
 	sv_numareanodes = 0;
 	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
+	SV_CreateAreaGrid (sv.worldmodel->mins, sv.worldmodel->maxs);
+	sv_usegrid = (sv_areagrid.value != 0);
+	SV_FlushTraceCache ();
+}
+
+/*
+===============
+SV_RelinkArea
+
+Moves every linked edict over to the tree or the grid, keeping the abs boxes
+they were linked with
+===============
+*/
+static void SV_RelinkArea (qboolean grid)
+{
+	edict_t	*ent;
+	int		i;
+
+	if (!sv.active || !sv_areacells || sv_usegrid == grid)
+		return;
+
+	sv_usegrid = grid;
+	for (i = 1; i < sv.num_edicts; i++)
+	{
+		ent = EDICT_NUM(i);
+		if (!ent->area.prev)
+			continue;
+		RemoveLink (&ent->area);
+		SV_LinkToArea (ent);
+	}
+}
+
+/*
+===============
+SV_AreaGrid_f -- called when sv_areagrid changes
+===============
+*/
+void SV_AreaGrid_f (cvar_t *var)
+{
+	SV_RelinkArea (var->value != 0);
 }
 
 
@@ -270,6 +421,7 @@ void SV_UnlinkEdict (edict_t *ent)
 {
 	if (!ent->area.prev)
 		return;		// not linked in anywhere
+	SV_FlushTraceCache ();
 	RemoveLink (&ent->area);
 	if (sv_link_next && *sv_link_next == &ent->area)
 		*sv_link_next = ent->area.next;
@@ -281,10 +433,10 @@ void SV_UnlinkEdict (edict_t *ent)
 
 /*
 ====================
-SV_TouchLinks
+SV_TouchLinkList
 ====================
 */
-void SV_TouchLinks ( edict_t *ent, areanode_t *node )
+static void SV_TouchLinkList ( edict_t *ent, link_t *list )
 {
 	link_t		*l, *next;
 	edict_t		*touch;
@@ -292,7 +444,7 @@ void SV_TouchLinks ( edict_t *ent, areanode_t *node )
 
 // touch linked edicts
 	sv_link_next = &next;
-	for (l = node->trigger_edicts.next ; l != &node->trigger_edicts ; l = next)
+	for (l = list->next ; l != list ; l = next)
 	{
 		if (!l)
 		{
@@ -327,15 +479,47 @@ void SV_TouchLinks ( edict_t *ent, areanode_t *node )
 	}
 
 	sv_link_next = NULL;
+}
+
+/*
+====================
+SV_TouchAreaNode
+====================
+*/
+static void SV_TouchAreaNode ( edict_t *ent, areanode_t *node )
+{
+	SV_TouchLinkList (ent, &node->trigger_edicts);
 
 // recurse down both sides
 	if (node->axis == -1)
 		return;
 
 	if ( ent->v.absmax[node->axis] > node->dist )
-		SV_TouchLinks ( ent, node->children[0] );
+		SV_TouchAreaNode ( ent, node->children[0] );
 	if ( ent->v.absmin[node->axis] < node->dist )
-		SV_TouchLinks ( ent, node->children[1] );
+		SV_TouchAreaNode ( ent, node->children[1] );
+}
+
+/*
+====================
+SV_TouchLinks
+====================
+*/
+static void SV_TouchLinks ( edict_t *ent )
+{
+	int		range[4], x, y;
+
+	if (!sv_usegrid)
+	{
+		SV_TouchAreaNode (ent, sv_areanodes);
+		return;
+	}
+
+	SV_TouchLinkList (ent, &sv_areacells[sv_areagridsize[0] * sv_areagridsize[1]].trigger_edicts);
+	SV_AreaGridRange (ent->v.absmin, ent->v.absmax, range);
+	for (y = range[1]; y <= range[3]; y++)
+		for (x = range[0]; x <= range[2]; x++)
+			SV_TouchLinkList (ent, &sv_areacells[y * sv_areagridsize[0] + x].trigger_edicts);
 }
 
 
@@ -391,8 +575,6 @@ SV_LinkEdict
 */
 void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 {
-	areanode_t	*node;
-
 	if (ent->area.prev)
 		SV_UnlinkEdict (ent);	// unlink from old position
 
@@ -402,6 +584,8 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 	if (ent->free)
 		return;
 
+	SV_FlushTraceCache ();
+
 // set the abs box
 	VectorAdd (ent->v.origin, ent->v.mins, ent->v.absmin);
 	VectorAdd (ent->v.origin, ent->v.maxs, ent->v.absmax);
@@ -436,6 +620,35 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 	if (ent->v.solid == SOLID_NOT)
 		return;
 
+	SV_LinkToArea (ent);
+
+// if touch_triggers, touch all entities at this node and decend for more
+	if (touch_triggers)
+		SV_TouchLinks ( ent );
+}
+
+/*
+===============
+SV_LinkToArea
+
+Puts an edict with its abs box set on the list it belongs to
+===============
+*/
+static void SV_LinkToArea (edict_t *ent)
+{
+	areanode_t	*node;
+	areacell_t	*cell;
+
+	if (sv_usegrid)
+	{
+		cell = SV_AreaGridCell (ent);
+		if (ent->v.solid == SOLID_TRIGGER)
+			InsertLinkBefore (&ent->area, &cell->trigger_edicts);
+		else
+			InsertLinkBefore (&ent->area, &cell->solid_edicts);
+		return;
+	}
+
 // find the first node that the ent's box crosses
 	node = sv_areanodes;
 	while (1)
@@ -456,10 +669,85 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 		InsertLinkBefore (&ent->area, &node->trigger_edicts);
 	else
 		InsertLinkBefore (&ent->area, &node->solid_edicts);
+}
 
-// if touch_triggers, touch all entities at this node and decend for more
-	if (touch_triggers)
-		SV_TouchLinks ( ent, sv_areanodes );
+/*
+===============
+SV_AreaEdicts
+
+Collects the numbers of the linked edicts whose abs boxes touch the box,
+lowest first. Returns how many were found, at most maxcount.
+===============
+*/
+static int SV_AreaEdictList (const link_t *list, const vec3_t mins, const vec3_t maxs, int *edicts, int count, int maxcount)
+{
+	const link_t	*l;
+	edict_t			*touch;
+
+	for (l = list->next; l != list && count < maxcount; l = l->next)
+	{
+		touch = EDICT_FROM_AREA(l);
+		if (mins[0] > touch->v.absmax[0]
+		|| mins[1] > touch->v.absmax[1]
+		|| mins[2] > touch->v.absmax[2]
+		|| maxs[0] < touch->v.absmin[0]
+		|| maxs[1] < touch->v.absmin[1]
+		|| maxs[2] < touch->v.absmin[2] )
+			continue;
+		edicts[count++] = NUM_FOR_EDICT(touch);
+	}
+	return count;
+}
+
+static int SV_AreaEdictNode (areanode_t *node, const vec3_t mins, const vec3_t maxs, int *edicts, int count, int maxcount)
+{
+	count = SV_AreaEdictList (&node->trigger_edicts, mins, maxs, edicts, count, maxcount);
+	count = SV_AreaEdictList (&node->solid_edicts, mins, maxs, edicts, count, maxcount);
+	if (node->axis == -1)
+		return count;
+	if (maxs[node->axis] > node->dist)
+		count = SV_AreaEdictNode (node->children[0], mins, maxs, edicts, count, maxcount);
+	if (mins[node->axis] < node->dist)
+		count = SV_AreaEdictNode (node->children[1], mins, maxs, edicts, count, maxcount);
+	return count;
+}
+
+static int SV_CompareEdictNums (const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+int SV_AreaEdicts (const vec3_t mins, const vec3_t maxs, int *edicts, int maxcount)
+{
+	areacell_t	*cell;
+	int			range[4], x, y, count;
+
+	if (!sv_usegrid)
+		count = SV_AreaEdictNode (sv_areanodes, mins, maxs, edicts, 0, maxcount);
+	else
+	{
+		cell = &sv_areacells[sv_areagridsize[0] * sv_areagridsize[1]];
+		count = SV_AreaEdictList (&cell->trigger_edicts, mins, maxs, edicts, 0, maxcount);
+		count = SV_AreaEdictList (&cell->solid_edicts, mins, maxs, edicts, count, maxcount);
+		SV_AreaGridRange (mins, maxs, range);
+		for (y = range[1]; y <= range[3]; y++)
+		{
+			for (x = range[0]; x <= range[2]; x++)
+			{
+				cell = &sv_areacells[y * sv_areagridsize[0] + x];
+				count = SV_AreaEdictList (&cell->trigger_edicts, mins, maxs, edicts, count, maxcount);
+				count = SV_AreaEdictList (&cell->solid_edicts, mins, maxs, edicts, count, maxcount);
+			}
+		}
+	}
+
+	qsort (edicts, count, sizeof(int), SV_CompareEdictNums);
+	return count;
+}
+
+qboolean SV_UsingAreaGrid (void)
+{
+	return sv_usegrid;
 }
 
 
@@ -696,6 +984,215 @@ qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec
 }
 
 
+/*
+===============================================================================
+
+BATCHED HULL CHECKS
+
+Up to HULLBATCH_MAX points or rays go down a hull together, one to an SSE
+lane, with the plane distances for all of them worked out at once. While
+both ends of every ray are on the same side of a node they simply split
+up between the children; a ray that crosses a plane leaves the packet and
+finishes in SV_RecursiveHullCheck from that node, which is where a trace
+of its own would have gone as well. The results are the same as tracing
+one at a time.
+
+===============================================================================
+*/
+
+#define	HULLBATCH_MAX	4
+
+typedef struct
+{
+	float	p1[3][HULLBATCH_MAX];	// one array per axis
+	float	p2[3][HULLBATCH_MAX];
+	float	*start[HULLBATCH_MAX];
+	float	*end[HULLBATCH_MAX];
+	trace_t	*trace[HULLBATCH_MAX];
+	int		*contents[HULLBATCH_MAX];
+} hullbatch_t;
+
+/*
+==================
+SV_HullBatchSides
+
+Sets bits in front and back for the lanes whose points are on that side of
+the plane, the same way the scalar code compares them
+==================
+*/
+static void SV_HullBatchSides (const mplane_t *plane, const float p[3][HULLBATCH_MAX], int *front, int *back)
+{
+#ifdef USE_SSE2
+	__m128	d, zero = _mm_setzero_ps ();
+
+	if (plane->type < 3)
+		d = _mm_sub_ps (_mm_loadu_ps (p[plane->type]), _mm_set1_ps (plane->dist));
+	else
+		d = _mm_sub_ps (_mm_add_ps (_mm_add_ps (
+			_mm_mul_ps (_mm_set1_ps (plane->normal[0]), _mm_loadu_ps (p[0])),
+			_mm_mul_ps (_mm_set1_ps (plane->normal[1]), _mm_loadu_ps (p[1]))),
+			_mm_mul_ps (_mm_set1_ps (plane->normal[2]), _mm_loadu_ps (p[2]))),
+			_mm_set1_ps (plane->dist));
+	*front = _mm_movemask_ps (_mm_cmpge_ps (d, zero));
+	*back = _mm_movemask_ps (_mm_cmplt_ps (d, zero));
+#else
+	float	d;
+	int		i;
+
+	*front = *back = 0;
+	for (i = 0; i < HULLBATCH_MAX; i++)
+	{
+		if (plane->type < 3)
+			d = p[plane->type][i] - plane->dist;
+		else
+			d = plane->normal[0]*p[0][i] + plane->normal[1]*p[1][i] + plane->normal[2]*p[2][i] - plane->dist;
+		if (d >= 0)
+			*front |= 1 << i;
+		if (d < 0)
+			*back |= 1 << i;
+	}
+#endif
+}
+
+/*
+==================
+SV_HullBatchPointContents
+==================
+*/
+static void SV_HullBatchPointContents (hull_t *hull, int num, hullbatch_t *b, int mask)
+{
+	mclipnode_t	*node;
+	int			front, back, i;
+
+	while (num >= 0)
+	{
+		if (num < hull->firstclipnode || num > hull->lastclipnode)
+			Sys_Error ("SV_HullPointContents: bad node number");
+
+		node = hull->clipnodes + num;
+		SV_HullBatchSides (hull->planes + node->planenum, b->p1, &front, &back);
+		back &= mask;
+		front = mask & ~back;	// a NaN distance goes to the front, as in SV_HullPointContents
+
+		if (front && back)
+		{
+			SV_HullBatchPointContents (hull, node->children[1], b, back);
+			mask = front;
+		}
+		else
+			mask = front | back;
+		num = node->children[back && !front];
+	}
+
+	for (i = 0; i < HULLBATCH_MAX; i++)
+		if (mask & (1 << i))
+			*b->contents[i] = num;
+}
+
+/*
+==================
+SV_HullPointContentsBatch
+
+Does SV_HullPointContents for count points
+==================
+*/
+void SV_HullPointContentsBatch (hull_t *hull, int num, int count, vec3_t *points, int *contents)
+{
+	hullbatch_t	b;
+	int			i, j, n;
+
+	memset (&b, 0, sizeof(b));
+	for (i = 0; i < count; i += n)
+	{
+		n = q_min (count - i, HULLBATCH_MAX);
+		for (j = 0; j < n; j++)
+		{
+			b.p1[0][j] = points[i + j][0];
+			b.p1[1][j] = points[i + j][1];
+			b.p1[2][j] = points[i + j][2];
+			b.contents[j] = &contents[i + j];
+		}
+		SV_HullBatchPointContents (hull, num, &b, (1 << n) - 1);
+	}
+}
+
+/*
+==================
+SV_HullBatchCheck
+==================
+*/
+static void SV_HullBatchCheck (hull_t *hull, int num, hullbatch_t *b, int mask)
+{
+	mclipnode_t	*node;
+	mplane_t	*plane;
+	int			front1, back1, front2, back2, front, back, cross, i;
+
+	while (num >= 0)
+	{
+		if (num < hull->firstclipnode || num > hull->lastclipnode)
+			Sys_Error ("SV_RecursiveHullCheck: bad node number");
+
+		node = hull->clipnodes + num;
+		plane = hull->planes + node->planenum;
+		SV_HullBatchSides (plane, b->p1, &front1, &back1);
+		SV_HullBatchSides (plane, b->p2, &front2, &back2);
+		front = mask & front1 & front2;
+		back = mask & back1 & back2;
+		cross = mask & ~(front | back);
+
+		for (i = 0; i < HULLBATCH_MAX; i++)
+			if (cross & (1 << i))
+				SV_RecursiveHullCheck (hull, num, 0, 1, b->start[i], b->end[i], b->trace[i]);
+
+		if (front && back)
+		{
+			SV_HullBatchCheck (hull, node->children[1], b, back);
+			mask = front;
+		}
+		else if (front || back)
+			mask = front | back;
+		else
+			return;
+		num = node->children[mask == back];
+	}
+
+	for (i = 0; i < HULLBATCH_MAX; i++)
+		if (mask & (1 << i))
+			SV_RecursiveHullCheck (hull, num, 0, 1, b->start[i], b->end[i], b->trace[i]);
+}
+
+/*
+==================
+SV_HullTraceBatch
+
+Does SV_RecursiveHullCheck from the top of the hull for count rays, with
+the traces filled in beforehand the same way
+==================
+*/
+void SV_HullTraceBatch (hull_t *hull, int count, vec3_t *starts, vec3_t *ends, trace_t *traces)
+{
+	hullbatch_t	b;
+	int			i, j, k, n;
+
+	memset (&b, 0, sizeof(b));
+	for (i = 0; i < count; i += n)
+	{
+		n = q_min (count - i, HULLBATCH_MAX);
+		for (j = 0; j < n; j++)
+		{
+			for (k = 0; k < 3; k++)
+			{
+				b.p1[k][j] = starts[i + j][k];
+				b.p2[k][j] = ends[i + j][k];
+			}
+			b.start[j] = starts[i + j];
+			b.end[j] = ends[i + j];
+			b.trace[j] = &traces[i + j];
+		}
+		SV_HullBatchCheck (hull, hull->firstclipnode, &b, (1 << n) - 1);
+	}
+}
+
 /*
 ==================
 SV_ClipMoveToEntity
@@ -737,23 +1234,87 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 	return trace;
 }
 
-//===========================================================================
-
 /*
-====================
-SV_ClipToLinks
+==================
+SV_ClipMovesToEntity
 
-Mins and maxs enclose the entire area swept by the move
+SV_ClipMoveToEntity for up to HULLBATCH_MAX moves of the same size
+==================
+*/
+static void SV_ClipMovesToEntity (edict_t *ent, int count, float **starts, float **ends, vec3_t mins, vec3_t maxs, trace_t *traces)
+{
+	vec3_t		offset;
+	vec3_t		start_l[HULLBATCH_MAX], end_l[HULLBATCH_MAX];
+	hull_t		*hull;
+	int			i;
+
+// get the clipping hull
+	hull = SV_HullForEntity (ent, mins, maxs, offset);
+
+	for (i = 0; i < count; i++)
+	{
+		memset (&traces[i], 0, sizeof(trace_t));
+		traces[i].fraction = 1;
+		traces[i].allsolid = true;
+		VectorCopy (ends[i], traces[i].endpos);
+		VectorSubtract (starts[i], offset, start_l[i]);
+		VectorSubtract (ends[i], offset, end_l[i]);
+	}
+
+	SV_HullTraceBatch (hull, count, start_l, end_l, traces);
+
+	for (i = 0; i < count; i++)
+	{
+		if (traces[i].fraction != 1)
+			VectorAdd (traces[i].endpos, offset, traces[i].endpos);
+		if (traces[i].fraction < 1 || traces[i].startsolid)
+			traces[i].ent = ent;
+	}
+}
+
+//===========================================================================
+
+/*
+====================
+SV_MergeClipTrace
+
+Keeps the trace against touch if it is nearer than the move's trace so far
+====================
+*/
+static void SV_MergeClipTrace (moveclip_t *clip, trace_t *trace, edict_t *touch)
+{
+	if (trace->allsolid || trace->startsolid ||
+	trace->fraction < clip->trace.fraction)
+	{
+		trace->ent = touch;
+	 	if (clip->trace.startsolid)
+		{
+			clip->trace = *trace;
+			clip->trace.startsolid = true;
+		}
+		else
+			clip->trace = *trace;
+	}
+	else if (trace->startsolid)
+		clip->trace.startsolid = true;
+}
+
+/*
+====================
+SV_ClipToLinkList
+
+Mins and maxs enclose the entire area swept by the move
 ====================
 */
-void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
+static void SV_ClipToLinkList ( link_t *list, void *data )
 {
+	moveclip_t	*clip = (moveclip_t *) data;
 	link_t		*l, *next;
 	edict_t		*touch;
 	trace_t		trace;
 
 // touch linked edicts
-	for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = next)
+	for (l = list->next ; l != list ; l = next)
 	{
 		next = l->next;
 		touch = EDICT_FROM_AREA(l);
@@ -793,30 +1354,53 @@ void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end);
 		else
 			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end);
-		if (trace.allsolid || trace.startsolid ||
-		trace.fraction < clip->trace.fraction)
-		{
-			trace.ent = touch;
-		 	if (clip->trace.startsolid)
-			{
-				clip->trace = trace;
-				clip->trace.startsolid = true;
-			}
-			else
-				clip->trace = trace;
-		}
-		else if (trace.startsolid)
-			clip->trace.startsolid = true;
+		SV_MergeClipTrace (clip, &trace, touch);
 	}
+}
+
+/*
+====================
+SV_ClipToAreaNode
+
+Hands each list of solid edicts that can touch the box to clipfunc
+====================
+*/
+typedef void (*cliplistfunc_t) (link_t *list, void *data);
+
+static void SV_ClipToAreaNode ( areanode_t *node, const vec3_t boxmins, const vec3_t boxmaxs, cliplistfunc_t clipfunc, void *data )
+{
+	clipfunc (&node->solid_edicts, data);
 
 // recurse down both sides
 	if (node->axis == -1)
 		return;
 
-	if ( clip->boxmaxs[node->axis] > node->dist )
-		SV_ClipToLinks ( node->children[0], clip );
-	if ( clip->boxmins[node->axis] < node->dist )
-		SV_ClipToLinks ( node->children[1], clip );
+	if ( boxmaxs[node->axis] > node->dist )
+		SV_ClipToAreaNode ( node->children[0], boxmins, boxmaxs, clipfunc, data );
+	if ( boxmins[node->axis] < node->dist )
+		SV_ClipToAreaNode ( node->children[1], boxmins, boxmaxs, clipfunc, data );
+}
+
+/*
+====================
+SV_ClipToLinks
+====================
+*/
+static void SV_ClipToLinks ( const vec3_t boxmins, const vec3_t boxmaxs, cliplistfunc_t clipfunc, void *data )
+{
+	int		range[4], x, y;
+
+	if (!sv_usegrid)
+	{
+		SV_ClipToAreaNode (sv_areanodes, boxmins, boxmaxs, clipfunc, data);
+		return;
+	}
+
+	clipfunc (&sv_areacells[sv_areagridsize[0] * sv_areagridsize[1]].solid_edicts, data);
+	SV_AreaGridRange (boxmins, boxmaxs, range);
+	for (y = range[1]; y <= range[3]; y++)
+		for (x = range[0]; x <= range[2]; x++)
+			clipfunc (&sv_areacells[y * sv_areagridsize[0] + x].solid_edicts, data);
 }
 
 
@@ -850,6 +1434,121 @@ boxmaxs[0] = boxmaxs[1] = boxmaxs[2] = 9999;
 #endif
 }
 
+/*
+===============================================================================
+
+TRACE CACHE
+
+With sv_tracecache set, SV_Move and SV_MoveBatch remember their results
+until anything is linked or unlinked, or the next server frame starts, so
+the same query asked again in between (SV_CheckBottom and the movestep code
+do this a lot) costs a hash lookup. Progs that change solid, owner, size or origin
+without relinking can see a stale result, which is why it is off by
+default.
+
+===============================================================================
+*/
+
+#define	TRACECACHE_SIZE	256
+
+typedef struct
+{
+	vec3_t	start, end, mins, maxs;
+	int		type;
+	edict_t	*passedict;
+} tracekey_t;
+
+typedef struct
+{
+	tracekey_t	key;
+	unsigned int	generation;	// valid while it matches sv_tracegeneration
+	trace_t		trace;
+} tracecache_t;
+
+cvar_t	sv_tracecache = {"sv_tracecache", "0", CVAR_NONE};
+
+static	tracecache_t	sv_tracecacheslots[TRACECACHE_SIZE];
+static	unsigned int	sv_tracegeneration = 1;
+static	qboolean		sv_tracecachefilled;	// a result was stored this generation
+
+static struct
+{
+	int		lookups, hits, flushes;
+} sv_tracestats;
+
+/*
+==================
+SV_FlushTraceCache
+
+Only moves to a new generation if something was stored in this one, so
+links and unlinks cost nothing while sv_tracecache is off
+==================
+*/
+void SV_FlushTraceCache (void)
+{
+	if (!sv_tracecachefilled)
+		return;
+	sv_tracecachefilled = false;
+
+	if (++sv_tracegeneration == 0)
+	{	// wrapped, so old slots could look current
+		memset (sv_tracecacheslots, 0, sizeof(sv_tracecacheslots));
+		sv_tracegeneration = 1;
+	}
+	sv_tracestats.flushes++;
+}
+
+/*
+==================
+SV_TraceCacheSlot
+
+Returns the slot for the query; it holds the answer if its generation is
+current. Otherwise it now has the query's key, and SV_Move fills it in.
+==================
+*/
+static tracecache_t *SV_TraceCacheSlot (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	tracekey_t		key;
+	tracecache_t	*slot;
+	const byte		*b;
+	unsigned int	hash;
+	size_t			i;
+
+	memset (&key, 0, sizeof(key));	// no stray padding bytes in the hash
+	VectorCopy (start, key.start);
+	VectorCopy (end, key.end);
+	VectorCopy (mins, key.mins);
+	VectorCopy (maxs, key.maxs);
+	key.type = type;
+	key.passedict = passedict;
+
+	hash = 2166136261u;
+	for (i = 0, b = (const byte *) &key; i < sizeof(key); i++)
+		hash = (hash ^ b[i]) * 16777619u;
+
+	sv_tracestats.lookups++;
+	slot = &sv_tracecacheslots[hash & (TRACECACHE_SIZE - 1)];
+	if (slot->generation == sv_tracegeneration && !memcmp (&slot->key, &key, sizeof(key)))
+		return slot;
+
+	slot->key = key;
+	slot->generation = 0;
+	return slot;
+}
+
+/*
+==================
+SV_TraceCacheStats_f
+==================
+*/
+void SV_TraceCacheStats_f (void)
+{
+	Con_Printf ("sv_tracecache %s\n", sv_tracecache.value ? "on" : "off");
+	Con_Printf ("%i lookups, %i hits (%.1f%%), %i flushes\n", sv_tracestats.lookups, sv_tracestats.hits,
+		sv_tracestats.lookups ? 100.0 * sv_tracestats.hits / sv_tracestats.lookups : 0.0, sv_tracestats.flushes);
+	memset (&sv_tracestats, 0, sizeof(sv_tracestats));
+}
+
 /*
 ==================
 SV_Move
@@ -858,8 +1557,24 @@ SV_Move
 trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
 {
 	moveclip_t	clip;
+	tracecache_t	*cached = NULL;
 	int			i;
 
+	if (!sv_benchmarking)
+	{
+		if (sv_arearecord.count < sv_arearecord.max)
+			SV_RecordMove (start, mins, maxs, end, type, passedict);
+		if (sv_tracecache.value)
+		{
+			cached = SV_TraceCacheSlot (start, mins, maxs, end, type, passedict);
+			if (cached->generation == sv_tracegeneration)
+			{
+				sv_tracestats.hits++;
+				return cached->trace;
+			}
+		}
+	}
+
 	memset ( &clip, 0, sizeof ( moveclip_t ) );
 
 // clip to world
@@ -890,8 +1605,422 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 	SV_MoveBounds ( start, clip.mins2, clip.maxs2, end, clip.boxmins, clip.boxmaxs );
 
 // clip to entities
-	SV_ClipToLinks ( sv_areanodes, &clip );
+	SV_ClipToLinks ( clip.boxmins, clip.boxmaxs, SV_ClipToLinkList, &clip );
+
+	if (cached)
+	{
+		cached->generation = sv_tracegeneration;
+		cached->trace = clip.trace;
+		sv_tracecachefilled = true;
+	}
 
 	return clip.trace;
 }
 
+/*
+==================
+SV_ClipBatchToLinkList
+
+SV_ClipToLinkList for all the moves of a batch. Each move sees the edicts
+that touch its own box in the same order SV_Move would give them.
+==================
+*/
+typedef struct
+{
+	moveclip_t	clip[HULLBATCH_MAX];
+	int			count;
+} movebatch_t;
+
+static void SV_ClipBatchToLinkList ( link_t *list, void *data )
+{
+	movebatch_t	*batch = (movebatch_t *) data;
+	moveclip_t	*clip, *first = &batch->clip[0];
+	link_t		*l, *next;
+	edict_t		*touch;
+	trace_t		traces[HULLBATCH_MAX];
+	float		*starts[HULLBATCH_MAX], *ends[HULLBATCH_MAX];
+	int			which[HULLBATCH_MAX];
+	int			i, n;
+
+	for (l = list->next ; l != list ; l = next)
+	{
+		next = l->next;
+		touch = EDICT_FROM_AREA(l);
+		if (touch->v.solid == SOLID_NOT)
+			continue;
+		if (touch == first->passedict)
+			continue;
+		if (touch->v.solid == SOLID_TRIGGER)
+			Sys_Error ("Trigger in clipping list");
+
+		if (first->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
+			continue;
+
+		if (first->passedict && first->passedict->v.size[0] && !touch->v.size[0])
+			continue;	// points never interact
+
+		if (first->passedict)
+		{
+		 	if (PROG_TO_EDICT(touch->v.owner) == first->passedict)
+				continue;	// don't clip against own missiles
+			if (PROG_TO_EDICT(first->passedict->v.owner) == touch)
+				continue;	// don't clip against owner
+		}
+
+		for (i = n = 0, clip = batch->clip; i < batch->count; i++, clip++)
+		{
+			if (clip->boxmins[0] > touch->v.absmax[0]
+			|| clip->boxmins[1] > touch->v.absmax[1]
+			|| clip->boxmins[2] > touch->v.absmax[2]
+			|| clip->boxmaxs[0] < touch->v.absmin[0]
+			|| clip->boxmaxs[1] < touch->v.absmin[1]
+			|| clip->boxmaxs[2] < touch->v.absmin[2] )
+				continue;
+			if (clip->trace.allsolid)
+				continue;
+			starts[n] = clip->start;
+			ends[n] = clip->end;
+			which[n++] = i;
+		}
+		if (!n)
+			continue;
+
+		if ((int)touch->v.flags & FL_MONSTER)
+			SV_ClipMovesToEntity (touch, n, starts, ends, first->mins2, first->maxs2, traces);
+		else
+			SV_ClipMovesToEntity (touch, n, starts, ends, first->mins, first->maxs, traces);
+		for (i = 0; i < n; i++)
+			SV_MergeClipTrace (&batch->clip[which[i]], &traces[i], touch);
+	}
+}
+
+/*
+==================
+SV_MoveBatch
+
+SV_Move for count moves of the same size, type and passedict, such as the
+probes under a monster's feet. The world hull and each edict in the way are
+traced for all the moves together, leaving out those the trace cache can
+answer.
+==================
+*/
+void SV_MoveBatch (int count, vec3_t *starts, vec3_t mins, vec3_t maxs, vec3_t *ends, int type, edict_t *passedict, trace_t *traces)
+{
+	movebatch_t	batch;
+	moveclip_t	*clip;
+	tracecache_t	*cached[HULLBATCH_MAX];
+	float		*s[HULLBATCH_MAX], *e[HULLBATCH_MAX];
+	trace_t		world[HULLBATCH_MAX];
+	vec3_t		boxmins, boxmaxs;
+	int			which[HULLBATCH_MAX];
+	int			i, j, k, n;
+
+	for (i = 0; i < count; i += n)
+	{
+		n = q_min (count - i, HULLBATCH_MAX);
+
+	// answer what the cache can and batch the rest
+		for (j = batch.count = 0; j < n; j++)
+		{
+			cached[batch.count] = NULL;
+			if (!sv_benchmarking)
+			{
+				if (sv_arearecord.count < sv_arearecord.max)
+					SV_RecordMove (starts[i + j], mins, maxs, ends[i + j], type, passedict);
+				if (sv_tracecache.value)
+				{
+					cached[batch.count] = SV_TraceCacheSlot (starts[i + j], mins, maxs, ends[i + j], type, passedict);
+					if (cached[batch.count]->generation == sv_tracegeneration)
+					{
+						sv_tracestats.hits++;
+						traces[i + j] = cached[batch.count]->trace;
+						continue;
+					}
+				}
+			}
+			s[batch.count] = starts[i + j];
+			e[batch.count] = ends[i + j];
+			which[batch.count++] = i + j;
+		}
+		if (!batch.count)
+			continue;
+
+	// clip to world
+		SV_ClipMovesToEntity (sv.edicts, batch.count, s, e, mins, maxs, world);
+
+		for (j = 0, clip = batch.clip; j < batch.count; j++, clip++)
+		{
+			memset (clip, 0, sizeof(moveclip_t));
+			clip->trace = world[j];
+			clip->start = s[j];
+			clip->end = e[j];
+			clip->mins = mins;
+			clip->maxs = maxs;
+			clip->type = type;
+			clip->passedict = passedict;
+			if (type == MOVE_MISSILE)
+			{
+				clip->mins2[0] = clip->mins2[1] = clip->mins2[2] = -15;
+				clip->maxs2[0] = clip->maxs2[1] = clip->maxs2[2] = 15;
+			}
+			else
+			{
+				VectorCopy (mins, clip->mins2);
+				VectorCopy (maxs, clip->maxs2);
+			}
+			SV_MoveBounds (s[j], clip->mins2, clip->maxs2, e[j], clip->boxmins, clip->boxmaxs);
+
+			if (!j)
+			{
+				VectorCopy (clip->boxmins, boxmins);
+				VectorCopy (clip->boxmaxs, boxmaxs);
+			}
+			else
+			{
+				for (k = 0; k < 3; k++)
+				{
+					boxmins[k] = q_min (boxmins[k], clip->boxmins[k]);
+					boxmaxs[k] = q_max (boxmaxs[k], clip->boxmaxs[k]);
+				}
+			}
+		}
+
+	// clip to entities
+		SV_ClipToLinks (boxmins, boxmaxs, SV_ClipBatchToLinkList, &batch);
+
+	// backwards, so two moves sharing a slot leave the later one's key and
+	// answer in it, as they would one at a time
+		for (j = batch.count - 1; j >= 0; j--)
+		{
+			traces[which[j]] = batch.clip[j].trace;
+			if (cached[j] && cached[j]->generation != sv_tracegeneration)
+			{
+				cached[j]->generation = sv_tracegeneration;
+				cached[j]->trace = batch.clip[j].trace;
+				sv_tracecachefilled = true;
+			}
+		}
+	}
+}
+
+/*
+===============================================================================
+
+AREA AND TRACE BENCHMARKS
+
+sv_areabench record <count> keeps the next count SV_Move calls, and
+sv_areabench [passes] runs them against both the areanode tree and the grid
+on the current edicts, reporting the time and any traces that came out
+differently. sv_tracebench [passes] runs the same moves one at a time and
+through SV_MoveBatch, batching runs of moves that could share one.
+
+===============================================================================
+*/
+
+static void SV_RecordMove (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	areamove_t	*move = &sv_arearecord.moves[sv_arearecord.count++];
+
+	VectorCopy (start, move->start);
+	VectorCopy (mins, move->mins);
+	VectorCopy (maxs, move->maxs);
+	VectorCopy (end, move->end);
+	move->type = type;
+	move->passent = passedict ? NUM_FOR_EDICT(passedict) : -1;
+	if (sv_arearecord.count == sv_arearecord.max)
+		Con_Printf ("sv_areabench: recorded %i moves\n", sv_arearecord.count);
+}
+
+/*
+===============
+SV_ReplayMoves
+
+Returns the time taken, and fills in the traces from the last pass
+===============
+*/
+static double SV_ReplayMoves (qboolean grid, int passes, trace_t *traces)
+{
+	areamove_t	*move;
+	double		start;
+	int			i, pass;
+
+	SV_RelinkArea (grid);
+	sv_benchmarking = true;
+
+	start = Sys_DoubleTime ();
+	for (pass = 0; pass < passes; pass++)
+	{
+		for (i = 0, move = sv_arearecord.moves; i < sv_arearecord.count; i++, move++)
+		{
+			if (move->passent >= sv.num_edicts)
+				continue;
+			traces[i] = SV_Move (move->start, move->mins, move->maxs, move->end, move->type,
+				move->passent == -1 ? NULL : EDICT_NUM(move->passent));
+		}
+	}
+
+	sv_benchmarking = false;
+	return Sys_DoubleTime () - start;
+}
+
+/*
+===============
+SV_AreaBench_f
+===============
+*/
+void SV_AreaBench_f (void)
+{
+	trace_t		*treetraces, *gridtraces;
+	double		treetime, gridtime;
+	qboolean	wasgrid;
+	int			i, passes, diffs, count;
+
+	if (!sv.active)
+	{
+		Con_Printf ("no server running\n");
+		return;
+	}
+
+	if (Cmd_Argc () >= 2 && !strcmp (Cmd_Argv (1), "record"))
+	{
+		count = (Cmd_Argc () >= 3) ? atoi (Cmd_Argv (2)) : 10000;
+		if (count < 1)
+			count = 1;
+		if (sv_arearecord.moves)
+			Z_Free (sv_arearecord.moves);
+		sv_arearecord.moves = (areamove_t *) Z_Malloc (count * sizeof(areamove_t));
+		sv_arearecord.count = 0;
+		sv_arearecord.max = count;
+		Con_Printf ("sv_areabench: recording %i moves\n", count);
+		return;
+	}
+
+	if (!sv_arearecord.count)
+	{
+		Con_Printf ("usage: sv_areabench record [count], then sv_areabench [passes]\n");
+		return;
+	}
+	if (sv_arearecord.count < sv_arearecord.max)
+	{
+		Con_Printf ("sv_areabench: still recording, %i of %i moves so far\n", sv_arearecord.count, sv_arearecord.max);
+		return;
+	}
+
+	passes = (Cmd_Argc () >= 2) ? q_max (1, atoi (Cmd_Argv (1))) : 10;
+	count = sv_arearecord.count;
+	treetraces = (trace_t *) Z_Malloc (count * sizeof(trace_t));
+	gridtraces = (trace_t *) Z_Malloc (count * sizeof(trace_t));
+
+	wasgrid = sv_usegrid;
+	treetime = SV_ReplayMoves (false, passes, treetraces);
+	gridtime = SV_ReplayMoves (true, passes, gridtraces);
+	SV_RelinkArea (wasgrid);
+
+	for (i = 0, diffs = 0; i < count; i++)
+	{
+		if (treetraces[i].fraction != gridtraces[i].fraction || treetraces[i].ent != gridtraces[i].ent
+		|| treetraces[i].startsolid != gridtraces[i].startsolid || treetraces[i].allsolid != gridtraces[i].allsolid)
+			diffs++;
+	}
+
+	Con_Printf ("%i moves x %i passes, %i edicts\n", count, passes, sv.num_edicts);
+	Con_Printf ("areanodes: %7.3f ms (%.3f us per move)\n", treetime * 1000.0, treetime * 1e6 / (count * passes));
+	Con_Printf ("grid %ix%i: %7.3f ms (%.3f us per move)\n", sv_areagridsize[0], sv_areagridsize[1],
+		gridtime * 1000.0, gridtime * 1e6 / (count * passes));
+	if (diffs)
+		Con_Printf ("%i traces differ\n", diffs);
+
+	Z_Free (gridtraces);
+	Z_Free (treetraces);
+}
+
+/*
+===============
+SV_TraceBench_f
+===============
+*/
+void SV_TraceBench_f (void)
+{
+	areamove_t	*move, *next;
+	trace_t		*single, *batched;
+	vec3_t		starts[HULLBATCH_MAX], ends[HULLBATCH_MAX];
+	double		singletime, batchtime;
+	edict_t		*pass;
+	int			i, j, n, passes, rep, count, diffs, batches;
+
+	if (!sv.active)
+	{
+		Con_Printf ("no server running\n");
+		return;
+	}
+	if (!sv_arearecord.count || sv_arearecord.count < sv_arearecord.max)
+	{
+		Con_Printf ("record some moves first with sv_areabench record [count]\n");
+		return;
+	}
+
+	passes = (Cmd_Argc () >= 2) ? q_max (1, atoi (Cmd_Argv (1))) : 10;
+	count = sv_arearecord.count;
+	single = (trace_t *) Z_Malloc (count * sizeof(trace_t));
+	batched = (trace_t *) Z_Malloc (count * sizeof(trace_t));
+	sv_benchmarking = true;
+
+	singletime = Sys_DoubleTime ();
+	for (rep = 0; rep < passes; rep++)
+	{
+		for (i = 0, move = sv_arearecord.moves; i < count; i++, move++)
+		{
+			if (move->passent >= sv.num_edicts)
+				continue;
+			single[i] = SV_Move (move->start, move->mins, move->maxs, move->end, move->type,
+				move->passent == -1 ? NULL : EDICT_NUM(move->passent));
+		}
+	}
+	singletime = Sys_DoubleTime () - singletime;
+
+	batches = 0;
+	batchtime = Sys_DoubleTime ();
+	for (rep = 0; rep < passes; rep++)
+	{
+		for (i = 0, batches = 0; i < count; i += n, batches++)
+		{
+			move = &sv_arearecord.moves[i];
+			for (n = 1, next = move + 1; n < HULLBATCH_MAX && i + n < count; n++, next++)
+			{
+				if (next->type != move->type || next->passent != move->passent
+				|| !VectorCompare (next->mins, move->mins) || !VectorCompare (next->maxs, move->maxs))
+					break;
+			}
+			if (move->passent >= sv.num_edicts)
+				continue;
+			for (j = 0; j < n; j++)
+			{
+				VectorCopy (move[j].start, starts[j]);
+				VectorCopy (move[j].end, ends[j]);
+			}
+			pass = (move->passent == -1) ? NULL : EDICT_NUM(move->passent);
+			SV_MoveBatch (n, starts, move->mins, move->maxs, ends, move->type, pass, &batched[i]);
+		}
+	}
+	batchtime = Sys_DoubleTime () - batchtime;
+	sv_benchmarking = false;
+
+	for (i = 0, diffs = 0, move = sv_arearecord.moves; i < count; i++, move++)
+	{
+		if (move->passent >= sv.num_edicts)
+			continue;
+		if (single[i].fraction != batched[i].fraction || single[i].ent != batched[i].ent
+		|| single[i].startsolid != batched[i].startsolid || single[i].allsolid != batched[i].allsolid
+		|| !VectorCompare (single[i].endpos, batched[i].endpos))
+			diffs++;
+	}
+
+	Con_Printf ("%i moves in %i batches x %i passes\n", count, batches, passes);
+	Con_Printf ("SV_Move:      %7.3f ms (%.3f us per move)\n", singletime * 1000.0, singletime * 1e6 / (count * passes));
+	Con_Printf ("SV_MoveBatch: %7.3f ms (%.3f us per move)\n", batchtime * 1000.0, batchtime * 1e6 / (count * passes));
+	if (diffs)
+		Con_Printf ("%i traces differ\n", diffs);
+
+	Z_Free (batched);
+	Z_Free (single);
+}
@@ -60,6 +60,24 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers);
 // sets ent->v.absmin and ent->v.absmax
 // if touchtriggers, calls prog functions for the intersected triggers
 
+int SV_AreaEdicts (const vec3_t mins, const vec3_t maxs, int *edicts, int maxcount);
+// fills in the numbers of the linked edicts whose abs boxes touch the box,
+// lowest first, and returns how many there were
+
+qboolean SV_UsingAreaGrid (void);
+// true when the edicts are linked into the grid rather than the areanodes
+
+extern	cvar_t	sv_areagrid;
+void SV_AreaGrid_f (cvar_t *var);
+void SV_AreaBench_f (void);
+void SV_TraceBench_f (void);
+
+extern	cvar_t	sv_tracecache;
+void SV_FlushTraceCache (void);
+// forgets the SV_Move results kept with sv_tracecache; linking and unlinking
+// do this, and SV_Physics at the start of each frame
+void SV_TraceCacheStats_f (void);
+
 int SV_PointContents (vec3_t p);
 int SV_TruePointContents (vec3_t p);
 // returns the CONTENTS_* value from the world at the given point.
@@ -83,5 +101,12 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 
 qboolean SV_RecursiveHullCheck (hull_t *hull, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace);
 
+void SV_MoveBatch (int count, vec3_t *starts, vec3_t mins, vec3_t maxs, vec3_t *ends, int type, edict_t *passedict, trace_t *traces);
+// SV_Move for several moves sharing the size, type and passedict, traced
+// through each hull together; the traces come out the same
+
+void SV_HullTraceBatch (hull_t *hull, int count, vec3_t *starts, vec3_t *ends, trace_t *traces);
+void SV_HullPointContentsBatch (hull_t *hull, int num, int count, vec3_t *points, int *contents);
+
 #endif	/* _QUAKE_WORLD_H */
 
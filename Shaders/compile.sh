@@ -0,0 +1,43 @@
+#!/bin/sh
+# Same steps as compile.bat, for building the shaders off Windows.
+# Uses glslangValidator from $VULKAN_SDK/bin if set, else from the PATH.
+
+cd "$(dirname "$0")" || exit 1
+
+if [ -n "$VULKAN_SDK" ]; then
+	GLSLANG="$VULKAN_SDK/bin/glslangValidator"
+else
+	GLSLANG=glslangValidator
+fi
+
+if [ ! -x ./bintoc ]; then
+	${CC:-cc} -o bintoc bintoc.c || exit 1
+fi
+
+set -e
+
+$GLSLANG -V basic.vert -o Compiled/basic.vspv
+$GLSLANG -V basic.frag -o Compiled/basic.fspv
+$GLSLANG -V basic_alphatest.frag -o Compiled/basic_alphatest.fspv
+$GLSLANG -V basic_notex.frag -o Compiled/basic_notex.fspv
+$GLSLANG -V world.vert -o Compiled/world.vspv
+$GLSLANG -V world.frag -o Compiled/world.fspv
+$GLSLANG -V world_fullbright.frag -o Compiled/world_fullbright.fspv
+$GLSLANG -V alias.vert -o Compiled/alias.vspv
+$GLSLANG -V alias.frag -o Compiled/alias.fspv
+$GLSLANG -V sky_layer.vert -o Compiled/sky_layer.vspv
+$GLSLANG -V sky_layer.frag -o Compiled/sky_layer.fspv
+$GLSLANG -V cull.comp -o Compiled/cull.cspv
+
+./bintoc Compiled/basic.vspv basic_vert_spv > Compiled/basic_vert.c
+./bintoc Compiled/basic.fspv basic_frag_spv > Compiled/basic_frag.c
+./bintoc Compiled/basic_notex.fspv basic_notex_frag_spv > Compiled/basic_notex_frag.c
+./bintoc Compiled/basic_alphatest.fspv basic_alphatest_frag_spv > Compiled/basic_alphatest_frag.c
+./bintoc Compiled/world.vspv world_vert_spv > Compiled/world_vert.c
+./bintoc Compiled/world.fspv world_frag_spv > Compiled/world_frag.c
+./bintoc Compiled/world_fullbright.fspv world_fullbright_frag_spv > Compiled/world_fullbright_frag.c
+./bintoc Compiled/alias.vspv alias_vert_spv > Compiled/alias_vert.c
+./bintoc Compiled/alias.fspv alias_frag_spv > Compiled/alias_frag.c
+./bintoc Compiled/sky_layer.vspv sky_layer_vert_spv > Compiled/sky_layer_vert.c
+./bintoc Compiled/sky_layer.fspv sky_layer_frag_spv > Compiled/sky_layer_frag.c
+./bintoc Compiled/cull.cspv cull_comp_spv > Compiled/cull_comp.c
@@ -43,5 +43,7 @@ extern unsigned char sky_layer_vert_spv[];
 extern int sky_layer_vert_spv_size;
 extern unsigned char sky_layer_frag_spv[];
 extern int sky_layer_frag_spv_size;
+extern unsigned char cull_comp_spv[];
+extern int cull_comp_spv_size;
 
 #endif